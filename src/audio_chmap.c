@@ -0,0 +1,140 @@
+#include <stdint.h>
+#include <string.h>
+#include "audio_chmap.h"
+#include "util/math.h"
+
+#define CHMAP_M3DB 0.70710678f
+
+// Speaker positions in WAVE and FLAC order
+enum {
+  CHMAP_L, CHMAP_R, CHMAP_C, CHMAP_LFE, CHMAP_BL, CHMAP_BR, CHMAP_BC, CHMAP_SL, CHMAP_SR, CHMAP_M
+};
+
+static const uint8_t chmap_layouts[DECODER_MAX_CHANNELS][DECODER_MAX_CHANNELS] = {
+  { CHMAP_M },
+  { CHMAP_L, CHMAP_R },
+  { CHMAP_L, CHMAP_R, CHMAP_C },
+  { CHMAP_L, CHMAP_R, CHMAP_BL, CHMAP_BR },
+  { CHMAP_L, CHMAP_R, CHMAP_C, CHMAP_BL, CHMAP_BR },
+  { CHMAP_L, CHMAP_R, CHMAP_C, CHMAP_LFE, CHMAP_BL, CHMAP_BR },
+  { CHMAP_L, CHMAP_R, CHMAP_C, CHMAP_LFE, CHMAP_BC, CHMAP_SL, CHMAP_SR },
+  { CHMAP_L, CHMAP_R, CHMAP_C, CHMAP_LFE, CHMAP_BL, CHMAP_BR, CHMAP_SL, CHMAP_SR },
+};
+
+// Left and right gains of every position in a stereo fold down
+static const float chmap_stereo[][2] = {
+  [CHMAP_L]   = { 1.0f, 0.0f },
+  [CHMAP_R]   = { 0.0f, 1.0f },
+  [CHMAP_C]   = { CHMAP_M3DB, CHMAP_M3DB },
+  [CHMAP_LFE] = { 0.0f, 0.0f },
+  [CHMAP_BL]  = { CHMAP_M3DB, 0.0f },
+  [CHMAP_BR]  = { 0.0f, CHMAP_M3DB },
+  [CHMAP_BC]  = { 0.5f, 0.5f },
+  [CHMAP_SL]  = { CHMAP_M3DB, 0.0f },
+  [CHMAP_SR]  = { 0.0f, CHMAP_M3DB },
+  [CHMAP_M]   = { 1.0f, 1.0f },
+};
+
+// Index of a position in a layout, -1 if the layout lacks that speaker
+static int chmap_find(const uint8_t *layout, uint8_t channels, uint8_t position) {
+  for (uint8_t c = 0; c < channels; c++)
+    if (layout[c] == position) return c;
+
+  return -1;
+}
+
+// Side and back channels stand in for each other
+static uint8_t chmap_surround(uint8_t position) {
+  switch (position) {
+    case CHMAP_BL: return CHMAP_SL;
+    case CHMAP_BR: return CHMAP_SR;
+    case CHMAP_SL: return CHMAP_BL;
+    case CHMAP_SR: return CHMAP_BR;
+    default:       return position;
+  }
+}
+
+// Split input over a pair of output positions, false if the output lacks them
+static bool chmap_split(float *m, uint8_t in, uint8_t i, const uint8_t *layout, uint8_t out, uint8_t left, uint8_t right) {
+  int l = chmap_find(layout, out, left), r = chmap_find(layout, out, right);
+  if (l < 0 || r < 0) return false;
+
+  m[l * in + i] += CHMAP_M3DB;
+  m[r * in + i] += CHMAP_M3DB;
+  return true;
+}
+
+static void chmap_default(float *m, uint8_t in, uint8_t out) {
+  const uint8_t *from = chmap_layouts[in - 1], *to = chmap_layouts[out - 1];
+
+  memset(m, 0, (size_t) out * in * sizeof(float));
+
+  // Positions present in the output are kept in place, missing ones are folded down per ITU-R BS.775
+  for (uint8_t i = 0; i < in; i++) {
+    const float *stereo = chmap_stereo[from[i]];
+
+    if (out == 1) {
+      m[i] = from[i] == CHMAP_M ? 1.0f : 0.5f * (stereo[0] + stereo[1]);
+      continue;
+    }
+
+    int o = chmap_find(to, out, from[i]);
+    if (o < 0) o = chmap_find(to, out, chmap_surround(from[i]));
+    if (o >= 0) {
+      m[o * in + i] += 1.0f;
+      continue;
+    }
+
+    if (from[i] == CHMAP_BC && (chmap_split(m, in, i, to, out, CHMAP_BL, CHMAP_BR) || chmap_split(m, in, i, to, out, CHMAP_SL, CHMAP_SR)))
+      continue;
+
+    // Every output of two and more channels starts with the front pair, LFE has no gain there
+    m[0 * in + i] += stereo[0];
+    m[1 * in + i] += stereo[1];
+  }
+}
+
+int audio_chmap_init(audio_chmap_t *map, uint8_t in_channels, uint8_t out_channels, const float *matrix) {
+  if (in_channels == 0 || in_channels > DECODER_MAX_CHANNELS || out_channels == 0 || out_channels > AUDIO_CHMAP_MAX_OUT)
+    return -1;
+
+  float m[AUDIO_CHMAP_MAX_OUT * DECODER_MAX_CHANNELS];
+
+  if (matrix) memcpy(m, matrix, (size_t) out_channels * in_channels * sizeof(float));
+  else chmap_default(m, in_channels, out_channels);
+
+  memset(map, 0, sizeof(audio_chmap_t));
+  map->in_channels = in_channels;
+  map->out_channels = out_channels;
+  map->identity = in_channels == out_channels;
+
+  for (uint8_t o = 0; o < out_channels; o++) {
+    for (uint8_t i = 0; i < in_channels; i++) {
+      float gain = m[o * in_channels + i];
+
+      if (gain != (i == o ? 1.0f : 0.0f)) map->identity = false;
+      if (gain == 0.0f) continue;
+
+      map->terms[o][map->count[o]++] = (audio_chmap_term_t) { .in = i, .gain = gain };
+    }
+  }
+
+  return 0;
+}
+
+void audio_chmap_apply(const audio_chmap_t *map, const audio_mix_ops_t *mix, float *const *dst, float *const *src, uint32_t frames) {
+  for (uint8_t o = 0; o < map->out_channels; o++) {
+    if (map->count[o] == 0) {
+      memset(dst[o], 0, frames * sizeof(float));
+      continue;
+    }
+
+    for (uint8_t t = 0; t < map->count[o]; t++) {
+      const audio_chmap_term_t *term = &map->terms[o][t];
+      int mode = t == 0 ? AUDIO_MIX_SET : AUDIO_MIX_ADD;
+
+      if (term->gain == 1.0f) mix->mix(dst[o], src[term->in], frames, mode);
+      else mix->mix_gain(dst[o], src[term->in], frames, term->gain, mode);
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef _H_AUDIO_CHMAP_
+#define _H_AUDIO_CHMAP_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "audio_mix.h"
+#include "decoder/decoder.h"
+
+/**
+ * Channel map of an input. Every output channel is a weighted sum of input channels, the
+ * matrix is reduced at attach time to the non zero terms of every output channel, so the
+ * audio thread only runs vector gain kernels over them.
+ *
+ * Default matrices follow WAVE and FLAC channel order:
+ *   1: M, 2: L R, 3: L R C, 4: L R BL BR, 5: L R C BL BR, 6: L R C LFE BL BR,
+ *   7: L R C LFE BC SL SR, 8: L R C LFE BL BR SL SR
+ * Channels are routed by speaker position, positions missing from the output are folded
+ * down with ITU-R BS.775 coefficients: side and back channels stand in for each other, back
+ * center is split over a back or side pair at -3 dB, the rest goes to the front pair (mono at
+ * unity, -3 dB for center and surrounds). LFE only feeds LFE and is dropped otherwise.
+ */
+
+#define AUDIO_CHMAP_MAX_OUT 8
+
+typedef struct {
+  uint8_t in;
+  float gain;
+} audio_chmap_term_t;
+
+typedef struct {
+  uint8_t in_channels;
+  uint8_t out_channels;
+  bool identity; // output channel n is input channel n, input can be read in place
+
+  uint8_t count[AUDIO_CHMAP_MAX_OUT];
+  audio_chmap_term_t terms[AUDIO_CHMAP_MAX_OUT][DECODER_MAX_CHANNELS];
+} audio_chmap_t;
+
+/**
+ * Build channel map
+ *
+ * @param map Map to be filled
+ * @param in_channels Input channels, up to DECODER_MAX_CHANNELS
+ * @param out_channels Output channels, up to AUDIO_CHMAP_MAX_OUT
+ * @param matrix Row major out_channels x in_channels gains, NULL for the default matrix
+ * @return 0 on success, -1 on invalid channel counts
+ */
+int audio_chmap_init(audio_chmap_t *map, uint8_t in_channels, uint8_t out_channels, const float *matrix);
+
+/**
+ * Map planar input to planar output. Output planes must not alias input planes
+ *
+ * @param map Channel map
+ * @param mix Gain kernels
+ * @param dst Output planes
+ * @param src Input planes
+ * @param frames Number of frames
+ */
+void audio_chmap_apply(const audio_chmap_t *map, const audio_mix_ops_t *mix, float *const *dst, float *const *src, uint32_t frames);
+
+#endif
\ No newline at end of file
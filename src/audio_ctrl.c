@@ -1,3 +1,7 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // clock_nanosleep
+#endif
+
 #include <stdbool.h>
 #include <stdatomic.h>
 #include <pthread.h>
@@ -30,11 +34,22 @@ static void *ctrl_thread(void *param) {
   while(ctrl->state == AUDIO_CTRL_STATE_OPENED) {
     audio_io_get_realtime_data(ctrl->audio, &ctrl->realtime_data);
 
-    log_ddebug("[REALTIME] TIME: %lld, PPS: %.1f, PEAK: %f, RMS: %f",
-      ctrl->realtime_data.time,
+    uint64_t sink_dropped = 0;
+    for(int i = 0; i < AUDIO_IO_SINKS; i++) sink_dropped += ctrl->realtime_data.sink_dropped[i];
+
+    log_ddebug("[REALTIME] TIME: %lld, PPS: %.1f, MISSED: %llu, UNDERRUNS: %llu, JITTER: %.1f/%.1f us, HEADROOM: %.1f/%.1f %%, SINK DROPPED: %llu, PEAK: %f, RMS: %f, GR: %.1f dB",
+      (long long) ctrl->realtime_data.time,
       ctrl->realtime_data.pps,
+      (unsigned long long) ctrl->realtime_data.missed,
+      (unsigned long long) ctrl->realtime_data.underruns,
+      ctrl->realtime_data.jitter,
+      ctrl->realtime_data.jitter_max,
+      ctrl->realtime_data.headroom,
+      ctrl->realtime_data.headroom_min,
+      (unsigned long long) sink_dropped,
       ctrl->realtime_data.peak[0][0],
-      ctrl->realtime_data.rms[0][0]
+      ctrl->realtime_data.rms[0][0],
+      ctrl->realtime_data.gain_reduction[0]
     );
 
     delta = os_gettime_ns() - last_time;    
@@ -73,7 +88,7 @@ void audio_ctrl_close(audio_ctrl_t *ctrl) {
   if (!ctrl) return;
 
   if (ctrl->initialized) {
-    ctrl->state = AUDIO_CTRL_STATE_OPENED;
+    ctrl->state = AUDIO_CTRL_STATE_CLOSED;
     pthread_join(ctrl->thread, NULL);
   }
 
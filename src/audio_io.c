@@ -1,11 +1,22 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // clock_nanosleep
+#endif
+
 #include <stdbool.h>
 #include <stdatomic.h>
 #include <pthread.h>
+#include <sched.h>
 #include <string.h>
+#include <math.h>
+#include <sys/mman.h>
 #include "audio_io.h"
+#include "audio_mix.h"
+#include "audio_chmap.h"
+#include "audio_prefetch.h"
+#include "audiobuffer.h"
 #include "pcm.h"
 #include "pcm_conv.h"
-#include "decoder/decoder_impl.h"
+#include "decoder/decoder.h"
 #include "logging.h"
 #include "util/mem.h"
 #include "util/math.h"
@@ -14,6 +25,20 @@
 #define AUDIO_IO_STATE_CLOSED 0
 #define AUDIO_IO_STATE_OPENED 1
 
+// Deadlines are rebased when audio thread falls behind more than this
+#define AUDIO_IO_MAX_LATE_PERIODS 4
+
+#define AUDIO_IO_PI_2 1.57079633f
+#define AUDIO_IO_PI_4 0.78539816f
+#define AUDIO_IO_SQRT2 1.41421356f
+
+// Crossfade curves are linear within segments of this many frames
+#define AUDIO_IO_FADE_SEGMENT 32
+
+_Static_assert(2 * AUDIO_IO_INPUTS <= AUDIO_PREFETCH_SLOTS, "every input needs two prefetch slots");
+_Static_assert(AUDIO_IO_INPUTS <= 32 && AUDIO_IO_BUSES <= 32 && AUDIO_IO_SINKS <= 32, "inputs, buses and sinks are tracked in 32-bit masks");
+_Static_assert(AUDIO_IO_MAX_CHANNELS <= AUDIO_CHMAP_MAX_OUT, "inputs are mapped to bus channels");
+
 struct audio_volmeter {
   float peak_last[AUDIO_IO_MAX_CHANNELS][4];
 };
@@ -24,21 +49,96 @@ struct audio_pps_history {
   uint64_t ticklist[AUDIO_PPS_SAMPLES];
 };
 
+struct audio_jitter_history {
+  int tickindex;
+  double ticksum;
+  uint64_t ticklist[AUDIO_PPS_SAMPLES];
+  uint64_t max;
+};
+
+struct audio_load_history {
+  int tickindex;
+  double ticksum;
+  uint64_t ticklist[AUDIO_PPS_SAMPLES];
+  uint64_t max;
+};
+
+// Written by control threads, read once per period by audio thread
+struct audio_params {
+  _Atomic float gain;
+  _Atomic float pan;
+  atomic_bool mute;
+};
+
 struct audio_bus {
+  struct audio_params params;
+  _Atomic(audio_limiter_t *) limiter;
   struct audio_volmeter volmeter;
+  struct audio_data data;
   float buffer[AUDIO_IO_MAX_CHANNELS][AUDIO_IO_OUTPUT_FRAMES];
 };
 
 struct audio_input {
-  audio_input_callback_t callback;
-  int bus_idx;
-  void *param;
+  // claimed by control threads, decoder is published to the audio thread
+  atomic_bool attached;
+  _Atomic(decoder_t *) decoder;
+  atomic_int bus_idx;
+  audio_chmap_t chmap; // set before decoder is published
+  struct audio_params params;
+  struct audio_data data;
   float buffer[AUDIO_IO_MAX_CHANNELS][AUDIO_IO_OUTPUT_FRAMES];
+
+  // decoded frames, skipped when channel map is identity
+  float *planes[DECODER_MAX_CHANNELS];
+  float decoded[DECODER_MAX_CHANNELS][AUDIO_IO_OUTPUT_FRAMES];
+
+  // Prefetch slot of the playing decoder, the other slot of the input pre-decodes the queued one.
+  // Queue is claimed by control threads until the decoder it replaced is reclaimed
+  atomic_int slot;
+  atomic_bool queued;
+  _Atomic(decoder_t *) next;     // published once its slot is attached
+  _Atomic(decoder_t *) finished; // left by audio thread after switching to the queued decoder
+  audio_chmap_t next_chmap;      // set before next is published
+  uint32_t next_fade;            // crossfade frames, set before next is published
+
+  // audio thread side, crossfade in progress and the queued decoder frames mixed into it
+  uint32_t fade_frames;
+  uint32_t fade_position;
+  float *fade_planes[AUDIO_IO_MAX_CHANNELS];
+  float fade_buffer[AUDIO_IO_MAX_CHANNELS][AUDIO_IO_OUTPUT_FRAMES];
+
+  // audio thread side, gains of input and its bus reached at the end of last period
+  bool gain_reset; // set before decoder is published, first period starts at target gains
+  float gain[AUDIO_IO_MAX_CHANNELS];
+  float gain_target[AUDIO_IO_MAX_CHANNELS];
 };
 
 struct audio_output {
   audio_output_callback_t callback;
+  audio_output_wait_callback_t wait;
   void *param;
+  uint8_t bus_idx;
+};
+
+struct audio_sink {
+  struct audio_io *audio;
+
+  // claimed by control threads, buffer is published to the audio thread
+  atomic_bool attached;
+  _Atomic(audiobuffer_t *) published;
+  atomic_int bus_idx;
+  atomic_uint_least64_t dropped;
+
+  audio_sink_info_t info;
+  audio_format_t af; // interleaved float frames kept in the ring
+  audiobuffer_t *buffer;
+
+  pthread_t thread;
+  atomic_bool running;
+
+  // sink thread side, planar frames handed to the callback
+  struct audio_data data;
+  float planes[AUDIO_IO_MAX_CHANNELS][AUDIO_IO_OUTPUT_FRAMES];
 };
 
 struct audio_io {
@@ -50,11 +150,27 @@ struct audio_io {
   uint8_t channels;
   uint32_t framerate;
 
+  int pacing;
+  uint32_t period_frames;
+  uint64_t period_ns;
+
+  const audio_mix_ops_t *mix;
+  audio_prefetch_t *prefetch;
+
+  // buses that hold non silent samples from previous periods
+  uint32_t dirty_buses;
+
   struct audio_input  input[AUDIO_IO_INPUTS];
   struct audio_bus    buses[AUDIO_IO_BUSES];
   struct audio_output output;
+  struct audio_sink   sinks[AUDIO_IO_SINKS];
 
   struct audio_pps_history pps_history;
+  struct audio_jitter_history jitter_history;
+  struct audio_load_history load_history;
+
+  // number of finished periods, used to retire detached decoders
+  atomic_uint_least64_t period;
 
   struct audio_io_realtime_data internal_rt_data;
   atomic_bool external_rt_data_ready;
@@ -64,30 +180,15 @@ struct audio_io {
 //
 // Realtime data calculation functions
 //
-static void audio_calculate_peak(struct audio_io *audio, uint32_t bus_idx, struct audio_data *data) {
+static void audio_calculate_meter(struct audio_io *audio, uint32_t bus_idx, audio_meter_t *meter, uint32_t frames) {
   struct audio_volmeter *volmeter = &audio->buses[bus_idx].volmeter;
 
   for(int ch = 0; ch < AUDIO_IO_MAX_CHANNELS; ch++) {
     float peak = max4(volmeter->peak_last[ch][0], volmeter->peak_last[ch][1], volmeter->peak_last[ch][2], volmeter->peak_last[ch][3]);
-    for(uint32_t i = 0; i < data->frames; i++) {
-      float sample = data->data[ch][i];
-      peak = fmaxf(peak, fabsf(sample));
-    }
+    peak = fmaxf(peak, meter[ch].peak);
 
     audio->internal_rt_data.peak[bus_idx][ch] = pcm_to_db(peak);
-  }
-}
-
-static void audio_calculate_rms(struct audio_io *audio, uint32_t bus_idx, struct audio_data *data) {
-  for(int ch = 0; ch < AUDIO_IO_MAX_CHANNELS; ch++) {
-    float sum = 0.0;
-    for(uint32_t i = 0; i < data->frames; i++) {
-      float sample = data->data[ch][i];
-      sum += sample * sample;
-    }
-
-    float rms = sqrtf(sum / data->frames);
-    audio->internal_rt_data.rms[bus_idx][ch] = pcm_to_db(rms);
+    audio->internal_rt_data.rms[bus_idx][ch] = pcm_to_db(sqrtf(meter[ch].sum / frames));
   }
 }
 
@@ -103,122 +204,503 @@ static void audio_calculate_pps(struct audio_io *audio, uint64_t delta) {
   audio->internal_rt_data.pps = (float) 1e9 / (ph->ticksum / AUDIO_PPS_SAMPLES);
 }
 
+static void audio_calculate_jitter(struct audio_io *audio, uint64_t latency) {
+  struct audio_jitter_history *jh = &audio->jitter_history;
+
+  jh->ticksum = jh->ticksum - jh->ticklist[jh->tickindex] + latency;
+  jh->ticklist[jh->tickindex] = latency;
+  jh->tickindex = (jh->tickindex + 1) % AUDIO_PPS_SAMPLES;
+  jh->max = max(jh->max, latency);
+
+  audio->internal_rt_data.jitter = (float) (jh->ticksum / AUDIO_PPS_SAMPLES) / 1e3;
+  audio->internal_rt_data.jitter_max = (float) jh->max / 1e3;
+}
+
+static void audio_calculate_headroom(struct audio_io *audio, uint64_t cost) {
+  struct audio_load_history *lh = &audio->load_history;
+
+  lh->ticksum = lh->ticksum - lh->ticklist[lh->tickindex] + cost;
+  lh->ticklist[lh->tickindex] = cost;
+  lh->tickindex = (lh->tickindex + 1) % AUDIO_PPS_SAMPLES;
+  lh->max = max(lh->max, cost);
+
+  // Render cost compared to the period budget
+  audio->internal_rt_data.headroom = 100.0f * (1.0f - (float) (lh->ticksum / AUDIO_PPS_SAMPLES) / audio->period_ns);
+  audio->internal_rt_data.headroom_min = 100.0f * (1.0f - (float) lh->max / audio->period_ns);
+}
+
 //
 // Audio thread functions
 //
-decoder_t decoder;
-uint8_t input_buf[AUDIO_IO_OUTPUT_FRAMES * 2 * 2];
 
-static void audio_input(struct audio_data *data, uint32_t frames, void *param) {
-  uint32_t r = decoder.ops.read_s16(&decoder.data, input_buf, AUDIO_IO_OUTPUT_FRAMES);
-  data->frames = pcm_fixed_to_float(decoder.data.af, data->data[0], input_buf, r);
+// Per channel gains of the parameter block, pan only affects the first two channels
+static void audio_params_gains(const struct audio_params *params, uint8_t channels, float *gains) {
+  float gain = atomic_load_explicit(&params->mute, memory_order_relaxed) ? 0.0f :
+    atomic_load_explicit(&params->gain, memory_order_relaxed);
+  float pan = atomic_load_explicit(&params->pan, memory_order_relaxed);
+
+  for (uint8_t ch = 0; ch < channels; ch++) gains[ch] = gain;
+
+  if (channels >= 2 && pan != 0.0f) {
+    float theta = (clamp(pan, -1.0f, 1.0f) + 1.0f) * AUDIO_IO_PI_4;
+    // Balance, the near side is capped at unity. cosf of pi/2 is slightly negative in float,
+    // hard pans have to silence the other side
+    gains[0] *= clamp(AUDIO_IO_SQRT2 * cosf(theta), 0.0f, 1.0f);
+    gains[1] *= clamp(AUDIO_IO_SQRT2 * sinf(theta), 0.0f, 1.0f);
+  }
+}
+
+static void audio_input_gains(struct audio_io *audio, struct audio_input *input, const float *bus_gains) {
+  audio_params_gains(&input->params, audio->channels, input->gain_target);
+
+  for (uint8_t ch = 0; ch < audio->channels; ch++) {
+    input->gain_target[ch] *= bus_gains[ch];
+    if (input->gain_reset) input->gain[ch] = input->gain_target[ch];
+  }
+
+  input->gain_reset = false;
+}
+
+static inline int audio_input_other_slot(int slot) {
+  return slot < AUDIO_IO_INPUTS ? slot + AUDIO_IO_INPUTS : slot - AUDIO_IO_INPUTS;
+}
+
+static void audio_input_silence(struct audio_io *audio, float *const *dst, uint32_t offset, uint32_t frames) {
+  for(uint8_t ch = 0; ch < audio->channels; ch++) memset(dst[ch] + offset, 0, frames * sizeof(float));
 }
 
-static inline void clamp_audio(struct audio_data *mix) {
-  size_t frames = mix->frames;
+// Frames of the prefetch slot mapped to bus channels, written to dst at offset
+static uint32_t audio_input_read(struct audio_io *audio, struct audio_input *input, int slot, const audio_chmap_t *chmap, float *const *dst, uint32_t offset, uint32_t frames) {
+  float *out[AUDIO_IO_MAX_CHANNELS];
+  for(uint8_t ch = 0; ch < audio->channels; ch++) out[ch] = dst[ch] + offset;
 
-  for (size_t ch = 0; ch < AUDIO_IO_MAX_CHANNELS; ch++) {
-    register float *m = mix->data[ch];
-    register float *end = &m[frames];
+  float *const *planes = chmap->identity ? out : input->planes;
 
-    while (m < end) {
-      register float v = *m;
-      *(m++) = clamp(v, -1.0f, 1.0f);
+  // Decoding happens in prefetch workers, here frames are only copied out
+  uint32_t r = audio_prefetch_read(audio->prefetch, slot, (float **) planes, frames);
+
+  if(!chmap->identity && r > 0) audio_chmap_apply(chmap, audio->mix, out, planes, r);
+
+  return r;
+}
+
+// Queued decoder takes over the input, replaced one waits for audio_io_input_reclaim.
+// Fails if the input is being detached
+static bool audio_input_switch(struct audio_input *input, decoder_t *decoder, decoder_t *next) {
+  if(!atomic_compare_exchange_strong(&input->decoder, &decoder, next)) return false;
+
+  int slot = atomic_load_explicit(&input->slot, memory_order_relaxed);
+
+  input->chmap = input->next_chmap;
+  input->fade_frames = 0;
+  input->fade_position = 0;
+
+  atomic_store_explicit(&input->slot, audio_input_other_slot(slot), memory_order_relaxed);
+  atomic_store_explicit(&input->next, NULL, memory_order_relaxed);
+  atomic_store_explicit(&input->finished, decoder, memory_order_release);
+
+  return true;
+}
+
+// Playing decoder fades out with cosine and queued one fades in with sine, power stays constant
+static void audio_input_crossfade(struct audio_io *audio, struct audio_input *input, int slot, uint32_t offset, uint32_t frames) {
+  const audio_mix_ops_t *mix = audio->mix;
+  int next_slot = audio_input_other_slot(slot);
+
+  uint32_t r = audio_input_read(audio, input, slot, &input->chmap, input->data.data, offset, frames);
+  if(r < frames) audio_input_silence(audio, input->data.data, offset + r, frames - r);
+
+  r = audio_input_read(audio, input, next_slot, &input->next_chmap, input->fade_planes, offset, frames);
+  if(r < frames) {
+    if(!audio_prefetch_eof(audio->prefetch, next_slot)) audio->internal_rt_data.underruns++;
+    audio_input_silence(audio, input->fade_planes, offset + r, frames - r);
+  }
+
+  for(uint32_t i = 0; i < frames; i += AUDIO_IO_FADE_SEGMENT) {
+    uint32_t count = min(frames - i, AUDIO_IO_FADE_SEGMENT);
+    float from = AUDIO_IO_PI_2 * (input->fade_position + i) / input->fade_frames;
+    float to = AUDIO_IO_PI_2 * (input->fade_position + i + count) / input->fade_frames;
+    float out = cosf(from), in = sinf(from);
+
+    for(uint8_t ch = 0; ch < audio->channels; ch++) {
+      float *dst = input->data.data[ch] + offset + i;
+
+      mix->mix_ramp(dst, dst, count, out, (cosf(to) - out) / count, AUDIO_MIX_SET);
+      mix->mix_ramp(dst, input->fade_planes[ch] + offset + i, count, in, (sinf(to) - in) / count, AUDIO_MIX_ADD);
     }
   }
+
+  input->fade_position += frames;
 }
 
-static inline void mix_audio(struct audio_data *mix, struct audio_data *input) {
-  size_t frames = min(mix->frames, input->frames);
-  
-  for (size_t ch = 0; ch < AUDIO_IO_MAX_CHANNELS; ch++) {
-    register float *m = mix->data[ch];
-    register float *i = input->data[ch];
-    register float *end = i + frames;
+static void audio_input(struct audio_io *audio, struct audio_input *input, decoder_t *decoder, uint32_t frames) {
+  uint32_t done = 0;
+
+  while(done < frames) {
+    int slot = atomic_load_explicit(&input->slot, memory_order_relaxed);
+    decoder_t *next = atomic_load_explicit(&input->next, memory_order_acquire);
+    uint32_t count = frames - done;
+
+    if(input->fade_frames > 0) {
+      count = min(count, input->fade_frames - input->fade_position);
+      audio_input_crossfade(audio, input, slot, done, count);
+      done += count;
 
-    while (i < end) *(m++) += *(i++);
+      if(input->fade_position < input->fade_frames) continue;
+      if(audio_input_switch(input, decoder, next)) {
+        decoder = next;
+        continue;
+      }
+
+      break;
+    }
+
+    // Crossfade starts exactly its length before the end of the playing decoder, or at once
+    // if less is left
+    if(next && input->next_fade > 0) {
+      uint64_t remaining = audio_prefetch_remaining(audio->prefetch, slot);
+
+      if(remaining <= input->next_fade) {
+        input->fade_frames = max(remaining, 1);
+        input->fade_position = 0;
+        continue;
+      }
+
+      if(remaining != UINT64_MAX) count = min(count, remaining - input->next_fade);
+    }
+
+    uint32_t r = audio_input_read(audio, input, slot, &input->chmap, input->data.data, done, count);
+    done += r;
+
+    if(r == count) continue;
+
+    // Gapless switch, queued decoder continues within the same period
+    if(audio_prefetch_eof(audio->prefetch, slot)) {
+      if(next && audio_input_switch(input, decoder, next)) {
+        decoder = next;
+        continue;
+      }
+    } else {
+      audio->internal_rt_data.underruns++;
+    }
+
+    break;
   }
+
+  // Short reads leave silence in the rest of the period
+  if(done < frames) audio_input_silence(audio, input->data.data, done, frames - done);
+
+  input->data.frames = frames;
 }
 
-static void audio_input_output(struct audio_io *audio) {
-  struct audio_data input_data[AUDIO_IO_INPUTS];
-  struct audio_data bus_data[AUDIO_IO_INPUTS];
+static void audio_mix_bus(struct audio_io *audio, uint32_t bus_idx, struct audio_data *bus, struct audio_input **inputs, uint8_t count) {
+  const audio_mix_ops_t *mix = audio->mix;
+  audio_meter_t meter[AUDIO_IO_MAX_CHANNELS];
 
-  memset(input_data, 0, sizeof(input_data));
-  memset(bus_data, 0, sizeof(bus_data));
+  audio_limiter_t *limiter = atomic_load_explicit(&audio->buses[bus_idx].limiter, memory_order_acquire);
+  bool clip = audio_limiter_mode(limiter) == AUDIO_LIMITER_CLIP;
 
-  for(int inp_idx = 0; inp_idx < AUDIO_IO_INPUTS; inp_idx++) {
-    struct audio_input *input = &audio->input[inp_idx];
-    
-    memset(input->buffer[0], 0, AUDIO_IO_OUTPUT_FRAMES * AUDIO_IO_MAX_CHANNELS * sizeof(float));
+  memset(meter, 0, sizeof(meter));
+
+  // Single pass over the bus: first input is stored, the rest are added with their gain
+  // ramps. In clip mode the last one is added together with clamping and metering
+  for (size_t ch = 0; ch < audio->channels; ch++) {
+    for (uint8_t i = 0; i < count; i++) {
+      struct audio_input *input = inputs[i];
+      int mode = i == 0 ? AUDIO_MIX_SET : AUDIO_MIX_ADD;
+      uint32_t frames = min(bus->frames, input->data.frames);
+      float step = (input->gain_target[ch] - input->gain[ch]) / frames;
+      float gain = input->gain[ch] + step; // ramp lands on the target at the last frame
+
+      if (clip && i == count - 1)
+        mix->mix_meter(bus->data[ch], input->data.data[ch], frames, gain, step, mode, &meter[ch]);
+      else if (step != 0.0f)
+        mix->mix_ramp(bus->data[ch], input->data.data[ch], frames, gain, step, mode);
+      else if (gain != 1.0f)
+        mix->mix_gain(bus->data[ch], input->data.data[ch], frames, gain, mode);
+      else
+        mix->mix(bus->data[ch], input->data.data[ch], frames, mode);
 
-    for(uint8_t ch = 0; ch < AUDIO_IO_MAX_CHANNELS; ch++) {
-      input_data[inp_idx].frames = AUDIO_IO_OUTPUT_FRAMES;
-      input_data[inp_idx].data[ch] = input->buffer[ch];
+      input->gain[ch] = input->gain_target[ch];
     }
   }
 
-  for(int bus_idx = 0; bus_idx < AUDIO_IO_BUSES; bus_idx++) {
-    struct audio_bus *bus = &audio->buses[bus_idx];
-    
-    memset(bus->buffer[0], 0, AUDIO_IO_OUTPUT_FRAMES * AUDIO_IO_MAX_CHANNELS * sizeof(float));
+  audio->internal_rt_data.gain_reduction[bus_idx] = audio_limiter_process(limiter, bus->data, bus->frames, meter);
+  audio_calculate_meter(audio, bus_idx, meter, bus->frames);
+}
+
+// Bus without inputs still plays out frames delayed by its limiter
+static bool audio_drain_bus(struct audio_io *audio, uint32_t bus_idx, struct audio_data *bus) {
+  audio_limiter_t *limiter = atomic_load_explicit(&audio->buses[bus_idx].limiter, memory_order_acquire);
+  audio_meter_t meter[AUDIO_IO_MAX_CHANNELS];
+
+  if(audio_limiter_pending(limiter) == 0) return false;
+
+  memset(meter, 0, sizeof(meter));
+
+  audio->internal_rt_data.gain_reduction[bus_idx] = audio_limiter_drain(limiter, bus->data, bus->frames, meter);
+  audio_calculate_meter(audio, bus_idx, meter, bus->frames);
+
+  return true;
+}
+
+static void audio_silence_bus(struct audio_io *audio, uint32_t bus_idx) {
+  struct audio_bus *bus = &audio->buses[bus_idx];
+
+  // Silent bus buffer is cleared only once, after its last input is gone
+  if(audio->dirty_buses & (1u << bus_idx)) {
+    memset(bus->buffer, 0, sizeof(bus->buffer));
+    audio->dirty_buses &= ~(1u << bus_idx);
+  }
+
+  for(int ch = 0; ch < AUDIO_IO_MAX_CHANNELS; ch++) {
+    audio->internal_rt_data.peak[bus_idx][ch] = -INFINITY;
+    audio->internal_rt_data.rms[bus_idx][ch] = -INFINITY;
+  }
+
+  audio->internal_rt_data.gain_reduction[bus_idx] = 0.0f;
+}
+
+// Copy bus period into sink ring. Whole period is dropped if it doesn't fit, so sink never plays a torn one
+static void audio_sink_push(struct audio_io *audio, struct audio_sink *sink, audiobuffer_t *buffer) {
+  struct audio_bus *bus = &audio->buses[atomic_load_explicit(&sink->bus_idx, memory_order_relaxed)];
+  uint32_t frames = audio->period_frames;
+
+  if(audiobuffer_write_begin(buffer, frames) < frames) {
+    audiobuffer_write_end(buffer);
+    atomic_fetch_add_explicit(&sink->dropped, frames, memory_order_relaxed);
+    return;
+  }
+
+  const float *planes[AUDIO_IO_MAX_CHANNELS];
+  uint32_t done = 0, count;
+  float *ptr;
+
+  while(done < frames && (count = audiobuffer_write(buffer, &ptr)) > 0) {
+    count = min(count, frames - done);
 
-    for(uint8_t ch = 0; ch < AUDIO_IO_MAX_CHANNELS; ch++) {
-      bus_data[bus_idx].frames = AUDIO_IO_OUTPUT_FRAMES;
-      bus_data[bus_idx].data[ch] = bus->buffer[ch];
+    for(int ch = 0; ch < AUDIO_IO_MAX_CHANNELS; ch++) planes[ch] = bus->data.data[ch] + done;
+    pcm_planar_to_fixed(sink->af, (uint8_t *) ptr, planes, count);
+
+    audiobuffer_write_fill(buffer, count);
+    done += count;
+  }
+
+  audiobuffer_write_end(buffer);
+}
+
+static void audio_sinks_push(struct audio_io *audio) {
+  uint32_t active_sinks = 0;
+
+  for(int sink_idx = 0; sink_idx < AUDIO_IO_SINKS; sink_idx++) {
+    struct audio_sink *sink = &audio->sinks[sink_idx];
+    audiobuffer_t *buffer = atomic_load_explicit(&sink->published, memory_order_acquire);
+
+    if(buffer) {
+      audio_sink_push(audio, sink, buffer);
+      active_sinks |= 1u << sink_idx;
     }
+
+    audio->internal_rt_data.sink_dropped[sink_idx] = atomic_load_explicit(&sink->dropped, memory_order_relaxed);
   }
 
+  audio->internal_rt_data.active_sinks = active_sinks;
+}
+
+static void audio_input_output(struct audio_io *audio) {
+  struct audio_input *bus_inputs[AUDIO_IO_BUSES][AUDIO_IO_INPUTS];
+  uint8_t bus_inputs_count[AUDIO_IO_BUSES] = { 0 };
+  uint32_t active_inputs = 0, active_buses = 0;
+  float bus_gains[AUDIO_IO_BUSES][AUDIO_IO_MAX_CHANNELS];
+
+  for(int bus_idx = 0; bus_idx < AUDIO_IO_BUSES; bus_idx++)
+    audio_params_gains(&audio->buses[bus_idx].params, audio->channels, bus_gains[bus_idx]);
+
   for(int inp_idx = 0; inp_idx < AUDIO_IO_INPUTS; inp_idx++) {
     struct audio_input *input = &audio->input[inp_idx];
+    decoder_t *decoder = atomic_load_explicit(&input->decoder, memory_order_acquire);
+
+    if(decoder) {
+      int bus_idx = atomic_load_explicit(&input->bus_idx, memory_order_relaxed);
+
+      audio_input(audio, input, decoder, audio->period_frames);
+      audio_input_gains(audio, input, bus_gains[bus_idx]);
+      bus_inputs[bus_idx][bus_inputs_count[bus_idx]++] = input;
 
-    if(input->callback) {
-      input->callback(&input_data[inp_idx], AUDIO_IO_OUTPUT_FRAMES, input->param);
-      mix_audio(&bus_data[input->bus_idx], &input_data[inp_idx]);
+      active_inputs |= 1u << inp_idx;
+      active_buses |= 1u << bus_idx;
     }
   }
 
   for(int bus_idx = 0; bus_idx < AUDIO_IO_BUSES; bus_idx++) {
-    clamp_audio(&bus_data[bus_idx]);
+    struct audio_bus *bus = &audio->buses[bus_idx];
+    bus->data.frames = audio->period_frames;
+
+    if(active_buses & (1u << bus_idx)) {
+      audio_mix_bus(audio, bus_idx, &bus->data, bus_inputs[bus_idx], bus_inputs_count[bus_idx]);
+    } else if(!audio_drain_bus(audio, bus_idx, &bus->data)) {
+      audio_silence_bus(audio, bus_idx);
+    }
+  }
+
+  audio->dirty_buses |= active_buses;
+  audio->internal_rt_data.active_inputs = active_inputs;
+  audio->internal_rt_data.active_buses = active_buses;
 
-    audio_calculate_peak(audio, bus_idx, &bus_data[bus_idx]);
-    audio_calculate_rms(audio, bus_idx, &bus_data[bus_idx]);
+  // Sinks get their copy first, primary output may block on the device
+  audio_sinks_push(audio);
+  audio->output.callback(&audio->buses[audio->output.bus_idx].data, audio->period_frames, audio->output.param);
+
+  atomic_fetch_add_explicit(&audio->period, 1, memory_order_release);
+}
+
+static bool audio_wait_output(struct audio_io *audio) {
+  // Output wait polls device descriptors and returns once it wants more data
+  while(audio->state == AUDIO_IO_STATE_OPENED) {
+    if(audio->output.wait(audio->output.param) > 0) return true;
+
+    // Failed or stalled device returns at once, back off a period instead of spinning at
+    // realtime priority and starving the thread that would close it
+    os_sleep_ns(audio->period_ns);
   }
 
-  audio->output.callback(&bus_data[0], AUDIO_IO_OUTPUT_FRAMES, audio->output.param);
+  return false;
 }
 
 static void *audio_thread(void *param) {
   struct audio_io *audio = param;
 
-  decoder.ops = decoder_mp3;
-  decoder.data.af = 0;
-  decoder.data.priv = 0;
-  decoder.ops.open(&decoder.data);
-
   uint64_t curr_time, last_time = os_gettime_ns();
+  uint64_t deadline = last_time;
   uint64_t delta;
 
-  bool rt_data_ready_expected = false;
+  bool rt_data_ready_expected;
 
   while(audio->state == AUDIO_IO_STATE_OPENED) {
+    deadline += audio->period_ns;
+
+    uint64_t render_start = os_gettime_ns();
+
     audio_input_output(audio);
 
+    uint64_t render_end = os_gettime_ns();
+    audio_calculate_headroom(audio, render_end - render_start);
+
+    if(render_end > deadline) {
+      audio->internal_rt_data.missed++;
+    }
+
+    // Sleep until the device or the clock asks for the next period
+    if(audio->pacing == AUDIO_IO_PACING_OUTPUT) {
+      if(!audio_wait_output(audio)) break;
+    } else {
+      os_sleep_until_ns(deadline);
+    }
+
     curr_time = os_gettime_ns();
-    delta = curr_time - last_time;  
+    delta = curr_time - last_time;
     last_time = curr_time;
 
     audio_calculate_pps(audio, delta);
 
+    if(curr_time > deadline) {
+      audio_calculate_jitter(audio, curr_time - deadline);
+
+      if(curr_time - deadline > audio->period_ns * AUDIO_IO_MAX_LATE_PERIODS)
+        deadline = curr_time;
+    } else {
+      // Device driven wakeups may come early, next period is scheduled from here
+      audio_calculate_jitter(audio, 0);
+      if(audio->pacing == AUDIO_IO_PACING_OUTPUT) deadline = curr_time;
+    }
+
     // Push new realtime data for external access if not ready;
+    rt_data_ready_expected = false;
     if(atomic_compare_exchange_strong(&audio->external_rt_data_ready, &rt_data_ready_expected, true)) {
       audio->external_rt_data = audio->internal_rt_data;
+      audio->jitter_history.max = 0;
+      audio->load_history.max = 0;
+    }
+  }
+
+  return NULL;
+}
+
+//
+// Sink thread functions
+//
+static void *sink_thread(void *param) {
+  struct audio_sink *sink = param;
+  uint32_t period_frames = sink->audio->period_frames;
+  uint64_t timeout_ns = sink->audio->period_ns * AUDIO_IO_SINK_PERIODS;
+  float *ptr;
+
+  while(atomic_load_explicit(&sink->running, memory_order_acquire)) {
+    // Audio thread wakes us once a whole period is queued
+    if(audiobuffer_wait_readable(sink->buffer, period_frames, timeout_ns) == 0) continue;
+
+    uint32_t available = audiobuffer_read_begin(sink->buffer, AUDIO_IO_OUTPUT_FRAMES);
+
+    if(available == 0) {
+      audiobuffer_read_end(sink->buffer);
+      continue;
+    }
+
+    uint32_t done = 0, count;
+    while((count = audiobuffer_read(sink->buffer, &ptr)) > 0) {
+      float *planes[AUDIO_IO_MAX_CHANNELS];
+      for(int ch = 0; ch < AUDIO_IO_MAX_CHANNELS; ch++) planes[ch] = sink->data.data[ch] + done;
+
+      pcm_fixed_to_planar(sink->af, planes, (const uint8_t *) ptr, count);
+      done = audiobuffer_read_consume(sink->buffer, count);
     }
+
+    audiobuffer_read_end(sink->buffer);
+
+    if(sink->info.wait) sink->info.wait(sink->info.param);
+
+    sink->data.frames = done;
+    sink->info.callback(&sink->data, done, sink->info.param);
   }
 
   return NULL;
 }
 
+// Returns once audio thread finished the period it may have started with old input or sink state
+static void audio_wait_period(struct audio_io *audio) {
+  uint64_t period = atomic_load(&audio->period);
+  while(audio->state == AUDIO_IO_STATE_OPENED && atomic_load(&audio->period) == period) {
+    os_sleep_ms(1);
+  }
+}
+
+static int audio_thread_create(struct audio_io *io, int sched_flags, int sched_priority) {
+  if(sched_flags & AUDIO_IO_SCHED_FIFO) {
+    pthread_attr_t attr;
+    struct sched_param param = { .sched_priority = sched_priority };
+
+    if(param.sched_priority <= 0)
+      param.sched_priority = sched_get_priority_max(SCHED_FIFO) / 2;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+
+    int rc = pthread_create(&io->thread, &attr, audio_thread, io);
+    pthread_attr_destroy(&attr);
+
+    if(rc == 0) {
+      log_write(MIZAR_LOGLEVEL_DEBUG, "AUDIO IO", "Audio thread uses SCHED_FIFO, priority %d", param.sched_priority);
+      return 0;
+    }
+
+    log_write(MIZAR_LOGLEVEL_WARN, "AUDIO IO", "Unable to use SCHED_FIFO: %s", strerror(rc));
+  }
+
+  return pthread_create(&io->thread, NULL, audio_thread, io);
+}
+
 //
 // Public functions
 //
@@ -236,21 +718,65 @@ int audio_io_open(audio_io_t **audio, audio_output_info_t* output_info) {
   io->framerate = af_get_rate(output_info->af);
 
   io->output.callback = output_info->callback;
+  io->output.wait = output_info->wait;
   io->output.param = output_info->param;
+  io->output.bus_idx = output_info->bus_idx < AUDIO_IO_BUSES ? output_info->bus_idx : 0;
+
+  io->mix = audio_mix_select();
+
+  if (audio_prefetch_open(&io->prefetch, output_info->prefetch_workers, output_info->prefetch_frames, output_info->resample_quality) != AUDIO_PREFETCH_SUCCESS)
+    goto fail;
+
+  for (int i = 0; i < AUDIO_IO_INPUTS; i++) {
+    for (int ch = 0; ch < AUDIO_IO_MAX_CHANNELS; ch++) io->input[i].data.data[ch] = io->input[i].buffer[ch];
+    for (int ch = 0; ch < AUDIO_IO_MAX_CHANNELS; ch++) io->input[i].fade_planes[ch] = io->input[i].fade_buffer[ch];
+    for (int ch = 0; ch < DECODER_MAX_CHANNELS; ch++) io->input[i].planes[ch] = io->input[i].decoded[ch];
+    atomic_init(&io->input[i].params.gain, 1.0f);
+    atomic_init(&io->input[i].slot, i);
+  }
+
+  for (int i = 0; i < AUDIO_IO_BUSES; i++) {
+    for (int ch = 0; ch < AUDIO_IO_MAX_CHANNELS; ch++) io->buses[i].data.data[ch] = io->buses[i].buffer[ch];
+    atomic_init(&io->buses[i].params.gain, 1.0f);
+
+    audio_limiter_t *limiter = audio_limiter_create(io->framerate, io->channels, AUDIO_IO_OUTPUT_FRAMES, &output_info->limiter);
+    if (!limiter) goto fail;
+    atomic_init(&io->buses[i].limiter, limiter);
+  }
+
+  for (int i = 0; i < AUDIO_IO_SINKS; i++) {
+    io->sinks[i].audio = io;
+    io->sinks[i].af = af_endian(AF_NATIVE_ENDIAN) | af_format(SF_FORMAT_FLOAT) | af_rate(io->framerate) | af_channels(io->channels);
+    for (int ch = 0; ch < AUDIO_IO_MAX_CHANNELS; ch++) io->sinks[i].data.data[ch] = io->sinks[i].planes[ch];
+  }
+
+  io->pacing = output_info->wait ? output_info->pacing : AUDIO_IO_PACING_CLOCK;
+
+  // Period follows the device, capped by the size of the internal buffers
+  io->period_frames = output_info->period_frames ? output_info->period_frames : AUDIO_IO_OUTPUT_FRAMES;
+  if (io->period_frames > AUDIO_IO_OUTPUT_FRAMES) {
+    log_write(MIZAR_LOGLEVEL_WARN, "AUDIO IO", "Period of %u frames exceeds %u, capped",
+      io->period_frames, AUDIO_IO_OUTPUT_FRAMES);
+    io->period_frames = AUDIO_IO_OUTPUT_FRAMES;
+  }
+  io->period_ns = pcm_frames_to_ns(io->framerate, io->period_frames);
+
+  if (output_info->sched_flags & AUDIO_IO_SCHED_MLOCK) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+      log_write(MIZAR_LOGLEVEL_WARN, "AUDIO IO", "Unable to lock memory: %s", strerror(errno));
+  }
   
   io->state = AUDIO_IO_STATE_OPENED;
 
-  if (pthread_create(&io->thread, NULL, audio_thread, io) != 0)
+  if (audio_thread_create(io, output_info->sched_flags, output_info->sched_priority) != 0)
     goto fail;
 
-  io->input[0].callback = audio_input;
-  io->input[0].bus_idx = 0;
   io->initialized = true;
   *audio = io;
 
-  float buffer_time = (float) AUDIO_IO_OUTPUT_FRAMES / af_get_rate(output_info->af);
+  float buffer_time = (float) io->period_frames / af_get_rate(output_info->af);
 
-  log_write(MIZAR_LOGLEVEL_DEBUG, "AUDIO IO", "Buffer time: %.2f ms", buffer_time * 1e3);
+  log_write(MIZAR_LOGLEVEL_DEBUG, "AUDIO IO", "Period: %u frames, %.2f ms", io->period_frames, buffer_time * 1e3);
 
   return AUDIO_IO_SUCCESS;
 
@@ -265,12 +791,268 @@ void audio_io_close(audio_io_t *audio) {
   if (audio->initialized) {
     audio->state = AUDIO_IO_STATE_CLOSED;
     pthread_join(audio->thread, NULL);
+
+    for (int i = 0; i < AUDIO_IO_SINKS; i++) audio_io_sink_detach(audio, i);
   }
 
+  audio_prefetch_close(audio->prefetch);
+
+  for (int i = 0; i < AUDIO_IO_BUSES; i++) audio_limiter_destroy(audio->buses[i].limiter);
+
   free(audio);
 }
 
 void audio_io_get_realtime_data(audio_io_t *audio, struct audio_io_realtime_data *realtime_data) {
   audio->external_rt_data_ready = false;
   *realtime_data = audio->external_rt_data;
+}
+
+int audio_io_input_attach(audio_io_t *audio, uint8_t input_idx, uint8_t bus_idx, decoder_t *decoder) {
+  return audio_io_input_attach_matrix(audio, input_idx, bus_idx, decoder, NULL);
+}
+
+int audio_io_input_attach_matrix(audio_io_t *audio, uint8_t input_idx, uint8_t bus_idx, decoder_t *decoder, const float *matrix) {
+  if(!audio || !decoder || input_idx >= AUDIO_IO_INPUTS || bus_idx >= AUDIO_IO_BUSES)
+    return AUDIO_IO_INVALIDPARAM;
+
+  uint8_t channels = af_get_channels(decoder->data.af);
+  if(channels == 0 || channels > DECODER_MAX_CHANNELS)
+    return AUDIO_IO_INVALIDPARAM;
+
+  struct audio_input *input = &audio->input[input_idx];
+
+  bool attached_expected = false;
+  if(!atomic_compare_exchange_strong(&input->attached, &attached_expected, true))
+    return AUDIO_IO_ERROR;
+
+  // Audio thread doesn't look at the input until decoder is published
+  audio_chmap_init(&input->chmap, channels, audio->channels, matrix);
+  input->gain_reset = true;
+  input->fade_frames = 0;
+
+  int slot = atomic_load(&input->slot);
+
+  if(audio_prefetch_attach(audio->prefetch, slot, decoder, audio->framerate, audio->period_frames) != AUDIO_PREFETCH_SUCCESS) {
+    atomic_store(&input->attached, false);
+    return AUDIO_IO_ERROR;
+  }
+
+  atomic_store_explicit(&input->bus_idx, bus_idx, memory_order_relaxed);
+  atomic_store_explicit(&input->decoder, decoder, memory_order_release);
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "AUDIO IO", "Input %u attached to bus %u, %u -> %u channels%s", input_idx, bus_idx,
+    channels, audio->channels, input->chmap.identity ? "" : (matrix ? ", user matrix" : ", default matrix"));
+
+  return AUDIO_IO_SUCCESS;
+}
+
+decoder_t *audio_io_input_detach(audio_io_t *audio, uint8_t input_idx) {
+  if(!audio || input_idx >= AUDIO_IO_INPUTS)
+    return NULL;
+
+  struct audio_input *input = &audio->input[input_idx];
+
+  decoder_t *decoder = atomic_exchange(&input->decoder, NULL);
+  if(!decoder) return NULL;
+
+  // Audio thread may still use the decoder within current period
+  audio_wait_period(audio);
+
+  int slot = atomic_load(&input->slot);
+  audio_prefetch_detach(audio->prefetch, slot);
+
+  // Queued or replaced decoder is released from the other slot, caller still owns it
+  decoder_t *next = atomic_exchange(&input->next, NULL);
+  decoder_t *finished = atomic_exchange(&input->finished, NULL);
+  if(next || finished) audio_prefetch_detach(audio->prefetch, audio_input_other_slot(slot));
+
+  atomic_store(&input->queued, false);
+  atomic_store(&input->attached, false);
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "AUDIO IO", "Input %u detached", input_idx);
+
+  return decoder;
+}
+
+int audio_io_input_queue(audio_io_t *audio, uint8_t input_idx, decoder_t *decoder, uint32_t crossfade_ms) {
+  if(!audio || !decoder || input_idx >= AUDIO_IO_INPUTS)
+    return AUDIO_IO_INVALIDPARAM;
+
+  uint8_t channels = af_get_channels(decoder->data.af);
+  if(channels == 0 || channels > DECODER_MAX_CHANNELS)
+    return AUDIO_IO_INVALIDPARAM;
+
+  struct audio_input *input = &audio->input[input_idx];
+
+  if(!atomic_load(&input->decoder))
+    return AUDIO_IO_ERROR;
+
+  bool queued_expected = false;
+  if(!atomic_compare_exchange_strong(&input->queued, &queued_expected, true))
+    return AUDIO_IO_ERROR;
+
+  // Playing slot doesn't change until the queued decoder is published
+  int slot = audio_input_other_slot(atomic_load(&input->slot));
+
+  audio_chmap_init(&input->next_chmap, channels, audio->channels, NULL);
+  input->next_fade = (uint64_t) crossfade_ms * audio->framerate / 1000;
+
+  if(audio_prefetch_attach(audio->prefetch, slot, decoder, audio->framerate, audio->period_frames) != AUDIO_PREFETCH_SUCCESS) {
+    atomic_store(&input->queued, false);
+    return AUDIO_IO_ERROR;
+  }
+
+  atomic_store_explicit(&input->next, decoder, memory_order_release);
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "AUDIO IO", "Input %u queued, %u -> %u channels, crossfade %u ms", input_idx,
+    channels, audio->channels, crossfade_ms);
+
+  return AUDIO_IO_SUCCESS;
+}
+
+decoder_t *audio_io_input_reclaim(audio_io_t *audio, uint8_t input_idx) {
+  if(!audio || input_idx >= AUDIO_IO_INPUTS)
+    return NULL;
+
+  struct audio_input *input = &audio->input[input_idx];
+
+  decoder_t *decoder = atomic_exchange(&input->finished, NULL);
+  if(!decoder) return NULL;
+
+  // Audio thread may still read the replaced slot within current period
+  audio_wait_period(audio);
+  audio_prefetch_detach(audio->prefetch, audio_input_other_slot(atomic_load(&input->slot)));
+
+  atomic_store(&input->queued, false);
+
+  return decoder;
+}
+
+int audio_io_input_set_gain(audio_io_t *audio, uint8_t input_idx, float gain) {
+  if(!audio || input_idx >= AUDIO_IO_INPUTS || !isfinite(gain) || gain < 0.0f)
+    return AUDIO_IO_INVALIDPARAM;
+
+  atomic_store_explicit(&audio->input[input_idx].params.gain, gain, memory_order_relaxed);
+  return AUDIO_IO_SUCCESS;
+}
+
+int audio_io_input_set_pan(audio_io_t *audio, uint8_t input_idx, float pan) {
+  if(!audio || input_idx >= AUDIO_IO_INPUTS || !(pan >= -1.0f && pan <= 1.0f))
+    return AUDIO_IO_INVALIDPARAM;
+
+  atomic_store_explicit(&audio->input[input_idx].params.pan, pan, memory_order_relaxed);
+  return AUDIO_IO_SUCCESS;
+}
+
+int audio_io_input_set_mute(audio_io_t *audio, uint8_t input_idx, bool mute) {
+  if(!audio || input_idx >= AUDIO_IO_INPUTS)
+    return AUDIO_IO_INVALIDPARAM;
+
+  atomic_store_explicit(&audio->input[input_idx].params.mute, mute, memory_order_relaxed);
+  return AUDIO_IO_SUCCESS;
+}
+
+int audio_io_bus_set_gain(audio_io_t *audio, uint8_t bus_idx, float gain) {
+  if(!audio || bus_idx >= AUDIO_IO_BUSES || !isfinite(gain) || gain < 0.0f)
+    return AUDIO_IO_INVALIDPARAM;
+
+  atomic_store_explicit(&audio->buses[bus_idx].params.gain, gain, memory_order_relaxed);
+  return AUDIO_IO_SUCCESS;
+}
+
+int audio_io_bus_set_pan(audio_io_t *audio, uint8_t bus_idx, float pan) {
+  if(!audio || bus_idx >= AUDIO_IO_BUSES || !(pan >= -1.0f && pan <= 1.0f))
+    return AUDIO_IO_INVALIDPARAM;
+
+  atomic_store_explicit(&audio->buses[bus_idx].params.pan, pan, memory_order_relaxed);
+  return AUDIO_IO_SUCCESS;
+}
+
+int audio_io_bus_set_mute(audio_io_t *audio, uint8_t bus_idx, bool mute) {
+  if(!audio || bus_idx >= AUDIO_IO_BUSES)
+    return AUDIO_IO_INVALIDPARAM;
+
+  atomic_store_explicit(&audio->buses[bus_idx].params.mute, mute, memory_order_relaxed);
+  return AUDIO_IO_SUCCESS;
+}
+
+int audio_io_bus_set_limiter(audio_io_t *audio, uint8_t bus_idx, const audio_limiter_params_t *params) {
+  if(!audio || bus_idx >= AUDIO_IO_BUSES)
+    return AUDIO_IO_INVALIDPARAM;
+
+  audio_limiter_t *limiter = audio_limiter_create(audio->framerate, audio->channels, AUDIO_IO_OUTPUT_FRAMES, params);
+  if(!limiter) return AUDIO_IO_ERROR;
+
+  limiter = atomic_exchange(&audio->buses[bus_idx].limiter, limiter);
+
+  // Audio thread may still use the old limiter within current period
+  audio_wait_period(audio);
+  audio_limiter_destroy(limiter);
+
+  return AUDIO_IO_SUCCESS;
+}
+
+int audio_io_sink_attach(audio_io_t *audio, uint8_t sink_idx, uint8_t bus_idx, const audio_sink_info_t *sink_info) {
+  if(!audio || !sink_info || !sink_info->callback || sink_idx >= AUDIO_IO_SINKS || bus_idx >= AUDIO_IO_BUSES)
+    return AUDIO_IO_INVALIDPARAM;
+
+  struct audio_sink *sink = &audio->sinks[sink_idx];
+
+  bool attached_expected = false;
+  if(!atomic_compare_exchange_strong(&sink->attached, &attached_expected, true))
+    return AUDIO_IO_ERROR;
+
+  uint32_t frames = sink_info->buffer_frames ? sink_info->buffer_frames : AUDIO_IO_OUTPUT_FRAMES * AUDIO_IO_SINK_PERIODS;
+  frames = max(frames, audio->period_frames * 2);
+
+  sink->info = *sink_info;
+  sink->buffer = audiobuffer_create(sink->af, frames);
+  if(!sink->buffer) goto fail;
+
+  atomic_store(&sink->dropped, 0);
+  atomic_store(&sink->running, true);
+  if(pthread_create(&sink->thread, NULL, sink_thread, sink) != 0) {
+    audiobuffer_destroy(sink->buffer);
+    goto fail;
+  }
+
+  atomic_store_explicit(&sink->bus_idx, bus_idx, memory_order_relaxed);
+  atomic_store_explicit(&sink->published, sink->buffer, memory_order_release);
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "AUDIO IO", "Sink %u (%s) attached to bus %u, buffer %u frames",
+    sink_idx, sink_info->name ? sink_info->name : "unnamed", bus_idx, frames);
+
+  return AUDIO_IO_SUCCESS;
+
+  fail:
+  sink->buffer = NULL;
+  atomic_store(&sink->attached, false);
+  return AUDIO_IO_ERROR;
+}
+
+int audio_io_sink_detach(audio_io_t *audio, uint8_t sink_idx) {
+  if(!audio || sink_idx >= AUDIO_IO_SINKS)
+    return AUDIO_IO_INVALIDPARAM;
+
+  struct audio_sink *sink = &audio->sinks[sink_idx];
+
+  if(!atomic_load(&sink->attached))
+    return AUDIO_IO_SUCCESS;
+
+  // Audio thread may still be writing to the buffer within current period
+  atomic_store_explicit(&sink->published, NULL, memory_order_release);
+  audio_wait_period(audio);
+
+  atomic_store_explicit(&sink->running, false, memory_order_release);
+  audiobuffer_wakeup(sink->buffer);
+  pthread_join(sink->thread, NULL);
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "AUDIO IO", "Sink %u detached, %llu frames dropped",
+    sink_idx, (unsigned long long) atomic_load(&sink->dropped));
+
+  audiobuffer_destroy(sink->buffer);
+  sink->buffer = NULL;
+  atomic_store(&sink->attached, false);
+
+  return AUDIO_IO_SUCCESS;
 }
\ No newline at end of file
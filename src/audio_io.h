@@ -2,14 +2,32 @@
 #define _H_AUDIO_IO_
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "pcm.h"
+#include "audio_limiter.h"
+#include "decoder/decoder.h"
 
-#define AUDIO_IO_MAX_CHANNELS 2
+// Channels of buses and outputs, set with meson -Dmax_channels
+#ifndef AUDIO_IO_MAX_CHANNELS
+  #define AUDIO_IO_MAX_CHANNELS 2
+#endif
 #define AUDIO_IO_INPUTS 8
 #define AUDIO_IO_BUSES 8
-#define AUDIO_IO_OUTPUT_FRAMES 1024
+#define AUDIO_IO_SINKS 4
+#define AUDIO_IO_OUTPUT_FRAMES 1024 // largest period, buffers are sized for it
 #define AUDIO_PPS_SAMPLES 100
 
+// Ring buffer between audio thread and a sink, in periods of AUDIO_IO_OUTPUT_FRAMES
+#define AUDIO_IO_SINK_PERIODS 8
+
+// Audio thread pacing
+#define AUDIO_IO_PACING_OUTPUT 0 // wait until output device asks for the next period
+#define AUDIO_IO_PACING_CLOCK  1 // sleep until absolute monotonic deadlines
+
+// Audio thread scheduling flags
+#define AUDIO_IO_SCHED_FIFO 0x01 // run audio thread with SCHED_FIFO policy
+#define AUDIO_IO_SCHED_MLOCK 0x02 // lock process memory with mlockall
+
 #define AUDIO_IO_SUCCESS 0
 #define AUDIO_IO_INVALIDPARAM -1
 #define AUDIO_IO_ERROR -2
@@ -25,11 +43,24 @@ struct audio_data {
 struct audio_io_realtime_data {
   uint64_t time;
   float pps;
+  uint64_t missed;  // periods rendered after their deadline
+  uint64_t underruns; // input periods short of decoded frames
+  float jitter;     // mean wakeup latency, us
+  float jitter_max; // max wakeup latency since last read, us
+  float headroom;     // mean share of the period left after rendering, percent
+  float headroom_min; // min headroom since last read, percent
+  uint32_t active_inputs; // bitmask of inputs with attached decoders
+  uint32_t active_buses;  // bitmask of buses that received any input
+  uint32_t active_sinks;  // bitmask of attached sinks
+  uint64_t sink_dropped[AUDIO_IO_SINKS]; // frames dropped because sink fell behind
   float rms[AUDIO_IO_BUSES][AUDIO_IO_MAX_CHANNELS];
   float peak[AUDIO_IO_BUSES][AUDIO_IO_MAX_CHANNELS];
+  float gain_reduction[AUDIO_IO_BUSES]; // deepest limiter reduction of last period, dB, 0 in clip mode
 };
 
 typedef void (*audio_output_callback_t)(struct audio_data *data, uint32_t frames, void *param);
+// Blocks until output can take more frames, returns number of frames it can take
+typedef uint32_t (*audio_output_wait_callback_t)(void *param);
 
 typedef struct {
 	const char *name;
@@ -38,14 +69,214 @@ typedef struct {
 
 	int mix;
 
+	// Bus delivered to the output
+	uint8_t bus_idx;
+
 	audio_output_callback_t callback;
+	audio_output_wait_callback_t wait;
 	void *param;
+
+	// Period negotiated with the output device, 0 for AUDIO_IO_OUTPUT_FRAMES
+	uint32_t period_frames;
+
+	// Inputs are decoded ahead by a worker pool, 0 for AUDIO_PREFETCH_* defaults
+	uint32_t prefetch_frames;
+	uint8_t prefetch_workers;
+
+	// Inputs of other rates are converted to the output rate, one of AUDIO_RESAMPLE_* presets
+	int resample_quality;
+
+	// Output stage of every bus, look-ahead mode delays buses by the attack time
+	audio_limiter_params_t limiter;
+
+	int pacing;
+	int sched_flags;
+	int sched_priority;
 } audio_output_info_t;
 
-typedef void (*audio_input_callback_t)(struct audio_data *data, uint32_t frames, void *param);
+/*
+  Sinks are additional outputs fed from a bus of the same rendered period. Audio thread only copies
+  the bus into sink ring buffer, sink thread delivers it. Sink that falls behind loses frames instead
+  of stalling audio thread and other outputs.
+*/
+typedef struct {
+	const char *name;
+
+	audio_output_callback_t callback;
+	audio_output_wait_callback_t wait; // optional
+	void *param;
+
+	// Ring buffer size in frames, 0 for AUDIO_IO_SINK_PERIODS periods
+	uint32_t buffer_frames;
+} audio_sink_info_t;
 
 int audio_io_open(audio_io_t **audio, audio_output_info_t* output_info);
 void audio_io_close(audio_io_t *audio);
 void audio_io_get_realtime_data(audio_io_t *audio, struct audio_io_realtime_data *realtime_data);
 
+/**
+ * Bind opened decoder to the input slot. Returns once the first period is decoded ahead,
+ * audio thread picks it up at the next period. Decoder channels are mapped to output
+ * channels with the default matrix, see audio_chmap.h
+ *
+ * @param audio Audio IO instance
+ * @param input_idx Input slot index
+ * @param bus_idx Bus the input is mixed into
+ * @param decoder Opened decoder with any rate and channels, must stay valid until detached
+ * @return AUDIO_IO_SUCCESS, AUDIO_IO_INVALIDPARAM or AUDIO_IO_ERROR if slot is busy
+ */
+int audio_io_input_attach(audio_io_t *audio, uint8_t input_idx, uint8_t bus_idx, decoder_t *decoder);
+
+/**
+ * Bind opened decoder to the input slot with a channel matrix
+ *
+ * @param audio Audio IO instance
+ * @param input_idx Input slot index
+ * @param bus_idx Bus the input is mixed into
+ * @param decoder Opened decoder with any rate and channels, must stay valid until detached
+ * @param matrix Row major gains, output channels x decoder channels. NULL for the default matrix
+ * @return AUDIO_IO_SUCCESS, AUDIO_IO_INVALIDPARAM or AUDIO_IO_ERROR if slot is busy
+ */
+int audio_io_input_attach_matrix(audio_io_t *audio, uint8_t input_idx, uint8_t bus_idx, decoder_t *decoder, const float *matrix);
+
+/**
+ * Unbind decoder from the input slot. Blocks until audio thread releases the decoder. Queued
+ * decoder and the one waiting to be reclaimed are unbound too, caller still owns them
+ *
+ * @param audio Audio IO instance
+ * @param input_idx Input slot index
+ * @return Currently playing decoder or NULL
+ */
+decoder_t *audio_io_input_detach(audio_io_t *audio, uint8_t input_idx);
+
+/*
+  Every input plays a queue of decoders. Queued decoder is decoded ahead in a second prefetch slot
+  of the input and takes over sample accurately: right after the last frame of the playing one, or
+  with an equal power crossfade that ends with it. Crossfade is scheduled from the decoder length
+  and shortened to what is left when the length is unknown. Replaced decoder is handed back with
+  audio_io_input_reclaim, after that the next one can be queued. Queue, reclaim and detach of
+  one input are expected from one control thread.
+*/
+
+/**
+ * Queue opened decoder after the one playing on the input. Returns once its first period is
+ * decoded ahead. Decoder channels are mapped with the default matrix
+ *
+ * @param audio Audio IO instance
+ * @param input_idx Input slot index
+ * @param decoder Opened decoder with any rate and channels, must stay valid until reclaimed or detached
+ * @param crossfade_ms Crossfade length, 0 for gapless playback
+ * @return AUDIO_IO_SUCCESS, AUDIO_IO_INVALIDPARAM or AUDIO_IO_ERROR if nothing is playing or a decoder is queued already
+ */
+int audio_io_input_queue(audio_io_t *audio, uint8_t input_idx, decoder_t *decoder, uint32_t crossfade_ms);
+
+/**
+ * Take back decoder replaced by the queued one. Blocks until audio thread releases it
+ *
+ * @param audio Audio IO instance
+ * @param input_idx Input slot index
+ * @return Finished decoder, to be closed by the caller, or NULL if the queued one didn't start yet
+ */
+decoder_t *audio_io_input_reclaim(audio_io_t *audio, uint8_t input_idx);
+
+/*
+  Gain, pan and mute of inputs and buses are written by control threads without locking and picked
+  up by audio thread at the next period. Changes are ramped linearly over that period inside the mix
+  kernels and reach the new value on its last frame, bus parameters are folded into the gains of
+  its inputs. Pan is applied to the first two channels as balance: both are at unity gain in the
+  center, the side it moves to stays at unity and the other one falls along a sine curve to
+  silence at a hard pan. Total power drops by 3 dB towards a hard pan.
+*/
+
+/**
+ * Set linear gain of the input slot, kept across attached decoders
+ *
+ * @param audio Audio IO instance
+ * @param input_idx Input slot index
+ * @param gain Linear gain, 1 for unity
+ * @return AUDIO_IO_SUCCESS or AUDIO_IO_INVALIDPARAM
+ */
+int audio_io_input_set_gain(audio_io_t *audio, uint8_t input_idx, float gain);
+
+/**
+ * Set pan of the input slot
+ *
+ * @param audio Audio IO instance
+ * @param input_idx Input slot index
+ * @param pan Position from -1 (left) to 1 (right), 0 for center
+ * @return AUDIO_IO_SUCCESS or AUDIO_IO_INVALIDPARAM
+ */
+int audio_io_input_set_pan(audio_io_t *audio, uint8_t input_idx, float pan);
+
+/**
+ * Mute or unmute the input slot
+ *
+ * @param audio Audio IO instance
+ * @param input_idx Input slot index
+ * @param mute True to mute
+ * @return AUDIO_IO_SUCCESS or AUDIO_IO_INVALIDPARAM
+ */
+int audio_io_input_set_mute(audio_io_t *audio, uint8_t input_idx, bool mute);
+
+/**
+ * Set linear gain of the bus
+ *
+ * @param audio Audio IO instance
+ * @param bus_idx Bus index
+ * @param gain Linear gain, 1 for unity
+ * @return AUDIO_IO_SUCCESS or AUDIO_IO_INVALIDPARAM
+ */
+int audio_io_bus_set_gain(audio_io_t *audio, uint8_t bus_idx, float gain);
+
+/**
+ * Set pan of the bus
+ *
+ * @param audio Audio IO instance
+ * @param bus_idx Bus index
+ * @param pan Position from -1 (left) to 1 (right), 0 for center
+ * @return AUDIO_IO_SUCCESS or AUDIO_IO_INVALIDPARAM
+ */
+int audio_io_bus_set_pan(audio_io_t *audio, uint8_t bus_idx, float pan);
+
+/**
+ * Mute or unmute the bus
+ *
+ * @param audio Audio IO instance
+ * @param bus_idx Bus index
+ * @param mute True to mute
+ * @return AUDIO_IO_SUCCESS or AUDIO_IO_INVALIDPARAM
+ */
+int audio_io_bus_set_mute(audio_io_t *audio, uint8_t bus_idx, bool mute);
+
+/**
+ * Replace limiter of the bus. Blocks until audio thread releases the old one, frames held
+ * in its delay line are dropped
+ *
+ * @param audio Audio IO instance
+ * @param bus_idx Bus index
+ * @param params Limiter parameters, NULL for defaults
+ * @return AUDIO_IO_SUCCESS, AUDIO_IO_INVALIDPARAM or AUDIO_IO_ERROR if limiter can't be created
+ */
+int audio_io_bus_set_limiter(audio_io_t *audio, uint8_t bus_idx, const audio_limiter_params_t *params);
+
+/**
+ * Start sink thread and bind it to the bus. Audio thread starts filling its buffer at the next period
+ *
+ * @param audio Audio IO instance
+ * @param sink_idx Sink slot index
+ * @param bus_idx Bus delivered to the sink
+ * @param sink_info Sink callbacks, param must stay valid until detached
+ * @return AUDIO_IO_SUCCESS, AUDIO_IO_INVALIDPARAM or AUDIO_IO_ERROR if slot is busy
+ */
+int audio_io_sink_attach(audio_io_t *audio, uint8_t sink_idx, uint8_t bus_idx, const audio_sink_info_t *sink_info);
+
+/**
+ * Unbind sink from the bus and stop its thread. Frames still buffered are discarded
+ *
+ * @param audio Audio IO instance
+ * @param sink_idx Sink slot index
+ * @return AUDIO_IO_SUCCESS or AUDIO_IO_INVALIDPARAM
+ */
+int audio_io_sink_detach(audio_io_t *audio, uint8_t sink_idx);
+
 #endif
\ No newline at end of file
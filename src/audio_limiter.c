@@ -0,0 +1,740 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "audio_limiter.h"
+#include "pcm.h"
+#include "decoder/decoder.h"
+#include "logging.h"
+#include "util/cpu.h"
+#include "util/mem.h"
+#include "util/math.h"
+
+#if defined(CPU_X86)
+  #include <immintrin.h>
+#endif
+
+#if defined(CPU_NEON)
+  #include <arm_neon.h>
+#endif
+
+#define LIMITER_PI 3.14159265358979323846
+
+// True peak detector interpolates 3 points between every two samples with 16 tap filters,
+// frame n is checked together with the interval before it, LIMITER_CENTER frames late.
+// Shorter or steeper windows droop near Nyquist and let peaks of content near 20 kHz through
+#define LIMITER_PHASES 3
+#define LIMITER_TAPS 16
+#define LIMITER_CENTER 7
+#define LIMITER_BETA 4.0
+
+// Soft clip knee relative to the ceiling, -3 dB
+#define LIMITER_KNEE 0.70710678f
+
+// Gain this close to the target is snapped to it
+#define LIMITER_EPSILON 1e-6f
+
+typedef struct {
+  const char *name;
+
+  // Store or max true peak estimate of frames of x, x[-LIMITER_TAPS + 1] must be readable
+  void (*detect)(float *det, const float *x, const float *coeffs, uint32_t frames, int mode);
+
+  // Store src scaled by gain into dst and update meter, NULL gain for unity
+  void (*apply)(float *dst, const float *src, const float *gain, uint32_t frames, audio_meter_t *meter);
+
+  // Soft clip dst in place and update meter, returns input peak
+  float (*softclip)(float *dst, uint32_t frames, float knee, float ceiling, audio_meter_t *meter);
+} limiter_ops_t;
+
+struct audio_limiter {
+  int mode;
+  uint8_t channels;
+  uint32_t max_frames;
+  const limiter_ops_t *ops;
+
+  float ceiling;
+  float release; // share of the remaining reduction recovered per frame
+
+  // Planar history of keep frames followed by new frames, output is read delay frames back
+  uint32_t lookahead;
+  uint32_t delay;
+  uint32_t keep;
+  uint32_t pending;
+  float *lines;
+  float *det;
+  float *gains;
+
+  // Smallest gain target of the last lookahead frames, monotonic queue
+  float *hold_value;
+  uint64_t *hold_expires;
+  uint32_t hold_head;
+  uint32_t hold_count;
+
+  // Moving average of held gain over lookahead frames
+  float *box;
+  uint32_t box_pos;
+  double box_sum;
+
+  float gain;
+  uint64_t pos;
+  uint32_t quiet; // frames since the last target below unity
+
+  float coeffs[LIMITER_PHASES * LIMITER_TAPS];
+};
+
+static const char *mode_names[] = {
+  [AUDIO_LIMITER_LOOKAHEAD] = "lookahead",
+  [AUDIO_LIMITER_SOFTCLIP]  = "softclip",
+  [AUDIO_LIMITER_CLIP]      = "clip",
+};
+
+//
+// Scalar kernels, also used for unaligned tails of vector kernels
+//
+static inline void detect_tail(float *det, const float *x, const float *coeffs, uint32_t frames, int mode) {
+  for (uint32_t n = 0; n < frames; n++) {
+    const float *w = x + n - (LIMITER_TAPS - 1);
+    float p = fabsf(w[LIMITER_CENTER + 1]);
+
+    for (int ph = 0; ph < LIMITER_PHASES; ph++) {
+      const float *h = coeffs + ph * LIMITER_TAPS;
+      float s = 0.0f;
+
+      for (int k = 0; k < LIMITER_TAPS; k++) s += w[k] * h[k];
+      p = fmaxf(p, fabsf(s));
+    }
+
+    det[n] = mode == AUDIO_MIX_ADD ? fmaxf(det[n], p) : p;
+  }
+}
+
+static inline void apply_tail(float *dst, const float *src, const float *gain, uint32_t frames, float *peak, float *sum) {
+  float p = *peak, s = *sum;
+
+  for (uint32_t i = 0; i < frames; i++) {
+    float v = gain ? src[i] * gain[i] : src[i];
+    dst[i] = v;
+    p = fmaxf(p, fabsf(v));
+    s += v * v;
+  }
+
+  *peak = p;
+  *sum = s;
+}
+
+// Linear up to the knee, then bent towards the ceiling: knee + r * d / (r + d)
+static inline float softclip_tail(float *dst, uint32_t frames, float knee, float ceiling, float *peak, float *sum) {
+  float range = ceiling - knee;
+  float in = 0.0f, p = *peak, s = *sum;
+
+  for (uint32_t i = 0; i < frames; i++) {
+    float a = fabsf(dst[i]);
+    float d = fmaxf(a - knee, 0.0f);
+    float v = copysignf(fminf(a, knee) + range * d / (range + d), dst[i]);
+
+    dst[i] = v;
+    in = fmaxf(in, a);
+    p = fmaxf(p, fabsf(v));
+    s += v * v;
+  }
+
+  *peak = p;
+  *sum = s;
+  return in;
+}
+
+static void detect_c(float *det, const float *x, const float *coeffs, uint32_t frames, int mode) {
+  detect_tail(det, x, coeffs, frames, mode);
+}
+
+static void apply_c(float *dst, const float *src, const float *gain, uint32_t frames, audio_meter_t *meter) {
+  apply_tail(dst, src, gain, frames, &meter->peak, &meter->sum);
+}
+
+static float softclip_c(float *dst, uint32_t frames, float knee, float ceiling, audio_meter_t *meter) {
+  return softclip_tail(dst, frames, knee, ceiling, &meter->peak, &meter->sum);
+}
+
+static const limiter_ops_t limiter_c = {
+  .name = "c",
+  .detect = detect_c,
+  .apply = apply_c,
+  .softclip = softclip_c,
+};
+
+//
+// SSE2 and AVX2 kernels
+//
+#if defined(CPU_X86) && defined(__SSE2__)
+static void detect_sse2(float *det, const float *x, const float *coeffs, uint32_t frames, int mode) {
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+  uint32_t n = 0;
+  for (; n + 4 <= frames; n += 4) {
+    const float *w = x + n - (LIMITER_TAPS - 1);
+    __m128 p = _mm_and_ps(_mm_loadu_ps(w + LIMITER_CENTER + 1), abs_mask);
+
+    for (int ph = 0; ph < LIMITER_PHASES; ph++) {
+      const float *h = coeffs + ph * LIMITER_TAPS;
+      __m128 s = _mm_mul_ps(_mm_loadu_ps(w), _mm_set1_ps(h[0]));
+
+      for (int k = 1; k < LIMITER_TAPS; k++)
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(w + k), _mm_set1_ps(h[k])));
+
+      p = _mm_max_ps(p, _mm_and_ps(s, abs_mask));
+    }
+
+    if (mode == AUDIO_MIX_ADD) p = _mm_max_ps(p, _mm_loadu_ps(det + n));
+    _mm_storeu_ps(det + n, p);
+  }
+
+  detect_tail(det + n, x + n, coeffs, frames - n, mode);
+}
+
+static void apply_sse2(float *dst, const float *src, const float *gain, uint32_t frames, audio_meter_t *meter) {
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+  __m128 vpeak = _mm_setzero_ps();
+  __m128 vsum = _mm_setzero_ps();
+
+  uint32_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    __m128 v = _mm_loadu_ps(src + i);
+    if (gain) v = _mm_mul_ps(v, _mm_loadu_ps(gain + i));
+    _mm_storeu_ps(dst + i, v);
+
+    vpeak = _mm_max_ps(vpeak, _mm_and_ps(v, abs_mask));
+    vsum = _mm_add_ps(vsum, _mm_mul_ps(v, v));
+  }
+
+  float p[4], s[4];
+  _mm_storeu_ps(p, vpeak);
+  _mm_storeu_ps(s, vsum);
+
+  meter->peak = max(meter->peak, max4(p[0], p[1], p[2], p[3]));
+  meter->sum += (s[0] + s[1]) + (s[2] + s[3]);
+
+  apply_tail(dst + i, src + i, gain ? gain + i : NULL, frames - i, &meter->peak, &meter->sum);
+}
+
+static float softclip_sse2(float *dst, uint32_t frames, float knee, float ceiling, audio_meter_t *meter) {
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 k = _mm_set1_ps(knee);
+  const __m128 r = _mm_set1_ps(ceiling - knee);
+  const __m128 zero = _mm_setzero_ps();
+
+  __m128 vin = _mm_setzero_ps();
+  __m128 vpeak = _mm_setzero_ps();
+  __m128 vsum = _mm_setzero_ps();
+
+  uint32_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    __m128 x = _mm_loadu_ps(dst + i);
+    __m128 a = _mm_and_ps(x, abs_mask);
+    __m128 d = _mm_max_ps(_mm_sub_ps(a, k), zero);
+    __m128 y = _mm_add_ps(_mm_min_ps(a, k), _mm_div_ps(_mm_mul_ps(r, d), _mm_add_ps(r, d)));
+
+    _mm_storeu_ps(dst + i, _mm_or_ps(y, _mm_andnot_ps(abs_mask, x)));
+
+    vin = _mm_max_ps(vin, a);
+    vpeak = _mm_max_ps(vpeak, y);
+    vsum = _mm_add_ps(vsum, _mm_mul_ps(y, y));
+  }
+
+  float in[4], p[4], s[4];
+  _mm_storeu_ps(in, vin);
+  _mm_storeu_ps(p, vpeak);
+  _mm_storeu_ps(s, vsum);
+
+  meter->peak = max(meter->peak, max4(p[0], p[1], p[2], p[3]));
+  meter->sum += (s[0] + s[1]) + (s[2] + s[3]);
+
+  float tail = softclip_tail(dst + i, frames - i, knee, ceiling, &meter->peak, &meter->sum);
+  return max(tail, max4(in[0], in[1], in[2], in[3]));
+}
+
+static const limiter_ops_t limiter_sse2 = {
+  .name = "sse2",
+  .detect = detect_sse2,
+  .apply = apply_sse2,
+  .softclip = softclip_sse2,
+};
+#endif
+
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+__attribute__((target("avx2")))
+static float hmax_avx2(__m256 v) {
+  float t[8];
+  _mm256_storeu_ps(t, v);
+  return max(max4(t[0], t[1], t[2], t[3]), max4(t[4], t[5], t[6], t[7]));
+}
+
+__attribute__((target("avx2")))
+static float hsum_avx2(__m256 v) {
+  float t[8];
+  _mm256_storeu_ps(t, v);
+  return ((t[0] + t[1]) + (t[2] + t[3])) + ((t[4] + t[5]) + (t[6] + t[7]));
+}
+
+__attribute__((target("avx2")))
+static void detect_avx2(float *det, const float *x, const float *coeffs, uint32_t frames, int mode) {
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+  uint32_t n = 0;
+  for (; n + 8 <= frames; n += 8) {
+    const float *w = x + n - (LIMITER_TAPS - 1);
+    __m256 p = _mm256_and_ps(_mm256_loadu_ps(w + LIMITER_CENTER + 1), abs_mask);
+
+    for (int ph = 0; ph < LIMITER_PHASES; ph++) {
+      const float *h = coeffs + ph * LIMITER_TAPS;
+      __m256 s = _mm256_mul_ps(_mm256_loadu_ps(w), _mm256_set1_ps(h[0]));
+
+      for (int k = 1; k < LIMITER_TAPS; k++)
+        s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_loadu_ps(w + k), _mm256_set1_ps(h[k])));
+
+      p = _mm256_max_ps(p, _mm256_and_ps(s, abs_mask));
+    }
+
+    if (mode == AUDIO_MIX_ADD) p = _mm256_max_ps(p, _mm256_loadu_ps(det + n));
+    _mm256_storeu_ps(det + n, p);
+  }
+
+  detect_tail(det + n, x + n, coeffs, frames - n, mode);
+}
+
+__attribute__((target("avx2")))
+static void apply_avx2(float *dst, const float *src, const float *gain, uint32_t frames, audio_meter_t *meter) {
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+  __m256 vpeak = _mm256_setzero_ps();
+  __m256 vsum = _mm256_setzero_ps();
+
+  uint32_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m256 v = _mm256_loadu_ps(src + i);
+    if (gain) v = _mm256_mul_ps(v, _mm256_loadu_ps(gain + i));
+    _mm256_storeu_ps(dst + i, v);
+
+    vpeak = _mm256_max_ps(vpeak, _mm256_and_ps(v, abs_mask));
+    vsum = _mm256_add_ps(vsum, _mm256_mul_ps(v, v));
+  }
+
+  meter->peak = max(meter->peak, hmax_avx2(vpeak));
+  meter->sum += hsum_avx2(vsum);
+
+  apply_tail(dst + i, src + i, gain ? gain + i : NULL, frames - i, &meter->peak, &meter->sum);
+}
+
+__attribute__((target("avx2")))
+static float softclip_avx2(float *dst, uint32_t frames, float knee, float ceiling, audio_meter_t *meter) {
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  const __m256 k = _mm256_set1_ps(knee);
+  const __m256 r = _mm256_set1_ps(ceiling - knee);
+  const __m256 zero = _mm256_setzero_ps();
+
+  __m256 vin = _mm256_setzero_ps();
+  __m256 vpeak = _mm256_setzero_ps();
+  __m256 vsum = _mm256_setzero_ps();
+
+  uint32_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m256 x = _mm256_loadu_ps(dst + i);
+    __m256 a = _mm256_and_ps(x, abs_mask);
+    __m256 d = _mm256_max_ps(_mm256_sub_ps(a, k), zero);
+    __m256 y = _mm256_add_ps(_mm256_min_ps(a, k), _mm256_div_ps(_mm256_mul_ps(r, d), _mm256_add_ps(r, d)));
+
+    _mm256_storeu_ps(dst + i, _mm256_or_ps(y, _mm256_andnot_ps(abs_mask, x)));
+
+    vin = _mm256_max_ps(vin, a);
+    vpeak = _mm256_max_ps(vpeak, y);
+    vsum = _mm256_add_ps(vsum, _mm256_mul_ps(y, y));
+  }
+
+  meter->peak = max(meter->peak, hmax_avx2(vpeak));
+  meter->sum += hsum_avx2(vsum);
+
+  float tail = softclip_tail(dst + i, frames - i, knee, ceiling, &meter->peak, &meter->sum);
+  return max(tail, hmax_avx2(vin));
+}
+
+static const limiter_ops_t limiter_avx2 = {
+  .name = "avx2",
+  .detect = detect_avx2,
+  .apply = apply_avx2,
+  .softclip = softclip_avx2,
+};
+#endif
+
+//
+// NEON kernels
+//
+#if defined(CPU_NEON)
+static void detect_neon(float *det, const float *x, const float *coeffs, uint32_t frames, int mode) {
+  uint32_t n = 0;
+  for (; n + 4 <= frames; n += 4) {
+    const float *w = x + n - (LIMITER_TAPS - 1);
+    float32x4_t p = vabsq_f32(vld1q_f32(w + LIMITER_CENTER + 1));
+
+    for (int ph = 0; ph < LIMITER_PHASES; ph++) {
+      const float *h = coeffs + ph * LIMITER_TAPS;
+      float32x4_t s = vmulq_n_f32(vld1q_f32(w), h[0]);
+
+      for (int k = 1; k < LIMITER_TAPS; k++) s = vmlaq_n_f32(s, vld1q_f32(w + k), h[k]);
+
+      p = vmaxq_f32(p, vabsq_f32(s));
+    }
+
+    if (mode == AUDIO_MIX_ADD) p = vmaxq_f32(p, vld1q_f32(det + n));
+    vst1q_f32(det + n, p);
+  }
+
+  detect_tail(det + n, x + n, coeffs, frames - n, mode);
+}
+
+static void apply_neon(float *dst, const float *src, const float *gain, uint32_t frames, audio_meter_t *meter) {
+  float32x4_t vpeak = vdupq_n_f32(0.0f);
+  float32x4_t vsum = vdupq_n_f32(0.0f);
+
+  uint32_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    float32x4_t v = vld1q_f32(src + i);
+    if (gain) v = vmulq_f32(v, vld1q_f32(gain + i));
+    vst1q_f32(dst + i, v);
+
+    vpeak = vmaxq_f32(vpeak, vabsq_f32(v));
+    vsum = vmlaq_f32(vsum, v, v);
+  }
+
+  float p[4], s[4];
+  vst1q_f32(p, vpeak);
+  vst1q_f32(s, vsum);
+
+  meter->peak = max(meter->peak, max4(p[0], p[1], p[2], p[3]));
+  meter->sum += (s[0] + s[1]) + (s[2] + s[3]);
+
+  apply_tail(dst + i, src + i, gain ? gain + i : NULL, frames - i, &meter->peak, &meter->sum);
+}
+
+static float softclip_neon(float *dst, uint32_t frames, float knee, float ceiling, audio_meter_t *meter) {
+  const float32x4_t k = vdupq_n_f32(knee);
+  const float32x4_t r = vdupq_n_f32(ceiling - knee);
+  const float32x4_t zero = vdupq_n_f32(0.0f);
+  const uint32x4_t sign_mask = vdupq_n_u32(0x80000000);
+
+  float32x4_t vin = vdupq_n_f32(0.0f);
+  float32x4_t vpeak = vdupq_n_f32(0.0f);
+  float32x4_t vsum = vdupq_n_f32(0.0f);
+
+  uint32_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    float32x4_t x = vld1q_f32(dst + i);
+    float32x4_t a = vabsq_f32(x);
+    float32x4_t d = vmaxq_f32(vsubq_f32(a, k), zero);
+    float32x4_t den = vaddq_f32(r, d);
+
+    // Reciprocal estimate refined twice, close to a division
+    float32x4_t inv = vrecpeq_f32(den);
+    inv = vmulq_f32(inv, vrecpsq_f32(den, inv));
+    inv = vmulq_f32(inv, vrecpsq_f32(den, inv));
+
+    float32x4_t y = vaddq_f32(vminq_f32(a, k), vmulq_f32(vmulq_f32(r, d), inv));
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(x), sign_mask);
+
+    vst1q_f32(dst + i, vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(y), sign)));
+
+    vin = vmaxq_f32(vin, a);
+    vpeak = vmaxq_f32(vpeak, y);
+    vsum = vmlaq_f32(vsum, y, y);
+  }
+
+  float in[4], p[4], s[4];
+  vst1q_f32(in, vin);
+  vst1q_f32(p, vpeak);
+  vst1q_f32(s, vsum);
+
+  meter->peak = max(meter->peak, max4(p[0], p[1], p[2], p[3]));
+  meter->sum += (s[0] + s[1]) + (s[2] + s[3]);
+
+  float tail = softclip_tail(dst + i, frames - i, knee, ceiling, &meter->peak, &meter->sum);
+  return max(tail, max4(in[0], in[1], in[2], in[3]));
+}
+
+static const limiter_ops_t limiter_neon = {
+  .name = "neon",
+  .detect = detect_neon,
+  .apply = apply_neon,
+  .softclip = softclip_neon,
+};
+#endif
+
+static const limiter_ops_t *limiter_ops_select(void) {
+  const limiter_ops_t *ops = &limiter_c;
+  unsigned features = cpu_features();
+
+#if defined(CPU_X86) && defined(__SSE2__)
+  if (features & CPU_FEATURE_SSE2) ops = &limiter_sse2;
+#endif
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+  if (features & CPU_FEATURE_AVX2) ops = &limiter_avx2;
+#endif
+#if defined(CPU_NEON)
+  if (features & CPU_FEATURE_NEON) ops = &limiter_neon;
+#endif
+
+  (void) features;
+  return ops;
+}
+
+//
+// Gain computation functions
+//
+
+// Zeroth order modified Bessel function of the first kind
+static double bessel_i0(double x) {
+  double sum = 1.0, term = 1.0;
+
+  for (int k = 1; k < 64; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12) break;
+  }
+
+  return sum;
+}
+
+// Kaiser windowed sinc rows at 1/4, 2/4 and 3/4 of the interval after the center tap
+static void limiter_build_coeffs(struct audio_limiter *l) {
+  double half = LIMITER_TAPS / 2;
+  double i0_beta = bessel_i0(LIMITER_BETA);
+
+  for (int ph = 0; ph < LIMITER_PHASES; ph++) {
+    float *row = l->coeffs + ph * LIMITER_TAPS;
+    double frac = (double) (ph + 1) / (LIMITER_PHASES + 1);
+    double sum = 0.0;
+
+    for (int k = 0; k < LIMITER_TAPS; k++) {
+      double x = k - LIMITER_CENTER - frac;
+      double t = x / half;
+      double sinc = sin(LIMITER_PI * x) / (LIMITER_PI * x);
+      double window = fabs(t) >= 1.0 ? 0.0 : bessel_i0(LIMITER_BETA * sqrt(1.0 - t * t)) / i0_beta;
+
+      row[k] = sinc * window;
+      sum += row[k];
+    }
+
+    for (int k = 0; k < LIMITER_TAPS; k++) row[k] /= sum;
+  }
+}
+
+// Gain of every frame: held for lookahead frames, averaged over them and released,
+// so it reaches the target of a peak by the time the peak leaves the delay line.
+// Returns NULL if the whole block stays at unity
+static const float *limiter_gains(struct audio_limiter *l, uint32_t frames, float *min_gain) {
+  uint32_t lookahead = l->lookahead;
+  float det_max = 0.0f;
+
+  for (uint32_t i = 0; i < frames; i++) det_max = fmaxf(det_max, l->det[i]);
+
+  // Idle limiter only keeps its window positions
+  if (det_max <= l->ceiling && l->gain == 1.0f && l->quiet >= 2 * lookahead) {
+    l->pos += frames;
+    l->quiet = min(l->quiet + frames, UINT32_MAX / 2);
+    l->hold_count = 0;
+    l->box_sum = lookahead;
+    *min_gain = 1.0f;
+    return NULL;
+  }
+
+  float lowest = 1.0f;
+
+  for (uint32_t i = 0; i < frames; i++) {
+    float target = l->det[i] > l->ceiling ? l->ceiling / l->det[i] : 1.0f;
+    uint64_t pos = l->pos++;
+
+    while (l->hold_count > 0 && l->hold_expires[l->hold_head] <= pos) {
+      l->hold_head = (l->hold_head + 1) % lookahead;
+      l->hold_count--;
+    }
+
+    while (l->hold_count > 0 && l->hold_value[(l->hold_head + l->hold_count - 1) % lookahead] >= target)
+      l->hold_count--;
+
+    uint32_t back = (l->hold_head + l->hold_count++) % lookahead;
+    l->hold_value[back] = target;
+    l->hold_expires[back] = pos + lookahead;
+
+    float hold = l->hold_value[l->hold_head];
+
+    l->box_sum += hold - l->box[l->box_pos];
+    l->box[l->box_pos] = hold;
+    l->box_pos = (l->box_pos + 1) % lookahead;
+
+    float smooth = (float) (l->box_sum / lookahead);
+
+    if (smooth < l->gain) {
+      l->gain = smooth;
+    } else {
+      l->gain += (smooth - l->gain) * l->release;
+      if (smooth - l->gain < LIMITER_EPSILON) l->gain = smooth;
+    }
+
+    l->gains[i] = l->gain;
+    lowest = fminf(lowest, l->gain);
+    l->quiet = target < 1.0f ? 0 : min(l->quiet + 1, UINT32_MAX / 2);
+  }
+
+  *min_gain = lowest;
+  return l->gains;
+}
+
+static float limiter_lookahead(struct audio_limiter *l, float *const *planes, uint32_t frames, audio_meter_t *meter) {
+  uint32_t stride = l->keep + l->max_frames;
+
+  for (uint8_t ch = 0; ch < l->channels; ch++) {
+    float *line = l->lines + (size_t) ch * stride;
+
+    memcpy(line + l->keep, planes[ch], frames * sizeof(float));
+    l->ops->detect(l->det, line + l->keep, l->coeffs, frames, ch == 0 ? AUDIO_MIX_SET : AUDIO_MIX_ADD);
+  }
+
+  float min_gain;
+  const float *gains = limiter_gains(l, frames, &min_gain);
+
+  for (uint8_t ch = 0; ch < l->channels; ch++) {
+    float *line = l->lines + (size_t) ch * stride;
+
+    l->ops->apply(planes[ch], line + l->keep - l->delay, gains, frames, &meter[ch]);
+    memmove(line, line + frames, l->keep * sizeof(float));
+  }
+
+  return min_gain < 1.0f ? -pcm_to_db(min_gain) : 0.0f;
+}
+
+//
+// Public functions
+//
+const char *audio_limiter_mode_name(int mode) {
+  if (mode < 0 || mode > AUDIO_LIMITER_CLIP) return NULL;
+  return mode_names[mode];
+}
+
+audio_limiter_t *audio_limiter_create(uint32_t rate, uint8_t channels, uint32_t max_frames, const audio_limiter_params_t *params) {
+  audio_limiter_params_t p = params ? *params : (audio_limiter_params_t) { 0 };
+
+  if (rate == 0 || channels == 0 || channels > DECODER_MAX_CHANNELS || max_frames == 0 || !audio_limiter_mode_name(p.mode))
+    return NULL;
+
+  if (p.attack_ms <= 0.0f) p.attack_ms = AUDIO_LIMITER_ATTACK_MS;
+  if (p.release_ms <= 0.0f) p.release_ms = AUDIO_LIMITER_RELEASE_MS;
+  if (p.ceiling_db >= 0.0f) p.ceiling_db = AUDIO_LIMITER_CEILING_DB;
+
+  struct audio_limiter *l = zalloc(sizeof(struct audio_limiter));
+  if (!l) return NULL;
+
+  l->mode = p.mode;
+  l->channels = channels;
+  l->max_frames = max_frames;
+  l->ops = limiter_ops_select();
+  l->ceiling = powf(10.0f, p.ceiling_db / 20.0f);
+  l->release = 1.0f - expf(-1000.0f / (p.release_ms * rate));
+
+  l->lookahead = max((uint32_t) lroundf(min(p.attack_ms, AUDIO_LIMITER_MAX_ATTACK_MS) * rate / 1000.0f), 1u);
+  l->delay = l->lookahead - 1 + LIMITER_CENTER;
+  l->keep = max(l->delay, (uint32_t) LIMITER_TAPS - 1);
+
+  if (l->mode == AUDIO_LIMITER_LOOKAHEAD) {
+    l->lines = malloc((size_t) (l->keep + max_frames) * channels * sizeof(float));
+    l->det = malloc((size_t) max_frames * sizeof(float));
+    l->gains = malloc((size_t) max_frames * sizeof(float));
+    l->hold_value = malloc((size_t) l->lookahead * sizeof(float));
+    l->hold_expires = malloc((size_t) l->lookahead * sizeof(uint64_t));
+    l->box = malloc((size_t) l->lookahead * sizeof(float));
+
+    if (!l->lines || !l->det || !l->gains || !l->hold_value || !l->hold_expires || !l->box) {
+      audio_limiter_destroy(l);
+      return NULL;
+    }
+
+    limiter_build_coeffs(l);
+  }
+
+  audio_limiter_reset(l);
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "LIMITER", "%s mode, ceiling %.1f dB, attack %u frames, release %.0f ms, %s kernels",
+    mode_names[l->mode], p.ceiling_db, l->mode == AUDIO_LIMITER_LOOKAHEAD ? l->lookahead : 0, p.release_ms, l->ops->name);
+
+  return l;
+}
+
+void audio_limiter_destroy(audio_limiter_t *limiter) {
+  if (!limiter) return;
+
+  free(limiter->lines);
+  free(limiter->det);
+  free(limiter->gains);
+  free(limiter->hold_value);
+  free(limiter->hold_expires);
+  free(limiter->box);
+  free(limiter);
+}
+
+void audio_limiter_reset(audio_limiter_t *l) {
+  l->gain = 1.0f;
+  l->pending = 0;
+  l->pos = 0;
+  l->quiet = UINT32_MAX / 2;
+  l->hold_head = 0;
+  l->hold_count = 0;
+
+  if (l->mode != AUDIO_LIMITER_LOOKAHEAD) return;
+
+  memset(l->lines, 0, (size_t) (l->keep + l->max_frames) * l->channels * sizeof(float));
+  for (uint32_t i = 0; i < l->lookahead; i++) l->box[i] = 1.0f;
+  l->box_pos = 0;
+  l->box_sum = l->lookahead;
+}
+
+int audio_limiter_mode(const audio_limiter_t *limiter) {
+  return limiter->mode;
+}
+
+uint32_t audio_limiter_pending(const audio_limiter_t *limiter) {
+  return limiter->pending;
+}
+
+float audio_limiter_process(audio_limiter_t *l, float *const *planes, uint32_t frames, audio_meter_t *meter) {
+  if (l->mode == AUDIO_LIMITER_LOOKAHEAD) {
+    l->pending = l->delay;
+    return limiter_lookahead(l, planes, frames, meter);
+  }
+
+  if (l->mode != AUDIO_LIMITER_SOFTCLIP) return 0.0f;
+
+  float knee = l->ceiling * LIMITER_KNEE;
+  float in = 0.0f;
+
+  for (uint8_t ch = 0; ch < l->channels; ch++)
+    in = fmaxf(in, l->ops->softclip(planes[ch], frames, knee, l->ceiling, &meter[ch]));
+
+  // Curve is monotonic, the loudest sample has the deepest reduction
+  if (in <= knee) return 0.0f;
+
+  float d = in - knee, range = l->ceiling - knee;
+  return pcm_to_db(in / (knee + range * d / (range + d)));
+}
+
+float audio_limiter_drain(audio_limiter_t *l, float *const *planes, uint32_t frames, audio_meter_t *meter) {
+  for (uint8_t ch = 0; ch < l->channels; ch++) memset(planes[ch], 0, frames * sizeof(float));
+
+  if (l->pending == 0) return 0.0f;
+
+  uint32_t pending = l->pending;
+  float reduction = audio_limiter_process(l, planes, frames, meter);
+
+  // Delay line holds only silence now, gain is released at once
+  if (frames >= pending) audio_limiter_reset(l);
+  else l->pending = pending - frames;
+
+  return reduction;
+}
\ No newline at end of file
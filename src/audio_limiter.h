@@ -0,0 +1,108 @@
+#ifndef _H_AUDIO_LIMITER_
+#define _H_AUDIO_LIMITER_
+
+#include <stdint.h>
+#include "audio_mix.h"
+
+/**
+ * Output stage of audio_io buses, keeps the sum of inputs below the ceiling.
+ *
+ * Look-ahead mode estimates true peaks with 4x oversampling and delays the bus by the
+ * attack time, so gain is already reduced when a peak arrives. Gain of all channels is
+ * linked, reduction is held for the attack time, smoothed over it and released exponentially.
+ * Soft clip mode has no delay and no state, samples above -3 dB of the ceiling are bent
+ * towards it. Clip mode is the plain clamp to [-1, 1] fused into the mix pass, see audio_mix.h.
+ */
+
+#define AUDIO_LIMITER_LOOKAHEAD 0 // true peak look-ahead limiter
+#define AUDIO_LIMITER_SOFTCLIP  1 // memoryless soft clipper
+#define AUDIO_LIMITER_CLIP      2 // hard clip, applied by mix kernels
+
+#define AUDIO_LIMITER_ATTACK_MS  5.0f
+#define AUDIO_LIMITER_RELEASE_MS 100.0f
+#define AUDIO_LIMITER_CEILING_DB -1.0f
+
+#define AUDIO_LIMITER_MAX_ATTACK_MS 50.0f
+
+typedef struct {
+  int mode;         // one of AUDIO_LIMITER_* modes
+  float attack_ms;  // look-ahead and attack time, 0 for AUDIO_LIMITER_ATTACK_MS
+  float release_ms; // time to recover 63% of reduction, 0 for AUDIO_LIMITER_RELEASE_MS
+  float ceiling_db; // highest output level, below 0. 0 for AUDIO_LIMITER_CEILING_DB
+} audio_limiter_params_t;
+
+struct audio_limiter;
+typedef struct audio_limiter audio_limiter_t;
+
+/**
+ * Create limiter
+ *
+ * @param rate Sample rate
+ * @param channels Number of channels
+ * @param max_frames Largest number of frames passed to audio_limiter_process
+ * @param params Limiter parameters, NULL for defaults
+ * @return Limiter or NULL on invalid parameters or allocation failure
+ */
+audio_limiter_t *audio_limiter_create(uint32_t rate, uint8_t channels, uint32_t max_frames, const audio_limiter_params_t *params);
+
+/**
+ * Release limiter
+ *
+ * @param limiter Limiter, may be NULL
+ */
+void audio_limiter_destroy(audio_limiter_t *limiter);
+
+/**
+ * Drop delayed frames and release gain reduction
+ *
+ * @param limiter Limiter
+ */
+void audio_limiter_reset(audio_limiter_t *limiter);
+
+/**
+ * Limiter mode
+ *
+ * @param limiter Limiter
+ * @return One of AUDIO_LIMITER_* modes
+ */
+int audio_limiter_mode(const audio_limiter_t *limiter);
+
+/**
+ * Frames of the last processed input still held in the delay line
+ *
+ * @param limiter Limiter
+ * @return Number of frames, 0 if the limiter has no delay or was drained
+ */
+uint32_t audio_limiter_pending(const audio_limiter_t *limiter);
+
+/**
+ * Limit planar frames in place and meter the output. Does nothing in clip mode
+ *
+ * @param limiter Limiter
+ * @param planes Channel planes
+ * @param frames Number of frames, up to max_frames
+ * @param meter Meter of every channel, output is added to it
+ * @return Deepest gain reduction within frames, dB
+ */
+float audio_limiter_process(audio_limiter_t *limiter, float *const *planes, uint32_t frames, audio_meter_t *meter);
+
+/**
+ * Push silence through the limiter to play out delayed frames
+ *
+ * @param limiter Limiter
+ * @param planes Channel planes, overwritten with delayed frames
+ * @param frames Number of frames, up to max_frames
+ * @param meter Meter of every channel, output is added to it
+ * @return Deepest gain reduction within frames, dB
+ */
+float audio_limiter_drain(audio_limiter_t *limiter, float *const *planes, uint32_t frames, audio_meter_t *meter);
+
+/**
+ * Mode name, used for logging
+ *
+ * @param mode One of AUDIO_LIMITER_* modes
+ * @return Mode name or NULL for unknown mode
+ */
+const char *audio_limiter_mode_name(int mode);
+
+#endif
\ No newline at end of file
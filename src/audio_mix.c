@@ -0,0 +1,405 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "audio_mix.h"
+#include "logging.h"
+#include "util/cpu.h"
+#include "util/math.h"
+
+#if defined(CPU_X86)
+  #include <immintrin.h>
+#endif
+
+#if defined(CPU_NEON)
+  #include <arm_neon.h>
+#endif
+
+//
+// Scalar kernels, also used for unaligned tails of vector kernels. Ramped gains are computed
+// as gain + step * i from the sample index in every kernel, so all of them match the scalar
+// ones and tails continue from index first
+//
+static inline void mix_meter_tail(float *dst, const float *src, uint32_t first, uint32_t samples, float gain, float step, int mode, float *peak, float *sum) {
+  float p = *peak, s = *sum;
+
+  for (uint32_t i = first; i < samples; i++) {
+    float g = gain + step * i;
+    float v = src ? (mode == AUDIO_MIX_ADD ? dst[i] + src[i] * g : src[i] * g) : dst[i];
+    v = clamp(v, -1.0f, 1.0f);
+    dst[i] = v;
+    p = fmaxf(p, fabsf(v));
+    s += v * v;
+  }
+
+  *peak = p;
+  *sum = s;
+}
+
+static void mix_c(float *dst, const float *src, uint32_t samples, int mode) {
+  if (mode == AUDIO_MIX_SET) {
+    memcpy(dst, src, samples * sizeof(float));
+    return;
+  }
+
+  for (uint32_t i = 0; i < samples; i++) dst[i] += src[i];
+}
+
+static inline void mix_gain_tail(float *dst, const float *src, uint32_t samples, float gain, int mode) {
+  if (mode == AUDIO_MIX_SET) {
+    for (uint32_t i = 0; i < samples; i++) dst[i] = src[i] * gain;
+  } else {
+    for (uint32_t i = 0; i < samples; i++) dst[i] += src[i] * gain;
+  }
+}
+
+static inline void mix_ramp_tail(float *dst, const float *src, uint32_t first, uint32_t samples, float gain, float step, int mode) {
+  if (mode == AUDIO_MIX_SET) {
+    for (uint32_t i = first; i < samples; i++) dst[i] = src[i] * (gain + step * i);
+  } else {
+    for (uint32_t i = first; i < samples; i++) dst[i] += src[i] * (gain + step * i);
+  }
+}
+
+static void mix_gain_c(float *dst, const float *src, uint32_t samples, float gain, int mode) {
+  mix_gain_tail(dst, src, samples, gain, mode);
+}
+
+static void mix_ramp_c(float *dst, const float *src, uint32_t samples, float gain, float step, int mode) {
+  mix_ramp_tail(dst, src, 0, samples, gain, step, mode);
+}
+
+static void mix_meter_c(float *dst, const float *src, uint32_t samples, float gain, float step, int mode, audio_meter_t *meter) {
+  mix_meter_tail(dst, src, 0, samples, gain, step, mode, &meter->peak, &meter->sum);
+}
+
+const audio_mix_ops_t audio_mix_c = {
+  .name = "c",
+  .mix = mix_c,
+  .mix_gain = mix_gain_c,
+  .mix_ramp = mix_ramp_c,
+  .mix_meter = mix_meter_c,
+};
+
+//
+// SSE2 and AVX2 kernels
+//
+#if defined(CPU_X86) && defined(__SSE2__)
+static void mix_sse2(float *dst, const float *src, uint32_t samples, int mode) {
+  if (mode == AUDIO_MIX_SET) {
+    memcpy(dst, src, samples * sizeof(float));
+    return;
+  }
+
+  uint32_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    _mm_storeu_ps(dst + i,     _mm_add_ps(_mm_loadu_ps(dst + i),     _mm_loadu_ps(src + i)));
+    _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_loadu_ps(dst + i + 4), _mm_loadu_ps(src + i + 4)));
+  }
+  for (; i < samples; i++) dst[i] += src[i];
+}
+
+static void mix_gain_sse2(float *dst, const float *src, uint32_t samples, float gain, int mode) {
+  const __m128 g = _mm_set1_ps(gain);
+
+  uint32_t i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+    if (mode == AUDIO_MIX_ADD) v = _mm_add_ps(_mm_loadu_ps(dst + i), v);
+    _mm_storeu_ps(dst + i, v);
+  }
+
+  mix_gain_tail(dst + i, src + i, samples - i, gain, mode);
+}
+
+static void mix_ramp_sse2(float *dst, const float *src, uint32_t samples, float gain, float step, int mode) {
+  const __m128 g0 = _mm_set1_ps(gain);
+  const __m128 gstep = _mm_set1_ps(step);
+  const __m128 four = _mm_set1_ps(4.0f);
+  __m128 idx = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+  uint32_t i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    __m128 g = _mm_add_ps(g0, _mm_mul_ps(gstep, idx));
+    __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+    if (mode == AUDIO_MIX_ADD) v = _mm_add_ps(_mm_loadu_ps(dst + i), v);
+    _mm_storeu_ps(dst + i, v);
+    idx = _mm_add_ps(idx, four);
+  }
+
+  mix_ramp_tail(dst, src, i, samples, gain, step, mode);
+}
+
+static void mix_meter_sse2(float *dst, const float *src, uint32_t samples, float gain, float step, int mode, audio_meter_t *meter) {
+  const __m128 lo = _mm_set1_ps(-1.0f);
+  const __m128 hi = _mm_set1_ps(1.0f);
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 g0 = _mm_set1_ps(gain);
+  const __m128 gstep = _mm_set1_ps(step);
+  const __m128 four = _mm_set1_ps(4.0f);
+
+  __m128 idx = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+  __m128 vpeak = _mm_setzero_ps();
+  __m128 vsum = _mm_setzero_ps();
+
+  uint32_t i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    __m128 g = _mm_add_ps(g0, _mm_mul_ps(gstep, idx));
+    __m128 v;
+    if (!src) v = _mm_loadu_ps(dst + i);
+    else if (mode == AUDIO_MIX_ADD) v = _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), g));
+    else v = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+    idx = _mm_add_ps(idx, four);
+
+    v = _mm_min_ps(_mm_max_ps(v, lo), hi);
+    _mm_storeu_ps(dst + i, v);
+
+    vpeak = _mm_max_ps(vpeak, _mm_and_ps(v, abs_mask));
+    vsum = _mm_add_ps(vsum, _mm_mul_ps(v, v));
+  }
+
+  float p[4], s[4];
+  _mm_storeu_ps(p, vpeak);
+  _mm_storeu_ps(s, vsum);
+
+  meter->peak = max(meter->peak, max4(p[0], p[1], p[2], p[3]));
+  meter->sum += (s[0] + s[1]) + (s[2] + s[3]);
+
+  mix_meter_tail(dst, src, i, samples, gain, step, mode, &meter->peak, &meter->sum);
+}
+
+static const audio_mix_ops_t audio_mix_sse2 = {
+  .name = "sse2",
+  .mix = mix_sse2,
+  .mix_gain = mix_gain_sse2,
+  .mix_ramp = mix_ramp_sse2,
+  .mix_meter = mix_meter_sse2,
+};
+#endif
+
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+__attribute__((target("avx2")))
+static void mix_avx2(float *dst, const float *src, uint32_t samples, int mode) {
+  if (mode == AUDIO_MIX_SET) {
+    memcpy(dst, src, samples * sizeof(float));
+    return;
+  }
+
+  uint32_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    _mm256_storeu_ps(dst + i,     _mm256_add_ps(_mm256_loadu_ps(dst + i),     _mm256_loadu_ps(src + i)));
+    _mm256_storeu_ps(dst + i + 8, _mm256_add_ps(_mm256_loadu_ps(dst + i + 8), _mm256_loadu_ps(src + i + 8)));
+  }
+  for (; i < samples; i++) dst[i] += src[i];
+}
+
+__attribute__((target("avx2")))
+static void mix_gain_avx2(float *dst, const float *src, uint32_t samples, float gain, int mode) {
+  const __m256 g = _mm256_set1_ps(gain);
+
+  uint32_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + i), g);
+    if (mode == AUDIO_MIX_ADD) v = _mm256_add_ps(_mm256_loadu_ps(dst + i), v);
+    _mm256_storeu_ps(dst + i, v);
+  }
+
+  mix_gain_tail(dst + i, src + i, samples - i, gain, mode);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 ramp_avx2(void) {
+  return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+}
+
+__attribute__((target("avx2")))
+static void mix_ramp_avx2(float *dst, const float *src, uint32_t samples, float gain, float step, int mode) {
+  const __m256 g0 = _mm256_set1_ps(gain);
+  const __m256 gstep = _mm256_set1_ps(step);
+  const __m256 eight = _mm256_set1_ps(8.0f);
+  __m256 idx = ramp_avx2();
+
+  uint32_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m256 g = _mm256_add_ps(g0, _mm256_mul_ps(gstep, idx));
+    __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + i), g);
+    if (mode == AUDIO_MIX_ADD) v = _mm256_add_ps(_mm256_loadu_ps(dst + i), v);
+    _mm256_storeu_ps(dst + i, v);
+    idx = _mm256_add_ps(idx, eight);
+  }
+
+  mix_ramp_tail(dst, src, i, samples, gain, step, mode);
+}
+
+__attribute__((target("avx2")))
+static void mix_meter_avx2(float *dst, const float *src, uint32_t samples, float gain, float step, int mode, audio_meter_t *meter) {
+  const __m256 lo = _mm256_set1_ps(-1.0f);
+  const __m256 hi = _mm256_set1_ps(1.0f);
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  const __m256 g0 = _mm256_set1_ps(gain);
+  const __m256 gstep = _mm256_set1_ps(step);
+  const __m256 eight = _mm256_set1_ps(8.0f);
+
+  __m256 idx = ramp_avx2();
+  __m256 vpeak = _mm256_setzero_ps();
+  __m256 vsum = _mm256_setzero_ps();
+
+  uint32_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m256 g = _mm256_add_ps(g0, _mm256_mul_ps(gstep, idx));
+    __m256 v;
+    if (!src) v = _mm256_loadu_ps(dst + i);
+    else if (mode == AUDIO_MIX_ADD) v = _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), g));
+    else v = _mm256_mul_ps(_mm256_loadu_ps(src + i), g);
+    idx = _mm256_add_ps(idx, eight);
+
+    v = _mm256_min_ps(_mm256_max_ps(v, lo), hi);
+    _mm256_storeu_ps(dst + i, v);
+
+    vpeak = _mm256_max_ps(vpeak, _mm256_and_ps(v, abs_mask));
+    vsum = _mm256_add_ps(vsum, _mm256_mul_ps(v, v));
+  }
+
+  float p[8], s[8];
+  _mm256_storeu_ps(p, vpeak);
+  _mm256_storeu_ps(s, vsum);
+
+  for (int k = 0; k < 8; k++) {
+    meter->peak = max(meter->peak, p[k]);
+    meter->sum += s[k];
+  }
+
+  mix_meter_tail(dst, src, i, samples, gain, step, mode, &meter->peak, &meter->sum);
+}
+
+static const audio_mix_ops_t audio_mix_avx2 = {
+  .name = "avx2",
+  .mix = mix_avx2,
+  .mix_gain = mix_gain_avx2,
+  .mix_ramp = mix_ramp_avx2,
+  .mix_meter = mix_meter_avx2,
+};
+#endif
+
+//
+// NEON kernels
+//
+#if defined(CPU_NEON)
+static void mix_neon(float *dst, const float *src, uint32_t samples, int mode) {
+  if (mode == AUDIO_MIX_SET) {
+    memcpy(dst, src, samples * sizeof(float));
+    return;
+  }
+
+  uint32_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    vst1q_f32(dst + i,     vaddq_f32(vld1q_f32(dst + i),     vld1q_f32(src + i)));
+    vst1q_f32(dst + i + 4, vaddq_f32(vld1q_f32(dst + i + 4), vld1q_f32(src + i + 4)));
+  }
+  for (; i < samples; i++) dst[i] += src[i];
+}
+
+static void mix_gain_neon(float *dst, const float *src, uint32_t samples, float gain, int mode) {
+  uint32_t i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    float32x4_t v = vld1q_f32(src + i);
+    if (mode == AUDIO_MIX_ADD) vst1q_f32(dst + i, vmlaq_n_f32(vld1q_f32(dst + i), v, gain));
+    else vst1q_f32(dst + i, vmulq_n_f32(v, gain));
+  }
+
+  mix_gain_tail(dst + i, src + i, samples - i, gain, mode);
+}
+
+static inline float32x4_t ramp_neon(void) {
+  const float offsets[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+  return vld1q_f32(offsets);
+}
+
+static void mix_ramp_neon(float *dst, const float *src, uint32_t samples, float gain, float step, int mode) {
+  const float32x4_t g0 = vdupq_n_f32(gain);
+  const float32x4_t four = vdupq_n_f32(4.0f);
+  float32x4_t idx = ramp_neon();
+
+  uint32_t i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    float32x4_t g = vaddq_f32(g0, vmulq_n_f32(idx, step));
+    float32x4_t v = vmulq_f32(vld1q_f32(src + i), g);
+    if (mode == AUDIO_MIX_ADD) v = vaddq_f32(vld1q_f32(dst + i), v);
+    vst1q_f32(dst + i, v);
+    idx = vaddq_f32(idx, four);
+  }
+
+  mix_ramp_tail(dst, src, i, samples, gain, step, mode);
+}
+
+static void mix_meter_neon(float *dst, const float *src, uint32_t samples, float gain, float step, int mode, audio_meter_t *meter) {
+  const float32x4_t lo = vdupq_n_f32(-1.0f);
+  const float32x4_t hi = vdupq_n_f32(1.0f);
+  const float32x4_t g0 = vdupq_n_f32(gain);
+  const float32x4_t four = vdupq_n_f32(4.0f);
+
+  float32x4_t idx = ramp_neon();
+  float32x4_t vpeak = vdupq_n_f32(0.0f);
+  float32x4_t vsum = vdupq_n_f32(0.0f);
+
+  uint32_t i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    float32x4_t g = vaddq_f32(g0, vmulq_n_f32(idx, step));
+    float32x4_t v;
+    if (!src) v = vld1q_f32(dst + i);
+    else if (mode == AUDIO_MIX_ADD) v = vaddq_f32(vld1q_f32(dst + i), vmulq_f32(vld1q_f32(src + i), g));
+    else v = vmulq_f32(vld1q_f32(src + i), g);
+    idx = vaddq_f32(idx, four);
+
+    v = vminq_f32(vmaxq_f32(v, lo), hi);
+    vst1q_f32(dst + i, v);
+
+    vpeak = vmaxq_f32(vpeak, vabsq_f32(v));
+    vsum = vmlaq_f32(vsum, v, v);
+  }
+
+  float p[4], s[4];
+  vst1q_f32(p, vpeak);
+  vst1q_f32(s, vsum);
+
+  meter->peak = max(meter->peak, max4(p[0], p[1], p[2], p[3]));
+  meter->sum += (s[0] + s[1]) + (s[2] + s[3]);
+
+  mix_meter_tail(dst, src, i, samples, gain, step, mode, &meter->peak, &meter->sum);
+}
+
+static const audio_mix_ops_t audio_mix_neon = {
+  .name = "neon",
+  .mix = mix_neon,
+  .mix_gain = mix_gain_neon,
+  .mix_ramp = mix_ramp_neon,
+  .mix_meter = mix_meter_neon,
+};
+#endif
+
+uint32_t audio_mix_available(const audio_mix_ops_t **ops, uint32_t size) {
+  unsigned features = cpu_features();
+  uint32_t count = 0;
+
+  if (count < size) ops[count++] = &audio_mix_c;
+#if defined(CPU_X86) && defined(__SSE2__)
+  if ((features & CPU_FEATURE_SSE2) && count < size) ops[count++] = &audio_mix_sse2;
+#endif
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+  if ((features & CPU_FEATURE_AVX2) && count < size) ops[count++] = &audio_mix_avx2;
+#endif
+#if defined(CPU_NEON)
+  if ((features & CPU_FEATURE_NEON) && count < size) ops[count++] = &audio_mix_neon;
+#endif
+
+  (void) features;
+  return count;
+}
+
+const audio_mix_ops_t *audio_mix_select(void) {
+  const audio_mix_ops_t *available[AUDIO_MIX_TABLES];
+  const audio_mix_ops_t *ops = available[audio_mix_available(available, AUDIO_MIX_TABLES) - 1];
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "AUDIO MIX", "Using %s kernels", ops->name);
+
+  return ops;
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#ifndef _H_AUDIO_MIX_
+#define _H_AUDIO_MIX_
+
+#include <stdint.h>
+
+/**
+ * Mixing and metering kernels for audio_io buses. Every kernel works on one channel plane.
+ *
+ * Buses are produced in a single pass: the first input is stored, next inputs are added
+ * and the last one is added together with clamping to [-1, 1] and metering. Gains of inputs
+ * are applied in the same pass, ramped linearly per sample from gain by step.
+ */
+
+#define AUDIO_MIX_SET 0 // dst = src
+#define AUDIO_MIX_ADD 1 // dst = dst + src
+
+#define AUDIO_MIX_TABLES 4 // scalar and every vector extension
+
+typedef struct {
+  float peak; // maximum absolute sample value
+  float sum;  // sum of squared samples
+} audio_meter_t;
+
+typedef struct {
+  const char *name;
+
+  // Store or add src into dst
+  void (*mix)(float *dst, const float *src, uint32_t samples, int mode);
+
+  // Store or add src scaled by gain into dst
+  void (*mix_gain)(float *dst, const float *src, uint32_t samples, float gain, int mode);
+
+  // Store or add src scaled by gain + i * step into dst
+  void (*mix_ramp)(float *dst, const float *src, uint32_t samples, float gain, float step, int mode);
+
+  // Store or add src scaled by gain + i * step into dst, clamp the result and update meter.
+  // With NULL src dst is only clamped and metered in place
+  void (*mix_meter)(float *dst, const float *src, uint32_t samples, float gain, float step, int mode, audio_meter_t *meter);
+} audio_mix_ops_t;
+
+// Scalar reference implementation
+extern const audio_mix_ops_t audio_mix_c;
+
+/**
+ * List kernels supported by current CPU, scalar reference first and the fastest last
+ *
+ * @param ops Tables to be filled, up to AUDIO_MIX_TABLES are written
+ * @param size Size of ops
+ * @return Number of tables written
+ */
+uint32_t audio_mix_available(const audio_mix_ops_t **ops, uint32_t size);
+
+/**
+ * Select the fastest kernels supported by current CPU
+ *
+ * @return Pointer to kernels table
+ */
+const audio_mix_ops_t *audio_mix_select(void);
+
+#endif
\ No newline at end of file
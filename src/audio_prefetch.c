@@ -0,0 +1,338 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // syscall
+#endif
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <string.h>
+#include "audio_prefetch.h"
+#include "audiobuffer.h"
+#include "pcm.h"
+#include "pcm_conv.h"
+#include "logging.h"
+#include "util/mem.h"
+#include "util/math.h"
+#include "util/time.h"
+#include "util/futex.h"
+
+// Frames decoded per write routine, reader sees them as soon as the routine ends
+#define AUDIO_PREFETCH_CHUNK 1024
+
+// Longest wait for the first frames on attach
+#define AUDIO_PREFETCH_ATTACH_TIMEOUT_NS 1000000000ULL
+
+_Static_assert(AUDIO_PREFETCH_SLOTS <= 32, "slots are tracked in 32-bit masks");
+
+struct audio_prefetch_slot {
+  // published to workers last on attach and cleared first on detach
+  _Atomic(decoder_t *) decoder;
+  audiobuffer_t *buffer;
+  audio_format_t af; // interleaved float frames kept in the ring
+
+  // worker side, set when decoder rate differs from the ring rate
+  audio_resampler_t *resampler;
+  float *scratch;         // decoded frames waiting for the resampler
+  uint32_t scratch_offset;
+  uint32_t scratch_frames;
+  bool decoded;           // decoder is done, resampler is being flushed
+
+  atomic_bool busy;  // claimed by a worker for decoding
+  atomic_bool eof;   // decoder has no more frames
+
+  // reader side
+  bool drained;
+  uint64_t length;   // frames of the stream at the ring rate, 0 when unknown
+  uint64_t position; // frames read
+};
+
+struct audio_prefetch {
+  pthread_t *threads;
+  uint8_t workers;
+  uint8_t started;
+
+  uint32_t lookahead;
+  int resample_quality;
+
+  atomic_bool running;
+  atomic_uint_least32_t pending; // slots that asked for refill
+  atomic_uint_least32_t wakeup;  // futex word workers sleep on
+
+  struct audio_prefetch_slot slots[AUDIO_PREFETCH_SLOTS];
+};
+
+static void prefetch_request(struct audio_prefetch *prefetch, uint8_t slot) {
+  uint32_t bit = 1u << slot;
+
+  // Only the first request wakes a worker, repeated ones are already being served
+  if(!(atomic_fetch_or_explicit(&prefetch->pending, bit, memory_order_acq_rel) & bit))
+    os_futex_wake(&prefetch->wakeup, 1);
+}
+
+//
+// Worker functions
+//
+
+// Decode in chunks and convert into the ring, returns 0 once decoder and filter are both drained
+static uint32_t prefetch_resample(struct audio_prefetch_slot *slot, decoder_t *decoder, float *out, uint32_t frames) {
+  uint8_t channels = af_get_channels(slot->af);
+  uint32_t done = 0;
+
+  while(done < frames) {
+    if(slot->scratch_offset == slot->scratch_frames && !slot->decoded) {
+      slot->scratch_offset = 0;
+      slot->scratch_frames = decoder->ops.read_f32(&decoder->data, &slot->scratch, 1, AUDIO_PREFETCH_CHUNK);
+      slot->decoded = slot->scratch_frames == 0;
+    }
+
+    uint32_t count = slot->scratch_frames - slot->scratch_offset;
+    const float *in = slot->decoded ? NULL : slot->scratch + (size_t) slot->scratch_offset * channels;
+
+    uint32_t r = audio_resampler_process(slot->resampler, in, &count, out + (size_t) done * channels, frames - done);
+
+    slot->scratch_offset += count;
+    done += r;
+
+    if(slot->decoded && r == 0) break;
+  }
+
+  return done;
+}
+
+static void prefetch_fill(struct audio_prefetch *prefetch, struct audio_prefetch_slot *slot) {
+  bool busy_expected = false;
+  if(!atomic_compare_exchange_strong(&slot->busy, &busy_expected, true))
+    return; // another worker is filling the slot up already
+
+  decoder_t *decoder;
+  float *ptr;
+
+  // Decoder is checked every chunk, detach waits for busy to drop
+  while((decoder = atomic_load(&slot->decoder)) && !atomic_load_explicit(&slot->eof, memory_order_relaxed)) {
+    if(audiobuffer_write_begin(slot->buffer, AUDIO_PREFETCH_CHUNK) == 0) {
+      audiobuffer_write_end(slot->buffer);
+      break;
+    }
+
+    size_t r = 0;
+    uint32_t count;
+    while((count = audiobuffer_write(slot->buffer, &ptr)) > 0) {
+      // Ring holds interleaved frames, decoder writes straight into it unless resampled
+      if(slot->resampler) r = prefetch_resample(slot, decoder, ptr, count);
+      else r = decoder->ops.read_f32(&decoder->data, &ptr, 1, count);
+      if(r == 0) break;
+
+      audiobuffer_write_fill(slot->buffer, r);
+    }
+
+    audiobuffer_write_end(slot->buffer);
+
+    if(r == 0) {
+      atomic_store_explicit(&slot->eof, true, memory_order_release);
+      // Attach may be waiting for frames that will never come
+      audiobuffer_wakeup(slot->buffer);
+    }
+  }
+
+  atomic_store(&slot->busy, false);
+}
+
+static void *prefetch_worker(void *param) {
+  struct audio_prefetch *prefetch = param;
+
+  while(atomic_load_explicit(&prefetch->running, memory_order_acquire)) {
+    uint32_t value = atomic_load_explicit(&prefetch->wakeup, memory_order_acquire);
+    uint32_t pending = atomic_load_explicit(&prefetch->pending, memory_order_acquire);
+
+    if(pending == 0) {
+      os_futex_wait(&prefetch->wakeup, value, OS_FUTEX_INFINITE);
+      continue;
+    }
+
+    // Claim one slot, other workers take the rest
+    uint8_t slot = __builtin_ctz(pending);
+    uint32_t bit = 1u << slot;
+
+    if(atomic_fetch_and_explicit(&prefetch->pending, ~bit, memory_order_acq_rel) & bit)
+      prefetch_fill(prefetch, &prefetch->slots[slot]);
+  }
+
+  return NULL;
+}
+
+//
+// Public functions
+//
+static void prefetch_slot_release(struct audio_prefetch_slot *slot) {
+  audiobuffer_destroy(slot->buffer);
+  audio_resampler_destroy(slot->resampler);
+  free(slot->scratch);
+
+  slot->buffer = NULL;
+  slot->resampler = NULL;
+  slot->scratch = NULL;
+}
+
+int audio_prefetch_open(audio_prefetch_t **prefetch, uint8_t workers, uint32_t lookahead_frames, int resample_quality) {
+  struct audio_prefetch *pf;
+
+  if(!(pf = zalloc(sizeof(struct audio_prefetch))))
+    return AUDIO_PREFETCH_ERROR;
+
+  pf->workers = workers ? workers : AUDIO_PREFETCH_WORKERS;
+  pf->lookahead = lookahead_frames ? lookahead_frames : AUDIO_PREFETCH_FRAMES;
+  pf->resample_quality = resample_quality;
+
+  if(!(pf->threads = zalloc(sizeof(pthread_t) * pf->workers)))
+    goto fail;
+
+  atomic_store(&pf->running, true);
+
+  for(; pf->started < pf->workers; pf->started++) {
+    if(pthread_create(&pf->threads[pf->started], NULL, prefetch_worker, pf) != 0)
+      goto fail;
+  }
+
+  *prefetch = pf;
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "PREFETCH", "%u workers, lookahead %u frames", pf->workers, pf->lookahead);
+
+  return AUDIO_PREFETCH_SUCCESS;
+
+  fail:
+  audio_prefetch_close(pf);
+  return AUDIO_PREFETCH_ERROR;
+}
+
+void audio_prefetch_close(audio_prefetch_t *prefetch) {
+  if(!prefetch) return;
+
+  atomic_store_explicit(&prefetch->running, false, memory_order_release);
+  os_futex_wake(&prefetch->wakeup, INT_MAX);
+
+  for(uint8_t i = 0; i < prefetch->started; i++) pthread_join(prefetch->threads[i], NULL);
+
+  // Workers are gone, slots left attached are released here
+  for(uint8_t i = 0; i < AUDIO_PREFETCH_SLOTS; i++) prefetch_slot_release(&prefetch->slots[i]);
+
+  free(prefetch->threads);
+  free(prefetch);
+}
+
+int audio_prefetch_attach(audio_prefetch_t *prefetch, uint8_t slot_idx, decoder_t *decoder, uint32_t rate, uint32_t min_frames) {
+  if(!prefetch || !decoder || slot_idx >= AUDIO_PREFETCH_SLOTS)
+    return AUDIO_PREFETCH_INVALIDPARAM;
+
+  struct audio_prefetch_slot *slot = &prefetch->slots[slot_idx];
+  if(atomic_load(&slot->decoder) || slot->buffer)
+    return AUDIO_PREFETCH_ERROR;
+
+  audio_format_t af = decoder->data.af;
+  uint32_t decoder_rate = af_get_rate(af);
+  uint8_t channels = af_get_channels(af);
+
+  if(rate == 0) rate = decoder_rate;
+  slot->af = af_endian(AF_NATIVE_ENDIAN) | af_format(SF_FORMAT_FLOAT) | af_rate(rate) | af_channels(channels);
+
+  if(rate != decoder_rate) {
+    slot->resampler = audio_resampler_create(decoder_rate, rate, channels, prefetch->resample_quality);
+    slot->scratch = malloc((size_t) AUDIO_PREFETCH_CHUNK * channels * sizeof(float));
+    if(!slot->resampler || !slot->scratch) goto fail;
+  }
+
+  if(!(slot->buffer = audiobuffer_create(slot->af, prefetch->lookahead)))
+    goto fail;
+
+  slot->scratch_offset = 0;
+  slot->scratch_frames = 0;
+  slot->decoded = false;
+  slot->drained = false;
+  slot->position = 0;
+
+  // Length is converted to the ring rate, good enough to schedule crossfades
+  uint64_t length = decoder->ops.length ? decoder->ops.length(&decoder->data) : 0;
+  slot->length = (uint64_t) ((double) length * rate / decoder_rate);
+
+  atomic_store(&slot->eof, false);
+  atomic_store_explicit(&slot->decoder, decoder, memory_order_release);
+
+  // Reader starts with decoded frames instead of an underrun
+  prefetch_request(prefetch, slot_idx);
+  audiobuffer_wait_readable(slot->buffer, max(min_frames, 1), AUDIO_PREFETCH_ATTACH_TIMEOUT_NS);
+
+  return AUDIO_PREFETCH_SUCCESS;
+
+  fail:
+  prefetch_slot_release(slot);
+  return AUDIO_PREFETCH_ERROR;
+}
+
+void audio_prefetch_detach(audio_prefetch_t *prefetch, uint8_t slot_idx) {
+  if(!prefetch || slot_idx >= AUDIO_PREFETCH_SLOTS)
+    return;
+
+  struct audio_prefetch_slot *slot = &prefetch->slots[slot_idx];
+
+  // Pairs with busy claim in prefetch_fill, worker either sees no decoder or is waited for
+  atomic_store(&slot->decoder, NULL);
+  while(atomic_load(&slot->busy)) {
+    os_sleep_ms(1);
+  }
+
+  atomic_fetch_and(&prefetch->pending, ~(1u << slot_idx));
+
+  prefetch_slot_release(slot);
+}
+
+uint32_t audio_prefetch_read(audio_prefetch_t *prefetch, uint8_t slot_idx, float **planes, uint32_t frames) {
+  struct audio_prefetch_slot *slot = &prefetch->slots[slot_idx];
+  uint8_t channels = af_get_channels(slot->af);
+  float *dst[DECODER_MAX_CHANNELS];
+  float *ptr;
+
+  // Loaded before the ring, frames written before end of stream are all visible then
+  bool eof = atomic_load_explicit(&slot->eof, memory_order_acquire);
+
+  uint32_t available = audiobuffer_read_begin(slot->buffer, UINT32_MAX);
+  uint32_t done = 0, count;
+
+  while(done < frames && (count = audiobuffer_read(slot->buffer, &ptr)) > 0) {
+    count = min(count, frames - done);
+
+    for(uint8_t ch = 0; ch < channels; ch++) dst[ch] = planes[ch] + done;
+    pcm_fixed_to_planar(slot->af, dst, (const uint8_t *) ptr, count);
+
+    done = audiobuffer_read_consume(slot->buffer, count);
+  }
+
+  audiobuffer_read_end(slot->buffer);
+
+  uint32_t remaining = available - done;
+
+  slot->position += done;
+
+  if(eof) slot->drained = remaining == 0;
+  else if(remaining < slot->buffer->capacity / 2) prefetch_request(prefetch, slot_idx);
+
+  return done;
+}
+
+bool audio_prefetch_eof(audio_prefetch_t *prefetch, uint8_t slot_idx) {
+  return prefetch->slots[slot_idx].drained;
+}
+
+uint64_t audio_prefetch_remaining(audio_prefetch_t *prefetch, uint8_t slot_idx) {
+  struct audio_prefetch_slot *slot = &prefetch->slots[slot_idx];
+
+  // Everything left is in the ring once decoder is done
+  if(atomic_load_explicit(&slot->eof, memory_order_acquire)) {
+    uint32_t available = audiobuffer_read_begin(slot->buffer, UINT32_MAX);
+    audiobuffer_read_end(slot->buffer);
+    return available;
+  }
+
+  if(slot->length == 0) return UINT64_MAX;
+
+  return slot->length > slot->position ? slot->length - slot->position : 0;
+}
\ No newline at end of file
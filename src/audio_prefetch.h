@@ -0,0 +1,95 @@
+#ifndef _H_AUDIO_PREFETCH_
+#define _H_AUDIO_PREFETCH_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "decoder/decoder.h"
+#include "audio_resample.h"
+
+#define AUDIO_PREFETCH_SLOTS 32
+#define AUDIO_PREFETCH_WORKERS 2
+#define AUDIO_PREFETCH_FRAMES 8192 // default lookahead
+
+#define AUDIO_PREFETCH_SUCCESS 0
+#define AUDIO_PREFETCH_INVALIDPARAM -1
+#define AUDIO_PREFETCH_ERROR -2
+
+/*
+  Decode ahead of the audio thread. Every slot owns a ring of interleaved float frames that a
+  small pool of workers, shared by all slots, keeps filled up to the lookahead. Reader asks for
+  a refill once the ring drops below half of the lookahead, so workers wake about twice per
+  lookahead and never touch the reader's thread. Decoders of another rate are resampled by the
+  workers as well, ring always holds frames of the reader's rate.
+*/
+struct audio_prefetch;
+typedef struct audio_prefetch audio_prefetch_t;
+
+/**
+ * Start worker pool
+ *
+ * @param prefetch Pool to be created
+ * @param workers Number of worker threads, 0 for AUDIO_PREFETCH_WORKERS
+ * @param lookahead_frames Frames decoded ahead for every slot, 0 for AUDIO_PREFETCH_FRAMES
+ * @param resample_quality One of AUDIO_RESAMPLE_* presets
+ * @return AUDIO_PREFETCH_SUCCESS or AUDIO_PREFETCH_ERROR
+ */
+int audio_prefetch_open(audio_prefetch_t **prefetch, uint8_t workers, uint32_t lookahead_frames, int resample_quality);
+
+/**
+ * Stop workers and release the pool. Slots have to be detached first
+ *
+ * @param prefetch Pool instance
+ */
+void audio_prefetch_close(audio_prefetch_t *prefetch);
+
+/**
+ * Bind decoder to the slot and wait until the first min_frames are decoded or the stream ended
+ *
+ * @param prefetch Pool instance
+ * @param slot Slot index
+ * @param decoder Opened decoder, must stay valid until detached
+ * @param rate Rate of frames handed to the reader, 0 keeps the decoder rate
+ * @param min_frames Frames that have to be ready before return
+ * @return AUDIO_PREFETCH_SUCCESS, AUDIO_PREFETCH_INVALIDPARAM or AUDIO_PREFETCH_ERROR
+ */
+int audio_prefetch_attach(audio_prefetch_t *prefetch, uint8_t slot, decoder_t *decoder, uint32_t rate, uint32_t min_frames);
+
+/**
+ * Unbind decoder from the slot. Blocks until workers release it, reader must be done with the slot
+ *
+ * @param prefetch Pool instance
+ * @param slot Slot index
+ */
+void audio_prefetch_detach(audio_prefetch_t *prefetch, uint8_t slot);
+
+/**
+ * Copy decoded frames to planar buffers and ask workers for a refill when needed. Never blocks
+ *
+ * @param prefetch Pool instance
+ * @param slot Slot index
+ * @param planes One buffer per decoder channel
+ * @param frames Number of frames wanted
+ * @return Number of frames copied, less than wanted on underrun or end of stream
+ */
+uint32_t audio_prefetch_read(audio_prefetch_t *prefetch, uint8_t slot, float **planes, uint32_t frames);
+
+/**
+ * Check whether decoder of the slot reached the end and all its frames were read
+ *
+ * @param prefetch Pool instance
+ * @param slot Slot index
+ * @return true at the end of stream
+ */
+bool audio_prefetch_eof(audio_prefetch_t *prefetch, uint8_t slot);
+
+/**
+ * Frames left for the reader. Exact once decoder reached the end, before that estimated from
+ * the decoder length
+ *
+ * @param prefetch Pool instance
+ * @param slot Slot index
+ * @return Number of frames, UINT64_MAX if decoder length is unknown
+ */
+uint64_t audio_prefetch_remaining(audio_prefetch_t *prefetch, uint8_t slot);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,349 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "audio_resample.h"
+#include "decoder/decoder.h"
+#include "logging.h"
+#include "util/cpu.h"
+#include "util/mem.h"
+#include "util/math.h"
+
+#if defined(CPU_X86)
+  #include <immintrin.h>
+#endif
+
+#if defined(CPU_NEON)
+  #include <arm_neon.h>
+#endif
+
+#define RESAMPLE_PI 3.14159265358979323846
+
+// Input frames buffered per channel on top of the filter length
+#define RESAMPLE_BLOCK 1024
+
+#define RESAMPLE_ALIGN 32
+
+typedef float (*resample_dot_t)(const float *x, const float *h, uint32_t taps);
+
+struct audio_resample_preset {
+  const char *name;
+  uint32_t taps;  // multiple of 8, vector kernels have no tails
+  double beta;    // Kaiser window shape, stopband attenuation
+  double rolloff; // passband edge relative to the lower Nyquist frequency
+};
+
+static const struct audio_resample_preset presets[] = {
+  [AUDIO_RESAMPLE_FAST]     = { "fast",     16,  6.0, 0.85 },
+  [AUDIO_RESAMPLE_BALANCED] = { "balanced", 32,  8.0, 0.91 },
+  [AUDIO_RESAMPLE_BEST]     = { "best",     64, 10.0, 0.95 },
+};
+
+struct audio_resampler {
+  uint32_t in_rate;
+  uint32_t out_rate;
+  uint8_t channels;
+  const struct audio_resample_preset *preset;
+  resample_dot_t dot;
+
+  // Output frame advances the input by step_int frames and phase by step_frac of phases
+  uint32_t phases;
+  uint32_t step_int;
+  uint32_t step_frac;
+
+  // Phases of the table, row table_phases is phase 1.0 where nearest row rounds up to it
+  uint32_t table_phases;
+  float *coeffs; // table_phases + 1 rows of taps
+
+  // Planar input history, index is the first frame under the filter
+  float *history;
+  uint32_t capacity;
+  uint32_t filled;
+  uint32_t index;
+  uint32_t phase;
+  uint32_t drain; // zero frames left to flush the filter at the end of stream
+};
+
+//
+// Dot product kernels
+//
+static float dot_c(const float *x, const float *h, uint32_t taps) {
+  float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+
+  for (uint32_t i = 0; i < taps; i += 4) {
+    s0 += x[i] * h[i];
+    s1 += x[i + 1] * h[i + 1];
+    s2 += x[i + 2] * h[i + 2];
+    s3 += x[i + 3] * h[i + 3];
+  }
+
+  return (s0 + s1) + (s2 + s3);
+}
+
+#if defined(CPU_X86) && defined(__SSE2__)
+static float dot_sse2(const float *x, const float *h, uint32_t taps) {
+  __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+
+  for (uint32_t i = 0; i < taps; i += 8) {
+    s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(x + i),     _mm_load_ps(h + i)));
+    s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_load_ps(h + i + 4)));
+  }
+
+  float s[4];
+  _mm_storeu_ps(s, _mm_add_ps(s0, s1));
+
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+#endif
+
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+__attribute__((target("avx2")))
+static float dot_avx2(const float *x, const float *h, uint32_t taps) {
+  __m256 s = _mm256_setzero_ps();
+
+  for (uint32_t i = 0; i < taps; i += 8)
+    s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_load_ps(h + i)));
+
+  __m128 v = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+  v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+
+  return _mm_cvtss_f32(v);
+}
+#endif
+
+#if defined(CPU_NEON)
+static float dot_neon(const float *x, const float *h, uint32_t taps) {
+  float32x4_t s0 = vdupq_n_f32(0.0f), s1 = vdupq_n_f32(0.0f);
+
+  for (uint32_t i = 0; i < taps; i += 8) {
+    s0 = vmlaq_f32(s0, vld1q_f32(x + i),     vld1q_f32(h + i));
+    s1 = vmlaq_f32(s1, vld1q_f32(x + i + 4), vld1q_f32(h + i + 4));
+  }
+
+  float s[4];
+  vst1q_f32(s, vaddq_f32(s0, s1));
+
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+#endif
+
+static resample_dot_t resample_dot_select(const char **name) {
+  resample_dot_t dot = dot_c;
+  unsigned features = cpu_features();
+
+  *name = "c";
+
+#if defined(CPU_X86) && defined(__SSE2__)
+  if (features & CPU_FEATURE_SSE2) { dot = dot_sse2; *name = "sse2"; }
+#endif
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+  if (features & CPU_FEATURE_AVX2) { dot = dot_avx2; *name = "avx2"; }
+#endif
+#if defined(CPU_NEON)
+  if (features & CPU_FEATURE_NEON) { dot = dot_neon; *name = "neon"; }
+#endif
+
+  (void) features;
+  return dot;
+}
+
+//
+// Filter design functions
+//
+
+// Zeroth order modified Bessel function of the first kind
+static double bessel_i0(double x) {
+  double sum = 1.0, term = 1.0;
+
+  for (int k = 1; k < 64; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12) break;
+  }
+
+  return sum;
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+  while (b) {
+    uint32_t t = a % b;
+    a = b;
+    b = t;
+  }
+
+  return a;
+}
+
+// Every row is the same low pass shifted by a fraction of a frame, with unity gain at DC
+static void resample_build_table(struct audio_resampler *r) {
+  const struct audio_resample_preset *preset = r->preset;
+  uint32_t taps = preset->taps;
+  double half = taps / 2;
+  double cutoff = preset->rolloff * min(1.0, (double) r->out_rate / r->in_rate);
+  double i0_beta = bessel_i0(preset->beta);
+
+  for (uint32_t p = 0; p <= r->table_phases; p++) {
+    float *row = r->coeffs + (size_t) p * taps;
+    double frac = (double) p / r->table_phases;
+    double sum = 0.0;
+
+    for (uint32_t k = 0; k < taps; k++) {
+      double x = k - (half - 1) - frac;
+      double t = x / half;
+      double sinc = x == 0.0 ? 1.0 : sin(RESAMPLE_PI * cutoff * x) / (RESAMPLE_PI * cutoff * x);
+      double window = fabs(t) >= 1.0 ? 0.0 : bessel_i0(preset->beta * sqrt(1.0 - t * t)) / i0_beta;
+
+      row[k] = sinc * window;
+      sum += row[k];
+    }
+
+    for (uint32_t k = 0; k < taps; k++) row[k] /= sum;
+  }
+}
+
+//
+// Public functions
+//
+const char *audio_resample_quality_name(int quality) {
+  if (quality <= AUDIO_RESAMPLE_DEFAULT || quality > AUDIO_RESAMPLE_BEST) quality = AUDIO_RESAMPLE_BALANCED;
+  return presets[quality].name;
+}
+
+audio_resampler_t *audio_resampler_create(uint32_t in_rate, uint32_t out_rate, uint8_t channels, int quality) {
+  if (in_rate == 0 || out_rate == 0 || channels == 0 || channels > DECODER_MAX_CHANNELS)
+    return NULL;
+
+  if (quality <= AUDIO_RESAMPLE_DEFAULT || quality > AUDIO_RESAMPLE_BEST) quality = AUDIO_RESAMPLE_BALANCED;
+
+  struct audio_resampler *r = zalloc(sizeof(struct audio_resampler));
+  if (!r) return NULL;
+
+  const char *kernel;
+
+  r->in_rate = in_rate;
+  r->out_rate = out_rate;
+  r->channels = channels;
+  r->preset = &presets[quality];
+  r->dot = resample_dot_select(&kernel);
+
+  uint32_t g = gcd(in_rate, out_rate);
+  r->phases = out_rate / g;
+  r->step_int = (in_rate / g) / r->phases;
+  r->step_frac = (in_rate / g) % r->phases;
+  r->table_phases = min(r->phases, AUDIO_RESAMPLE_MAX_PHASES);
+
+  // Rows are aligned for vector loads of coefficients
+  size_t table_size = (size_t) (r->table_phases + 1) * r->preset->taps * sizeof(float);
+  r->coeffs = aligned_alloc(RESAMPLE_ALIGN, (table_size + RESAMPLE_ALIGN - 1) & ~((size_t) RESAMPLE_ALIGN - 1));
+
+  r->capacity = r->preset->taps + RESAMPLE_BLOCK;
+  r->history = malloc((size_t) r->capacity * channels * sizeof(float));
+
+  if (!r->coeffs || !r->history) {
+    audio_resampler_destroy(r);
+    return NULL;
+  }
+
+  resample_build_table(r);
+  audio_resampler_reset(r);
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "RESAMPLE", "%u -> %u Hz, %s preset, %u taps, %u phases%s, %s kernels",
+    in_rate, out_rate, r->preset->name, r->preset->taps, r->table_phases,
+    r->table_phases < r->phases ? " (nearest)" : "", kernel);
+
+  return r;
+}
+
+void audio_resampler_destroy(audio_resampler_t *resampler) {
+  if (!resampler) return;
+
+  free(resampler->coeffs);
+  free(resampler->history);
+  free(resampler);
+}
+
+void audio_resampler_reset(audio_resampler_t *r) {
+  uint32_t delay = r->preset->taps / 2 - 1;
+
+  // Filter center sits on the first input frame
+  memset(r->history, 0, (size_t) r->capacity * r->channels * sizeof(float));
+  r->filled = delay;
+  r->index = 0;
+  r->phase = 0;
+  r->drain = r->preset->taps / 2;
+}
+
+// Drop frames behind the filter and append new ones, zeros when flushing
+static uint32_t resample_refill(struct audio_resampler *r, const float *in, uint32_t frames) {
+  uint32_t drop = min(r->index, r->filled);
+
+  if (drop > 0) {
+    for (uint8_t ch = 0; ch < r->channels; ch++) {
+      float *h = r->history + (size_t) ch * r->capacity;
+      memmove(h, h + drop, (r->filled - drop) * sizeof(float));
+    }
+
+    r->filled -= drop;
+    r->index -= drop;
+  }
+
+  uint32_t count = min(frames, r->capacity - r->filled);
+
+  for (uint8_t ch = 0; ch < r->channels; ch++) {
+    float *h = r->history + (size_t) ch * r->capacity + r->filled;
+
+    if (!in) {
+      memset(h, 0, count * sizeof(float));
+      continue;
+    }
+
+    for (uint32_t i = 0; i < count; i++) h[i] = in[(size_t) i * r->channels + ch];
+  }
+
+  r->filled += count;
+  return count;
+}
+
+uint32_t audio_resampler_process(audio_resampler_t *r, const float *in, uint32_t *in_frames, float *out, uint32_t out_frames) {
+  uint32_t taps = r->preset->taps;
+  uint32_t available = in ? *in_frames : 0;
+  uint32_t consumed = 0, produced = 0;
+
+  while (produced < out_frames) {
+    while (produced < out_frames && r->index + taps <= r->filled) {
+      uint32_t row = r->table_phases == r->phases ? r->phase : (uint32_t) (((uint64_t) r->phase * r->table_phases + r->phases / 2) / r->phases);
+      const float *h = r->coeffs + (size_t) row * taps;
+      float *dst = out + (size_t) produced * r->channels;
+
+      for (uint8_t ch = 0; ch < r->channels; ch++)
+        dst[ch] = r->dot(r->history + (size_t) ch * r->capacity + r->index, h, taps);
+
+      produced++;
+
+      r->index += r->step_int;
+      r->phase += r->step_frac;
+      if (r->phase >= r->phases) {
+        r->phase -= r->phases;
+        r->index++;
+      }
+    }
+
+    if (produced == out_frames) break;
+
+    uint32_t count;
+    if (in) {
+      count = resample_refill(r, in + (size_t) consumed * r->channels, available - consumed);
+      consumed += count;
+    } else {
+      count = resample_refill(r, NULL, r->drain);
+      r->drain -= count;
+    }
+
+    if (count == 0) break;
+  }
+
+  if (in_frames) *in_frames = consumed;
+
+  return produced;
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#ifndef _H_AUDIO_RESAMPLE_
+#define _H_AUDIO_RESAMPLE_
+
+#include <stdint.h>
+
+/**
+ * Polyphase windowed-sinc sample rate converter for interleaved float frames.
+ *
+ * Rates are reduced to L/M, every output frame is a dot product of one of L precomputed
+ * Kaiser windowed sinc phases with the input history of each channel. Standard rates need
+ * at most a few hundred phases and are converted exactly, others use the nearest of
+ * AUDIO_RESAMPLE_MAX_PHASES phases. Output is aligned with input, the filter delay is
+ * compensated on start and flushed at the end of stream.
+ */
+
+#define AUDIO_RESAMPLE_DEFAULT  0 // AUDIO_RESAMPLE_BALANCED
+#define AUDIO_RESAMPLE_FAST     1 // 16 taps, for many simultaneous inputs
+#define AUDIO_RESAMPLE_BALANCED 2 // 32 taps
+#define AUDIO_RESAMPLE_BEST     3 // 64 taps, transparent passband up to 0.95 of Nyquist
+
+#define AUDIO_RESAMPLE_MAX_PHASES 1024
+
+struct audio_resampler;
+typedef struct audio_resampler audio_resampler_t;
+
+/**
+ * Create converter and build its filter table
+ *
+ * @param in_rate Input rate
+ * @param out_rate Output rate
+ * @param channels Number of interleaved channels, up to DECODER_MAX_CHANNELS
+ * @param quality One of AUDIO_RESAMPLE_* presets
+ * @return Converter or NULL on invalid parameters or allocation failure
+ */
+audio_resampler_t *audio_resampler_create(uint32_t in_rate, uint32_t out_rate, uint8_t channels, int quality);
+
+/**
+ * Release converter
+ *
+ * @param resampler Converter, may be NULL
+ */
+void audio_resampler_destroy(audio_resampler_t *resampler);
+
+/**
+ * Drop filter history, next input starts a new stream
+ *
+ * @param resampler Converter
+ */
+void audio_resampler_reset(audio_resampler_t *resampler);
+
+/**
+ * Convert frames. Input is consumed only as far as needed for the output, the rest is left
+ * to the next call
+ *
+ * @param resampler Converter
+ * @param in Interleaved input frames, NULL at the end of stream flushes frames held by the filter
+ * @param in_frames Number of input frames, number of consumed frames is written back
+ * @param out Interleaved output buffer
+ * @param out_frames Output buffer size in frames
+ * @return Number of frames written to out, 0 with NULL in once the stream is flushed
+ */
+uint32_t audio_resampler_process(audio_resampler_t *resampler, const float *in, uint32_t *in_frames, float *out, uint32_t out_frames);
+
+/**
+ * Preset name, used for logging
+ *
+ * @param quality One of AUDIO_RESAMPLE_* presets
+ * @return Preset name
+ */
+const char *audio_resample_quality_name(int quality);
+
+#endif
\ No newline at end of file
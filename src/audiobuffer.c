@@ -1,163 +1,267 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // memfd_create, syscall
+#endif
+
 #include <stddef.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "audiobuffer.h"
 #include "util/mem.h"
 #include "util/math.h"
+#include "util/time.h"
+#include "util/futex.h"
 #include "pcm.h"
 
+// Map the same pages twice in a row, so a region crossing the end continues in the second copy.
+// AUDIOBUFFER_NO_MIRROR keeps storage in plain memory, tests run the split region path with it
+static float* audiobuffer_map_mirrored(size_t size) {
+#if defined(AUDIOBUFFER_NO_MIRROR)
+  (void) size;
+  return NULL;
+#endif
+
+  int fd = memfd_create("audiobuffer", MFD_CLOEXEC);
+  if (fd < 0) return NULL;
+
+  uint8_t* addr = MAP_FAILED;
+
+  if (ftruncate(fd, size) != 0) goto end;
+
+  // Reserve both halves first, then replace them with views of the same memory
+  addr = mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) goto end;
+
+  if (mmap(addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+      mmap(addr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(addr, size * 2);
+    addr = MAP_FAILED;
+  }
+
+  end:
+  close(fd);
+  return addr == MAP_FAILED ? NULL : (float*) addr;
+}
+
 audiobuffer_t* audiobuffer_create(audio_format_t af, uint32_t frames) {
   audiobuffer_t* b;
+  uint32_t channels = af_get_channels(af);
+  size_t page_size = sysconf(_SC_PAGESIZE);
+
+  if (channels == 0 || frames == 0) return NULL;
+
+  // Power of two frames of at least a page keep every copy page aligned
+  uint32_t capacity = 1;
+  while (capacity < frames || capacity * sizeof(float) < page_size) capacity <<= 1;
+
+  if (!(b = aligned_alloc(AUDIOBUFFER_CACHE_LINE, sizeof(audiobuffer_t)))) return NULL;
+  memset(b, 0, sizeof(audiobuffer_t));
 
-  uint32_t capacity = frames * af_get_channels(af);
-  b = pmalloc(offsetof(audiobuffer_t, data) + capacity * sizeof(float));
-  
   b->af = af;
+  b->channels = channels;
   b->capacity = capacity;
-  b->frames = frames;
-  b->available = b->read_index = b->write_index = 0;
-  
+  b->mask = capacity - 1;
+  b->data_size = (size_t) capacity * channels * sizeof(float);
+
+  if ((b->data = audiobuffer_map_mirrored(b->data_size))) {
+    b->mirrored = 1;
+  } else if (!(b->data = pmalloc(b->data_size))) {
+    free(b);
+    return NULL;
+  }
+
+  audiobuffer_reset(b);
+
   return b;
 }
 
 void audiobuffer_destroy(audiobuffer_t* b) {
+  if (!b) return;
+
+  if (b->mirrored) munmap(b->data, b->data_size * 2);
+  else free(b->data);
+
   free(b);
 }
 
 void audiobuffer_reset(audiobuffer_t* b) {
-  b->read_index = b->write_index = 0;
-  b->available = 0;
-  b->frames = 0;
+  atomic_store_explicit(&b->read_position, 0, memory_order_relaxed);
+  atomic_store_explicit(&b->write_position, 0, memory_order_relaxed);
+  atomic_store_explicit(&b->frames, 0, memory_order_relaxed);
+  atomic_store_explicit(&b->read_waiting, 0, memory_order_relaxed);
+  atomic_store_explicit(&b->write_waiting, 0, memory_order_relaxed);
+  memset(&b->r, 0, sizeof(b->r));
+  memset(&b->w, 0, sizeof(b->w));
+  atomic_thread_fence(memory_order_release);
 }
 
 uint64_t audiobuffer_get_frames(audiobuffer_t* b) {
-  return b->frames;
+  return atomic_load_explicit(&b->frames, memory_order_relaxed);
 }
 
 void audiobuffer_set_frames(audiobuffer_t* b, uint64_t frames) {
-  b->frames = frames;
+  atomic_store_explicit(&b->frames, frames, memory_order_relaxed);
 }
 
-uint32_t audiobuffer_read_begin(audiobuffer_t* b, const uint32_t max_frames) {
-  if(b->r_begin || max_frames == 0) return 0;
-
-  uint32_t channels = af_get_channels(b->af);
+// Contiguous part of the session region, whole region when storage is mirrored
+static uint32_t audiobuffer_span(audiobuffer_t* b, audiobuffer_session_t* s, float** ptr) {
+  if (!s->begin || s->available == 0) return 0;
 
-  b->r_begin = 1;
-  b->r_max_samples = max_frames * channels;
-  b->r_index = b->read_index;
-  b->r_count = 0;
+  uint32_t index = s->position & b->mask;
 
-  b->r_available = b->available;
-  b->r_available = min(b->r_available, b->r_max_samples);
+  *ptr = &b->data[(size_t) index * b->channels];
 
-  return b->r_available / af_get_channels(b->af);
+  return b->mirrored ? s->available : min(s->available, b->capacity - index);
 }
 
-uint32_t audiobuffer_read(audiobuffer_t* b, float** ptr) {
-  if(!b->r_begin) return 0;
+static uint32_t audiobuffer_advance(audiobuffer_session_t* s, const uint32_t frames) {
+  if (!s->begin) return 0;
 
-  uint32_t channels = af_get_channels(b->af);
-  uint32_t samples = b->r_max_samples - b->r_count;
-  float* src = b->data;
+  uint32_t count = min(frames, s->available);
 
-  if (b->r_available == 0) return 0;
+  s->available -= count;
+  s->position += count;
+  s->count += count;
 
-  uint32_t limit = min(b->r_index + b->r_available, b->capacity);
-  uint32_t count = min(limit - b->r_index, samples);
-  
-  *ptr = &src[b->r_index];
-
-  return count / channels;
+  return s->count;
 }
 
-uint32_t audiobuffer_read_consume(audiobuffer_t* b, const uint32_t frames) {
-  if(!b->r_begin) return 0;
+uint32_t audiobuffer_read_begin(audiobuffer_t* b, const uint32_t max_frames) {
+  if (b->r.begin || max_frames == 0) return 0;
 
-  uint32_t channels = af_get_channels(b->af);
-  uint32_t samples = frames * channels;
+  // Acquire pairs with release in write_end, frames written before it are visible
+  uint64_t read_position = atomic_load_explicit(&b->read_position, memory_order_relaxed);
+  uint64_t write_position = atomic_load_explicit(&b->write_position, memory_order_acquire);
 
-  b->r_available = b->r_available - samples;
-  b->r_index = (b->r_index + samples) % b->capacity;
-  b->r_count = b->r_count + samples;
+  b->r.begin = 1;
+  b->r.position = read_position;
+  b->r.count = 0;
+  b->r.available = min((uint32_t) (write_position - read_position), max_frames);
 
-  return b->r_count / channels;
+  return b->r.available;
+}
+
+uint32_t audiobuffer_read(audiobuffer_t* b, float** ptr) {
+  return audiobuffer_span(b, &b->r, ptr);
+}
+
+uint32_t audiobuffer_read_consume(audiobuffer_t* b, const uint32_t frames) {
+  return audiobuffer_advance(&b->r, frames);
 }
 
 uint32_t audiobuffer_read_end(audiobuffer_t* b) {
-  if(!b->r_begin) return 0;
+  if (!b->r.begin) return 0;
 
-  b->r_begin = 0;
+  b->r.begin = 0;
 
-  if(b->r_count == 0) return 0;
+  if (b->r.count == 0) return 0;
 
-  uint32_t channels = af_get_channels(b->af);
+  // Release pairs with acquire in write_begin, space is handed back only after reading finished
+  atomic_store_explicit(&b->read_position, b->r.position, memory_order_release);
+  atomic_fetch_add_explicit(&b->frames, b->r.count, memory_order_relaxed);
 
-  b->read_index = (b->read_index + b->r_count) % b->capacity;
-  b->available -= b->r_count;
-  b->frames += b->r_count / channels;
+  // Orders position store before waiting flag load, pairs with the fence in the waiter
+  atomic_thread_fence(memory_order_seq_cst);
+  uint32_t waiting = atomic_load_explicit(&b->read_waiting, memory_order_relaxed);
+  if (waiting && b->capacity - (uint32_t) (atomic_load_explicit(&b->write_position, memory_order_relaxed) - b->r.position) >= waiting)
+    os_futex_wake(&b->read_futex, 1);
 
-  return b->r_count / channels;
+  return b->r.count;
 }
-uint32_t audiobuffer_write_begin(audiobuffer_t* b, const uint32_t max_frames) {
-  if(b->w_begin || max_frames == 0) return 0;
 
-  uint32_t channels = af_get_channels(b->af);
+uint32_t audiobuffer_write_begin(audiobuffer_t* b, const uint32_t max_frames) {
+  if (b->w.begin || max_frames == 0) return 0;
 
-  b->w_begin = 1;
-  b->w_max_samples = max_frames * channels;
-  b->w_index = b->write_index;
-  b->w_count = 0;
+  uint64_t write_position = atomic_load_explicit(&b->write_position, memory_order_relaxed);
+  uint64_t read_position = atomic_load_explicit(&b->read_position, memory_order_acquire);
 
-  b->w_available = b->capacity - b->available;
-  b->w_available = min(b->w_available, b->w_max_samples);
+  b->w.begin = 1;
+  b->w.position = write_position;
+  b->w.count = 0;
+  b->w.available = min(b->capacity - (uint32_t) (write_position - read_position), max_frames);
 
-  return b->w_available / channels;
+  return b->w.available;
 }
 
 uint32_t audiobuffer_write(audiobuffer_t* b, float** ptr) {
-  if(!b->w_begin) return 0;
-  
-  uint32_t channels = af_get_channels(b->af);
-  uint32_t samples = b->w_max_samples - b->w_count;
-  float* dst = b->data;
-
-  if (b->w_available == 0) return 0;
+  return audiobuffer_span(b, &b->w, ptr);
+}
 
-  uint32_t limit = min(b->w_index + b->w_available, b->capacity);
-  uint32_t count = min(limit - b->w_index, samples);
-  
-  *ptr = &dst[b->w_index];
+uint32_t audiobuffer_write_fill(audiobuffer_t* b, const uint32_t frames) {
+  if (frames == 0) return 0;
 
-  return count / channels;
+  return audiobuffer_advance(&b->w, frames);
 }
 
-uint32_t audiobuffer_write_fill(audiobuffer_t* b, const uint32_t frames) {
-  if(!b->w_begin || frames == 0) return 0;
+uint32_t audiobuffer_write_end(audiobuffer_t* b) {
+  if (!b->w.begin) return 0;
 
-  uint32_t channels = af_get_channels(b->af);
-  uint32_t samples = frames * channels;
+  b->w.begin = 0;
 
-  b->w_available = b->w_available - samples;
-  b->w_index = (b->w_index + samples) % b->capacity;
-  b->w_count = b->w_count + samples;
+  if (b->w.count == 0) return 0;
 
-  return b->w_count / channels;
+  atomic_store_explicit(&b->write_position, b->w.position, memory_order_release);
+
+  atomic_thread_fence(memory_order_seq_cst);
+  uint32_t waiting = atomic_load_explicit(&b->write_waiting, memory_order_relaxed);
+  if (waiting && (uint32_t) (b->w.position - atomic_load_explicit(&b->read_position, memory_order_relaxed)) >= waiting)
+    os_futex_wake(&b->write_futex, 1);
+
+  return b->w.count;
 }
 
-uint32_t audiobuffer_write_end(audiobuffer_t* b) {
-  if(!b->w_begin) return 0;
+// Waiter publishes its watermark, then sleeps on the futex of the other side while the
+// watermark isn't reached. Futex value is sampled before the check, so a wake between the
+// check and the sleep makes the sleep return immediately
+static uint32_t audiobuffer_wait(audiobuffer_t* b, atomic_uint_least32_t* futex, atomic_uint_least32_t* waiting,
+                                 int readable, uint32_t min_frames, uint64_t timeout_ns) {
+  uint64_t deadline = timeout_ns == AUDIOBUFFER_WAIT_INFINITE ? UINT64_MAX : os_gettime_ns() + timeout_ns;
+  uint32_t frames;
 
-  b->w_begin = 0;
+  min_frames = max(min(min_frames, b->capacity), 1);
 
-  if(b->w_count == 0) return 0;
+  atomic_store_explicit(waiting, min_frames, memory_order_relaxed);
 
-  uint32_t channels = af_get_channels(b->af);
+  while (1) {
+    uint32_t value = atomic_load_explicit(futex, memory_order_acquire);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    uint64_t read_position = atomic_load_explicit(&b->read_position, memory_order_acquire);
+    uint64_t write_position = atomic_load_explicit(&b->write_position, memory_order_acquire);
+    uint32_t filled = (uint32_t) (write_position - read_position);
+
+    frames = readable ? filled : b->capacity - filled;
+    if (frames >= min_frames) break;
+
+    uint64_t now = os_gettime_ns();
+    if (now >= deadline) break;
+
+    os_futex_wait(futex, value, timeout_ns == AUDIOBUFFER_WAIT_INFINITE ? OS_FUTEX_INFINITE : deadline - now);
+
+    // Forced wakeup clears the watermark
+    if (atomic_load_explicit(waiting, memory_order_relaxed) == 0) break;
+  }
+
+  atomic_store_explicit(waiting, 0, memory_order_relaxed);
+
+  return frames;
+}
+
+uint32_t audiobuffer_wait_readable(audiobuffer_t* b, uint32_t min_frames, uint64_t timeout_ns) {
+  return audiobuffer_wait(b, &b->write_futex, &b->write_waiting, 1, min_frames, timeout_ns);
+}
+
+uint32_t audiobuffer_wait_writable(audiobuffer_t* b, uint32_t min_frames, uint64_t timeout_ns) {
+  return audiobuffer_wait(b, &b->read_futex, &b->read_waiting, 0, min_frames, timeout_ns);
+}
 
-  b->write_index = (b->write_index + b->w_count) % b->capacity;
-  b->available += b->w_count;
+void audiobuffer_wakeup(audiobuffer_t* b) {
+  atomic_store_explicit(&b->read_waiting, 0, memory_order_relaxed);
+  atomic_store_explicit(&b->write_waiting, 0, memory_order_relaxed);
 
-  return b->w_count / channels;
+  os_futex_wake(&b->read_futex, 1);
+  os_futex_wake(&b->write_futex, 1);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef _H_AUDIOBUFFER_
 #define _H_AUDIOBUFFER_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdatomic.h>
 #include "pcm.h"
@@ -8,37 +9,59 @@
 /**
  * Audio ring buffer implementation. Thread safe and lock free for one producer and one consumer.
  * 
- * This buffer can only hold array of float values.
+ * This buffer can only hold array of float values, frames are interleaved.
+ *
+ * Capacity is a power of two in frames and positions are free running counters, so wrapping
+ * is a mask. Each side owns its position on a separate cache line and publishes it with release
+ * ordering once a read or write routine ends. Storage is mapped twice back to back, so any
+ * readable or writable region is one contiguous span. When mirroring is unavailable regions are
+ * split at the end of the storage and read/write return them in two pieces.
+ *
+ * Either side may block until the other one crosses a watermark. Waiter publishes the number of
+ * frames it needs, the other side issues a futex wake only when its routine end crosses it.
  */
 
-typedef struct {
-  audio_format_t af;
-  size_t capacity;
-  
-  // last consume frame number
-  atomic_uint_least64_t	 frames;
+#define AUDIOBUFFER_CACHE_LINE 64
 
-  // all indexes and ofsets in pcm samples
-  atomic_uint_least32_t available;
+#define AUDIOBUFFER_WAIT_INFINITE UINT64_MAX
 
-  uint32_t read_index;
-  uint32_t write_index;
-
-  // read/write begin/end state
-  uint8_t r_begin;
-  uint8_t w_begin;
-  uint32_t r_available, r_max_samples, r_index, r_count;
-  uint32_t w_available, w_max_samples, w_index, w_count;
+typedef struct {
+  uint64_t position;   // own position at routine begin
+  uint32_t available;  // frames left in current routine
+  uint32_t count;      // frames processed in current routine
+  uint8_t begin;
+} audiobuffer_session_t;
 
-  float data[];
+typedef struct {
+  audio_format_t af;
+  uint32_t channels;
+  uint32_t capacity;   // frames, power of two
+  uint32_t mask;
+
+  float *data;
+  size_t data_size;    // bytes of a single storage copy
+  uint8_t mirrored;
+
+  // consumer side
+  _Alignas(AUDIOBUFFER_CACHE_LINE) atomic_uint_least64_t read_position;
+  atomic_uint_least64_t frames; // last consumed frame number
+  atomic_uint_least32_t read_futex;   // bumped when a waiting producer gets its space
+  atomic_uint_least32_t read_waiting; // free frames awaited by producer, 0 if it doesn't wait
+  audiobuffer_session_t r;
+
+  // producer side
+  _Alignas(AUDIOBUFFER_CACHE_LINE) atomic_uint_least64_t write_position;
+  atomic_uint_least32_t write_futex;   // bumped when a waiting consumer gets its frames
+  atomic_uint_least32_t write_waiting; // frames awaited by consumer, 0 if it doesn't wait
+  audiobuffer_session_t w;
 } audiobuffer_t;
 
 /**
  * Audio ring buffer initialization
  *
  * @param af Audio format that our buffer will hold
- * @param frames Buffer capacity in PCM frames
- * @return Pointer to initialized buffer
+ * @param frames Minimal buffer capacity in PCM frames, rounded up to a power of two
+ * @return Pointer to initialized buffer or NULL
  */
 audiobuffer_t* audiobuffer_create(audio_format_t af, uint32_t frames);
 
@@ -51,6 +74,8 @@ void audiobuffer_destroy(audiobuffer_t* b);
 
 /**
  * Reset buffer. This function reset all counter and buffer become empty
+ * 
+ * Neither producer nor consumer may be inside a routine
  *
  * @param b Pointer to initialized buffer
  */
@@ -149,4 +174,35 @@ uint32_t audiobuffer_write_fill(audiobuffer_t* b, const uint32_t frames);
  */
 uint32_t audiobuffer_write_end(audiobuffer_t* b);
 
+/**
+ * Block consumer until at least min_frames can be read
+ * 
+ * Must be called outside of read routine
+ *
+ * @param b Pointer to initialized buffer
+ * @param min_frames High watermark, clamped to buffer capacity
+ * @param timeout_ns Relative timeout or AUDIOBUFFER_WAIT_INFINITE
+ * @return Number of frames available for reading, less than min_frames on timeout or wakeup
+ */
+uint32_t audiobuffer_wait_readable(audiobuffer_t* b, uint32_t min_frames, uint64_t timeout_ns);
+
+/**
+ * Block producer until at least min_frames can be written
+ * 
+ * Must be called outside of write routine
+ *
+ * @param b Pointer to initialized buffer
+ * @param min_frames Low watermark expressed as free space, clamped to buffer capacity
+ * @param timeout_ns Relative timeout or AUDIOBUFFER_WAIT_INFINITE
+ * @return Free space available for writing in frames, less than min_frames on timeout or wakeup
+ */
+uint32_t audiobuffer_wait_writable(audiobuffer_t* b, uint32_t min_frames, uint64_t timeout_ns);
+
+/**
+ * Release both sides from their waits regardless of watermarks. Used on stop and seek
+ *
+ * @param b Pointer to initialized buffer
+ */
+void audiobuffer_wakeup(audiobuffer_t* b);
+
 #endif
\ No newline at end of file
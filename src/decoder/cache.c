@@ -0,0 +1,336 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // realpath
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "decoder/decoder.h"
+#include "decoder/cache.h"
+#include "logging.h"
+#include "util/djb2_hash.h"
+
+#define DECODER_CACHE_MAGIC "MIZARC1"
+
+// Tells apart temporary files of writers in one process, decoders of the same file may record at once
+static atomic_uint cache_writer_serial;
+
+struct decoder_cache_header {
+  char magic[8];
+  uint64_t size;
+  int64_t mtime;
+  uint32_t name_length;
+  uint32_t reserved;
+  uint64_t payload_size;
+  // followed by file path, padding up to DECODER_CACHE_ALIGN and payload
+};
+
+struct decoder_cache_entry {
+  char name[NAME_MAX + 1];
+  int64_t used;
+  uint64_t size;
+};
+
+static size_t cache_payload_offset(uint32_t name_length) {
+  size_t offset = sizeof(struct decoder_cache_header) + name_length;
+  return (offset + DECODER_CACHE_ALIGN - 1) & ~((size_t) DECODER_CACHE_ALIGN - 1);
+}
+
+static int cache_mkdir(const char *path) {
+  return mkdir(path, 0755) == 0 || errno == EEXIST ? 0 : -1;
+}
+
+static int cache_dir(char *path, size_t size) {
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  int n;
+
+  if (xdg && *xdg) {
+    n = snprintf(path, size, "%s", xdg);
+  } else if (home && *home) {
+    n = snprintf(path, size, "%s/.cache", home);
+  } else {
+    return -1;
+  }
+
+  if (n < 0 || (size_t) n >= size || cache_mkdir(path) != 0) return -1;
+
+  size_t len = n;
+  n = snprintf(path + len, size - len, "/%s", DECODER_CACHE_DIR);
+  if (n < 0 || (size_t) n >= size - len || cache_mkdir(path) != 0) return -1;
+
+  return 0;
+}
+
+// Entries are keyed by absolute path, the same file opened by a relative one hits the same entry
+static const char *cache_name(const decoder_source_t *source, char *buffer) {
+  return realpath(source->name, buffer) ? buffer : source->name;
+}
+
+static int cache_write_all(int fd, const uint8_t *buf, size_t size) {
+  while (size > 0) {
+    ssize_t r = write(fd, buf, size);
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+
+    buf += r;
+    size -= r;
+  }
+
+  return 0;
+}
+
+int decoder_cache_path(char *path, size_t size, const decoder_source_t *source, const char *kind) {
+  if (source->type != DECODER_SOURCE_MMAP || !source->name)
+    return DECODER_UNSUPPORTED;
+
+  char name[PATH_MAX];
+
+  if (cache_dir(path, size) != 0)
+    return DECODER_ERROR;
+
+  size_t len = strlen(path);
+  int n = snprintf(path + len, size - len, "/%08x.%s", djb2_hash(cache_name(source, name)), kind);
+  if (n < 0 || (size_t) n >= size - len)
+    return DECODER_ERROR;
+
+  return DECODER_SUCCESS;
+}
+
+int decoder_cache_map(decoder_cache_mapping_t *mapping, const decoder_source_t *source, const char *kind) {
+  char path[PATH_MAX], name_buffer[PATH_MAX];
+  struct stat st;
+
+  memset(mapping, 0, sizeof(decoder_cache_mapping_t));
+
+  int rc = decoder_cache_path(path, sizeof(path), source, kind);
+  if (rc != DECODER_SUCCESS)
+    return rc;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return DECODER_ERROR;
+
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(struct decoder_cache_header))
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+  if (map == MAP_FAILED) {
+    close(fd);
+    return DECODER_ERROR;
+  }
+
+  const struct decoder_cache_header *header = map;
+  const char *name = cache_name(source, name_buffer);
+  size_t offset = cache_payload_offset(header->name_length);
+
+  // Entry of another file with the same hash, of an older version of this one or a truncated one
+  if (memcmp(header->magic, DECODER_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->size != source->size || header->mtime != source->mtime ||
+      header->name_length != strlen(name) || offset > (size_t) st.st_size ||
+      header->payload_size > (size_t) st.st_size - offset ||
+      memcmp((const char *) map + sizeof(struct decoder_cache_header), name, header->name_length) != 0) {
+    munmap(map, st.st_size);
+    close(fd);
+    return DECODER_ERROR;
+  }
+
+  // Modification time of the entry orders eviction
+  futimens(fd, NULL);
+  close(fd);
+
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  mapping->base = map;
+  mapping->length = st.st_size;
+  mapping->payload = (const uint8_t *) map + offset;
+  mapping->size = header->payload_size;
+
+  return DECODER_SUCCESS;
+}
+
+void decoder_cache_unmap(decoder_cache_mapping_t *mapping) {
+  if (mapping->base) munmap(mapping->base, mapping->length);
+  memset(mapping, 0, sizeof(decoder_cache_mapping_t));
+}
+
+void *decoder_cache_load(const decoder_source_t *source, const char *kind, size_t *size) {
+  decoder_cache_mapping_t mapping;
+
+  if (decoder_cache_map(&mapping, source, kind) != DECODER_SUCCESS)
+    return NULL;
+
+  void *payload = malloc(mapping.size ? mapping.size : 1);
+  if (payload) {
+    memcpy(payload, mapping.payload, mapping.size);
+    *size = mapping.size;
+  }
+
+  decoder_cache_unmap(&mapping);
+  return payload;
+}
+
+int decoder_cache_writer_open(decoder_cache_writer_t *writer, const decoder_source_t *source, const char *kind) {
+  char name_buffer[PATH_MAX];
+  uint8_t padding[DECODER_CACHE_ALIGN] = { 0 };
+
+  writer->fd = -1;
+  writer->payload_size = 0;
+
+  int rc = decoder_cache_path(writer->path, sizeof(writer->path), source, kind);
+  if (rc != DECODER_SUCCESS)
+    return rc;
+
+  const char *name = cache_name(source, name_buffer);
+
+  struct decoder_cache_header header = {
+    .magic = DECODER_CACHE_MAGIC,
+    .size = source->size,
+    .mtime = source->mtime,
+    .name_length = strlen(name),
+  };
+
+  size_t padding_size = cache_payload_offset(header.name_length) - sizeof(header) - header.name_length;
+
+  // Readers see either the old entry or the complete new one
+  snprintf(writer->temp, sizeof(writer->temp), "%s.%d.%u", writer->path, (int) getpid(),
+           atomic_fetch_add_explicit(&cache_writer_serial, 1, memory_order_relaxed));
+
+  writer->fd = open(writer->temp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (writer->fd < 0) return DECODER_ERROR;
+
+  // Payload size is filled in on commit
+  if (cache_write_all(writer->fd, (const uint8_t *) &header, sizeof(header)) != 0 ||
+      cache_write_all(writer->fd, (const uint8_t *) name, header.name_length) != 0 ||
+      cache_write_all(writer->fd, padding, padding_size) != 0) {
+    decoder_cache_writer_abort(writer);
+    return DECODER_ERROR;
+  }
+
+  return DECODER_SUCCESS;
+}
+
+int decoder_cache_writer_append(decoder_cache_writer_t *writer, const void *data, size_t size) {
+  if (writer->fd < 0 || cache_write_all(writer->fd, data, size) != 0)
+    return DECODER_ERROR;
+
+  writer->payload_size += size;
+  return DECODER_SUCCESS;
+}
+
+int decoder_cache_writer_commit(decoder_cache_writer_t *writer) {
+  if (writer->fd < 0)
+    return DECODER_ERROR;
+
+  int ok = pwrite(writer->fd, &writer->payload_size, sizeof(writer->payload_size),
+                  offsetof(struct decoder_cache_header, payload_size)) == sizeof(writer->payload_size);
+
+  if (close(writer->fd) != 0) ok = 0;
+  writer->fd = -1;
+
+  if (!ok || rename(writer->temp, writer->path) != 0) {
+    log_write(MIZAR_LOGLEVEL_WARN, "DECODER", "Unable to write cache entry %s", writer->path);
+    unlink(writer->temp);
+    return DECODER_ERROR;
+  }
+
+  return DECODER_SUCCESS;
+}
+
+void decoder_cache_writer_abort(decoder_cache_writer_t *writer) {
+  if (writer->fd < 0) return;
+
+  close(writer->fd);
+  unlink(writer->temp);
+  writer->fd = -1;
+}
+
+int decoder_cache_store(const decoder_source_t *source, const char *kind, const void *payload, size_t size) {
+  decoder_cache_writer_t writer;
+
+  int rc = decoder_cache_writer_open(&writer, source, kind);
+  if (rc != DECODER_SUCCESS)
+    return rc;
+
+  if (decoder_cache_writer_append(&writer, payload, size) != DECODER_SUCCESS) {
+    decoder_cache_writer_abort(&writer);
+    return DECODER_ERROR;
+  }
+
+  return decoder_cache_writer_commit(&writer);
+}
+
+static int cache_entry_compare(const void *a, const void *b) {
+  int64_t x = ((const struct decoder_cache_entry *) a)->used;
+  int64_t y = ((const struct decoder_cache_entry *) b)->used;
+
+  return (x > y) - (x < y);
+}
+
+uint64_t decoder_cache_trim(const char *kind, uint64_t budget) {
+  char path[PATH_MAX];
+  struct decoder_cache_entry *entries = NULL;
+  size_t count = 0, capacity = 0;
+  uint64_t total = 0;
+
+  if (cache_dir(path, sizeof(path)) != 0) return 0;
+
+  DIR *dir = opendir(path);
+  if (!dir) return 0;
+
+  size_t kind_length = strlen(kind);
+  struct dirent *e;
+  struct stat st;
+
+  while ((e = readdir(dir))) {
+    size_t length = strlen(e->d_name);
+
+    // Unfinished entries end with writer pid and serial and are skipped
+    if (length <= kind_length + 1 || e->d_name[length - kind_length - 1] != '.' ||
+        strcmp(e->d_name + length - kind_length, kind) != 0 ||
+        fstatat(dirfd(dir), e->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+      continue;
+
+    if (count == capacity) {
+      size_t grown = capacity ? capacity * 2 : 64;
+      struct decoder_cache_entry *p = realloc(entries, grown * sizeof(struct decoder_cache_entry));
+      if (!p) break;
+
+      entries = p;
+      capacity = grown;
+    }
+
+    snprintf(entries[count].name, sizeof(entries[count].name), "%s", e->d_name);
+    entries[count].used = (int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    entries[count].size = st.st_size;
+    total += st.st_size;
+    count++;
+  }
+
+  if (total > budget) {
+    qsort(entries, count, sizeof(struct decoder_cache_entry), cache_entry_compare);
+
+    for (size_t i = 0; i < count && total > budget; i++) {
+      if (unlinkat(dirfd(dir), entries[i].name, 0) != 0) continue;
+
+      log_write(MIZAR_LOGLEVEL_DEBUG, "DECODER", "Evicted cache entry %s, %llu bytes",
+        entries[i].name, (unsigned long long) entries[i].size);
+      total -= entries[i].size;
+    }
+  }
+
+  closedir(dir);
+  free(entries);
+
+  return total;
+}
\ No newline at end of file
@@ -0,0 +1,131 @@
+#ifndef _H_DECODER_CACHE_
+#define _H_DECODER_CACHE_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "decoder/source.h"
+
+#define DECODER_CACHE_DIR "mizar"
+
+// Payload offset in entry files, mapped payloads can be read as any sample type
+#define DECODER_CACHE_ALIGN 16
+
+// Entry path buffer size, PATH_MAX isn't visible to plain C11 includers
+#define DECODER_CACHE_PATH_SIZE 4096
+
+/*
+  Data derived from a file, kept between runs in $XDG_CACHE_HOME/mizar (~/.cache/mizar).
+  Entries are named by a hash of the file path and carry its size and modification time,
+  an entry of a changed file is treated as missing. Only mapped file sources are cached.
+*/
+
+typedef struct {
+  void *base;
+  size_t length;
+
+  const uint8_t *payload;
+  size_t size;
+} decoder_cache_mapping_t;
+
+typedef struct {
+  int fd;
+  uint64_t payload_size;
+  char path[DECODER_CACHE_PATH_SIZE];
+  char temp[DECODER_CACHE_PATH_SIZE + 32];
+} decoder_cache_writer_t;
+
+/**
+ * Build cache entry path for the source, creating cache directory when needed
+ *
+ * @param path Buffer for the entry path
+ * @param size Buffer size
+ * @param source Mapped file source
+ * @param kind Entry kind, used as file extension
+ * @return DECODER_SUCCESS, DECODER_UNSUPPORTED for sources that aren't cached or DECODER_ERROR
+ */
+int decoder_cache_path(char *path, size_t size, const decoder_source_t *source, const char *kind);
+
+/**
+ * Load cache entry of the source
+ *
+ * @param source Mapped file source
+ * @param kind Entry kind
+ * @param size Payload size is written here
+ * @return Payload to be released with free or NULL if entry is missing or stale
+ */
+void *decoder_cache_load(const decoder_source_t *source, const char *kind, size_t *size);
+
+/**
+ * Store cache entry of the source. Entry is replaced atomically
+ *
+ * @param source Mapped file source
+ * @param kind Entry kind
+ * @param payload Data to be stored
+ * @param size Payload size
+ * @return DECODER_SUCCESS or error code
+ */
+int decoder_cache_store(const decoder_source_t *source, const char *kind, const void *payload, size_t size);
+
+/**
+ * Map cache entry of the source read only. Entry is marked as recently used
+ *
+ * @param mapping Mapping to be filled
+ * @param source Mapped file source
+ * @param kind Entry kind
+ * @return DECODER_SUCCESS, DECODER_UNSUPPORTED or DECODER_ERROR if entry is missing or stale
+ */
+int decoder_cache_map(decoder_cache_mapping_t *mapping, const decoder_source_t *source, const char *kind);
+
+/**
+ * Release entry mapping
+ *
+ * @param mapping Mapping filled by decoder_cache_map
+ */
+void decoder_cache_unmap(decoder_cache_mapping_t *mapping);
+
+/**
+ * Start writing cache entry of the source. Payload is appended piece by piece and becomes
+ * visible to readers only on commit
+ *
+ * @param writer Writer to be opened
+ * @param source Mapped file source
+ * @param kind Entry kind
+ * @return DECODER_SUCCESS or error code
+ */
+int decoder_cache_writer_open(decoder_cache_writer_t *writer, const decoder_source_t *source, const char *kind);
+
+/**
+ * Append to the payload
+ *
+ * @param writer Opened writer
+ * @param data Payload piece
+ * @param size Piece size
+ * @return DECODER_SUCCESS or DECODER_ERROR
+ */
+int decoder_cache_writer_append(decoder_cache_writer_t *writer, const void *data, size_t size);
+
+/**
+ * Finish the entry and replace the old one atomically
+ *
+ * @param writer Opened writer, closed on return
+ * @return DECODER_SUCCESS or DECODER_ERROR
+ */
+int decoder_cache_writer_commit(decoder_cache_writer_t *writer);
+
+/**
+ * Drop unfinished entry
+ *
+ * @param writer Opened writer, closed on return
+ */
+void decoder_cache_writer_abort(decoder_cache_writer_t *writer);
+
+/**
+ * Remove least recently used entries of a kind until they fit into the budget
+ *
+ * @param kind Entry kind
+ * @param budget Total size of entries in bytes
+ * @return Number of bytes left in entries of the kind
+ */
+uint64_t decoder_cache_trim(const char *kind, uint64_t budget);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include "pcm_conv.h"
+#include "logging.h"
+#include "util/math.h"
+#include "decoder/decoder.h"
+#include "decoder/decoder_impl.h"
+#include "decoder/pcm_cache.h"
+
+#define DECODER_PLANAR_CHUNK_FRAMES 256
+
+typedef struct {
+  const decoder_ops_t *ops;
+  const decoder_info_t *info;
+} decoder_entry_t;
+
+// Order matters: decoders with strong magic bytes go first,
+// mp3 frame sync is weak and is probed last
+static const decoder_entry_t decoders[] = {
+  { &decoder_flac, &decoder_flac_info },
+  { &decoder_wav,  &decoder_wav_info  },
+  { &decoder_mp3,  &decoder_mp3_info  },
+};
+
+#define DECODERS_COUNT (sizeof(decoders) / sizeof(decoders[0]))
+
+static int list_contains(const char *const *list, const char *value) {
+  if (!list || !value) return 0;
+
+  for (; *list; list++) {
+    if (strcasecmp(*list, value) == 0) return 1;
+  }
+
+  return 0;
+}
+
+static const char *path_ext(const char *path) {
+  const char *dot = strrchr(path, '.');
+  const char *slash = strrchr(path, '/');
+
+  if (!dot || (slash && dot < slash)) return NULL;
+
+  return dot + 1;
+}
+
+static void decoder_use(decoder_t *decoder, const decoder_entry_t *entry) {
+  decoder->ops = *entry->ops;
+  decoder->info = entry->info;
+  decoder->data.af = 0;
+  decoder->data.priv = NULL;
+}
+
+// Mapped and memory sources are probed in place, callback ones are read and rewound
+static size_t source_header(decoder_source_t *source, uint8_t *header, size_t size) {
+  if (source->data) {
+    size = min(size, source->size);
+    memcpy(header, source->data, size);
+    return size;
+  }
+
+  size = decoder_source_read(source, header, size);
+  if (!decoder_source_seek(source, 0, DECODER_SEEK_START)) return 0;
+
+  return size;
+}
+
+int decoder_find(decoder_t *decoder, decoder_source_t *source, const char *mime) {
+  if (!decoder || !source)
+    return DECODER_INVALIDPARAM;
+
+  uint8_t header[DECODER_PROBE_SIZE];
+  size_t header_size = source_header(source, header, sizeof(header));
+
+  for (size_t i = 0; i < DECODERS_COUNT && header_size > 0; i++) {
+    if (decoders[i].ops->probe && decoders[i].ops->probe(header, header_size)) {
+      decoder_use(decoder, &decoders[i]);
+      return DECODER_SUCCESS;
+    }
+  }
+
+  const char *ext = source->name ? path_ext(source->name) : NULL;
+
+  for (size_t i = 0; i < DECODERS_COUNT; i++) {
+    if (list_contains(decoders[i].info->ext, ext)) {
+      decoder_use(decoder, &decoders[i]);
+      return DECODER_SUCCESS;
+    }
+  }
+
+  for (size_t i = 0; i < DECODERS_COUNT; i++) {
+    if (list_contains(decoders[i].info->mime, mime)) {
+      decoder_use(decoder, &decoders[i]);
+      return DECODER_SUCCESS;
+    }
+  }
+
+  return DECODER_UNSUPPORTED;
+}
+
+static int decoder_open_internal(decoder_t *decoder, const char *mime) {
+  decoder_source_t *source = &decoder->source;
+
+  // Replay of a cached file skips decoding
+  if (decoder_pcm_cache_open(decoder) == DECODER_SUCCESS) {
+    log_write(MIZAR_LOGLEVEL_DEBUG, "DECODER", "Opened %s from decoded cache, %u Hz, %u channels",
+      source->name, af_get_rate(decoder->data.af), af_get_channels(decoder->data.af));
+    return DECODER_SUCCESS;
+  }
+
+  int rc = decoder_find(decoder, source, mime);
+  if (rc != DECODER_SUCCESS) {
+    log_write(MIZAR_LOGLEVEL_WARN, "DECODER", "No decoder found for %s", source->name);
+    return rc;
+  }
+
+  decoder->data.source = source;
+
+  rc = decoder->ops.open(&decoder->data, source);
+  if (rc != DECODER_SUCCESS) {
+    log_write(MIZAR_LOGLEVEL_WARN, "DECODER", "Unable to open %s with %s decoder", source->name, decoder->info->name);
+    return rc;
+  }
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "DECODER", "Opened %s with %s (%s), %u Hz, %u channels",
+    source->name, decoder->info->name, decoder->info->impl,
+    af_get_rate(decoder->data.af), af_get_channels(decoder->data.af));
+
+  decoder_pcm_cache_record(decoder);
+
+  return DECODER_SUCCESS;
+}
+
+int decoder_open(decoder_t *decoder, const char *path, const char *mime) {
+  if (!decoder || !path)
+    return DECODER_INVALIDPARAM;
+
+  if (decoder_source_open_file(&decoder->source, path) != DECODER_SUCCESS) {
+    log_write(MIZAR_LOGLEVEL_WARN, "DECODER", "Unable to open %s", path);
+    return DECODER_ERROR;
+  }
+
+  int rc = decoder_open_internal(decoder, mime);
+  if (rc != DECODER_SUCCESS) decoder_source_close(&decoder->source);
+
+  return rc;
+}
+
+int decoder_open_source(decoder_t *decoder, const decoder_source_t *source, const char *mime) {
+  if (!decoder || !source || source->type == DECODER_SOURCE_NONE)
+    return DECODER_INVALIDPARAM;
+
+  decoder->source = *source;
+
+  int rc = decoder_open_internal(decoder, mime);
+  if (rc != DECODER_SUCCESS) decoder_source_close(&decoder->source);
+
+  return rc;
+}
+
+int decoder_close(decoder_t *decoder) {
+  if (!decoder)
+    return DECODER_INVALIDPARAM;
+
+  int rc = decoder->ops.close(&decoder->data);
+  decoder->data.priv = NULL;
+  decoder->data.source = NULL;
+
+  decoder_source_close(&decoder->source);
+
+  return rc == 0 ? DECODER_SUCCESS : DECODER_ERROR;
+}
+
+size_t decoder_read_planar(void *handle, decoder_read_interleaved_t read, uint8_t channels, float **buffer, size_t frames) {
+  if (channels == 0 || channels > DECODER_MAX_CHANNELS)
+    return 0;
+
+  float chunk[DECODER_PLANAR_CHUNK_FRAMES * DECODER_MAX_CHANNELS];
+  float *dst[DECODER_MAX_CHANNELS];
+  size_t total = 0;
+
+  while (total < frames) {
+    size_t count = read(handle, chunk, min(frames - total, DECODER_PLANAR_CHUNK_FRAMES));
+    if (count == 0) break;
+
+    for (uint8_t ch = 0; ch < channels; ch++) dst[ch] = buffer[ch] + total;
+    pcm_deinterleave_float(dst, chunk, channels, count);
+
+    total += count;
+  }
+
+  return total;
+}
\ No newline at end of file
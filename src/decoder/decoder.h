@@ -4,9 +4,21 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include "pcm.h"
+#include "decoder/source.h"
+
+#define DECODER_SUCCESS 0
+#define DECODER_INVALIDPARAM -1
+#define DECODER_ERROR -2
+#define DECODER_UNSUPPORTED -3
+
+#define DECODER_MAX_CHANNELS 8
+
+// Number of header bytes inspected by probe functions
+#define DECODER_PROBE_SIZE 64
 
 typedef struct {
   audio_format_t af;
+  decoder_source_t *source; // stream being decoded, valid until close
   void *priv;
 } decoder_data_t;
 
@@ -17,16 +29,27 @@ typedef struct {
   // This arrays must ends with NULL pointer
   const char *const* ext;
   const char *const* mime;
+
+  // Decoding costs enough to keep decoded frames in the cache, see decoder/pcm_cache.h
+  int cacheable;
 } decoder_info_t;
 
 typedef struct {
-  int (*open)(decoder_data_t *data);
+  // Returns non zero if header looks like a stream this decoder understands
+  int (*probe)(const uint8_t *header, size_t size);
+
+  int (*open)(decoder_data_t *data, decoder_source_t *source);
   int (*close)(decoder_data_t *data);
 
   size_t (*read_s16)(decoder_data_t *data, uint8_t *buffer, size_t frames);
+  // Decode straight to float. With planes == 1 samples are interleaved into buffer[0],
+  // with planes == channels every channel is written to its own buffer.
+  size_t (*read_f32)(decoder_data_t *data, float **buffer, uint8_t planes, size_t frames);
   int (*seek)(decoder_data_t *data, long offset);
 
   long (*duration)(decoder_data_t *data);
+  // Total number of PCM frames, 0 when unknown
+  uint64_t (*length)(decoder_data_t *data);
   long (*bitrate)(decoder_data_t *data);
   long (*bitrate_current)(decoder_data_t *data);
 } decoder_ops_t;
@@ -34,15 +57,72 @@ typedef struct {
 typedef struct {
   decoder_data_t data;
   decoder_ops_t ops;
+  const decoder_info_t *info;
+  decoder_source_t source;
 } decoder_t;
 
+typedef size_t (*decoder_read_interleaved_t)(void *handle, float *buffer, size_t frames);
+
+/**
+ * Find decoder for the source. Stream header is probed first, then extension of the source name and mime type
+ *
+ * @param decoder Decoder to be filled with found ops and info
+ * @param source Opened source, callback sources are rewound after probing
+ * @param mime Mime type hint, may be NULL
+ * @return DECODER_SUCCESS or DECODER_UNSUPPORTED if no decoder matches
+ */
+int decoder_find(decoder_t *decoder, decoder_source_t *source, const char *mime);
+
+/**
+ * Map the file, find decoder for it and open it
+ *
+ * @param decoder Decoder to be opened
+ * @param path Path to the file
+ * @param mime Mime type hint, may be NULL
+ * @return DECODER_SUCCESS or error code
+ */
+int decoder_open(decoder_t *decoder, const char *path, const char *mime);
+
+/**
+ * Find decoder for the source and open it. Source is copied into the decoder
+ *
+ * @param decoder Decoder to be opened
+ * @param source Memory or callback source, see decoder/source.h
+ * @param mime Mime type hint, may be NULL
+ * @return DECODER_SUCCESS or error code
+ */
+int decoder_open_source(decoder_t *decoder, const decoder_source_t *source, const char *mime);
+
+/**
+ * Close decoder and release its source
+ *
+ * @param decoder Opened decoder
+ * @return DECODER_SUCCESS or error code
+ */
+int decoder_close(decoder_t *decoder);
+
+/**
+ * Split output of an interleaved float reader into planar buffers
+ *
+ * @param handle Reader specific handle
+ * @param read Interleaved float reader
+ * @param channels Number of channels in the stream
+ * @param buffer Array of channel buffers
+ * @param frames Maximum number of frames to read
+ * @return Number of frames read
+ */
+size_t decoder_read_planar(void *handle, decoder_read_interleaved_t read, uint8_t channels, float **buffer, size_t frames);
+
 
 
-#define decoder_set(dst,src)  ((decoder_ops_t*)(dst))->open            = ((decoder_ops_t*)(src))->open,\
+#define decoder_set(dst,src)  ((decoder_ops_t*)(dst))->probe           = ((decoder_ops_t*)(src))->probe,\
+                              ((decoder_ops_t*)(dst))->open            = ((decoder_ops_t*)(src))->open,\
                               ((decoder_ops_t*)(dst))->close           = ((decoder_ops_t*)(src))->close,\
                               ((decoder_ops_t*)(dst))->read_s16        = ((decoder_ops_t*)(src))->read_s16,\
+                              ((decoder_ops_t*)(dst))->read_f32        = ((decoder_ops_t*)(src))->read_f32,\
                               ((decoder_ops_t*)(dst))->seek            = ((decoder_ops_t*)(src))->seek,\
                               ((decoder_ops_t*)(dst))->duration        = ((decoder_ops_t*)(src))->duration,\
+                              ((decoder_ops_t*)(dst))->length          = ((decoder_ops_t*)(src))->length,\
                               ((decoder_ops_t*)(dst))->bitrate         = ((decoder_ops_t*)(src))->bitrate,\
                               ((decoder_ops_t*)(dst))->bitrate_current = ((decoder_ops_t*)(src))->bitrate_current;
 
@@ -3,7 +3,13 @@
 
 #include "decoder/decoder.h"
 
-const decoder_ops_t decoder_mp3;
-const decoder_info_t decoder_mp3_info;
+extern const decoder_ops_t decoder_mp3;
+extern const decoder_info_t decoder_mp3_info;
+
+extern const decoder_ops_t decoder_flac;
+extern const decoder_info_t decoder_flac_info;
+
+extern const decoder_ops_t decoder_wav;
+extern const decoder_info_t decoder_wav_info;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "pcm.h"
+#include "util/mem.h"
+#include "decoder/decoder_impl.h"
+
+#define DR_FLAC_IMPLEMENTATION
+#include "decoder/dr_libs/dr_flac.h"
+
+struct flac_decoder {
+  drflac *flac;
+  long bitrate;
+};
+
+static int decoder_flac_probe(const uint8_t *header, size_t size) {
+  if (size >= 4 && memcmp(header, "fLaC", 4) == 0) return 1;
+
+  // FLAC stream inside Ogg container: first page carries "\x7fFLAC" packet
+  return size >= 33 && memcmp(header, "OggS", 4) == 0 && memcmp(header + 28, "\x7f" "FLAC", 5) == 0;
+}
+
+static drflac_bool32 flac_seek(void *source, int offset, drflac_seek_origin origin) {
+  return decoder_source_seek(source, offset, origin == drflac_seek_origin_start ? DECODER_SEEK_START : DECODER_SEEK_CURRENT);
+}
+
+int decoder_flac_open(decoder_data_t *data, decoder_source_t *source) {
+  struct flac_decoder *dec = zalloc(sizeof(struct flac_decoder));
+  if (!dec) return DECODER_ERROR;
+
+  if (source->data)
+    dec->flac = drflac_open_memory(source->data, source->size);
+  else
+    dec->flac = drflac_open(decoder_source_read, flac_seek, source);
+  if (!dec->flac) {
+    free(dec);
+    data->priv = NULL;
+    return DECODER_ERROR;
+  }
+
+  drflac *flac = dec->flac;
+  data->af = af_endian(0) | af_format(SF_FORMAT_S16) | af_rate(flac->sampleRate) | af_channels(flac->channels);
+  data->priv = dec;
+
+  // Callback sources may not know their size
+  if (source->size > 0 && flac->totalPCMFrameCount > 0)
+    dec->bitrate = (long) (source->size * 8 * flac->sampleRate / flac->totalPCMFrameCount);
+
+  return DECODER_SUCCESS;
+}
+
+int decoder_flac_close(decoder_data_t *data) {
+  struct flac_decoder *dec = data->priv;
+
+  drflac_close(dec->flac);
+  free(data->priv);
+
+  return 0;
+}
+
+size_t decoder_flac_read_s16(decoder_data_t *data, uint8_t *buffer, size_t frames) {
+  struct flac_decoder *dec = data->priv;
+
+  return drflac_read_pcm_frames_s16(dec->flac, frames, (drflac_int16*) buffer);
+}
+
+static size_t flac_read_interleaved(void *handle, float *buffer, size_t frames) {
+  return drflac_read_pcm_frames_f32(handle, frames, buffer);
+}
+
+size_t decoder_flac_read_f32(decoder_data_t *data, float **buffer, uint8_t planes, size_t frames) {
+  struct flac_decoder *dec = data->priv;
+  drflac *flac = dec->flac;
+
+  if (planes == 1)
+    return drflac_read_pcm_frames_f32(flac, frames, buffer[0]);
+
+  if (planes != flac->channels)
+    return 0;
+
+  return decoder_read_planar(flac, flac_read_interleaved, planes, buffer, frames);
+}
+
+int decoder_flac_seek(decoder_data_t *data, long offset) {
+  struct flac_decoder *dec = data->priv;
+
+  int r = drflac_seek_to_pcm_frame(dec->flac, (drflac_uint64) af_get_rate(data->af) * offset / 1000);
+
+  return r;
+}
+
+long decoder_flac_duration(decoder_data_t *data) {
+  struct flac_decoder *dec = data->priv;
+
+  return dec->flac->totalPCMFrameCount / af_get_rate(data->af);
+}
+
+uint64_t decoder_flac_length(decoder_data_t *data) {
+  struct flac_decoder *dec = data->priv;
+
+  return dec->flac->totalPCMFrameCount;
+}
+
+long decoder_flac_bitrate(decoder_data_t *data) {
+  struct flac_decoder *dec = data->priv;
+  return dec->bitrate;
+}
+
+long decoder_flac_bitrate_current(decoder_data_t *data) {
+  return decoder_flac_bitrate(data);
+}
+
+
+static const char *const flac_ext[]  = { "flac", "fla", "oga", NULL };
+static const char *const flac_mime[] = { "audio/flac", "audio/x-flac", NULL };
+
+const decoder_ops_t decoder_flac = {
+  .probe = decoder_flac_probe,
+  .open = decoder_flac_open,
+  .close = decoder_flac_close,
+
+  .read_s16 = decoder_flac_read_s16,
+  .read_f32 = decoder_flac_read_f32,
+  .seek = decoder_flac_seek,
+
+  .duration = decoder_flac_duration,
+  .length = decoder_flac_length,
+  .bitrate = decoder_flac_bitrate,
+  .bitrate_current = decoder_flac_bitrate_current
+};
+
+const decoder_info_t decoder_flac_info = {
+    .name = "flac",
+    .impl = "dr_flac",
+    .ext = flac_ext,
+    .mime = flac_mime,
+    .cacheable = 1
+  };
\ No newline at end of file
@@ -1,57 +1,448 @@
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include "pcm.h"
+#include "logging.h"
 #include "util/mem.h"
+#include "util/math.h"
 #include "decoder/decoder_impl.h"
+#include "decoder/cache.h"
 
 #define DR_MP3_IMPLEMENTATION
 #include "decoder/dr_libs/dr_mp3.h"
 
-int decoder_mp3_open(decoder_data_t *data) {
-  drmp3 *mp3 = pmalloc(sizeof(drmp3));
-  data->af = af_endian(0) | af_format(SF_FORMAT_S16) | af_rate(44100) | af_channels(2);
-  data->priv = mp3;
+// One seek point per second bounds any seek to a second of decoding
+#define MP3_SEEK_POINT_SECONDS 1
+#define MP3_SEEK_POINTS_MAX (1 << 20)
+#define MP3_SEEK_CACHE_KIND "mp3seek"
 
-  int r = drmp3_init_file(mp3, "test6.mp3", NULL);
+// Frames decoded ahead of a seek point before its samples are exact: synthesis filters carry
+// state over from the last ones, those in turn need their bit reservoir of up to 511 bytes filled
+#define MP3_SEEK_SYNTHESIS_FRAMES 3
+#define MP3_SEEK_RESERVOIR_BYTES 511
+#define MP3_SEEK_PRIMING_MAX 64
 
-  return r;
+// Layout of cached seek tables, older entries are scanned again
+#define MP3_SEEK_CACHE_VERSION 1
+
+// Frames of delay added by the decoder itself, on top of the encoder delay of the LAME tag
+#define MP3_DECODER_DELAY 529
+
+// Bytes read from the first frame, enough for the Xing and LAME tags
+#define MP3_TAG_SIZE 256
+
+struct mp3_decoder {
+  drmp3 mp3;
+
+  drmp3_seek_point *seek_points;
+  uint32_t seek_point_count;
+  uint64_t frames; // total PCM frames, 0 when unknown
+
+  // Gapless stream: Info frame and delays are skipped, padding is cut off
+  uint64_t skip;     // decoded frames in front of the first played one
+  uint64_t playable; // played frames, 0 when unknown
+  uint64_t position; // played frames read so far
+};
+
+// Cached seek table: total frames, point count and the points themselves
+struct mp3_seek_cache {
+  uint64_t frames;
+  uint32_t count;
+  uint32_t version;
+  drmp3_seek_point points[];
+};
+
+static int decoder_mp3_probe(const uint8_t *header, size_t size) {
+  if (size >= 3 && memcmp(header, "ID3", 3) == 0) return 1;
+
+  // MPEG audio frame sync with valid version, layer and bitrate fields
+  return size >= 4 && header[0] == 0xff && (header[1] & 0xe0) == 0xe0
+    && (header[1] & 0x18) != 0x08 && (header[1] & 0x06) != 0x00
+    && (header[2] & 0xf0) != 0xf0;
+}
+
+static drmp3_bool32 mp3_seek(void *source, int offset, drmp3_seek_origin origin) {
+  return decoder_source_seek(source, offset, origin == drmp3_seek_origin_start ? DECODER_SEEK_START : DECODER_SEEK_CURRENT);
+}
+
+static drmp3_bool32 mp3_init(drmp3 *mp3, decoder_source_t *source) {
+  if (source->data)
+    return drmp3_init_memory(mp3, source->data, source->size, NULL);
+
+  return drmp3_init(mp3, decoder_source_read, mp3_seek, source, NULL);
+}
+
+static int mp3_read_at(decoder_source_t *source, size_t offset, uint8_t *buffer, size_t size) {
+  if (source->data) {
+    if (offset + size > source->size) return 0;
+    memcpy(buffer, source->data + offset, size);
+    return 1;
+  }
+
+  // Callback source is rewound for dr_mp3 afterwards
+  int ok = decoder_source_seek(source, (int) offset, DECODER_SEEK_START) &&
+    decoder_source_read(source, buffer, size) == size;
+
+  decoder_source_seek(source, 0, DECODER_SEEK_START);
+  return ok;
+}
+
+static uint32_t mp3_be32(const uint8_t *p) {
+  return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+// Xing or Info frame written by encoders in front of the stream, with encoder delay and
+// padding in the LAME tag that follows it, see http://gabriel.mp3-tech.org/mp3infotag.html
+static void mp3_gapless(struct mp3_decoder *dec, decoder_source_t *source) {
+  uint8_t tag[MP3_TAG_SIZE];
+  size_t offset = 0;
+
+  if (!mp3_read_at(source, 0, tag, 10)) return;
+
+  // ID3v2 tag size is syncsafe, footer adds another 10 bytes
+  if (memcmp(tag, "ID3", 3) == 0)
+    offset = 10 + ((tag[6] & 0x7f) << 21 | (tag[7] & 0x7f) << 14 | (tag[8] & 0x7f) << 7 | (tag[9] & 0x7f)) + (tag[5] & 0x10 ? 10 : 0);
+
+  if (!mp3_read_at(source, offset, tag, sizeof(tag))) return;
+
+  // Layer III frame header only
+  if (tag[0] != 0xff || (tag[1] & 0xe0) != 0xe0 || (tag[1] & 0x06) != 0x02) return;
+
+  int mpeg1 = (tag[1] & 0x18) == 0x18;
+  int mono = (tag[3] >> 6) == 3;
+  uint32_t frame_samples = mpeg1 ? 1152 : 576;
+  const uint8_t *xing = tag + 4 + (mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+
+  if (memcmp(xing, "Xing", 4) != 0 && memcmp(xing, "Info", 4) != 0) return;
+
+  uint32_t flags = mp3_be32(xing + 4);
+  uint64_t frames = flags & 0x1 ? mp3_be32(xing + 8) : 0;
+  const uint8_t *lame = xing + 8 + (flags & 0x1 ? 4 : 0) + (flags & 0x2 ? 4 : 0) + (flags & 0x4 ? 100 : 0) + (flags & 0x8 ? 4 : 0);
+
+  // Info frame decodes to silence
+  dec->skip = frame_samples;
+  dec->playable = frames * frame_samples;
+
+  uint32_t delay = 0, padding = 0;
+
+  if (lame + 24 <= tag + sizeof(tag) && lame[0] != 0) {
+    delay = lame[21] << 4 | lame[22] >> 4;
+    padding = (lame[22] & 0x0f) << 8 | lame[23];
+    dec->skip += delay + MP3_DECODER_DELAY;
+  }
+
+  if (dec->playable > delay + padding) dec->playable -= delay + padding;
+  else dec->playable = 0;
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "MP3", "Gapless info of %s: %llu frames, delay %u, padding %u", source->name,
+    (unsigned long long) dec->playable, delay, padding);
+}
+
+static int mp3_seek_table_load(struct mp3_decoder *dec, decoder_source_t *source) {
+  size_t size;
+  struct mp3_seek_cache *cache = decoder_cache_load(source, MP3_SEEK_CACHE_KIND, &size);
+  if (!cache) return 0;
+
+  if (size < sizeof(struct mp3_seek_cache) || cache->frames == 0 || cache->version != MP3_SEEK_CACHE_VERSION ||
+      size != sizeof(struct mp3_seek_cache) + (size_t) cache->count * sizeof(drmp3_seek_point) ||
+      (cache->count && !(dec->seek_points = malloc((size_t) cache->count * sizeof(drmp3_seek_point))))) {
+    free(cache);
+    return 0;
+  }
+
+  if (cache->count) memcpy(dec->seek_points, cache->points, (size_t) cache->count * sizeof(drmp3_seek_point));
+  dec->seek_point_count = cache->count;
+  dec->frames = cache->frames;
+
+  free(cache);
+  return 1;
+}
+
+static void mp3_seek_table_store(struct mp3_decoder *dec, decoder_source_t *source) {
+  size_t size = sizeof(struct mp3_seek_cache) + (size_t) dec->seek_point_count * sizeof(drmp3_seek_point);
+  struct mp3_seek_cache *cache = zalloc(size);
+  if (!cache) return;
+
+  cache->frames = dec->frames;
+  cache->count = dec->seek_point_count;
+  cache->version = MP3_SEEK_CACHE_VERSION;
+  memcpy(cache->points, dec->seek_points, (size_t) dec->seek_point_count * sizeof(drmp3_seek_point));
+
+  decoder_cache_store(source, MP3_SEEK_CACHE_KIND, cache, size);
+  free(cache);
+}
+
+static int mp3_seek_point_add(struct mp3_decoder *dec, uint32_t *capacity, uint64_t position, uint64_t frame, uint32_t priming) {
+  if (dec->seek_point_count == *capacity) {
+    uint32_t grown = *capacity ? *capacity * 2 : 64;
+    drmp3_seek_point *points = realloc(dec->seek_points, (size_t) grown * sizeof(drmp3_seek_point));
+    if (!points) return 0;
+
+    dec->seek_points = points;
+    *capacity = grown;
+  }
+
+  dec->seek_points[dec->seek_point_count++] = (drmp3_seek_point) {
+    .seekPosInBytes = position,
+    .pcmFrameIndex = frame,
+    .mp3FramesToDiscard = priming,
+  };
+
+  return 1;
+}
+
+// Stream read frame by frame with mp3_frame_next
+struct mp3_frame {
+  uint64_t position;   // byte offset of the frame just decoded
+  uint32_t main_data;  // bytes of it that go to the bit reservoir
+  uint64_t pcm_frames; // PCM frames decoded since the restart
+  float fraction;
+};
+
+#ifndef DRMP3_VERSION_MAJOR
+/*
+  The only code relying on dr_mp3 internals, those of 0.4.6 which doesn't define DRMP3_VERSION_* yet.
+  Its seek tables decode the frames in front of a point without synthesis, which leaves the bit
+  reservoir empty, and low bitrate frames after the point fail to decode and are skipped without
+  being counted. Here every priming frame is decoded in full.
+
+  Decodes the next frame and drops its samples. When restart isn't NULL the decoder is reset first
+  and reading starts over at its byte position, with PCM frame position of the stream at its index
+*/
+static uint32_t mp3_frame_next(drmp3 *mp3, const drmp3_seek_point *restart, int synthesize, struct mp3_frame *frame) {
+  if (restart) {
+    if (!drmp3__on_seek_64(mp3, restart->seekPosInBytes, drmp3_seek_origin_start))
+      return 0;
+
+    drmp3_reset(mp3);
+    mp3->currentPCMFrame = restart->pcmFrameIndex;
+    memset(frame, 0, sizeof(struct mp3_frame));
+  }
+
+  frame->position = mp3->streamCursor - mp3->dataSize;
+
+  uint32_t count = drmp3_decode_next_frame_ex(mp3, synthesize ? (drmp3d_sample_t *) mp3->pcmFrames : NULL, DRMP3_TRUE);
+  if (count == 0) return 0;
+
+  mp3->pcmFramesConsumedInMP3Frame += mp3->pcmFramesRemainingInMP3Frame;
+  mp3->pcmFramesRemainingInMP3Frame = 0;
+
+  const uint8_t *h = mp3->decoder.header;
+  uint64_t bytes = mp3->streamCursor - mp3->dataSize - frame->position;
+  uint32_t side = DRMP3_HDR_TEST_MPEG1(h) ? (DRMP3_HDR_IS_MONO(h) ? 17 : 32) : (DRMP3_HDR_IS_MONO(h) ? 9 : 17);
+  uint32_t overhead = DRMP3_HDR_SIZE + (DRMP3_HDR_IS_CRC(h) ? 2 : 0) + side;
+
+  frame->main_data = bytes > overhead ? min(bytes - overhead, (uint64_t) DRMP3_MAX_BITRESERVOIR_BYTES) : 0;
+  drmp3__accumulate_running_pcm_frame_count(mp3, count, &frame->pcm_frames, &frame->fraction);
+
+  return count;
+}
+#else
+// Later versions are only seeked through their public API, streams aren't indexed
+static uint32_t mp3_frame_next(drmp3 *mp3, const drmp3_seek_point *restart, int synthesize, struct mp3_frame *frame) {
+  return 0;
+}
+#endif
+
+// Frames to decode in front of frame i, main data sizes of the frames before it are kept in a ring
+static uint32_t mp3_seek_priming(const uint16_t *main_data, uint64_t i) {
+  uint32_t priming = 0, bytes = 0;
+
+  while (priming < min(i, (uint64_t) MP3_SEEK_PRIMING_MAX) &&
+         (priming < MP3_SEEK_SYNTHESIS_FRAMES || bytes < MP3_SEEK_RESERVOIR_BYTES)) {
+    priming++;
+    if (priming > MP3_SEEK_SYNTHESIS_FRAMES) bytes += main_data[(i - priming) % MP3_SEEK_PRIMING_MAX];
+  }
+
+  return priming;
+}
+
+// Stream is scanned once per file, later opens read the table from cache. A point is the first
+// sample of a frame and keeps the position of the frames that prime the decoder for it
+static int mp3_seek_table_calculate(struct mp3_decoder *dec) {
+  drmp3 *mp3 = &dec->mp3;
+  const drmp3_seek_point start = { 0 };
+  struct mp3_frame frame;
+  uint64_t positions[MP3_SEEK_PRIMING_MAX];
+  uint16_t main_data[MP3_SEEK_PRIMING_MAX];
+  uint32_t capacity = 0;
+
+  if (mp3->sampleRate == 0) return 0;
+
+  uint64_t interval = (uint64_t) mp3->sampleRate * MP3_SEEK_POINT_SECONDS, next = interval;
+
+  for (uint64_t i = 0;; i++) {
+    uint64_t frames = i ? frame.pcm_frames : 0;
+    if (mp3_frame_next(mp3, i ? NULL : &start, 0, &frame) == 0) break;
+
+    if (frames >= next && dec->seek_point_count < MP3_SEEK_POINTS_MAX) {
+      uint32_t priming = mp3_seek_priming(main_data, i);
+
+      if (!mp3_seek_point_add(dec, &capacity, positions[(i - priming) % MP3_SEEK_PRIMING_MAX], frames, priming)) break;
+      next = frames + interval;
+    }
+
+    positions[i % MP3_SEEK_PRIMING_MAX] = frame.position;
+    main_data[i % MP3_SEEK_PRIMING_MAX] = frame.main_data;
+    dec->frames = frame.pcm_frames;
+  }
+
+  drmp3_seek_to_start_of_stream(mp3);
+
+  // Streams up to a second long have no points, seeks decode from the start
+  return dec->frames > 0;
+}
+
+// Priming frames in front of the point are decoded and dropped, the rest is read up to the frame
+static int mp3_seek_frame(struct mp3_decoder *dec, uint64_t frame) {
+  drmp3 *mp3 = &dec->mp3;
+  const drmp3_seek_point *point = NULL;
+  struct mp3_frame primed;
+  uint32_t lo = 0, hi = dec->seek_point_count;
+
+  // Last point at or before the frame
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (dec->seek_points[mid].pcmFrameIndex <= frame) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo > 0) point = &dec->seek_points[lo - 1];
+
+  // Decoding on from the current position is no slower than from the point
+  if (point && point->mp3FramesToDiscard > 0 && !(frame >= mp3->currentPCMFrame && mp3->currentPCMFrame >= point->pcmFrameIndex)) {
+    for (uint16_t i = 0; i < point->mp3FramesToDiscard; i++) {
+      if (mp3_frame_next(mp3, i == 0 ? point : NULL, 1, &primed) == 0)
+        return 0;
+    }
+  }
+
+  return drmp3_seek_to_pcm_frame(mp3, frame);
+}
+
+static void mp3_seek_table(struct mp3_decoder *dec, decoder_source_t *source) {
+  // Endless callback streams have nothing to index
+  if (!source->data && source->size == 0) return;
+
+  int cached = mp3_seek_table_load(dec, source);
+
+  if (!cached && !mp3_seek_table_calculate(dec)) {
+    log_write(MIZAR_LOGLEVEL_WARN, "MP3", "Unable to build seek table for %s", source->name);
+    return;
+  }
+
+  if (!cached) mp3_seek_table_store(dec, source);
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "MP3", "Seek table of %s: %u points, %llu frames%s", source->name,
+    dec->seek_point_count, (unsigned long long) dec->frames, cached ? ", cached" : "");
+}
+
+int decoder_mp3_open(decoder_data_t *data, decoder_source_t *source) {
+  struct mp3_decoder *dec = zalloc(sizeof(struct mp3_decoder));
+  if (!dec) return DECODER_ERROR;
+
+  drmp3 *mp3 = &dec->mp3;
+
+  mp3_gapless(dec, source);
+
+  if (!mp3_init(mp3, source)) {
+    free(dec);
+    data->priv = NULL;
+    return DECODER_ERROR;
+  }
+
+  // Without config dr_mp3 keeps rate and channels of the first frame
+  data->af = af_endian(0) | af_format(SF_FORMAT_S16) | af_rate(mp3->sampleRate) | af_channels(mp3->channels);
+  data->priv = dec;
+
+  mp3_seek_table(dec, source);
+
+  if (dec->skip) mp3_seek_frame(dec, dec->skip);
+
+  return DECODER_SUCCESS;
+}
+
+// Frames left before the padding of a gapless stream
+static size_t mp3_playable(struct mp3_decoder *dec, size_t frames) {
+  if (!dec->playable) return frames;
+  return dec->position < dec->playable ? min(frames, dec->playable - dec->position) : 0;
 }
 
 int decoder_mp3_close(decoder_data_t *data) {
-  drmp3 *mp3 = data->priv;
+  struct mp3_decoder *dec = data->priv;
+  drmp3 *mp3 = &dec->mp3;
 
   drmp3_uninit(mp3);
+  free(dec->seek_points);
   free(data->priv);
 
   return 0;
 }
 
 size_t decoder_mp3_read_s16(decoder_data_t *data, uint8_t *buffer, size_t frames) {
-  drmp3 *mp3 = data->priv;
+  struct mp3_decoder *dec = data->priv;
+  drmp3 *mp3 = &dec->mp3;
 
-  size_t mp3_frames = drmp3_read_pcm_frames_s16(mp3, frames, (drmp3_int16*) buffer);
+  size_t mp3_frames = drmp3_read_pcm_frames_s16(mp3, mp3_playable(dec, frames), (drmp3_int16*) buffer);
+  dec->position += mp3_frames;
 
   return mp3_frames;
 }
 
+static size_t mp3_read_interleaved(void *handle, float *buffer, size_t frames) {
+  return drmp3_read_pcm_frames_f32(handle, frames, buffer);
+}
+
+size_t decoder_mp3_read_f32(decoder_data_t *data, float **buffer, uint8_t planes, size_t frames) {
+  struct mp3_decoder *dec = data->priv;
+  drmp3 *mp3 = &dec->mp3;
+  size_t r;
+
+  frames = mp3_playable(dec, frames);
+
+  if (planes == 1)
+    r = drmp3_read_pcm_frames_f32(mp3, frames, buffer[0]);
+  else if (planes == mp3->channels)
+    r = decoder_read_planar(mp3, mp3_read_interleaved, planes, buffer, frames);
+  else
+    return 0;
+
+  dec->position += r;
+  return r;
+}
+
 int decoder_mp3_seek(decoder_data_t *data, long offset) {
-  drmp3 *mp3 = data->priv;
+  struct mp3_decoder *dec = data->priv;
+
+  uint64_t frame = (uint64_t) af_get_rate(data->af) * offset / 1000;
+  if (dec->playable) frame = min(frame, dec->playable);
 
-  int r = drmp3_seek_to_pcm_frame(mp3, af_get_rate(data->af) * offset / 1000);
+  int r = mp3_seek_frame(dec, dec->skip + frame);
+  if (r) dec->position = frame;
 
   return r;
 }
 
 long decoder_mp3_duration(decoder_data_t *data) {
-  drmp3 *mp3 = data->priv;
+  struct mp3_decoder *dec = data->priv;
+  drmp3 *mp3 = &dec->mp3;
 
-  long frames = drmp3_get_pcm_frame_count(mp3) / af_get_rate(data->af);
+  // Known from the LAME tag or the seek table, otherwise the stream is scanned
+  uint64_t total = dec->playable ? dec->playable : dec->frames ? dec->frames : drmp3_get_pcm_frame_count(mp3);
+  long frames = total / af_get_rate(data->af);
 
   return frames;
 }
 
+uint64_t decoder_mp3_length(decoder_data_t *data) {
+  struct mp3_decoder *dec = data->priv;
+
+  if (dec->playable) return dec->playable;
+  return dec->frames > dec->skip ? dec->frames - dec->skip : 0;
+}
+
 long decoder_mp3_bitrate_current(decoder_data_t *data) {
-  drmp3 *mp3 = data->priv;
+  struct mp3_decoder *dec = data->priv;
+  drmp3 *mp3 = &dec->mp3;
   return mp3->frameInfo.bitrate_kbps * 1024;
 }
 
@@ -64,13 +455,16 @@ static const char *const mp3_ext[]  = { "mp3", "mp2", NULL };
 static const char *const mp3_mime[] = { "audio/mpeg", NULL };
 
 const decoder_ops_t decoder_mp3 = {
+  .probe = decoder_mp3_probe,
   .open = decoder_mp3_open,
   .close = decoder_mp3_close,
 
   .read_s16 = decoder_mp3_read_s16,
+  .read_f32 = decoder_mp3_read_f32,
   .seek = decoder_mp3_seek,
 
   .duration = decoder_mp3_duration,
+  .length = decoder_mp3_length,
   .bitrate = decoder_mp3_bitrate,
   .bitrate_current = decoder_mp3_bitrate_current
 };
@@ -79,5 +473,6 @@ const decoder_info_t decoder_mp3_info = {
     .name = "mp3",
     .impl = "dr_mp3",
     .ext = mp3_ext,
-    .mime = mp3_mime
+    .mime = mp3_mime,
+    .cacheable = 1
   };
\ No newline at end of file
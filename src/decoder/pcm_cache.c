@@ -0,0 +1,328 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "pcm.h"
+#include "pcm_conv.h"
+#include "logging.h"
+#include "util/mem.h"
+#include "util/math.h"
+#include "decoder/cache.h"
+#include "decoder/pcm_cache.h"
+
+#define PCM_CACHE_CHUNK_SAMPLES 1024
+
+// Entry payload starts with the stream format, interleaved float frames follow
+struct pcm_cache_header {
+  uint32_t rate;
+  uint8_t channels;
+  uint8_t reserved[11];
+};
+
+_Static_assert(sizeof(struct pcm_cache_header) % sizeof(float) == 0, "frames follow the header aligned");
+
+struct pcm_cache_reader {
+  decoder_cache_mapping_t mapping;
+  const float *samples;
+  uint64_t frames;
+  uint64_t position;
+  uint8_t channels;
+};
+
+struct pcm_cache_recorder {
+  // wrapped decoder
+  decoder_ops_t ops;
+  decoder_data_t data;
+
+  decoder_cache_writer_t writer;
+  uint8_t channels;
+  int recording; // cleared by anything that breaks a front to back read
+  int complete;
+};
+
+static uint64_t pcm_cache_budget = DECODER_PCM_CACHE_BUDGET;
+
+void decoder_pcm_cache_budget(uint64_t bytes) {
+  pcm_cache_budget = bytes;
+}
+
+//
+// Reader functions
+//
+static int pcm_cache_reader_close(decoder_data_t *data) {
+  struct pcm_cache_reader *reader = data->priv;
+
+  decoder_cache_unmap(&reader->mapping);
+  free(reader);
+
+  return 0;
+}
+
+static size_t pcm_cache_reader_read_s16(decoder_data_t *data, uint8_t *buffer, size_t frames) {
+  struct pcm_cache_reader *reader = data->priv;
+  audio_format_t af = af_endian(AF_NATIVE_ENDIAN) | af_format(SF_FORMAT_S16) | af_channels(reader->channels);
+
+  size_t count = min(frames, reader->frames - reader->position);
+  if (count == 0) return 0;
+
+  pcm_float_to_fixed(af, buffer, reader->samples + reader->position * reader->channels, count);
+  reader->position += count;
+
+  return count;
+}
+
+static size_t pcm_cache_reader_read_f32(decoder_data_t *data, float **buffer, uint8_t planes, size_t frames) {
+  struct pcm_cache_reader *reader = data->priv;
+  const float *src = reader->samples + reader->position * reader->channels;
+
+  size_t count = min(frames, reader->frames - reader->position);
+  if (count == 0) return 0;
+
+  if (planes == 1)
+    memcpy(buffer[0], src, count * reader->channels * sizeof(float));
+  else if (planes == reader->channels)
+    pcm_deinterleave_float(buffer, src, reader->channels, count);
+  else
+    return 0;
+
+  reader->position += count;
+
+  return count;
+}
+
+static int pcm_cache_reader_seek(decoder_data_t *data, long offset) {
+  struct pcm_cache_reader *reader = data->priv;
+
+  reader->position = min((uint64_t) af_get_rate(data->af) * offset / 1000, reader->frames);
+
+  return 1;
+}
+
+static long pcm_cache_reader_duration(decoder_data_t *data) {
+  struct pcm_cache_reader *reader = data->priv;
+  return reader->frames / af_get_rate(data->af);
+}
+
+static uint64_t pcm_cache_reader_length(decoder_data_t *data) {
+  struct pcm_cache_reader *reader = data->priv;
+  return reader->frames;
+}
+
+static long pcm_cache_reader_bitrate(decoder_data_t *data) {
+  return (long) af_get_rate(data->af) * af_get_channels(data->af) * 32;
+}
+
+static const decoder_ops_t pcm_cache_reader_ops = {
+  .close = pcm_cache_reader_close,
+
+  .read_s16 = pcm_cache_reader_read_s16,
+  .read_f32 = pcm_cache_reader_read_f32,
+  .seek = pcm_cache_reader_seek,
+
+  .duration = pcm_cache_reader_duration,
+  .length = pcm_cache_reader_length,
+  .bitrate = pcm_cache_reader_bitrate,
+  .bitrate_current = pcm_cache_reader_bitrate
+};
+
+static const decoder_info_t pcm_cache_reader_info = {
+    .name = "cache",
+    .impl = "mapped pcm",
+  };
+
+int decoder_pcm_cache_open(decoder_t *decoder) {
+  if (pcm_cache_budget == 0)
+    return DECODER_UNSUPPORTED;
+
+  struct pcm_cache_reader *reader = zalloc(sizeof(struct pcm_cache_reader));
+  if (!reader) return DECODER_ERROR;
+
+  int rc = decoder_cache_map(&reader->mapping, &decoder->source, DECODER_PCM_CACHE_KIND);
+  if (rc != DECODER_SUCCESS) {
+    free(reader);
+    return rc;
+  }
+
+  const struct pcm_cache_header *header = (const struct pcm_cache_header *) reader->mapping.payload;
+
+  if (reader->mapping.size < sizeof(struct pcm_cache_header) || header->rate == 0 ||
+      header->channels == 0 || header->channels > DECODER_MAX_CHANNELS) {
+    decoder_cache_unmap(&reader->mapping);
+    free(reader);
+    return DECODER_ERROR;
+  }
+
+  reader->channels = header->channels;
+  reader->samples = (const float *) (header + 1);
+  reader->frames = (reader->mapping.size - sizeof(struct pcm_cache_header)) / (sizeof(float) * header->channels);
+
+  decoder->ops = pcm_cache_reader_ops;
+  decoder->info = &pcm_cache_reader_info;
+  decoder->data.af = af_endian(AF_NATIVE_ENDIAN) | af_format(SF_FORMAT_FLOAT) | af_rate(header->rate) | af_channels(header->channels);
+  decoder->data.source = &decoder->source;
+  decoder->data.priv = reader;
+
+  return DECODER_SUCCESS;
+}
+
+//
+// Recorder functions
+//
+static void pcm_cache_recorder_stop(struct pcm_cache_recorder *recorder) {
+  if (!recorder->recording) return;
+
+  decoder_cache_writer_abort(&recorder->writer);
+  recorder->recording = 0;
+}
+
+static int pcm_cache_recorder_close(decoder_data_t *data) {
+  struct pcm_cache_recorder *recorder = data->priv;
+
+  if (recorder->recording && recorder->complete) {
+    if (decoder_cache_writer_commit(&recorder->writer) == DECODER_SUCCESS) {
+      log_write(MIZAR_LOGLEVEL_DEBUG, "DECODER", "Cached %llu bytes of decoded %s",
+        (unsigned long long) recorder->writer.payload_size, data->source->name);
+
+      decoder_cache_trim(DECODER_PCM_CACHE_KIND, pcm_cache_budget);
+    }
+  } else {
+    pcm_cache_recorder_stop(recorder);
+  }
+
+  int rc = recorder->ops.close(&recorder->data);
+  free(recorder);
+
+  return rc;
+}
+
+static size_t pcm_cache_recorder_read_s16(decoder_data_t *data, uint8_t *buffer, size_t frames) {
+  struct pcm_cache_recorder *recorder = data->priv;
+
+  // Fixed point frames can't be recorded losslessly
+  pcm_cache_recorder_stop(recorder);
+
+  return recorder->ops.read_s16(&recorder->data, buffer, frames);
+}
+
+static void pcm_cache_recorder_append(struct pcm_cache_recorder *recorder, float **buffer, uint8_t planes, size_t frames) {
+  uint8_t channels = recorder->channels;
+  int rc = DECODER_SUCCESS;
+
+  if (planes == 1) {
+    rc = decoder_cache_writer_append(&recorder->writer, buffer[0], frames * channels * sizeof(float));
+  } else {
+    audio_format_t af = af_endian(AF_NATIVE_ENDIAN) | af_format(SF_FORMAT_FLOAT) | af_channels(channels);
+    float chunk[PCM_CACHE_CHUNK_SAMPLES];
+    const float *src[DECODER_MAX_CHANNELS];
+    size_t step = PCM_CACHE_CHUNK_SAMPLES / channels;
+
+    for (size_t done = 0; done < frames && rc == DECODER_SUCCESS; done += step) {
+      size_t count = min(step, frames - done);
+
+      for (uint8_t ch = 0; ch < channels; ch++) src[ch] = buffer[ch] + done;
+      pcm_planar_to_fixed(af, (uint8_t *) chunk, src, count);
+
+      rc = decoder_cache_writer_append(&recorder->writer, chunk, count * channels * sizeof(float));
+    }
+  }
+
+  if (rc != DECODER_SUCCESS) pcm_cache_recorder_stop(recorder);
+}
+
+static size_t pcm_cache_recorder_read_f32(decoder_data_t *data, float **buffer, uint8_t planes, size_t frames) {
+  struct pcm_cache_recorder *recorder = data->priv;
+
+  size_t r = recorder->ops.read_f32(&recorder->data, buffer, planes, frames);
+
+  if (recorder->recording) {
+    if (r > 0) pcm_cache_recorder_append(recorder, buffer, planes, r);
+    else if (frames > 0) recorder->complete = 1;
+  }
+
+  return r;
+}
+
+static int pcm_cache_recorder_seek(decoder_data_t *data, long offset) {
+  struct pcm_cache_recorder *recorder = data->priv;
+
+  // Entry would have a gap
+  pcm_cache_recorder_stop(recorder);
+
+  return recorder->ops.seek(&recorder->data, offset);
+}
+
+static long pcm_cache_recorder_duration(decoder_data_t *data) {
+  struct pcm_cache_recorder *recorder = data->priv;
+  return recorder->ops.duration(&recorder->data);
+}
+
+static uint64_t pcm_cache_recorder_length(decoder_data_t *data) {
+  struct pcm_cache_recorder *recorder = data->priv;
+  return recorder->ops.length ? recorder->ops.length(&recorder->data) : 0;
+}
+
+static long pcm_cache_recorder_bitrate(decoder_data_t *data) {
+  struct pcm_cache_recorder *recorder = data->priv;
+  return recorder->ops.bitrate(&recorder->data);
+}
+
+static long pcm_cache_recorder_bitrate_current(decoder_data_t *data) {
+  struct pcm_cache_recorder *recorder = data->priv;
+  return recorder->ops.bitrate_current(&recorder->data);
+}
+
+static const decoder_ops_t pcm_cache_recorder_ops = {
+  .close = pcm_cache_recorder_close,
+
+  .read_s16 = pcm_cache_recorder_read_s16,
+  .read_f32 = pcm_cache_recorder_read_f32,
+  .seek = pcm_cache_recorder_seek,
+
+  .duration = pcm_cache_recorder_duration,
+  .length = pcm_cache_recorder_length,
+  .bitrate = pcm_cache_recorder_bitrate,
+  .bitrate_current = pcm_cache_recorder_bitrate_current
+};
+
+int decoder_pcm_cache_record(decoder_t *decoder) {
+  decoder_data_t *data = &decoder->data;
+  uint8_t channels = af_get_channels(data->af);
+
+  if (pcm_cache_budget == 0 || !decoder->info->cacheable || channels == 0 || channels > DECODER_MAX_CHANNELS)
+    return DECODER_UNSUPPORTED;
+
+  // Entry that alone exceeds the budget would evict everything else, streams of unknown length
+  // may be endless
+  uint64_t frames = decoder->ops.length ? decoder->ops.length(data) : 0;
+  if (frames == 0 || frames > pcm_cache_budget / (channels * sizeof(float)))
+    return DECODER_UNSUPPORTED;
+
+  struct pcm_cache_recorder *recorder = zalloc(sizeof(struct pcm_cache_recorder));
+  if (!recorder) return DECODER_ERROR;
+
+  int rc = decoder_cache_writer_open(&recorder->writer, &decoder->source, DECODER_PCM_CACHE_KIND);
+  if (rc != DECODER_SUCCESS) {
+    free(recorder);
+    return rc;
+  }
+
+  struct pcm_cache_header header = {
+    .rate = af_get_rate(data->af),
+    .channels = channels
+  };
+
+  if (decoder_cache_writer_append(&recorder->writer, &header, sizeof(header)) != DECODER_SUCCESS) {
+    decoder_cache_writer_abort(&recorder->writer);
+    free(recorder);
+    return DECODER_ERROR;
+  }
+
+  recorder->ops = decoder->ops;
+  recorder->data = *data;
+  recorder->channels = channels;
+  recorder->recording = 1;
+
+  decoder->ops = pcm_cache_recorder_ops;
+  data->priv = recorder;
+
+  return DECODER_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#ifndef _H_DECODER_PCM_CACHE_
+#define _H_DECODER_PCM_CACHE_
+
+#include <stdint.h>
+#include "decoder/decoder.h"
+
+#define DECODER_PCM_CACHE_KIND "pcm"
+
+// Default size of all decoded entries together
+#define DECODER_PCM_CACHE_BUDGET (2048ULL << 20)
+
+/*
+  Decoded audio of files, kept in the decoder cache (see decoder/cache.h) as interleaved float frames.
+  A file decoded from start to end is recorded on the fly, later opens map the entry and skip decoding.
+  Least recently played entries are evicted once all of them together exceed the budget.
+*/
+
+/**
+ * Set size of all decoded entries together
+ *
+ * @param bytes Budget in bytes, 0 disables the cache
+ */
+void decoder_pcm_cache_budget(uint64_t bytes);
+
+/**
+ * Open decoded entry of the source instead of a decoder
+ *
+ * @param decoder Decoder with a mapped file source
+ * @return DECODER_SUCCESS or error code if there is no usable entry
+ */
+int decoder_pcm_cache_open(decoder_t *decoder);
+
+/**
+ * Record frames read from an opened decoder. Entry is stored on close if the stream was read
+ * to the end without seeking, otherwise it is dropped
+ *
+ * @param decoder Opened decoder of a mapped file source
+ * @return DECODER_SUCCESS or DECODER_UNSUPPORTED if the stream isn't worth caching
+ */
+int decoder_pcm_cache_record(decoder_t *decoder);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,97 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // madvise, O_CLOEXEC, st_mtim
+#endif
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "decoder/decoder.h"
+#include "decoder/source.h"
+#include "logging.h"
+#include "util/math.h"
+
+int decoder_source_open_file(decoder_source_t *source, const char *path) {
+  memset(source, 0, sizeof(decoder_source_t));
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return DECODER_ERROR;
+
+  struct stat st;
+  void *map = MAP_FAILED;
+
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  // Mapping keeps the file referenced
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    log_write(MIZAR_LOGLEVEL_WARN, "DECODER", "Unable to map %s", path);
+    return DECODER_ERROR;
+  }
+
+  // Decoders read front to back, kernel may read ahead aggressively and drop pages behind
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  source->type = DECODER_SOURCE_MMAP;
+  source->name = path;
+  source->data = map;
+  source->size = st.st_size;
+  source->mtime = (int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+  return DECODER_SUCCESS;
+}
+
+void decoder_source_open_memory(decoder_source_t *source, const char *name, const void *data, size_t size) {
+  memset(source, 0, sizeof(decoder_source_t));
+
+  source->type = DECODER_SOURCE_MEMORY;
+  source->name = name ? name : "memory";
+  source->data = data;
+  source->size = size;
+}
+
+void decoder_source_open_callbacks(decoder_source_t *source, const char *name, decoder_source_read_t read, decoder_source_seek_t seek, void *user) {
+  memset(source, 0, sizeof(decoder_source_t));
+
+  source->type = DECODER_SOURCE_CALLBACKS;
+  source->name = name ? name : "stream";
+  source->read = read;
+  source->seek = seek;
+  source->user = user;
+}
+
+void decoder_source_close(decoder_source_t *source) {
+  if (source->type == DECODER_SOURCE_MMAP)
+    munmap((void *) source->data, source->size);
+
+  memset(source, 0, sizeof(decoder_source_t));
+}
+
+size_t decoder_source_read(void *param, void *buffer, size_t size) {
+  decoder_source_t *source = param;
+
+  if (source->type == DECODER_SOURCE_CALLBACKS)
+    return source->read(source->user, buffer, size);
+
+  size_t count = min(size, source->size - source->position);
+  memcpy(buffer, source->data + source->position, count);
+  source->position += count;
+
+  return count;
+}
+
+int decoder_source_seek(void *param, int offset, int origin) {
+  decoder_source_t *source = param;
+
+  if (source->type == DECODER_SOURCE_CALLBACKS)
+    return source->seek ? source->seek(source->user, offset, origin) : 0;
+
+  int64_t position = (origin == DECODER_SEEK_START ? 0 : (int64_t) source->position) + offset;
+  if (position < 0 || (uint64_t) position > source->size) return 0;
+
+  source->position = position;
+  return 1;
+}
\ No newline at end of file
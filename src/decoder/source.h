@@ -0,0 +1,78 @@
+#ifndef _H_DECODER_SOURCE_
+#define _H_DECODER_SOURCE_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DECODER_SOURCE_NONE      0
+#define DECODER_SOURCE_MMAP      1 // file mapped into memory, owned by the source
+#define DECODER_SOURCE_MEMORY    2 // caller owned buffer
+#define DECODER_SOURCE_CALLBACKS 3 // caller provided read and seek
+
+#define DECODER_SEEK_START   0
+#define DECODER_SEEK_CURRENT 1
+
+// Same shapes as dr_libs read and seek procs, seek returns non zero on success
+typedef size_t (*decoder_source_read_t)(void *user, void *buffer, size_t size);
+typedef int (*decoder_source_seek_t)(void *user, int offset, int origin);
+
+/*
+  Byte stream a decoder reads from. Mapped and memory sources expose the whole stream through data
+  and size, so decoders can hand it to their memory readers without a copy. Callback sources are
+  read through decoder_source_read and decoder_source_seek, which also work for the other types.
+*/
+typedef struct {
+  int type;
+  const char *name;   // path or caller given name, used for logging
+
+  const uint8_t *data;
+  size_t size;        // 0 when unknown for callback sources
+  size_t position;
+  int64_t mtime;      // modification time of mapped file, ns. Keys decoder caches
+
+  decoder_source_read_t read;
+  decoder_source_seek_t seek;
+  void *user;
+} decoder_source_t;
+
+/**
+ * Map file into memory for sequential reading. Pages are shared with other sources of the same file
+ *
+ * @param source Source to be opened
+ * @param path Path to the file
+ * @return DECODER_SUCCESS or DECODER_ERROR
+ */
+int decoder_source_open_file(decoder_source_t *source, const char *path);
+
+/**
+ * Read from a buffer that stays valid until the decoder is closed
+ *
+ * @param source Source to be initialized
+ * @param name Name used for logging, may be NULL
+ * @param data Encoded stream
+ * @param size Stream size in bytes
+ */
+void decoder_source_open_memory(decoder_source_t *source, const char *name, const void *data, size_t size);
+
+/**
+ * Read through caller callbacks
+ *
+ * @param source Source to be initialized
+ * @param name Name used for logging, may be NULL
+ * @param read Read callback
+ * @param seek Seek callback, relative to stream start or current position
+ * @param user Passed to callbacks
+ */
+void decoder_source_open_callbacks(decoder_source_t *source, const char *name, decoder_source_read_t read, decoder_source_seek_t seek, void *user);
+
+/**
+ * Release mapping of the source, other types are left to the caller
+ *
+ * @param source Opened source
+ */
+void decoder_source_close(decoder_source_t *source);
+
+size_t decoder_source_read(void *source, void *buffer, size_t size);
+int decoder_source_seek(void *source, int offset, int origin);
+
+#endif
\ No newline at end of file
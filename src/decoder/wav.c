@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "pcm.h"
+#include "util/mem.h"
+#include "decoder/decoder_impl.h"
+
+#define DR_WAV_IMPLEMENTATION
+#include "decoder/dr_libs/dr_wav.h"
+
+struct wav_decoder {
+  drwav wav;
+};
+
+static int decoder_wav_probe(const uint8_t *header, size_t size) {
+  if (size < 12) return 0;
+
+  // RIFF container, RF64 is left out as dr_wav doesn't parse ds64 sizes
+  if (memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVE", 4) == 0)
+    return 1;
+
+  // Sony Wave64 starts with the "riff" GUID
+  return size >= 16 && memcmp(header, "riff\x2e\x91\xcf\x11\xa5\xd6\x28\xdb\x04\xc1\x00\x00", 16) == 0;
+}
+
+static drwav_bool32 wav_seek(void *source, int offset, drwav_seek_origin origin) {
+  return decoder_source_seek(source, offset, origin == drwav_seek_origin_start ? DECODER_SEEK_START : DECODER_SEEK_CURRENT);
+}
+
+static drwav_bool32 wav_init(drwav *wav, decoder_source_t *source) {
+  if (source->data)
+    return drwav_init_memory(wav, source->data, source->size);
+
+  return drwav_init(wav, decoder_source_read, wav_seek, source);
+}
+
+int decoder_wav_open(decoder_data_t *data, decoder_source_t *source) {
+  struct wav_decoder *dec = pmalloc(sizeof(struct wav_decoder));
+  if (!dec) return DECODER_ERROR;
+
+  drwav *wav = &dec->wav;
+
+  if (!wav_init(wav, source)) {
+    free(dec);
+    data->priv = NULL;
+    return DECODER_ERROR;
+  }
+
+  data->af = af_endian(0) | af_format(SF_FORMAT_S16) | af_rate(wav->sampleRate) | af_channels(wav->channels);
+  data->priv = dec;
+
+  return DECODER_SUCCESS;
+}
+
+int decoder_wav_close(decoder_data_t *data) {
+  struct wav_decoder *dec = data->priv;
+
+  drwav_uninit(&dec->wav);
+  free(data->priv);
+
+  return 0;
+}
+
+size_t decoder_wav_read_s16(decoder_data_t *data, uint8_t *buffer, size_t frames) {
+  struct wav_decoder *dec = data->priv;
+
+  return drwav_read_pcm_frames_s16(&dec->wav, frames, (drwav_int16*) buffer);
+}
+
+static size_t wav_read_interleaved(void *handle, float *buffer, size_t frames) {
+  return drwav_read_pcm_frames_f32(handle, frames, buffer);
+}
+
+size_t decoder_wav_read_f32(decoder_data_t *data, float **buffer, uint8_t planes, size_t frames) {
+  struct wav_decoder *dec = data->priv;
+  drwav *wav = &dec->wav;
+
+  if (planes == 1)
+    return drwav_read_pcm_frames_f32(wav, frames, buffer[0]);
+
+  if (planes != wav->channels)
+    return 0;
+
+  return decoder_read_planar(wav, wav_read_interleaved, planes, buffer, frames);
+}
+
+int decoder_wav_seek(decoder_data_t *data, long offset) {
+  struct wav_decoder *dec = data->priv;
+
+  int r = drwav_seek_to_pcm_frame(&dec->wav, (drwav_uint64) af_get_rate(data->af) * offset / 1000);
+
+  return r;
+}
+
+long decoder_wav_duration(decoder_data_t *data) {
+  struct wav_decoder *dec = data->priv;
+
+  return dec->wav.totalPCMFrameCount / af_get_rate(data->af);
+}
+
+uint64_t decoder_wav_length(decoder_data_t *data) {
+  struct wav_decoder *dec = data->priv;
+
+  return dec->wav.totalPCMFrameCount;
+}
+
+long decoder_wav_bitrate(decoder_data_t *data) {
+  struct wav_decoder *dec = data->priv;
+  return (long) dec->wav.fmt.avgBytesPerSec * 8;
+}
+
+long decoder_wav_bitrate_current(decoder_data_t *data) {
+  return decoder_wav_bitrate(data);
+}
+
+
+static const char *const wav_ext[]  = { "wav", "wave", "w64", NULL };
+static const char *const wav_mime[] = { "audio/wav", "audio/x-wav", "audio/wave", "audio/vnd.wave", NULL };
+
+const decoder_ops_t decoder_wav = {
+  .probe = decoder_wav_probe,
+  .open = decoder_wav_open,
+  .close = decoder_wav_close,
+
+  .read_s16 = decoder_wav_read_s16,
+  .read_f32 = decoder_wav_read_f32,
+  .seek = decoder_wav_seek,
+
+  .duration = decoder_wav_duration,
+  .length = decoder_wav_length,
+  .bitrate = decoder_wav_bitrate,
+  .bitrate_current = decoder_wav_bitrate_current
+};
+
+const decoder_info_t decoder_wav_info = {
+    .name = "wav",
+    .impl = "dr_wav",
+    .ext = wav_ext,
+    .mime = wav_mime
+  };
\ No newline at end of file
@@ -1,53 +1,256 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // clock_nanosleep
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "logging.h"
 //#include "playback.h"
 //#include "commandqueue.h"
 #include "decoder/decoder_impl.h"
+#include "decoder/pcm_cache.h"
 #include "pcm.h"
-#include "pcm_conv.h"
 #include "audio_io.h"
+#include "audio_resample.h"
 #include "audio_ctrl.h"
 #include "output/output.h"
 #include "util/common.h"
+#include "util/math.h"
 #include "util/time.h"
 //#include "osc_ctrl.h"
 
+#define OUTPUT_DRIVER_DEFAULT "alsa"
+#define PLAY_TIME_SC 230
+
 audio_format_t output_af = af_endian(0) | af_format(SF_FORMAT_S16) | af_rate(44100) | af_channels(2);
-uint8_t output_buf[1024 * 2 * 2];
 
 void output_callback(struct audio_data *data, uint32_t frames, void *param) {
-  uint32_t r = pcm_float_to_fixed(output_af, output_buf, data->data[0], frames);
-  data->frames = output_device_ops.write(output_buf, r);
+  output_t *output = param;
+  data->frames = output_write_planar(output, (const float *const *) data->data, frames);
+}
+
+uint32_t output_wait_callback(void *param) {
+  output_t *output = param;
+  return output->ops.wait(&output->data);
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-c megabytes] [-r quality] [-l limiter] [-x ms] [-o driver[:device][@bus]]... [file[@bus]...]\n", name);
+  fprintf(stderr, "  -c: size of decoded audio cache, 0 disables it (default %llu)\n", DECODER_PCM_CACHE_BUDGET >> 20);
+  fprintf(stderr, "  -r: resampling of inputs with another rate: fast, balanced, best (default %s)\n",
+    audio_resample_quality_name(AUDIO_RESAMPLE_DEFAULT));
+  fprintf(stderr, "  -l: output stage of buses: lookahead, softclip, clip (default %s)\n",
+    audio_limiter_mode_name(AUDIO_LIMITER_LOOKAHEAD));
+  fprintf(stderr, "  -x: play files one after another on the first input, crossfaded for ms, 0 for gapless\n");
+  fprintf(stderr, "  drivers: alsa, file, null, pipe\n");
+  fprintf(stderr, "  first output paces playback, others are fed from their buses through ring buffers\n");
+}
+
+static int parse_quality(const char *name) {
+  for(int quality = AUDIO_RESAMPLE_FAST; quality <= AUDIO_RESAMPLE_BEST; quality++) {
+    if(strcmp(name, audio_resample_quality_name(quality)) == 0) return quality;
+  }
+
+  return -1;
+}
+
+static int parse_limiter(const char *name) {
+  for(int mode = AUDIO_LIMITER_LOOKAHEAD; mode <= AUDIO_LIMITER_CLIP; mode++) {
+    if(strcmp(name, audio_limiter_mode_name(mode)) == 0) return mode;
+  }
+
+  return -1;
+}
+
+// Strip trailing @bus from spec, bus 0 when absent
+static uint8_t parse_bus(char *spec) {
+  char *at = strrchr(spec, '@');
+  if(!at || at[1] == '\0' || strspn(at + 1, "0123456789") != strlen(at + 1)) return 0;
+
+  int bus = atoi(at + 1);
+  if(bus >= AUDIO_IO_BUSES) return 0;
+
+  *at = '\0';
+  return bus;
 }
 
-int main() {
+int main(int argc, char **argv) {
+  char output_spec[1 + AUDIO_IO_SINKS][256] = { OUTPUT_DRIVER_DEFAULT };
+  int outputs = 0;
+  int resample_quality = AUDIO_RESAMPLE_DEFAULT;
+  int limiter_mode = AUDIO_LIMITER_LOOKAHEAD;
+  int crossfade_ms = -1;
+  int opt;
+
+  while((opt = getopt(argc, argv, "c:r:l:x:o:h")) != -1) {
+    switch(opt) {
+      case 'c':
+        decoder_pcm_cache_budget(strtoull(optarg, NULL, 10) << 20);
+        break;
+      case 'r':
+        if((resample_quality = parse_quality(optarg)) < 0) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'l':
+        if((limiter_mode = parse_limiter(optarg)) < 0) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'x':
+        if((crossfade_ms = atoi(optarg)) < 0) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'o':
+        if(outputs == 1 + AUDIO_IO_SINKS) {
+          fprintf(stderr, "At most %d outputs are supported\n", 1 + AUDIO_IO_SINKS);
+          return 1;
+        }
+        snprintf(output_spec[outputs++], sizeof(output_spec[0]), "%s", optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
   log_init(MIZAR_LOGLEVEL_DEBUG);
   log_info("Mizar (version: %s)", VERSION);
   log_info("Server's pid is %lli", os_getpid());
 
-  output_device_ops.init();
-  output_device_ops.open(output_af);
+  if(outputs == 0) outputs = 1;
+
+  // driver[:device][@bus], first output is the primary one
+  output_t output[1 + AUDIO_IO_SINKS];
+  uint8_t output_bus[1 + AUDIO_IO_SINKS];
+  output_latency_t latency = { .latency_us = 20000, .periods = 2 };
+
+  for(int i = 0; i < outputs; i++) {
+    output_bus[i] = parse_bus(output_spec[i]);
+
+    char *output_device = strchr(output_spec[i], ':');
+    if(output_device) *output_device++ = '\0';
+
+    output_latency_t output_latency = latency;
+    if(output_open(&output[i], output_spec[i], output_device, output_af, &output_latency) != OUTPUT_SUCCESS) {
+      log_error("Unable to open %s output", output_spec[i]);
+      return 1;
+    }
+
+    if(i == 0) latency = output_latency;
+  }
 
   audio_io_t *audio;
-  audio_output_info_t output_info;
+  audio_output_info_t output_info = { 0 };
   
-  output_info.name = "ALSA";
-  output_info.af =  af_endian(0) | af_format(SF_FORMAT_S16) | af_rate(44100) | af_channels(2);
+  output_info.name = output[0].info->name;
+  output_info.af = output_af;
+  output_info.bus_idx = output_bus[0];
   output_info.callback = output_callback;
+  output_info.wait = output[0].ops.wait ? output_wait_callback : NULL;
+  output_info.param = &output[0];
+  output_info.period_frames = latency.period_frames;
+  output_info.resample_quality = resample_quality;
+  output_info.limiter.mode = limiter_mode;
+  output_info.pacing = AUDIO_IO_PACING_OUTPUT;
+  output_info.sched_flags = AUDIO_IO_SCHED_FIFO | AUDIO_IO_SCHED_MLOCK;
 
   log_info("Started");
 
   audio_io_open(&audio, &output_info);
 
+  for(int i = 1; i < outputs; i++) {
+    audio_sink_info_t sink_info = { 0 };
+
+    sink_info.name = output[i].info->name;
+    sink_info.callback = output_callback;
+    sink_info.wait = output[i].ops.wait ? output_wait_callback : NULL;
+    sink_info.param = &output[i];
+
+    audio_io_sink_attach(audio, i - 1, output_bus[i], &sink_info);
+  }
+
+  decoder_t decoders[AUDIO_IO_INPUTS] = { 0 };
+  const char *default_path = "test6.mp3";
+  int files = argc - optind;
+  int inputs = files > 0 && crossfade_ms < 0 ? min(files, AUDIO_IO_INPUTS) : 1;
+
+  for(int i = 0; i < inputs; i++) {
+    char *path = files > 0 ? argv[optind + i] : (char *) default_path;
+    uint8_t bus = files > 0 ? parse_bus(path) : 0;
+
+    if(decoder_open(&decoders[i], path, NULL) != DECODER_SUCCESS) {
+      log_error("Unable to open %s", path);
+      decoders[i].data.priv = NULL;
+      continue;
+    }
+
+    audio_io_input_attach(audio, i, bus, &decoders[i]);
+  }
+
   audio_ctrl_t *audio_ctrl;
   audio_ctrl_open(&audio_ctrl, audio);
 
-  os_sleep_sc(230);
+  if(crossfade_ms < 0) {
+    os_sleep_sc(PLAY_TIME_SC);
+  } else {
+    // Queue mode, the playing file and the queued one alternate between two decoders
+    int next_file = 1;
+    bool queue_free = true;
+
+    for(uint64_t end = os_gettime_ns() + PLAY_TIME_SC * 1000000000ULL; os_gettime_ns() < end; os_sleep_ms(100)) {
+      decoder_t *finished = audio_io_input_reclaim(audio, 0);
+      if(finished) {
+        decoder_close(finished);
+        queue_free = true;
+      }
+
+      if(!queue_free || next_file >= files) continue;
+
+      char *path = argv[optind + next_file];
+      decoder_t *decoder = &decoders[next_file++ % 2];
+
+      if(decoder_open(decoder, path, NULL) != DECODER_SUCCESS) {
+        log_error("Unable to open %s", path);
+        decoder->data.priv = NULL;
+        continue;
+      }
+
+      if(audio_io_input_queue(audio, 0, decoder, crossfade_ms) != AUDIO_IO_SUCCESS) {
+        log_error("Unable to queue %s", path);
+        decoder_close(decoder);
+        continue;
+      }
+
+      queue_free = false;
+    }
+  }
 
   audio_ctrl_close(audio_ctrl);
+
+  for(int i = 0; i < inputs; i++) {
+    decoder_t *decoder = audio_io_input_detach(audio, i);
+    if(decoder) decoder_close(decoder);
+  }
+
+  // Queued decoder or the one not reclaimed yet is still open
+  if(crossfade_ms >= 0) {
+    for(int i = 0; i < 2; i++) {
+      if(decoders[i].data.priv) decoder_close(&decoders[i]);
+    }
+  }
+
+  for(int i = 1; i < outputs; i++) audio_io_sink_detach(audio, i - 1);
+
   audio_io_close(audio);
+  for(int i = 0; i < outputs; i++) output_close(&output[i]);
   
   //osc_ctrl_init();
   //osc_ctrl_start();
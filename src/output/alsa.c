@@ -1,20 +1,22 @@
 #include <alsa/asoundlib.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include "output.h"
 #include "pcm.h"
 #include "logging.h"
 
-#define ALSA_BUFFER_TIME_MAX 20 * 1e3;  // 20 ms
+#define ALSA_DEVICE_DEFAULT "default"
 
-static audio_format_t alsa_af;
-
-static char *alsa_device = "default";
-static snd_pcm_t *alsa_handle;
-static snd_pcm_format_t alsa_fmt;
-static int alsa_frame_size;
-static int alsa_can_pause;
-static snd_pcm_status_t *status;
+struct alsa_output {
+  snd_pcm_t *handle;
+  snd_pcm_format_t fmt;
+  int can_pause;
+  int mmap;
+  snd_pcm_uframes_t mmap_offset;
+  snd_pcm_uframes_t period_frames;
+  snd_pcm_uframes_t buffer_frames;
+};
 
 /* dummy alsa error handler */
 static void error_handler(const char *file, int line, const char *function,
@@ -25,7 +27,7 @@ static void error_handler(const char *file, int line, const char *function,
   va_end(argptr);
 }
 
-static int alsa_set_hw_params() {
+static int alsa_set_hw_params(struct alsa_output *alsa, audio_format_t af, output_latency_t *latency) {
   int rc, dir;
 
   snd_pcm_hw_params_t *hwparams = NULL;
@@ -35,141 +37,224 @@ static int alsa_set_hw_params() {
     return -1;
   }
 
-  rc = snd_pcm_hw_params_any(alsa_handle, hwparams);
+  rc = snd_pcm_hw_params_any(alsa->handle, hwparams);
   if (rc < 0) {
     log_error("Error: snd_pcm_hw_params_any");
-    return -1;
-  }
-
-  unsigned int buffer_time_max = ALSA_BUFFER_TIME_MAX;
-  rc = snd_pcm_hw_params_set_buffer_time_max(alsa_handle, hwparams, &buffer_time_max, &dir);
-  if (rc < 0) {
-    log_error("Error: snd_pcm_hw_params_set_buffer_time_max");
-    return -1;
+    goto fail;
   }
 
-  log_write(MIZAR_LOGLEVEL_DEBUG, "ALSA", "Buffer time: %.2f ms", (float)buffer_time_max / 1e3);
-
-  alsa_can_pause = snd_pcm_hw_params_can_pause(hwparams);
+  alsa->can_pause = snd_pcm_hw_params_can_pause(hwparams);
   
-  log_write(MIZAR_LOGLEVEL_DEBUG, "ALSA", "Can pause: %s", alsa_can_pause ? "yes" : "no");
+  log_write(MIZAR_LOGLEVEL_DEBUG, "ALSA", "Can pause: %s", alsa->can_pause ? "yes" : "no");
+
+  // Prefer mmap access so conversion can write straight into the device ring
+  alsa->mmap = snd_pcm_hw_params_test_access(alsa->handle, hwparams, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
 
-  rc = snd_pcm_hw_params_set_access(alsa_handle, hwparams, SND_PCM_ACCESS_RW_INTERLEAVED);
+  rc = snd_pcm_hw_params_set_access(alsa->handle, hwparams,
+      alsa->mmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED);
   if (rc < 0) {
     log_error("Error: snd_pcm_hw_params_set_access");
-    return -1;
+    goto fail;
   }
 
-  alsa_fmt = snd_pcm_build_linear_format(
-      af_get_depth(alsa_af), af_get_depth(alsa_af),
-      af_get_signed(alsa_af) ? 0 : 1, af_get_endian(alsa_af));
-  rc = snd_pcm_hw_params_set_format(alsa_handle, hwparams, alsa_fmt);
+  log_write(MIZAR_LOGLEVEL_DEBUG, "ALSA", "Access: %s", alsa->mmap ? "mmap" : "rw");
+
+  if (af_get_format(af) == SF_FORMAT_FLOAT) {
+    alsa->fmt = af_get_endian(af) ? SND_PCM_FORMAT_FLOAT_BE : SND_PCM_FORMAT_FLOAT_LE;
+  } else {
+    // physical width differs from depth for 24-in-32 formats
+    alsa->fmt = snd_pcm_build_linear_format(
+        af_get_depth(af), af_get_sample_size(af) * 8,
+        af_get_signed(af) ? 0 : 1, af_get_endian(af));
+  }
+  rc = snd_pcm_hw_params_set_format(alsa->handle, hwparams, alsa->fmt);
   if (rc < 0) {
     log_error("Error: snd_pcm_hw_params_set_format");
-    return -1;
+    goto fail;
   }
 
-  rc = snd_pcm_hw_params_set_channels(alsa_handle, hwparams,
-                                      af_get_channels(alsa_af));
+  rc = snd_pcm_hw_params_set_channels(alsa->handle, hwparams,
+                                      af_get_channels(af));
   if (rc < 0) {
     log_error("Error: snd_pcm_hw_params_set_channels");
-    return -1;
+    goto fail;
   }
 
-  unsigned int rate = af_get_rate(alsa_af);
+  unsigned int rate = af_get_rate(af);
   dir = 0;
-  rc = snd_pcm_hw_params_set_rate_near(alsa_handle, hwparams, &rate, &dir);
+  rc = snd_pcm_hw_params_set_rate_near(alsa->handle, hwparams, &rate, &dir);
   if (rc < 0) {
     log_error("Error: snd_pcm_hw_params_set_rate_near");
-    return -1;
+    goto fail;
+  }
+
+  // Buffer goes first, period count then splits it
+  unsigned int buffer_time = latency->latency_us ? latency->latency_us : OUTPUT_LATENCY_DEFAULT;
+  dir = 0;
+  rc = snd_pcm_hw_params_set_buffer_time_near(alsa->handle, hwparams, &buffer_time, &dir);
+  if (rc < 0) {
+    log_error("Error: snd_pcm_hw_params_set_buffer_time_near");
+    goto fail;
   }
 
-  rc = snd_pcm_hw_params(alsa_handle, hwparams);
+  unsigned int periods = latency->periods ? latency->periods : OUTPUT_PERIODS_DEFAULT;
+  dir = 0;
+  rc = snd_pcm_hw_params_set_periods_near(alsa->handle, hwparams, &periods, &dir);
+  if (rc < 0) {
+    log_error("Error: snd_pcm_hw_params_set_periods_near");
+    goto fail;
+  }
+
+  rc = snd_pcm_hw_params(alsa->handle, hwparams);
   if (rc < 0) {
     log_error("Error:  snd_pcm_hw_params");
-    return -1;
+    goto fail;
   }
 
+  snd_pcm_hw_params_get_period_size(hwparams, &alsa->period_frames, &dir);
+  snd_pcm_hw_params_get_buffer_size(hwparams, &alsa->buffer_frames);
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "ALSA", "Period: %lu frames, buffer: %lu frames (%.2f ms)",
+    alsa->period_frames, alsa->buffer_frames, (float) alsa->buffer_frames * 1e3 / rate);
+
+  latency->period_frames = alsa->period_frames;
+  latency->buffer_frames = alsa->buffer_frames;
+
   snd_pcm_hw_params_free(hwparams);
   return rc;
+
+  fail:
+  snd_pcm_hw_params_free(hwparams);
+  return -1;
 }
 
-static int output_alsa_init() {
+static int alsa_set_sw_params(struct alsa_output *alsa) {
   int rc;
 
-  snd_lib_error_set_handler(error_handler);
-
-  rc = snd_pcm_status_malloc(&status);
+  snd_pcm_sw_params_t *swparams = NULL;
+  rc = snd_pcm_sw_params_malloc(&swparams);
   if (rc < 0) {
-    log_error("Error: snd_pcm_status_malloc");
+    log_error("snd_pcm_sw_params_malloc");
     return -1;
   }
 
-  return rc;
-}
+  rc = snd_pcm_sw_params_current(alsa->handle, swparams);
+  if (rc < 0) {
+    log_error("Error: snd_pcm_sw_params_current");
+    goto fail;
+  }
+
+  // Wake up once a whole period can be written
+  rc = snd_pcm_sw_params_set_avail_min(alsa->handle, swparams, alsa->period_frames);
+  if (rc < 0) {
+    log_error("Error: snd_pcm_sw_params_set_avail_min");
+    goto fail;
+  }
 
-static int output_alsa_destroy() {
-  snd_pcm_status_free(status);
+  // Start once the buffer holds every whole period
+  rc = snd_pcm_sw_params_set_start_threshold(alsa->handle, swparams,
+      (alsa->buffer_frames / alsa->period_frames) * alsa->period_frames);
+  if (rc < 0) {
+    log_error("Error: snd_pcm_sw_params_set_start_threshold");
+    goto fail;
+  }
 
-  return 0;
+  rc = snd_pcm_sw_params(alsa->handle, swparams);
+  if (rc < 0) {
+    log_error("Error: snd_pcm_sw_params");
+    goto fail;
+  }
+
+  snd_pcm_sw_params_free(swparams);
+  return rc;
+
+  fail:
+  snd_pcm_sw_params_free(swparams);
+  return -1;
 }
 
-static int output_alsa_open(audio_format_t af) {
+static int output_alsa_open(output_data_t *data, output_latency_t *latency) {
   int rc;
 
-  alsa_af = af;
-  alsa_frame_size = af_get_frame_size(af);
+  snd_lib_error_set_handler(error_handler);
+
+  struct alsa_output *alsa = calloc(1, sizeof(struct alsa_output));
+  if (!alsa) return OUTPUT_ERROR;
+
+  const char *device = data->device ? data->device : ALSA_DEVICE_DEFAULT;
 
-  rc = snd_pcm_open(&alsa_handle, alsa_device, SND_PCM_STREAM_PLAYBACK, 0);
+  rc = snd_pcm_open(&alsa->handle, device, SND_PCM_STREAM_PLAYBACK, 0);
   if (rc < 0) {
     log_error("Error: snd_pcm_open");
-    return -1;
+    free(alsa);
+    return OUTPUT_ERROR;
   }
 
-  rc = alsa_set_hw_params();
+  rc = alsa_set_hw_params(alsa, data->af, latency);
   if (rc < 0) {
     log_error("Error: alsa_set_hw_params");
-    return -1;
+    goto fail;
+  }
+
+  rc = alsa_set_sw_params(alsa);
+  if (rc < 0) {
+    log_error("Error: alsa_set_sw_params");
+    goto fail;
   }
 
-  rc = snd_pcm_prepare(alsa_handle);
+  rc = snd_pcm_prepare(alsa->handle);
   if (rc < 0) {
     log_error("Error: snd_pcm_prepare");
-    return -1;
+    goto fail;
   }
 
-  return 0;
+  data->priv = alsa;
+  return OUTPUT_SUCCESS;
+
+  fail:
+  snd_pcm_close(alsa->handle);
+  free(alsa);
+  return OUTPUT_ERROR;
 }
 
-static int output_alsa_close() {
+static int output_alsa_close(output_data_t *data) {
+  struct alsa_output *alsa = data->priv;
   int rc;
 
-  rc = snd_pcm_drain(alsa_handle);
+  rc = snd_pcm_drain(alsa->handle);
   log_ddebug("snd_pcm_drain: %d", rc);
 
-  rc = snd_pcm_close(alsa_handle);
+  rc = snd_pcm_close(alsa->handle);
   log_ddebug("snd_pcm_close: %d", rc);
 
-  return rc ? -1 : 0;
+  free(alsa);
+  data->priv = NULL;
+
+  return rc ? OUTPUT_ERROR : OUTPUT_SUCCESS;
 }
 
-static int output_alsa_drop() {
+static int output_alsa_drop(output_data_t *data) {
+  struct alsa_output *alsa = data->priv;
 	int rc;
 
-	rc = snd_pcm_drop(alsa_handle);
+	rc = snd_pcm_drop(alsa->handle);
   log_ddebug("snd_pcm_drop: %d", rc);
 
-	rc = snd_pcm_prepare(alsa_handle);
+	rc = snd_pcm_prepare(alsa->handle);
   log_ddebug("snd_pcm_prepare: %d", rc);
 
-	return rc ? -1 : 0;
+	return rc ? OUTPUT_ERROR : OUTPUT_SUCCESS;
 }
 
-static uint32_t output_alsa_write(const uint8_t *buf, uint32_t frames) {
+static uint32_t output_alsa_write(output_data_t *data, const uint8_t *buf, uint32_t frames) {
+  struct alsa_output *alsa = data->priv;
   snd_pcm_sframes_t alsa_frames;
 
-  alsa_frames = snd_pcm_writei(alsa_handle, buf, frames);
-  if (alsa_frames < 0) alsa_frames = snd_pcm_recover(alsa_handle, alsa_frames, 0);
+  if (alsa->mmap)
+    alsa_frames = snd_pcm_mmap_writei(alsa->handle, buf, frames);
+  else
+    alsa_frames = snd_pcm_writei(alsa->handle, buf, frames);
+  if (alsa_frames < 0) alsa_frames = snd_pcm_recover(alsa->handle, alsa_frames, 0);
   if (alsa_frames < 0) {
     log_ddebug("snd_pcm_writei failed: %s", snd_strerror(alsa_frames));
     return 0;
@@ -178,11 +263,11 @@ static uint32_t output_alsa_write(const uint8_t *buf, uint32_t frames) {
   return alsa_frames;
 }
 
-static size_t output_alsa_get_available() {
+static size_t alsa_get_available(struct alsa_output *alsa) {
   snd_pcm_sframes_t alsa_frames;
 
-  alsa_frames = snd_pcm_avail_update(alsa_handle);
-  if (alsa_frames < 0) alsa_frames = snd_pcm_recover(alsa_handle, alsa_frames, 0);
+  alsa_frames = snd_pcm_avail_update(alsa->handle);
+  if (alsa_frames < 0) alsa_frames = snd_pcm_recover(alsa->handle, alsa_frames, 0);
   if (alsa_frames < 0) {
     log_ddebug("snd_pcm_avail_update failed: %s", snd_strerror(alsa_frames));
     return 0;
@@ -191,25 +276,77 @@ static size_t output_alsa_get_available() {
   return alsa_frames;
 }
 
-static uint32_t output_alsa_wait() {
-  uint32_t frames = output_alsa_get_available();
-  if(frames > 0) return frames;
+static uint32_t output_alsa_wait(output_data_t *data) {
+  struct alsa_output *alsa = data->priv;
 
-  snd_pcm_sframes_t alsa_frames = snd_pcm_wait(alsa_handle, 100);
+  uint32_t frames = alsa_get_available(alsa);
+  if(frames >= alsa->period_frames) return frames;
+
+  snd_pcm_sframes_t alsa_frames = snd_pcm_wait(alsa->handle, 100);
   if (alsa_frames < 0) return 0;
 
-  return output_alsa_get_available();
+  return alsa_get_available(alsa);
+}
+
+static uint8_t *output_alsa_begin(output_data_t *data, uint32_t *frames) {
+  struct alsa_output *alsa = data->priv;
+  const snd_pcm_channel_area_t *areas;
+  snd_pcm_uframes_t alsa_frames = *frames;
+  int rc;
+
+  if (!alsa->mmap) return NULL;
+
+  // avail_update has to precede mmap_begin to sync hardware pointer
+  if (alsa_get_available(alsa) == 0) {
+    *frames = 0;
+    return NULL;
+  }
+
+  rc = snd_pcm_mmap_begin(alsa->handle, &areas, &alsa->mmap_offset, &alsa_frames);
+  if (rc < 0) {
+    log_ddebug("snd_pcm_mmap_begin failed: %s", snd_strerror(rc));
+    snd_pcm_recover(alsa->handle, rc, 0);
+    *frames = 0;
+    return NULL;
+  }
+
+  *frames = alsa_frames;
+
+  // Interleaved access: all channels share one area, first channel starts the frame
+  return (uint8_t *) areas[0].addr + (areas[0].first + alsa->mmap_offset * areas[0].step) / 8;
+}
+
+static uint32_t output_alsa_commit(output_data_t *data, uint32_t frames) {
+  struct alsa_output *alsa = data->priv;
+  snd_pcm_sframes_t alsa_frames;
+
+  alsa_frames = snd_pcm_mmap_commit(alsa->handle, alsa->mmap_offset, frames);
+  if (alsa_frames < 0 || (snd_pcm_uframes_t) alsa_frames != frames) {
+    log_ddebug("snd_pcm_mmap_commit failed: %s", snd_strerror(alsa_frames < 0 ? alsa_frames : -EPIPE));
+    snd_pcm_recover(alsa->handle, alsa_frames < 0 ? alsa_frames : -EPIPE, 0);
+    return 0;
+  }
+
+  // mmap transfers never start the stream, kick it once there is no room for another chunk
+  if (snd_pcm_state(alsa->handle) == SND_PCM_STATE_PREPARED && alsa_get_available(alsa) < frames) {
+    int rc = snd_pcm_start(alsa->handle);
+    if (rc < 0) log_ddebug("snd_pcm_start failed: %s", snd_strerror(rc));
+  }
+
+  return alsa_frames;
 }
 
-static int output_alsa_pause() {
-  if (alsa_can_pause) {
-    snd_pcm_state_t state = snd_pcm_state(alsa_handle);
+static int output_alsa_pause(output_data_t *data) {
+  struct alsa_output *alsa = data->priv;
+
+  if (alsa->can_pause) {
+    snd_pcm_state_t state = snd_pcm_state(alsa->handle);
 
     switch (state) {
       case SND_PCM_STATE_PREPARED:
         break;
       case SND_PCM_STATE_RUNNING:
-        snd_pcm_pause(alsa_handle, 1);
+        snd_pcm_pause(alsa->handle, 1);
         break;
       default:
         log_ddebug("error: state is not RUNNING or PREPARED");
@@ -219,19 +356,21 @@ static int output_alsa_pause() {
     return 0;
   } else {
     log_ddebug("snd_pcm_drop");
-    return snd_pcm_drop(alsa_handle);
+    return snd_pcm_drop(alsa->handle);
   }
 }
 
-static int output_alsa_unpause() {
-  if (alsa_can_pause) {
-    snd_pcm_state_t state = snd_pcm_state(alsa_handle);
+static int output_alsa_unpause(output_data_t *data) {
+  struct alsa_output *alsa = data->priv;
+
+  if (alsa->can_pause) {
+    snd_pcm_state_t state = snd_pcm_state(alsa->handle);
 
     switch (state) {
       case SND_PCM_STATE_PREPARED:
         break;
       case SND_PCM_STATE_PAUSED:
-        snd_pcm_pause(alsa_handle, 0);
+        snd_pcm_pause(alsa->handle, 0);
         break;
       default:
         log_ddebug("error: state is not PAUSED or PREPARED");
@@ -241,18 +380,23 @@ static int output_alsa_unpause() {
     return 0;
   } else {
     log_ddebug("snd_pcm_prepare");
-    return snd_pcm_prepare(alsa_handle);
+    return snd_pcm_prepare(alsa->handle);
   }
 }
 
-const struct output_device output_device_ops = {
-    .init = output_alsa_init,
-    .destroy = output_alsa_destroy,
+const struct output_device output_alsa = {
     .open = output_alsa_open,
     .close = output_alsa_close,
     .drop = output_alsa_drop,
     .write = output_alsa_write,
     .wait = output_alsa_wait,
+    .begin = output_alsa_begin,
+    .commit = output_alsa_commit,
     .pause = output_alsa_pause,
     .unpause = output_alsa_unpause,
+};
+
+const output_info_t output_alsa_info = {
+    .name = "alsa",
+    .desc = "ALSA pcm device",
 };
\ No newline at end of file
@@ -1,57 +1,338 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // pwrite, strdup, O_CLOEXEC
+#endif
+
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 #include "output.h"
 #include "pcm.h"
-#include "util.h"
+#include "logging.h"
+#include "util/math.h"
+#include "util/time.h"
 
-FILE* f;
+#define FILE_PATH_DEFAULT "./output.wav"
 
-static int output_file_init() {
-  f = fopen("./output.wav", "wb");
+// Seconds of audio the queue between audio thread and writer can hold
+#define FILE_QUEUE_SECONDS 4
+// Writer flushes once this much is queued, or every FILE_WRITER_INTERVAL_MS
+#define FILE_WRITE_BATCH (256 * 1024)
+#define FILE_WRITER_INTERVAL_MS 50
 
-  return 0;
+#define CACHE_LINE_SIZE 64
+
+// RIFF header with a JUNK chunk reserved for ds64, so the file can be turned into RF64 on close.
+// Recordings past 4 GiB are for other tools, the WAV decoder doesn't read RF64 yet
+#define WAV_HEADER_SIZE 80
+#define WAV_RIFF_MAX 0xffffffffULL
+
+#define WAV_FORMAT_PCM 0x0001
+#define WAV_FORMAT_IEEE_FLOAT 0x0003
+
+/*
+  Audio thread is the only producer and the writer thread is the only consumer of the queue.
+  Positions are free running frame counters, the queue is indexed modulo its power of two capacity.
+  When the queue is full frames are dropped and counted, audio thread never waits for the disk.
+*/
+struct file_output {
+  int fd;
+  char *path;
+  audio_format_t af;
+  uint32_t frame_size;
+
+  uint8_t *queue;
+  uint32_t capacity;    // frames, power of two
+  uint32_t batch;       // frames
+
+  // producer side
+  _Alignas(CACHE_LINE_SIZE) atomic_uint_least64_t head;
+  uint64_t begin_head;
+  uint64_t dropped;
+
+  // consumer side
+  _Alignas(CACHE_LINE_SIZE) atomic_uint_least64_t tail;
+  uint64_t data_size;
+  int error;
+
+  pthread_t thread;
+  atomic_bool running;
+};
+
+static void wav_put_16(uint8_t *p, uint16_t v) {
+  p[0] = v; p[1] = v >> 8;
 }
 
-static int output_file_destroy() {
-  fclose(f);
+static void wav_put_32(uint8_t *p, uint32_t v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
 
-  return 0;
+static void wav_put_64(uint8_t *p, uint64_t v) {
+  wav_put_32(p, v);
+  wav_put_32(p + 4, v >> 32);
 }
 
-static int output_file_open(audio_format_t af) {
+static int wav_write_header(struct file_output *file) {
+  uint8_t header[WAV_HEADER_SIZE] = { 0 };
+  audio_format_t af = file->af;
+  uint64_t riff_size = WAV_HEADER_SIZE - 8 + file->data_size;
+  bool rf64 = riff_size > WAV_RIFF_MAX;
+
+  memcpy(header, rf64 ? "RF64" : "RIFF", 4);
+  wav_put_32(header + 4, rf64 ? WAV_RIFF_MAX : riff_size);
+  memcpy(header + 8, "WAVE", 4);
+
+  memcpy(header + 12, rf64 ? "ds64" : "JUNK", 4);
+  wav_put_32(header + 16, 28);
+  if (rf64) {
+    wav_put_64(header + 20, riff_size);
+    wav_put_64(header + 28, file->data_size);
+    wav_put_64(header + 36, file->data_size / file->frame_size);
+  }
+
+  memcpy(header + 48, "fmt ", 4);
+  wav_put_32(header + 52, 16);
+  wav_put_16(header + 56, af_get_format(af) == SF_FORMAT_FLOAT ? WAV_FORMAT_IEEE_FLOAT : WAV_FORMAT_PCM);
+  wav_put_16(header + 58, af_get_channels(af));
+  wav_put_32(header + 60, af_get_rate(af));
+  wav_put_32(header + 64, af_get_second_size(af));
+  wav_put_16(header + 68, af_get_frame_size(af));
+  wav_put_16(header + 70, af_get_sample_size(af) * 8);
+
+  memcpy(header + 72, "data", 4);
+  wav_put_32(header + 76, rf64 ? WAV_RIFF_MAX : file->data_size);
+
+  if (pwrite(file->fd, header, sizeof(header), 0) != sizeof(header)) return -1;
+
   return 0;
 }
 
-static int output_file_close() {
-  return 0;
+// WAV stores little endian samples, 8-bit ones unsigned, wider ones signed
+static int wav_format_supported(audio_format_t af) {
+  if (af_get_endian(af) != 0) return 0;
+
+  switch (af_get_format(af)) {
+    case SF_FORMAT_U8:
+    case SF_FORMAT_S16:
+    case SF_FORMAT_S24:
+    case SF_FORMAT_S32:
+    case SF_FORMAT_FLOAT:
+      return 1;
+    default:
+      return 0;
+  }
 }
 
-static int output_file_write(const uint8_t *buf, size_t len) {
-  fwrite(buf, 1, len, f);
+static int file_write_all(struct file_output *file, const uint8_t *buf, size_t size) {
+  while (size > 0) {
+    ssize_t r = write(file->fd, buf, size);
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+
+    buf += r;
+    size -= r;
+    file->data_size += r;
+  }
 
   return 0;
 }
 
-static int output_file_buffer_space() {
-  return 1024*1024;
+// Write everything queued up to head, in at most two contiguous pieces
+static void file_flush(struct file_output *file) {
+  uint64_t tail = atomic_load_explicit(&file->tail, memory_order_relaxed);
+  uint64_t head = atomic_load_explicit(&file->head, memory_order_acquire);
+
+  while (tail < head) {
+    uint32_t index = tail & (file->capacity - 1);
+    uint32_t count = min(head - tail, (uint64_t) (file->capacity - index));
+
+    if (!file->error && file_write_all(file, file->queue + (size_t) index * file->frame_size, (size_t) count * file->frame_size) != 0) {
+      log_write(MIZAR_LOGLEVEL_ERROR, "FILE", "Write to %s failed: %s", file->path, strerror(errno));
+      file->error = 1;
+    }
+
+    tail += count;
+    atomic_store_explicit(&file->tail, tail, memory_order_release);
+  }
+}
+
+static void *file_writer_thread(void *param) {
+  struct file_output *file = param;
+
+  while (atomic_load_explicit(&file->running, memory_order_acquire)) {
+    uint64_t tail = atomic_load_explicit(&file->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&file->head, memory_order_acquire);
+
+    // Batch small periods into large writes
+    if (head - tail >= file->batch) file_flush(file);
+    else os_sleep_ms(FILE_WRITER_INTERVAL_MS);
+  }
+
+  file_flush(file);
+  return NULL;
+}
+
+static int output_file_open(output_data_t *data, output_latency_t *latency) {
+  if (!wav_format_supported(data->af)) {
+    log_write(MIZAR_LOGLEVEL_WARN, "FILE", "Sample format is not supported by WAV");
+    return OUTPUT_UNSUPPORTED;
+  }
+
+  const char *path = data->device ? data->device : FILE_PATH_DEFAULT;
+  const char *ext = strrchr(path, '.');
+  if (ext && strcasecmp(ext, ".wav") != 0) {
+    log_write(MIZAR_LOGLEVEL_WARN, "FILE", "Only WAV recording is supported, %s", path);
+    return OUTPUT_UNSUPPORTED;
+  }
+
+  // Queue positions live on their own cache lines, allocation has to honour that
+  struct file_output *file = aligned_alloc(CACHE_LINE_SIZE, sizeof(struct file_output));
+  if (!file) return OUTPUT_ERROR;
+  memset(file, 0, sizeof(struct file_output));
+
+  file->af = data->af;
+  file->frame_size = af_get_frame_size(data->af);
+  file->path = strdup(path);
+
+  file->capacity = 1;
+  while (file->capacity < af_get_rate(data->af) * FILE_QUEUE_SECONDS) file->capacity <<= 1;
+  file->batch = max(FILE_WRITE_BATCH / file->frame_size, 1);
+
+  file->queue = malloc((size_t) file->capacity * file->frame_size);
+  if (!file->queue || !file->path) goto fail;
+
+  file->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (file->fd < 0) {
+    log_write(MIZAR_LOGLEVEL_WARN, "FILE", "Unable to open %s: %s", path, strerror(errno));
+    goto fail;
+  }
+
+  // Sizes are unknown yet, header is rewritten on close
+  if (wav_write_header(file) != 0 || lseek(file->fd, WAV_HEADER_SIZE, SEEK_SET) < 0) {
+    close(file->fd);
+    goto fail;
+  }
+
+  atomic_store(&file->running, true);
+  if (pthread_create(&file->thread, NULL, file_writer_thread, file) != 0) {
+    close(file->fd);
+    goto fail;
+  }
+
+  data->priv = file;
+  return OUTPUT_SUCCESS;
+
+  fail:
+  free(file->queue);
+  free(file->path);
+  free(file);
+  return OUTPUT_ERROR;
+}
+
+static int output_file_close(output_data_t *data) {
+  struct file_output *file = data->priv;
+
+  atomic_store_explicit(&file->running, false, memory_order_release);
+  pthread_join(file->thread, NULL);
+
+  int rc = file->error;
+  if (wav_write_header(file) != 0) rc = -1;
+  if (close(file->fd) != 0) rc = -1;
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "FILE", "Recorded %llu bytes to %s, %llu frames dropped",
+    (unsigned long long) file->data_size, file->path, (unsigned long long) file->dropped);
+
+  free(file->queue);
+  free(file->path);
+  free(file);
+  data->priv = NULL;
+
+  return rc ? OUTPUT_ERROR : OUTPUT_SUCCESS;
+}
+
+static int output_file_drop(output_data_t *data) {
+  return OUTPUT_SUCCESS;
+}
+
+// Audio thread converts straight into the queue
+static uint8_t *output_file_begin(output_data_t *data, uint32_t *frames) {
+  struct file_output *file = data->priv;
+
+  uint64_t head = atomic_load_explicit(&file->head, memory_order_relaxed);
+  uint64_t tail = atomic_load_explicit(&file->tail, memory_order_acquire);
+
+  uint32_t index = head & (file->capacity - 1);
+  uint32_t space = file->capacity - (head - tail);
+  uint32_t count = min(min(space, file->capacity - index), *frames);
+
+  if (count == 0) {
+    // Writer is behind, drop instead of blocking
+    file->dropped += *frames;
+    *frames = 0;
+    return NULL;
+  }
+
+  file->begin_head = head;
+  *frames = count;
+
+  return file->queue + (size_t) index * file->frame_size;
 }
 
-static int output_file_pause() {
+static uint32_t output_file_commit(output_data_t *data, uint32_t frames) {
+  struct file_output *file = data->priv;
+
+  atomic_store_explicit(&file->head, file->begin_head + frames, memory_order_release);
+
+  return frames;
+}
+
+static uint32_t output_file_write(output_data_t *data, const uint8_t *buf, uint32_t frames) {
+  uint32_t done = 0;
+
+  while (done < frames) {
+    uint32_t count = frames - done;
+    uint8_t *dst = output_file_begin(data, &count);
+    if (!dst) break;
+
+    memcpy(dst, buf + (size_t) done * af_get_frame_size(data->af), (size_t) count * af_get_frame_size(data->af));
+    output_file_commit(data, count);
+
+    done += count;
+  }
+
+  // Dropped frames are accounted for in begin, report everything as consumed
+  return frames;
+}
+
+static int output_file_pause(output_data_t *data) {
   return 0;
 }
 
-static int output_file_unpause() {
+static int output_file_unpause(output_data_t *data) {
   return 0;
 }
 
-const struct output_device output_device_ops = {
-    .init = output_file_init,
-    .destroy = output_file_destroy,
+const struct output_device output_file = {
     .open = output_file_open,
     .close = output_file_close,
+    .drop = output_file_drop,
     .write = output_file_write,
-    .buffer_space = output_file_buffer_space,
+    .begin = output_file_begin,
+    .commit = output_file_commit,
     .pause = output_file_pause,
     .unpause = output_file_unpause,
+};
+
+const output_info_t output_file_info = {
+    .name = "file",
+    .desc = "WAV recorder with asynchronous writer",
 };
\ No newline at end of file
@@ -0,0 +1,162 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // clock_nanosleep
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "output.h"
+#include "pcm.h"
+#include "logging.h"
+#include "util/time.h"
+
+// Discards everything. Used for load testing on machines without sound hardware
+//   realtime:   consumes frames at the configured rate from a virtual device buffer
+//   throughput: consumes frames as fast as they are produced
+#define NULL_MODE_REALTIME 0
+#define NULL_MODE_THROUGHPUT 1
+
+struct null_output {
+  int mode;
+  uint32_t rate;
+  uint32_t period_frames;
+  uint32_t buffer_frames;
+
+  uint64_t opened;    // open time, ns
+  uint64_t start;     // time the virtual device started playing, 0 when stopped
+  uint64_t queued;    // frames written since start
+
+  uint64_t frames;    // total frames consumed
+  uint64_t underruns;
+};
+
+// Frames the virtual device has played since start
+static uint64_t null_played(struct null_output *null, uint64_t now) {
+  return (now - null->start) * null->rate / 1000000000ULL;
+}
+
+static int output_null_open(output_data_t *data, output_latency_t *latency) {
+  int mode;
+
+  if (!data->device || strcmp(data->device, "realtime") == 0) {
+    mode = NULL_MODE_REALTIME;
+  } else if (strcmp(data->device, "throughput") == 0) {
+    mode = NULL_MODE_THROUGHPUT;
+  } else {
+    log_write(MIZAR_LOGLEVEL_WARN, "NULL", "Unknown mode %s, expected realtime or throughput", data->device);
+    return OUTPUT_INVALIDPARAM;
+  }
+
+  struct null_output *null = calloc(1, sizeof(struct null_output));
+  if (!null) return OUTPUT_ERROR;
+
+  uint32_t latency_us = latency->latency_us ? latency->latency_us : OUTPUT_LATENCY_DEFAULT;
+  uint32_t periods = latency->periods ? latency->periods : OUTPUT_PERIODS_DEFAULT;
+
+  null->mode = mode;
+  null->rate = af_get_rate(data->af);
+  null->period_frames = (uint64_t) null->rate * latency_us / 1000000 / periods;
+  if (null->period_frames == 0) null->period_frames = 1;
+  null->buffer_frames = null->period_frames * periods;
+  null->opened = os_gettime_ns();
+
+  latency->period_frames = null->period_frames;
+  latency->buffer_frames = null->buffer_frames;
+
+  data->priv = null;
+  return OUTPUT_SUCCESS;
+}
+
+static int output_null_close(output_data_t *data) {
+  struct null_output *null = data->priv;
+
+  double elapsed = (double) (os_gettime_ns() - null->opened) / 1e9;
+  double audio_time = (double) null->frames / null->rate;
+
+  log_write(MIZAR_LOGLEVEL_INFO, "NULL", "%s: %llu frames in %.2f s (%.2fx realtime), %llu underruns",
+    null->mode == NULL_MODE_REALTIME ? "realtime" : "throughput",
+    (unsigned long long) null->frames, elapsed, elapsed > 0 ? audio_time / elapsed : 0.0,
+    (unsigned long long) null->underruns);
+
+  free(null);
+  data->priv = NULL;
+
+  return OUTPUT_SUCCESS;
+}
+
+static int output_null_drop(output_data_t *data) {
+  struct null_output *null = data->priv;
+
+  null->start = 0;
+  null->queued = 0;
+
+  return OUTPUT_SUCCESS;
+}
+
+static uint32_t output_null_write(output_data_t *data, const uint8_t *buf, uint32_t frames) {
+  struct null_output *null = data->priv;
+
+  null->frames += frames;
+  if (null->mode == NULL_MODE_THROUGHPUT) return frames;
+
+  uint64_t now = os_gettime_ns();
+
+  // Device ran dry before these frames arrived, restart playback like ALSA does after xrun
+  if (null->start && null_played(null, now) > null->queued) {
+    null->underruns++;
+    null->start = 0;
+  }
+
+  if (!null->start) {
+    null->start = now;
+    null->queued = 0;
+  }
+
+  null->queued += frames;
+  return frames;
+}
+
+static uint32_t output_null_wait(output_data_t *data) {
+  struct null_output *null = data->priv;
+
+  if (null->mode == NULL_MODE_THROUGHPUT || !null->start)
+    return null->period_frames;
+
+  // Sleep until a whole period of the virtual buffer is free
+  uint64_t now = os_gettime_ns();
+  uint64_t played = null_played(null, now);
+  uint64_t fill = null->queued > played ? null->queued - played : 0;
+
+  if (fill + null->period_frames > null->buffer_frames) {
+    uint64_t target = null->queued + null->period_frames - null->buffer_frames;
+    os_sleep_until_ns(null->start + pcm_frames_to_ns(null->rate, target));
+
+    played = null_played(null, os_gettime_ns());
+    fill = null->queued > played ? null->queued - played : 0;
+  }
+
+  return fill < null->buffer_frames ? null->buffer_frames - fill : 0;
+}
+
+static int output_null_pause(output_data_t *data) {
+  return output_null_drop(data);
+}
+
+static int output_null_unpause(output_data_t *data) {
+  return 0;
+}
+
+const struct output_device output_null = {
+    .open = output_null_open,
+    .close = output_null_close,
+    .drop = output_null_drop,
+    .write = output_null_write,
+    .wait = output_null_wait,
+    .pause = output_null_pause,
+    .unpause = output_null_unpause,
+};
+
+const output_info_t output_null_info = {
+    .name = "null",
+    .desc = "Discards output, realtime or throughput paced",
+};
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "pcm_conv.h"
+#include "logging.h"
+#include "util/math.h"
+#include "output/output.h"
+#include "output/output_impl.h"
+
+typedef struct {
+  const struct output_device *ops;
+  const output_info_t *info;
+} output_entry_t;
+
+static const output_entry_t outputs[] = {
+  { &output_alsa, &output_alsa_info },
+  { &output_file, &output_file_info },
+  { &output_null, &output_null_info },
+  { &output_pipe, &output_pipe_info },
+};
+
+#define OUTPUTS_COUNT (sizeof(outputs) / sizeof(outputs[0]))
+
+int output_find(output_t *output, const char *name) {
+  if (!output || !name)
+    return OUTPUT_INVALIDPARAM;
+
+  for (size_t i = 0; i < OUTPUTS_COUNT; i++) {
+    if (strcmp(outputs[i].info->name, name) == 0) {
+      memset(output, 0, sizeof(*output));
+      output->ops = *outputs[i].ops;
+      output->info = outputs[i].info;
+      return OUTPUT_SUCCESS;
+    }
+  }
+
+  return OUTPUT_UNSUPPORTED;
+}
+
+int output_open(output_t *output, const char *name, const char *device, audio_format_t af, output_latency_t *latency) {
+  int rc = output_find(output, name);
+  if (rc != OUTPUT_SUCCESS) {
+    log_write(MIZAR_LOGLEVEL_WARN, "OUTPUT", "No output driver named %s", name ? name : "(null)");
+    return rc;
+  }
+
+  if (af_get_channels(af) == 0 || af_get_channels(af) > OUTPUT_MAX_CHANNELS)
+    return OUTPUT_INVALIDPARAM;
+
+  output_latency_t defaults = { 0 };
+  if (!latency) latency = &defaults;
+
+  output->data.af = af;
+  output->data.device = device;
+
+  // Drivers with begin/commit may still refuse to map, so staging buffer is always there
+  output->buffer = malloc((size_t) OUTPUT_BUFFER_FRAMES * af_get_frame_size(af));
+  if (!output->buffer) return OUTPUT_ERROR;
+
+  rc = output->ops.open(&output->data, latency);
+  if (rc != OUTPUT_SUCCESS) {
+    log_write(MIZAR_LOGLEVEL_WARN, "OUTPUT", "Unable to open %s output", name);
+    free(output->buffer);
+    output->buffer = NULL;
+    return rc;
+  }
+
+  // Outputs without a device clock get a period derived from the requested latency
+  if (latency->period_frames == 0) {
+    uint32_t latency_us = latency->latency_us ? latency->latency_us : OUTPUT_LATENCY_DEFAULT;
+    uint32_t periods = latency->periods ? latency->periods : OUTPUT_PERIODS_DEFAULT;
+
+    latency->period_frames = max((uint64_t) af_get_rate(af) * latency_us / 1000000 / periods, 1);
+    latency->buffer_frames = latency->period_frames * periods;
+  }
+
+  log_write(MIZAR_LOGLEVEL_DEBUG, "OUTPUT", "Opened %s (%s) output%s%s, period %u frames",
+    output->info->name, output->info->desc, device ? " on " : "", device ? device : "",
+    latency->period_frames);
+
+  return OUTPUT_SUCCESS;
+}
+
+int output_close(output_t *output) {
+  if (!output || !output->info)
+    return OUTPUT_INVALIDPARAM;
+
+  int rc = output->ops.close(&output->data);
+
+  free(output->buffer);
+  output->buffer = NULL;
+
+  return rc;
+}
+
+// Sets *unmapped when driver refused to map memory and write has to be used instead
+static uint32_t output_write_mapped(output_t *output, const float *const *planes, uint32_t frames, int *unmapped) {
+  const float *src[OUTPUT_MAX_CHANNELS];
+  uint8_t channels = af_get_channels(output->data.af);
+  uint32_t done = 0;
+
+  while (done < frames) {
+    uint32_t count = frames - done;
+    uint8_t *area = output->ops.begin(&output->data, &count);
+
+    if (!area) {
+      // device ring is full, wait for room and retry
+      if (count == 0 && output->ops.wait && output->ops.wait(&output->data) > 0) continue;
+
+      *unmapped = count != 0;
+      break;
+    }
+
+    for (uint8_t ch = 0; ch < channels; ch++) src[ch] = planes[ch] + done;
+
+    pcm_planar_to_fixed(output->data.af, area, src, count);
+    if (output->ops.commit(&output->data, count) != count) break;
+
+    done += count;
+  }
+
+  return done;
+}
+
+uint32_t output_write_planar(output_t *output, const float *const *planes, uint32_t frames) {
+  const float *src[OUTPUT_MAX_CHANNELS];
+  uint8_t channels = af_get_channels(output->data.af);
+  uint32_t done = 0;
+
+  if (output->ops.begin) {
+    int unmapped = 0;
+
+    done = output_write_mapped(output, planes, frames, &unmapped);
+    if (!unmapped) return done;
+  }
+
+  while (done < frames) {
+    uint32_t count = min(frames - done, OUTPUT_BUFFER_FRAMES);
+
+    for (uint8_t ch = 0; ch < channels; ch++) src[ch] = planes[ch] + done;
+
+    pcm_planar_to_fixed(output->data.af, output->buffer, src, count);
+
+    uint32_t written = output->ops.write(&output->data, output->buffer, count);
+    done += written;
+    if (written < count) break;
+  }
+
+  return done;
+}
\ No newline at end of file
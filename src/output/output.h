@@ -4,18 +4,103 @@
 #include <stdint.h>
 #include "pcm.h"
 
+#define OUTPUT_SUCCESS 0
+#define OUTPUT_INVALIDPARAM -1
+#define OUTPUT_ERROR -2
+#define OUTPUT_UNSUPPORTED -3
+
+#define OUTPUT_MAX_CHANNELS 8
+
+// Latency profile used when open is asked for device defaults
+#define OUTPUT_LATENCY_DEFAULT 20000 // 20 ms
+#define OUTPUT_PERIODS_DEFAULT 2
+
+// Frames converted at once by output_write_planar when device memory can't be mapped
+#define OUTPUT_BUFFER_FRAMES 1024
+
+// Latency profile requested from output on open, achieved sizes are written back
+typedef struct {
+	uint32_t latency_us;    // target buffer latency, 0 for device default
+	uint32_t periods;       // periods per buffer, 0 for device default
+
+	uint32_t period_frames; // negotiated period size
+	uint32_t buffer_frames; // negotiated buffer size
+} output_latency_t;
+
+typedef struct {
+	audio_format_t af;
+	const char *device;     // driver specific target: ALSA pcm name, file path, command
+	void *priv;
+} output_data_t;
+
+typedef struct {
+	const char *name;
+	const char *desc;
+} output_info_t;
+
 struct output_device {
-	int (*init)(void);
-	int (*destroy)(void);
-	int (*open)(audio_format_t af);
-	int (*close)(void);
-	int (*drop)(void);
-	uint32_t (*write)(const uint8_t *buf, uint32_t frames);
-	uint32_t (*wait)(void);
-	int (*pause)(void);
-	int (*unpause)(void);
+	int (*open)(output_data_t *data, output_latency_t *latency);
+	int (*close)(output_data_t *data);
+	int (*drop)(output_data_t *data);
+	uint32_t (*write)(output_data_t *data, const uint8_t *buf, uint32_t frames);
+	// Optional, blocks until output can take more frames. Outputs without it are paced by clock
+	uint32_t (*wait)(output_data_t *data);
+	// Zero-copy access, optional. begin maps up to *frames contiguous interleaved frames of
+	// device memory and updates *frames, returns NULL when mapping is unavailable.
+	// Each successful begin is followed by commit with the number of frames filled
+	uint8_t *(*begin)(output_data_t *data, uint32_t *frames);
+	uint32_t (*commit)(output_data_t *data, uint32_t frames);
+	int (*pause)(output_data_t *data);
+	int (*unpause)(output_data_t *data);
 };
 
-const struct output_device output_device_ops;
+typedef struct {
+	output_data_t data;
+	struct output_device ops;
+	const output_info_t *info;
+
+	// staging buffer for outputs without begin/commit
+	uint8_t *buffer;
+} output_t;
+
+/**
+ * Find output driver by name
+ *
+ * @param output Output to be filled with driver ops and info
+ * @param name Driver name: alsa, file, null or pipe
+ * @return OUTPUT_SUCCESS or OUTPUT_UNSUPPORTED if there is no such driver
+ */
+int output_find(output_t *output, const char *name);
+
+/**
+ * Find output driver by name and open an instance of it
+ *
+ * @param output Output instance to be opened
+ * @param name Driver name
+ * @param device Driver specific target, may be NULL for driver default
+ * @param af Sample format written to the output
+ * @param latency Requested latency profile, negotiated sizes are written back. May be NULL
+ * @return OUTPUT_SUCCESS or error code
+ */
+int output_open(output_t *output, const char *name, const char *device, audio_format_t af, output_latency_t *latency);
+
+/**
+ * Close output instance and release its resources
+ *
+ * @param output Opened output
+ * @return OUTPUT_SUCCESS or error code
+ */
+int output_close(output_t *output);
+
+/**
+ * Convert planar float frames to the output format and write them. Conversion goes straight
+ * into device memory when the driver supports begin/commit
+ *
+ * @param output Opened output
+ * @param planes One buffer per output channel
+ * @param frames Number of frames
+ * @return Number of frames written
+ */
+uint32_t output_write_planar(output_t *output, const float *const *planes, uint32_t frames);
 
 #endif
\ No newline at end of file
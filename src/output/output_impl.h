@@ -0,0 +1,18 @@
+#ifndef _H_OUTPUT_IMPL_
+#define _H_OUTPUT_IMPL_
+
+#include "output/output.h"
+
+extern const struct output_device output_alsa;
+extern const output_info_t output_alsa_info;
+
+extern const struct output_device output_file;
+extern const output_info_t output_file_info;
+
+extern const struct output_device output_null;
+extern const output_info_t output_null_info;
+
+extern const struct output_device output_pipe;
+extern const output_info_t output_pipe_info;
+
+#endif
\ No newline at end of file
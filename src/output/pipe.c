@@ -0,0 +1,86 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // popen, pclose
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include "output.h"
+#include "pcm.h"
+#include "logging.h"
+
+// Raw interleaved PCM written to stdin of a command, or to our stdout when there is no command
+struct pipe_output {
+  FILE *f;
+  int is_process;
+  uint32_t frame_size;
+};
+
+static int output_pipe_open(output_data_t *data, output_latency_t *latency) {
+  struct pipe_output *pipe = calloc(1, sizeof(struct pipe_output));
+  if (!pipe) return OUTPUT_ERROR;
+
+  if (data->device && data->device[0] != '\0' && !(data->device[0] == '-' && data->device[1] == '\0')) {
+    // Reader going away must not kill the whole server
+    signal(SIGPIPE, SIG_IGN);
+
+    pipe->f = popen(data->device, "w");
+    pipe->is_process = 1;
+  } else {
+    pipe->f = stdout;
+  }
+
+  if (!pipe->f) {
+    log_write(MIZAR_LOGLEVEL_WARN, "PIPE", "Unable to start %s", data->device);
+    free(pipe);
+    return OUTPUT_ERROR;
+  }
+
+  pipe->frame_size = af_get_frame_size(data->af);
+
+  data->priv = pipe;
+  return OUTPUT_SUCCESS;
+}
+
+static int output_pipe_close(output_data_t *data) {
+  struct pipe_output *pipe = data->priv;
+  int rc = pipe->is_process ? pclose(pipe->f) : fflush(pipe->f);
+
+  free(pipe);
+  data->priv = NULL;
+
+  return rc ? OUTPUT_ERROR : OUTPUT_SUCCESS;
+}
+
+static int output_pipe_drop(output_data_t *data) {
+  return OUTPUT_SUCCESS;
+}
+
+static uint32_t output_pipe_write(output_data_t *data, const uint8_t *buf, uint32_t frames) {
+  struct pipe_output *pipe = data->priv;
+
+  return fwrite(buf, pipe->frame_size, frames, pipe->f);
+}
+
+static int output_pipe_pause(output_data_t *data) {
+  return 0;
+}
+
+static int output_pipe_unpause(output_data_t *data) {
+  return 0;
+}
+
+const struct output_device output_pipe = {
+    .open = output_pipe_open,
+    .close = output_pipe_close,
+    .drop = output_pipe_drop,
+    .write = output_pipe_write,
+    .pause = output_pipe_pause,
+    .unpause = output_pipe_unpause,
+};
+
+const output_info_t output_pipe_info = {
+    .name = "pipe",
+    .desc = "Raw PCM to a command or stdout",
+};
\ No newline at end of file
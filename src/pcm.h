@@ -27,11 +27,13 @@ typedef uint32_t audio_format_t;
 #define SF_FORMAT_U8    0x02 /* 8-bit unsigned */
 #define SF_FORMAT_S16   0x03 /* 16-bit signed */
 #define SF_FORMAT_U16   0x04 /* 16-bit unsigned */
-#define SF_FORMAT_S24   0x05 /* 24-bit signed */
-#define SF_FORMAT_U24   0x06 /* 24-bit unsigned */
-#define SF_FORMAT_S32   0x07 /* 24-bit signed */
-#define SF_FORMAT_U32   0x08 /* 24-bit unsigned */
+#define SF_FORMAT_S24   0x05 /* 24-bit signed, packed in 3 bytes */
+#define SF_FORMAT_U24   0x06 /* 24-bit unsigned, packed in 3 bytes */
+#define SF_FORMAT_S32   0x07 /* 32-bit signed */
+#define SF_FORMAT_U32   0x08 /* 32-bit unsigned */
 #define SF_FORMAT_FLOAT 0x09 /* float in range -1.0 to 1.0 */
+#define SF_FORMAT_S24_32 0x0a /* 24-bit signed in low bits of 32-bit container */
+#define SF_FORMAT_U24_32 0x0b /* 24-bit unsigned in low bits of 32-bit container */
 
 #define AF_ENDIAN_MASK    0x00000001
 #define AF_FORMAT_MASK    0x0000003e
@@ -59,11 +61,13 @@ static inline uint8_t af_get_signed(audio_format_t af) {
     case SF_FORMAT_U8: 
     case SF_FORMAT_U16:
     case SF_FORMAT_U24:
+    case SF_FORMAT_U24_32:
     case SF_FORMAT_U32:
     case SF_FORMAT_FLOAT: return 0;
     case SF_FORMAT_S8:
     case SF_FORMAT_S16:
     case SF_FORMAT_S24:
+    case SF_FORMAT_S24_32:
     case SF_FORMAT_S32: return 1;
   }
 }
@@ -76,7 +80,9 @@ static inline uint8_t af_get_depth(audio_format_t af) {
     case SF_FORMAT_S16:
     case SF_FORMAT_U16: return 16;
     case SF_FORMAT_S24:
-    case SF_FORMAT_U24: return 24;
+    case SF_FORMAT_U24:
+    case SF_FORMAT_S24_32:
+    case SF_FORMAT_U24_32: return 24;
     case SF_FORMAT_S32:
     case SF_FORMAT_U32:
     case SF_FORMAT_FLOAT: return 32;
@@ -92,6 +98,8 @@ static inline uint8_t af_get_sample_size(audio_format_t af) {
     case SF_FORMAT_U16: return 2;
     case SF_FORMAT_S24:
     case SF_FORMAT_U24: return 3;
+    case SF_FORMAT_S24_32:
+    case SF_FORMAT_U24_32:
     case SF_FORMAT_S32:
     case SF_FORMAT_U32:
     case SF_FORMAT_FLOAT: return 4;
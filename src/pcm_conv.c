@@ -1,296 +1,837 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "pcm_conv.h"
+#include "util/cpu.h"
 #include "util/mem.h"
+#include "util/math.h"
 #include "util/int128.h"
 
-static void float_to_u8 (uint8_t *dst, const float *src, const uint32_t samples) {
+// PCM_CONV_NO_SIMD leaves only scalar converters, tests compare vector paths against them
+#if defined(CPU_X86) && defined(__SSE2__) && !defined(PCM_CONV_NO_SIMD)
+  #include <emmintrin.h>
+  #define PCM_CONV_SSE2 1
+#endif
+
+#if defined(__aarch64__) && !defined(PCM_CONV_NO_SIMD)
+  #include <arm_neon.h>
+  #define PCM_CONV_NEON 1
+#endif
+
+/*
+  Conversion rules, same for every path:
+    float -> fixed: scale by 2^(depth-1), round to nearest, saturate to the signed range,
+                    unsigned formats flip the sign bit of the result
+    fixed -> float: flip sign bit of unsigned formats, divide by 2^(depth-1)
+  Byte order is swapped in the same pass when af endian differs from the native one.
+*/
+
+#define S8_SCALE   128.0f
+#define S16_SCALE  32768.0f
+#define S24_SCALE  8388608.0f
+#define S32_SCALE  2147483648.0f
+
+// Largest float below 2^31, converting 2^31 itself overflows int32
+#define S32_MAX_F  2147483520.0f
+
+// Staging size for planar conversions without a fused kernel
+#define PCM_CONV_CHUNK_SAMPLES 1024
+
+static inline int32_t float_to_int(float f, float scale, float lo, float hi) {
+	float v = f * scale;
+	v = v < lo ? lo : v;
+	v = v > hi ? hi : v;
+	return (int32_t) lrintf(v);
+}
+
+//
+// Scalar converters. Vector versions below process the bulk and leave the tail here
+//
+static void float_to_8(uint8_t *dst, const float *src, uint32_t samples, uint8_t sign) {
+	for (uint32_t i = 0; i < samples; i++)
+		dst[i] = (uint8_t) float_to_int(src[i], S8_SCALE, -128.0f, 127.0f) ^ sign;
+}
+
+static void float_to_16(uint8_t *dst, const float *src, uint32_t samples, uint16_t sign, int swap) {
+	uint16_t *out = (uint16_t *) dst;
+
 	for (uint32_t i = 0; i < samples; i++) {
-		float f = src[i] * INT32_MAX;
-
-		if (f >= INT32_MAX)
-			dst[i] = UINT8_MAX;
-		else if (f <= INT32_MIN)
-			dst[i] = 0;
-		else
-			dst[i] = (unsigned int)((lrintf(f) >> 24) - INT8_MIN);
+		uint16_t v = (uint16_t) float_to_int(src[i], S16_SCALE, -32768.0f, 32767.0f) ^ sign;
+		out[i] = swap ? BSWAP_16(v) : v;
 	}
 }
 
-static void float_to_s8 (uint8_t *dst, const float *src, const uint32_t samples) {
+static void float_to_24(uint8_t *dst, const float *src, uint32_t samples, uint32_t sign, int big_endian) {
 	for (uint32_t i = 0; i < samples; i++) {
-		float f = src[i] * INT32_MAX;
-
-		if (f >= INT32_MAX)
-			dst[i] = INT8_MAX;
-		else if (f <= INT32_MIN)
-			dst[i] = INT8_MIN;
-		else
-			dst[i] = lrintf(f) >> 24;
+		uint32_t v = (uint32_t) float_to_int(src[i], S24_SCALE, -8388608.0f, 8388607.0f) ^ sign;
+		uint8_t *out = dst + i * 3;
+
+		if (big_endian) {
+			out[0] = v >> 16; out[1] = v >> 8; out[2] = v;
+		} else {
+			out[0] = v; out[1] = v >> 8; out[2] = v >> 16;
+		}
 	}
 }
 
-static void float_to_u16 (uint8_t *dst, const float *src, const uint32_t samples) {
+static void float_to_24_32(uint8_t *dst, const float *src, uint32_t samples, uint32_t sign, uint32_t mask, int swap) {
+	uint32_t *out = (uint32_t *) dst;
+
 	for (uint32_t i = 0; i < samples; i++) {
-		uint16_t *out_val = (uint16_t *)(dst + i * sizeof (uint16_t));
-		float f = src[i] * INT32_MAX;
-
-		if (f >= INT32_MAX)
-			*out_val = UINT16_MAX;
-		else if (f <= INT32_MIN)
-			*out_val = 0;
-		else
-			*out_val = (unsigned int)((lrintf(f) >> 16) - INT16_MIN);
+		uint32_t v = ((uint32_t) float_to_int(src[i], S24_SCALE, -8388608.0f, 8388607.0f) ^ sign) & mask;
+		out[i] = swap ? BSWAP_32(v) : v;
 	}
 }
 
-static void float_to_s16 (uint8_t *dst, const float *src, const uint32_t samples) {
+static void float_to_32(uint8_t *dst, const float *src, uint32_t samples, uint32_t sign, int swap) {
+	uint32_t *out = (uint32_t *) dst;
+
 	for (uint32_t i = 0; i < samples; i++) {
-		int16_t *out_val = (int16_t *)(dst + i * sizeof (int16_t));
-		float f = src[i] * INT32_MAX;
-
-		if (f >= INT32_MAX)
-			*out_val = INT16_MAX;
-		else if (f <= INT32_MIN)
-			*out_val = INT16_MIN;
-		else
-			*out_val = lrintf(f) >> 16;
+		uint32_t v = (uint32_t) float_to_int(src[i], S32_SCALE, -S32_SCALE, S32_MAX_F) ^ sign;
+		out[i] = swap ? BSWAP_32(v) : v;
 	}
 }
 
-static void float_to_u24 (uint8_t *dst, const float *src,const uint32_t samples) {
+static void float_to_float(uint8_t *dst, const float *src, uint32_t samples, int swap) {
+	if (!swap) {
+		memcpy(dst, src, samples * sizeof(float));
+		return;
+	}
 
+	uint32_t *out = (uint32_t *) dst;
+	const uint32_t *in = (const uint32_t *) src;
+	for (uint32_t i = 0; i < samples; i++) out[i] = BSWAP_32(in[i]);
 }
 
-static void float_to_s24 (uint8_t *dst, const float *src, const uint32_t samples) {
+static void from_8_to_float(float *dst, const uint8_t *src, uint32_t samples, uint8_t sign) {
+	for (uint32_t i = 0; i < samples; i++) dst[i] = (int8_t) (src[i] ^ sign) / S8_SCALE;
+}
 
+static void from_16_to_float(float *dst, const uint8_t *src, uint32_t samples, uint16_t sign, int swap) {
+	const uint16_t *in = (const uint16_t *) src;
+
+	for (uint32_t i = 0; i < samples; i++) {
+		uint16_t v = swap ? BSWAP_16(in[i]) : in[i];
+		dst[i] = (int16_t) (v ^ sign) / S16_SCALE;
+	}
+}
+
+static void from_24_to_float(float *dst, const uint8_t *src, uint32_t samples, uint32_t sign, int big_endian) {
+	for (uint32_t i = 0; i < samples; i++) {
+		const uint8_t *in = src + i * 3;
+		uint32_t v = big_endian
+			? (uint32_t) in[0] << 16 | (uint32_t) in[1] << 8 | in[2]
+			: (uint32_t) in[2] << 16 | (uint32_t) in[1] << 8 | in[0];
+
+		// sign extend from 24 bits
+		dst[i] = ((int32_t) ((v ^ sign) << 8) >> 8) / S24_SCALE;
+	}
 }
 
-static void float_to_u32 (uint8_t *dst, const float *src, const uint32_t samples) {
-	const unsigned int U32_MAX = (1 << 24) - 1;
-	const int S32_MAX = (1 << 23) - 1;
-	const int S32_MIN = -(1 << 23);
+static void from_24_32_to_float(float *dst, const uint8_t *src, uint32_t samples, uint32_t sign, int swap) {
+	const uint32_t *in = (const uint32_t *) src;
 
 	for (uint32_t i = 0; i < samples; i++) {
-		uint32_t *out_val = (uint32_t *)(dst + i * sizeof (uint32_t));
-		float f = src[i] * S32_MAX;
-
-		if (f >= S32_MAX)
-			*out_val = U32_MAX << 8;
-		else if (f <= S32_MIN)
-			*out_val = 0;
-		else
-			*out_val = (uint32_t)(lrintf(f) - S32_MIN) << 8;
+		uint32_t v = swap ? BSWAP_32(in[i]) : in[i];
+		dst[i] = ((int32_t) ((v ^ sign) << 8) >> 8) / S24_SCALE;
 	}
 }
 
-static void float_to_s32 (uint8_t *dst, const float *src, const uint32_t samples)
-{
-	const int S32_MAX = (1 << 23) - 1;
-	const int S32_MIN = -(1 << 23);
+static void from_32_to_float(float *dst, const uint8_t *src, uint32_t samples, uint32_t sign, int swap) {
+	const uint32_t *in = (const uint32_t *) src;
 
 	for (uint32_t i = 0; i < samples; i++) {
-		int32_t *out_val = (int32_t *)(dst + i * sizeof (int32_t));
-		float f = src[i] * S32_MAX;
-
-		if (f >= S32_MAX)
-			*out_val = S32_MAX << 8;
-		else if (f <= S32_MIN)
-			*out_val = S32_MIN * 256;
-		else
-			*out_val = lrintf(f) << 8;
+		uint32_t v = swap ? BSWAP_32(in[i]) : in[i];
+		dst[i] = (int32_t) (v ^ sign) / S32_SCALE;
 	}
 }
 
-static void u8_to_float (float *dst, const uint8_t *src, const uint32_t samples) {
-	for (uint32_t i = 0; i < samples; i++) dst[i] = (((int)*src++) + INT8_MIN) / (float)(INT8_MAX + 1);
+static void from_float_to_float(float *dst, const uint8_t *src, uint32_t samples, int swap) {
+	if (!swap) {
+		memcpy(dst, src, samples * sizeof(float));
+		return;
+	}
+
+	uint32_t *out = (uint32_t *) dst;
+	const uint32_t *in = (const uint32_t *) src;
+	for (uint32_t i = 0; i < samples; i++) out[i] = BSWAP_32(in[i]);
 }
 
-static void s8_to_float (float *dst, const uint8_t *src, const uint32_t samples) {
-	for (uint32_t i = 0; i < samples; i++) dst[i] = *src++ / (float)(INT8_MAX + 1);
+//
+// SSE2 kernels, return number of processed samples
+//
+#if defined(PCM_CONV_SSE2)
+static inline __m128i sse2_bswap_16(__m128i v) {
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
 }
 
-static void u16_to_float (float *dst, const uint8_t *src, const uint32_t samples) {
-	const uint16_t *in_16 = (uint16_t *)src;
-	for (uint32_t i = 0; i < samples; i++) dst[i] = ((int)*in_16++ + INT16_MIN) / (float)(INT16_MAX + 1);
+static inline __m128i sse2_bswap_32(__m128i v) {
+	v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xb1), 0xb1);
+	return sse2_bswap_16(v);
 }
 
-static void s16_to_float (float *dst, const uint8_t *src, const uint32_t samples) {
-	const int16_t *in_16 = (int16_t *)src;
-	for (uint32_t i = 0; i < samples; i++) dst[i] = *in_16++ / (float)(INT16_MAX + 1);
+static uint32_t float_to_16_sse2(uint8_t *dst, const float *src, uint32_t samples, uint16_t sign, int swap) {
+	const __m128 scale = _mm_set1_ps(S16_SCALE);
+	const __m128 lo = _mm_set1_ps(-1.0f);
+	const __m128 hi = _mm_set1_ps(1.0f);
+	const __m128i flip = _mm_set1_epi16((short) sign);
+
+	uint32_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		__m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo), hi);
+		__m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), lo), hi);
+
+		// packs saturates 32768 to 32767
+		__m128i v = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(a, scale)), _mm_cvtps_epi32(_mm_mul_ps(b, scale)));
+		v = _mm_xor_si128(v, flip);
+		if (swap) v = sse2_bswap_16(v);
+
+		_mm_storeu_si128((__m128i *) (dst + i * 2), v);
+	}
+
+	return i;
 }
 
-static void u24_to_float (float *dst, const uint8_t *src, const uint32_t samples) {
-  // that will hurt
+static uint32_t float_to_32_sse2(uint8_t *dst, const float *src, uint32_t samples, float scale_f, float lo_f, float hi_f, uint32_t sign, uint32_t mask, int swap) {
+	const __m128 scale = _mm_set1_ps(scale_f);
+	const __m128 lo = _mm_set1_ps(lo_f);
+	const __m128 hi = _mm_set1_ps(hi_f);
+	const __m128i flip = _mm_set1_epi32((int) sign);
+	const __m128i keep = _mm_set1_epi32((int) mask);
+
+	uint32_t i = 0;
+	for (; i + 4 <= samples; i += 4) {
+		__m128 f = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+		f = _mm_min_ps(_mm_max_ps(f, lo), hi);
+
+		__m128i v = _mm_and_si128(_mm_xor_si128(_mm_cvtps_epi32(f), flip), keep);
+		if (swap) v = sse2_bswap_32(v);
+
+		_mm_storeu_si128((__m128i *) (dst + i * 4), v);
+	}
+
+	return i;
 }
 
-static void s24_to_float (float *dst, const uint8_t *src, const uint32_t samples) {
-	// and this too
+static uint32_t from_16_to_float_sse2(float *dst, const uint8_t *src, uint32_t samples, uint16_t sign, int swap) {
+	const __m128 scale = _mm_set1_ps(1.0f / S16_SCALE);
+	const __m128i flip = _mm_set1_epi16((short) sign);
+
+	uint32_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (src + i * 2));
+		if (swap) v = sse2_bswap_16(v);
+		v = _mm_xor_si128(v, flip);
+
+		// sign extend 16 -> 32 bits
+		__m128i l = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i h = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+		_mm_storeu_ps(dst + i,     _mm_mul_ps(_mm_cvtepi32_ps(l), scale));
+		_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(h), scale));
+	}
+
+	return i;
 }
 
-static void u32_to_float (float *dst, const uint8_t *src, const uint32_t samples) {
-	const uint32_t *in_32 = (uint32_t *)src;
-	for (uint32_t i = 0; i < samples; i++) dst[i] = ((float)*in_32++ + (float)INT32_MIN) / ((float)INT32_MAX + 1.0);
+static uint32_t from_32_to_float_sse2(float *dst, const uint8_t *src, uint32_t samples, float scale_f, uint32_t sign, int shift, int swap) {
+	const __m128 scale = _mm_set1_ps(1.0f / scale_f);
+	const __m128i flip = _mm_set1_epi32((int) sign);
+
+	uint32_t i = 0;
+	for (; i + 4 <= samples; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (src + i * 4));
+		if (swap) v = sse2_bswap_32(v);
+		v = _mm_xor_si128(v, flip);
+		if (shift) v = _mm_srai_epi32(_mm_slli_epi32(v, shift), shift);
+
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+
+	return i;
 }
 
-static void s32_to_float (float *dst, const uint8_t *src,  const uint32_t samples) {
-	const int32_t *in_32 = (int32_t *) src;
-	for (uint32_t i = 0; i < samples; i++) dst[i] = *in_32++ / ((float)INT32_MAX + 1.0);
+//
+// Stereo planar <-> interleaved kernels, format conversion and interleaving in one pass
+//
+static uint32_t planar2_to_16_sse2(uint8_t *dst, const float *l, const float *r, uint32_t frames, uint16_t sign, int swap) {
+	const __m128 scale = _mm_set1_ps(S16_SCALE);
+	const __m128 lo = _mm_set1_ps(-1.0f);
+	const __m128 hi = _mm_set1_ps(1.0f);
+	const __m128i flip = _mm_set1_epi16((short) sign);
+
+#define LOAD_S32(p) _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), lo), hi), scale))
+	uint32_t i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		__m128i vl = _mm_packs_epi32(LOAD_S32(l + i), LOAD_S32(l + i + 4));
+		__m128i vr = _mm_packs_epi32(LOAD_S32(r + i), LOAD_S32(r + i + 4));
+
+		__m128i va = _mm_xor_si128(_mm_unpacklo_epi16(vl, vr), flip);
+		__m128i vb = _mm_xor_si128(_mm_unpackhi_epi16(vl, vr), flip);
+		if (swap) {
+			va = sse2_bswap_16(va);
+			vb = sse2_bswap_16(vb);
+		}
+
+		_mm_storeu_si128((__m128i *) (dst + i * 4), va);
+		_mm_storeu_si128((__m128i *) (dst + i * 4 + 16), vb);
+	}
+#undef LOAD_S32
+
+	return i;
 }
 
-static void swap_sign_8(uint8_t* src, const uint32_t samples) {
-	for (uint32_t i = 0; i < samples; i++) *src++ ^= 1 << 7;
+static uint32_t planar2_to_32_sse2(uint8_t *dst, const float *l, const float *r, uint32_t frames, float scale_f, float lo_f, float hi_f, uint32_t sign, uint32_t mask, int swap) {
+	const __m128 scale = _mm_set1_ps(scale_f);
+	const __m128 lo = _mm_set1_ps(lo_f);
+	const __m128 hi = _mm_set1_ps(hi_f);
+	const __m128i flip = _mm_set1_epi32((int) sign);
+	const __m128i keep = _mm_set1_epi32((int) mask);
+
+	uint32_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		__m128i vl = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(l + i), scale), lo), hi));
+		__m128i vr = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(r + i), scale), lo), hi));
+
+		__m128i a = _mm_and_si128(_mm_xor_si128(_mm_unpacklo_epi32(vl, vr), flip), keep);
+		__m128i b = _mm_and_si128(_mm_xor_si128(_mm_unpackhi_epi32(vl, vr), flip), keep);
+		if (swap) {
+			a = sse2_bswap_32(a);
+			b = sse2_bswap_32(b);
+		}
+
+		_mm_storeu_si128((__m128i *) (dst + i * 8), a);
+		_mm_storeu_si128((__m128i *) (dst + i * 8 + 16), b);
+	}
+
+	return i;
 }
 
-static void swap_sign_16(uint16_t* src, const uint32_t samples) {
-	for (uint32_t i = 0; i < samples; i++) *src++ ^= 1 << 15;
+static uint32_t planar2_to_float_sse2(uint8_t *dst, const float *l, const float *r, uint32_t frames, int swap) {
+	uint32_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		__m128 vl = _mm_loadu_ps(l + i), vr = _mm_loadu_ps(r + i);
+		__m128i a = _mm_castps_si128(_mm_unpacklo_ps(vl, vr));
+		__m128i b = _mm_castps_si128(_mm_unpackhi_ps(vl, vr));
+		if (swap) {
+			a = sse2_bswap_32(a);
+			b = sse2_bswap_32(b);
+		}
+
+		_mm_storeu_si128((__m128i *) (dst + i * 8), a);
+		_mm_storeu_si128((__m128i *) (dst + i * 8 + 16), b);
+	}
+
+	return i;
 }
 
-static void swap_sign_24(uint8_t* src, const uint32_t samples) {
-	for (uint32_t i = 0; i < samples; i++) src[i * 3] ^= 1 << 15; // bad impl
+static uint32_t from_16_to_planar2_sse2(float *l, float *r, const uint8_t *src, uint32_t frames, uint16_t sign, int swap) {
+	const __m128 scale = _mm_set1_ps(1.0f / S16_SCALE);
+	const __m128i flip = _mm_set1_epi16((short) sign);
+
+	uint32_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (src + i * 4));
+		if (swap) v = sse2_bswap_16(v);
+		v = _mm_xor_si128(v, flip);
+
+		// every 32-bit lane holds one frame, left sample in the low half
+		__m128i vl = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+		__m128i vr = _mm_srai_epi32(v, 16);
+
+		_mm_storeu_ps(l + i, _mm_mul_ps(_mm_cvtepi32_ps(vl), scale));
+		_mm_storeu_ps(r + i, _mm_mul_ps(_mm_cvtepi32_ps(vr), scale));
+	}
+
+	return i;
 }
 
-static void swap_sign_32(uint32_t* src, const uint32_t samples) {
-	for (uint32_t i = 0; i < samples; i++) *src++ ^= 1 << 31;
+static uint32_t from_32_to_planar2_sse2(float *l, float *r, const uint8_t *src, uint32_t frames, float scale_f, uint32_t sign, int shift, int is_float, int swap) {
+	const __m128 scale = _mm_set1_ps(1.0f / scale_f);
+	const __m128i flip = _mm_set1_epi32((int) sign);
+
+	uint32_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (src + i * 8));
+		__m128i b = _mm_loadu_si128((const __m128i *) (src + i * 8 + 16));
+		if (swap) {
+			a = sse2_bswap_32(a);
+			b = sse2_bswap_32(b);
+		}
+
+		__m128 fa, fb;
+		if (is_float) {
+			fa = _mm_castsi128_ps(a);
+			fb = _mm_castsi128_ps(b);
+		} else {
+			a = _mm_xor_si128(a, flip);
+			b = _mm_xor_si128(b, flip);
+			if (shift) {
+				a = _mm_srai_epi32(_mm_slli_epi32(a, shift), shift);
+				b = _mm_srai_epi32(_mm_slli_epi32(b, shift), shift);
+			}
+			fa = _mm_mul_ps(_mm_cvtepi32_ps(a), scale);
+			fb = _mm_mul_ps(_mm_cvtepi32_ps(b), scale);
+		}
+
+		_mm_storeu_ps(l + i, _mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(r + i, _mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+
+	return i;
 }
+#endif
 
-static uint32_t swap_sign(audio_format_t af, uint8_t *src, const uint32_t frames) {
-	switch (af_get_format(af)) {
-    case SF_FORMAT_U8:
-		case SF_FORMAT_S8: 
-      swap_sign_8((uint8_t *)src, frames * af_get_channels(af));
-      break;
-		case SF_FORMAT_U16:
-		case SF_FORMAT_S16: 
-      swap_sign_16((uint16_t *)src, frames * af_get_channels(af));
-      break;
-		case SF_FORMAT_U24:
-		case SF_FORMAT_S24:
-      swap_sign_24((uint8_t *)src, frames * af_get_channels(af));
-			break;
-		case SF_FORMAT_U32:
-		case SF_FORMAT_S32:
-      swap_sign_32((uint32_t *)src, frames * af_get_channels(af));
-			break;
-		case SF_FORMAT_FLOAT:
-		default:
-    	return 0;
+//
+// NEON kernels, return number of processed samples
+//
+#if defined(PCM_CONV_NEON)
+static uint32_t float_to_16_neon(uint8_t *dst, const float *src, uint32_t samples, uint16_t sign, int swap) {
+	const uint16x8_t flip = vdupq_n_u16(sign);
+
+	uint32_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		int32x4_t a = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i), S16_SCALE));
+		int32x4_t b = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i + 4), S16_SCALE));
+
+		uint16x8_t v = vreinterpretq_u16_s16(vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+		v = veorq_u16(v, flip);
+		if (swap) v = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(v)));
+
+		vst1q_u16((uint16_t *) (dst + i * 2), v);
 	}
 
-	return frames;
+	return i;
 }
 
-static void swap_endian_16(int16_t* src, const uint32_t samples) {
-  for (uint32_t i = 0; i < samples; i++) src[i] = BSWAP_16(src[i]);
+static uint32_t float_to_32_neon(uint8_t *dst, const float *src, uint32_t samples, float scale_f, float lo_f, float hi_f, uint32_t sign, uint32_t mask, int swap) {
+	const float32x4_t lo = vdupq_n_f32(lo_f);
+	const float32x4_t hi = vdupq_n_f32(hi_f);
+	const uint32x4_t flip = vdupq_n_u32(sign);
+	const uint32x4_t keep = vdupq_n_u32(mask);
+
+	uint32_t i = 0;
+	for (; i + 4 <= samples; i += 4) {
+		float32x4_t f = vmulq_n_f32(vld1q_f32(src + i), scale_f);
+		f = vminq_f32(vmaxq_f32(f, lo), hi);
+
+		uint32x4_t v = vandq_u32(veorq_u32(vreinterpretq_u32_s32(vcvtnq_s32_f32(f)), flip), keep);
+		if (swap) v = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(v)));
+
+		vst1q_u32((uint32_t *) (dst + i * 4), v);
+	}
+
+	return i;
 }
 
-static void swap_endian_24(int8_t* src, const uint32_t samples) {
-  for (uint32_t i = 0; i < samples; i++) src[i] = BSWAP_24(src[i] | src[i + 1] << 8 | src[i + 2] << 16); // bad impl
+static uint32_t from_16_to_float_neon(float *dst, const uint8_t *src, uint32_t samples, uint16_t sign, int swap) {
+	const uint16x8_t flip = vdupq_n_u16(sign);
+
+	uint32_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		uint16x8_t v = vld1q_u16((const uint16_t *) (src + i * 2));
+		if (swap) v = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(v)));
+		int16x8_t s = vreinterpretq_s16_u16(veorq_u16(v, flip));
+
+		vst1q_f32(dst + i,     vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))), 1.0f / S16_SCALE));
+		vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))), 1.0f / S16_SCALE));
+	}
+
+	return i;
 }
 
-static void swap_endian_32(int32_t* src, const uint32_t samples) {
-  for (uint32_t i = 0; i < samples; i++) src[i] = BSWAP_32(src[i]);
+static uint32_t from_32_to_float_neon(float *dst, const uint8_t *src, uint32_t samples, float scale_f, uint32_t sign, int shift, int swap) {
+	const uint32x4_t flip = vdupq_n_u32(sign);
+	const int32x4_t left = vdupq_n_s32(shift);
+	const int32x4_t right = vdupq_n_s32(-shift);
+
+	uint32_t i = 0;
+	for (; i + 4 <= samples; i += 4) {
+		uint32x4_t v = vld1q_u32((const uint32_t *) (src + i * 4));
+		if (swap) v = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(v)));
+		int32x4_t s = vreinterpretq_s32_u32(veorq_u32(v, flip));
+		s = vshlq_s32(vshlq_s32(s, left), right);
+
+		vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(s), 1.0f / scale_f));
+	}
+
+	return i;
 }
 
-static uint32_t swap_endian (audio_format_t af, uint8_t* src, uint32_t frames) {
-  uint8_t fmt = af_get_format(af);
+//
+// Stereo planar <-> interleaved kernels, vst2/vld2 do the (de)interleaving
+//
+static uint32_t planar2_to_16_neon(uint8_t *dst, const float *l, const float *r, uint32_t frames, uint16_t sign, int swap) {
+	const uint16x8_t flip = vdupq_n_u16(sign);
+
+	uint32_t i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		uint16x8x2_t v;
+		v.val[0] = vreinterpretq_u16_s16(vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(l + i), S16_SCALE))),
+		                                              vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(l + i + 4), S16_SCALE)))));
+		v.val[1] = vreinterpretq_u16_s16(vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(r + i), S16_SCALE))),
+		                                              vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(r + i + 4), S16_SCALE)))));
+
+		for (int k = 0; k < 2; k++) {
+			v.val[k] = veorq_u16(v.val[k], flip);
+			if (swap) v.val[k] = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(v.val[k])));
+		}
+
+		vst2q_u16((uint16_t *) (dst + i * 4), v);
+	}
 
-	if (fmt == SF_FORMAT_U8 || fmt == SF_FORMAT_S8)	return -1;
+	return i;
+}
 
-	switch (fmt) {
-		case SF_FORMAT_U16:
-		case SF_FORMAT_S16: 
-      swap_endian_16((int16_t *)src, frames * af_get_channels(af));
-      break;
-		case SF_FORMAT_U24:
-		case SF_FORMAT_S24:
-      swap_endian_24((int8_t *)src, frames * af_get_channels(af));
-			break;
-		case SF_FORMAT_U32:
-		case SF_FORMAT_S32:
-		case SF_FORMAT_FLOAT:
-      swap_endian_32((int32_t *)src, frames * af_get_channels(af));
-			break;
-		default:
-      return 0;
+static uint32_t planar2_to_32_neon(uint8_t *dst, const float *l, const float *r, uint32_t frames, float scale_f, float lo_f, float hi_f, uint32_t sign, uint32_t mask, int swap) {
+	const float32x4_t lo = vdupq_n_f32(lo_f);
+	const float32x4_t hi = vdupq_n_f32(hi_f);
+	const uint32x4_t flip = vdupq_n_u32(sign);
+	const uint32x4_t keep = vdupq_n_u32(mask);
+	const float *src[2] = { l, r };
+
+	uint32_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		uint32x4x2_t v;
+
+		for (int k = 0; k < 2; k++) {
+			float32x4_t f = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(src[k] + i), scale_f), lo), hi);
+			v.val[k] = vandq_u32(veorq_u32(vreinterpretq_u32_s32(vcvtnq_s32_f32(f)), flip), keep);
+			if (swap) v.val[k] = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(v.val[k])));
+		}
+
+		vst2q_u32((uint32_t *) (dst + i * 8), v);
+	}
+
+	return i;
+}
+
+static uint32_t planar2_to_float_neon(uint8_t *dst, const float *l, const float *r, uint32_t frames, int swap) {
+	uint32_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		uint32x4x2_t v;
+		v.val[0] = vreinterpretq_u32_f32(vld1q_f32(l + i));
+		v.val[1] = vreinterpretq_u32_f32(vld1q_f32(r + i));
+
+		if (swap) {
+			v.val[0] = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(v.val[0])));
+			v.val[1] = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(v.val[1])));
+		}
+
+		vst2q_u32((uint32_t *) (dst + i * 8), v);
 	}
 
-	return frames;
+	return i;
 }
 
-uint32_t pcm_float_to_fixed(audio_format_t af, uint8_t* dst, float* src, uint32_t frames) {
+static uint32_t from_16_to_planar2_neon(float *l, float *r, const uint8_t *src, uint32_t frames, uint16_t sign, int swap) {
+	const uint16x8_t flip = vdupq_n_u16(sign);
+	float *dst[2] = { l, r };
+
+	uint32_t i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		uint16x8x2_t v = vld2q_u16((const uint16_t *) (src + i * 4));
+
+		for (int k = 0; k < 2; k++) {
+			uint16x8_t u = v.val[k];
+			if (swap) u = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(u)));
+			int16x8_t s = vreinterpretq_s16_u16(veorq_u16(u, flip));
+
+			vst1q_f32(dst[k] + i,     vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))), 1.0f / S16_SCALE));
+			vst1q_f32(dst[k] + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))), 1.0f / S16_SCALE));
+		}
+	}
+
+	return i;
+}
+
+static uint32_t from_32_to_planar2_neon(float *l, float *r, const uint8_t *src, uint32_t frames, float scale_f, uint32_t sign, int shift, int is_float, int swap) {
+	const uint32x4_t flip = vdupq_n_u32(sign);
+	const int32x4_t left = vdupq_n_s32(shift);
+	const int32x4_t right = vdupq_n_s32(-shift);
+	float *dst[2] = { l, r };
+
+	uint32_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		uint32x4x2_t v = vld2q_u32((const uint32_t *) (src + i * 8));
+
+		for (int k = 0; k < 2; k++) {
+			uint32x4_t u = v.val[k];
+			if (swap) u = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(u)));
+
+			if (is_float) {
+				vst1q_f32(dst[k] + i, vreinterpretq_f32_u32(u));
+			} else {
+				int32x4_t s = vreinterpretq_s32_u32(veorq_u32(u, flip));
+				s = vshlq_s32(vshlq_s32(s, left), right);
+				vst1q_f32(dst[k] + i, vmulq_n_f32(vcvtq_f32_s32(s), 1.0f / scale_f));
+			}
+		}
+	}
+
+	return i;
+}
+#endif
+
+#if defined(PCM_CONV_SSE2)
+  #define float_to_16_simd      float_to_16_sse2
+  #define float_to_32_simd      float_to_32_sse2
+  #define from_16_to_float_simd from_16_to_float_sse2
+  #define from_32_to_float_simd from_32_to_float_sse2
+  #define planar2_to_16_simd    planar2_to_16_sse2
+  #define planar2_to_32_simd    planar2_to_32_sse2
+  #define planar2_to_float_simd planar2_to_float_sse2
+  #define from_16_to_planar2_simd from_16_to_planar2_sse2
+  #define from_32_to_planar2_simd from_32_to_planar2_sse2
+#elif defined(PCM_CONV_NEON)
+  #define float_to_16_simd      float_to_16_neon
+  #define float_to_32_simd      float_to_32_neon
+  #define from_16_to_float_simd from_16_to_float_neon
+  #define from_32_to_float_simd from_32_to_float_neon
+  #define planar2_to_16_simd    planar2_to_16_neon
+  #define planar2_to_32_simd    planar2_to_32_neon
+  #define planar2_to_float_simd planar2_to_float_neon
+  #define from_16_to_planar2_simd from_16_to_planar2_neon
+  #define from_32_to_planar2_simd from_32_to_planar2_neon
+#else
+  #define float_to_16_simd(dst, src, samples, sign, swap) 0
+  #define float_to_32_simd(dst, src, samples, scale, lo, hi, sign, mask, swap) 0
+  #define from_16_to_float_simd(dst, src, samples, sign, swap) 0
+  #define from_32_to_float_simd(dst, src, samples, scale, sign, shift, swap) 0
+  #define planar2_to_16_simd(dst, l, r, frames, sign, swap) 0
+  #define planar2_to_32_simd(dst, l, r, frames, scale, lo, hi, sign, mask, swap) 0
+  #define planar2_to_float_simd(dst, l, r, frames, swap) 0
+  #define from_16_to_planar2_simd(l, r, src, frames, sign, swap) 0
+  #define from_32_to_planar2_simd(l, r, src, frames, scale, sign, shift, is_float, swap) 0
+#endif
+
+//
+// Public functions
+//
+uint32_t pcm_samples_to_fixed(audio_format_t af, uint8_t* dst, const float* src, uint32_t samples) {
+  int swap = af_get_endian(af) != AF_NATIVE_ENDIAN;
+  uint32_t done;
+
   switch(af_get_format(af)) {
     case SF_FORMAT_U8:
-      float_to_u8(dst, src, frames * af_get_channels(af));
+      float_to_8(dst, src, samples, 0x80);
       break;
     case SF_FORMAT_S8:
-      float_to_s8(dst, src, frames * af_get_channels(af));
+      float_to_8(dst, src, samples, 0);
       break;
     case SF_FORMAT_U16:
-      float_to_u16(dst, src, frames * af_get_channels(af));
-      break;
-    case SF_FORMAT_S16:
-      float_to_s16(dst, src, frames * af_get_channels(af));
+    case SF_FORMAT_S16: {
+      uint16_t sign = af_get_format(af) == SF_FORMAT_U16 ? 0x8000 : 0;
+      done = float_to_16_simd(dst, src, samples, sign, swap);
+      float_to_16(dst + done * 2, src + done, samples - done, sign, swap);
       break;
+    }
     case SF_FORMAT_U24:
-      float_to_u24(dst, src, frames * af_get_channels(af));
+      float_to_24(dst, src, samples, 0x800000, af_get_endian(af));
       break;
     case SF_FORMAT_S24:
-      float_to_s24(dst, src, frames * af_get_channels(af));
+      float_to_24(dst, src, samples, 0, af_get_endian(af));
       break;
-    case SF_FORMAT_U32:
-      float_to_u32(dst, src, frames * af_get_channels(af));
+    case SF_FORMAT_U24_32:
+    case SF_FORMAT_S24_32: {
+      int is_unsigned = af_get_format(af) == SF_FORMAT_U24_32;
+      uint32_t sign = is_unsigned ? 0x800000 : 0;
+      uint32_t mask = is_unsigned ? 0xffffff : 0xffffffff;
+      done = float_to_32_simd(dst, src, samples, S24_SCALE, -8388608.0f, 8388607.0f, sign, mask, swap);
+      float_to_24_32(dst + done * 4, src + done, samples - done, sign, mask, swap);
       break;
-    case SF_FORMAT_S32:
-      float_to_s32(dst, src, frames * af_get_channels(af));
+    }
+    case SF_FORMAT_U32:
+    case SF_FORMAT_S32: {
+      uint32_t sign = af_get_format(af) == SF_FORMAT_U32 ? 0x80000000 : 0;
+      done = float_to_32_simd(dst, src, samples, S32_SCALE, -S32_SCALE, S32_MAX_F, sign, 0xffffffff, swap);
+      float_to_32(dst + done * 4, src + done, samples - done, sign, swap);
       break;
+    }
     case SF_FORMAT_FLOAT:
+      float_to_float(dst, src, samples, swap);
+      break;
     default:
       return 0;
   }
 
-  if(af_get_endian(af) != AF_NATIVE_ENDIAN) {
-    swap_endian(af, dst, frames);
-  }
-
-  return frames;
+  return samples;
 }
 
-uint32_t pcm_fixed_to_float(audio_format_t af, float* dst, uint8_t* src, uint32_t frames) {
-  if(af_get_endian(af) != AF_NATIVE_ENDIAN) {
-    swap_endian(af, src, frames);
-  }
-  
+uint32_t pcm_samples_to_float(audio_format_t af, float* dst, const uint8_t* src, uint32_t samples) {
+  int swap = af_get_endian(af) != AF_NATIVE_ENDIAN;
+  uint32_t done;
+
   switch(af_get_format(af)) {
     case SF_FORMAT_U8:
-      u8_to_float(dst, src, frames * af_get_channels(af));
+      from_8_to_float(dst, src, samples, 0x80);
       break;
     case SF_FORMAT_S8:
-      s8_to_float(dst, src, frames * af_get_channels(af));
+      from_8_to_float(dst, src, samples, 0);
       break;
     case SF_FORMAT_U16:
-      u16_to_float(dst, src, frames * af_get_channels(af));
-      break;
-    case SF_FORMAT_S16:
-      s16_to_float(dst, src, frames * af_get_channels(af));
+    case SF_FORMAT_S16: {
+      uint16_t sign = af_get_format(af) == SF_FORMAT_U16 ? 0x8000 : 0;
+      done = from_16_to_float_simd(dst, src, samples, sign, swap);
+      from_16_to_float(dst + done, src + done * 2, samples - done, sign, swap);
       break;
+    }
     case SF_FORMAT_U24:
-      u24_to_float(dst, src, frames * af_get_channels(af));
+      from_24_to_float(dst, src, samples, 0x800000, af_get_endian(af));
       break;
     case SF_FORMAT_S24:
-      s24_to_float(dst, src, frames * af_get_channels(af));
+      from_24_to_float(dst, src, samples, 0, af_get_endian(af));
       break;
+    case SF_FORMAT_U24_32:
+    case SF_FORMAT_S24_32: {
+      uint32_t sign = af_get_format(af) == SF_FORMAT_U24_32 ? 0x800000 : 0;
+      done = from_32_to_float_simd(dst, src, samples, S24_SCALE, sign, 8, swap);
+      from_24_32_to_float(dst + done, src + done * 4, samples - done, sign, swap);
+      break;
+    }
     case SF_FORMAT_U32:
-      u32_to_float(dst, src, frames * af_get_channels(af));
+    case SF_FORMAT_S32: {
+      uint32_t sign = af_get_format(af) == SF_FORMAT_U32 ? 0x80000000 : 0;
+      done = from_32_to_float_simd(dst, src, samples, S32_SCALE, sign, 0, swap);
+      from_32_to_float(dst + done, src + done * 4, samples - done, sign, swap);
       break;
-    case SF_FORMAT_S32:
-      s32_to_float(dst, src, frames * af_get_channels(af));
+    }
+    case SF_FORMAT_FLOAT:
+      from_float_to_float(dst, src, samples, swap);
       break;
+    default:
+      return 0;
+  }
+
+  return samples;
+}
+
+uint32_t pcm_float_to_fixed(audio_format_t af, uint8_t* dst, const float* src, uint32_t frames) {
+  if (pcm_samples_to_fixed(af, dst, src, frames * af_get_channels(af)) == 0) return 0;
+  return frames;
+}
+
+uint32_t pcm_fixed_to_float(audio_format_t af, float* dst, const uint8_t* src, uint32_t frames) {
+  if (pcm_samples_to_float(af, dst, src, frames * af_get_channels(af)) == 0) return 0;
+  return frames;
+}
+
+// Stereo fast paths, return number of frames done, the caller finishes the rest
+static uint32_t planar2_to_fixed(audio_format_t af, uint8_t* dst, const float* l, const float* r, uint32_t frames, int swap) {
+  switch(af_get_format(af)) {
+    case SF_FORMAT_U16:
+      return planar2_to_16_simd(dst, l, r, frames, 0x8000, swap);
+    case SF_FORMAT_S16:
+      return planar2_to_16_simd(dst, l, r, frames, 0, swap);
+    case SF_FORMAT_U24_32:
+      return planar2_to_32_simd(dst, l, r, frames, S24_SCALE, -8388608.0f, 8388607.0f, 0x800000, 0xffffff, swap);
+    case SF_FORMAT_S24_32:
+      return planar2_to_32_simd(dst, l, r, frames, S24_SCALE, -8388608.0f, 8388607.0f, 0, 0xffffffff, swap);
+    case SF_FORMAT_U32:
+      return planar2_to_32_simd(dst, l, r, frames, S32_SCALE, -S32_SCALE, S32_MAX_F, 0x80000000, 0xffffffff, swap);
+    case SF_FORMAT_S32:
+      return planar2_to_32_simd(dst, l, r, frames, S32_SCALE, -S32_SCALE, S32_MAX_F, 0, 0xffffffff, swap);
     case SF_FORMAT_FLOAT:
+      return planar2_to_float_simd(dst, l, r, frames, swap);
     default:
       return 0;
   }
+}
+
+static uint32_t fixed_to_planar2(audio_format_t af, float* l, float* r, const uint8_t* src, uint32_t frames, int swap) {
+  switch(af_get_format(af)) {
+    case SF_FORMAT_U16:
+      return from_16_to_planar2_simd(l, r, src, frames, 0x8000, swap);
+    case SF_FORMAT_S16:
+      return from_16_to_planar2_simd(l, r, src, frames, 0, swap);
+    case SF_FORMAT_U24_32:
+      return from_32_to_planar2_simd(l, r, src, frames, S24_SCALE, 0x800000, 8, 0, swap);
+    case SF_FORMAT_S24_32:
+      return from_32_to_planar2_simd(l, r, src, frames, S24_SCALE, 0, 8, 0, swap);
+    case SF_FORMAT_U32:
+      return from_32_to_planar2_simd(l, r, src, frames, S32_SCALE, 0x80000000, 0, 0, swap);
+    case SF_FORMAT_S32:
+      return from_32_to_planar2_simd(l, r, src, frames, S32_SCALE, 0, 0, 0, swap);
+    case SF_FORMAT_FLOAT:
+      return from_32_to_planar2_simd(l, r, src, frames, 1.0f, 0, 0, 1, swap);
+    default:
+      return 0;
+  }
+}
+
+uint32_t pcm_planar_to_fixed(audio_format_t af, uint8_t* dst, const float* const* src, uint32_t frames) {
+  uint8_t channels = af_get_channels(af);
+  uint32_t frame_size = af_get_frame_size(af);
+  uint32_t done = 0;
+
+  if (channels == 0) return 0;
+  if (channels == 1) return pcm_samples_to_fixed(af, dst, src[0], frames) ? frames : 0;
+  if (channels == 2) done = planar2_to_fixed(af, dst, src[0], src[1], frames, af_get_endian(af) != AF_NATIVE_ENDIAN);
+
+  // Remaining frames and other layouts go through a small interleaved chunk
+  float chunk[PCM_CONV_CHUNK_SAMPLES];
+  uint32_t step = PCM_CONV_CHUNK_SAMPLES / channels;
+
+  while (done < frames) {
+    uint32_t count = min(step, frames - done);
+
+    for (uint8_t ch = 0; ch < channels; ch++) {
+      const float *s = src[ch] + done;
+      for (uint32_t i = 0; i < count; i++) chunk[i * channels + ch] = s[i];
+    }
+
+    if (pcm_samples_to_fixed(af, dst + done * frame_size, chunk, count * channels) == 0) return 0;
+    done += count;
+  }
+
+  return frames;
+}
+
+uint32_t pcm_fixed_to_planar(audio_format_t af, float** dst, const uint8_t* src, uint32_t frames) {
+  uint8_t channels = af_get_channels(af);
+  uint32_t frame_size = af_get_frame_size(af);
+  uint32_t done = 0;
+
+  if (channels == 0) return 0;
+  if (channels == 1) return pcm_samples_to_float(af, dst[0], src, frames) ? frames : 0;
+  if (channels == 2) done = fixed_to_planar2(af, dst[0], dst[1], src, frames, af_get_endian(af) != AF_NATIVE_ENDIAN);
+
+  float chunk[PCM_CONV_CHUNK_SAMPLES];
+  uint32_t step = PCM_CONV_CHUNK_SAMPLES / channels;
+
+  while (done < frames) {
+    uint32_t count = min(step, frames - done);
+
+    if (pcm_samples_to_float(af, chunk, src + done * frame_size, count * channels) == 0) return 0;
+
+    for (uint8_t ch = 0; ch < channels; ch++) {
+      float *d = dst[ch] + done;
+      for (uint32_t i = 0; i < count; i++) d[i] = chunk[i * channels + ch];
+    }
+
+    done += count;
+  }
+
+  return frames;
+}
+
+uint32_t pcm_deinterleave_float(float** dst, const float* src, uint8_t channels, uint32_t frames) {
+  if (channels == 2) {
+    float *l = dst[0], *r = dst[1];
+    uint32_t i = from_32_to_planar2_simd(l, r, (const uint8_t *) src, frames, 1.0f, 0, 0, 1, 0);
+
+    for (; i < frames; i++) {
+      l[i] = src[i * 2];
+      r[i] = src[i * 2 + 1];
+    }
+    return frames;
+  }
+
+  for (uint8_t ch = 0; ch < channels; ch++) {
+    float *d = dst[ch];
+    for (uint32_t i = 0; i < frames; i++) d[i] = src[i * channels + ch];
+  }
 
   return frames;
 }
\ No newline at end of file
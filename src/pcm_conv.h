@@ -4,7 +4,17 @@
 #include <stdint.h>
 #include "pcm.h"
 
-uint32_t pcm_float_to_fixed(audio_format_t af, uint8_t* dst, float* src, uint32_t frames);
-uint32_t pcm_fixed_to_float(audio_format_t af, float* dst, uint8_t* src, uint32_t frames);
+// Sample count based variants, usable on planar buffers
+uint32_t pcm_samples_to_fixed(audio_format_t af, uint8_t* dst, const float* src, uint32_t samples);
+uint32_t pcm_samples_to_float(audio_format_t af, float* dst, const uint8_t* src, uint32_t samples);
+
+// Frame count based, interleaved. Source buffer is never modified, byte order is swapped on the fly
+uint32_t pcm_float_to_fixed(audio_format_t af, uint8_t* dst, const float* src, uint32_t frames);
+uint32_t pcm_fixed_to_float(audio_format_t af, float* dst, const uint8_t* src, uint32_t frames);
+// Planar float <-> interleaved fixed, conversion and (de)interleaving are done in one pass
+uint32_t pcm_planar_to_fixed(audio_format_t af, uint8_t* dst, const float* const* src, uint32_t frames);
+uint32_t pcm_fixed_to_planar(audio_format_t af, float** dst, const uint8_t* src, uint32_t frames);
+
+uint32_t pcm_deinterleave_float(float** dst, const float* src, uint8_t channels, uint32_t frames);
 
 #endif
\ No newline at end of file
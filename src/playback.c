@@ -19,6 +19,10 @@
 #define PLAYBACK_PPS_MAX_SAMPLES 10
 #define PLAYBACK_REALTIME_PUSH_FACTOR 1
 
+// Producer refills once a quarter of the buffer is free, waits are bounded so state changes are seen
+#define PLAYBACK_REFILL_FRAMES (PLAYBACK_BUFFER_FRAMES / 4)
+#define PLAYBACK_WAIT_TIMEOUT_NS 100000000ULL
+
 struct playback_state {
   audiobuffer_t* buffer;
   command_queue_t* cmdqueue;
@@ -134,7 +138,7 @@ static void control_loop(void* arg) {
 
         uv_mutex_lock(&state.consumer_mutex);
         
-        rc = output_device_ops.open(output_af);
+        rc = output_device_ops.open(output_af, NULL);
         if (rc < 0) {
           log_error("Unable to open output audio device");
           uv_mutex_unlock(&state.consumer_mutex);
@@ -161,6 +165,7 @@ static void control_loop(void* arg) {
         uv_mutex_unlock(&state.consumer_mutex);
 
         audiobuffer_reset(state.buffer);
+        audiobuffer_wakeup(state.buffer);
         controller_ready = 0;
 
         break;
@@ -193,6 +198,8 @@ static void control_loop(void* arg) {
         output_device_ops.pause();
         uv_mutex_unlock(&state.consumer_mutex);
 
+        audiobuffer_wakeup(state.buffer);
+
         break;
       case PLAYBACK_CMD_SEEK:
         if(!controller_ready) break;
@@ -207,6 +214,7 @@ static void control_loop(void* arg) {
         output_device_ops.drop();
         audiobuffer_reset(state.buffer);
         audiobuffer_set_frames(state.buffer, pcm_ns_to_frames(af_get_rate(internal_af), (uint64_t) offset * 1e6));
+        audiobuffer_wakeup(state.buffer);
         
         uv_mutex_unlock(&state.consumer_mutex);
         uv_mutex_unlock(&state.producer_mutex);
@@ -224,6 +232,8 @@ static void control_loop(void* arg) {
         state.consumer_enabled = 0;
         uv_mutex_unlock(&state.consumer_mutex);
 
+        audiobuffer_wakeup(state.buffer);
+
         break;
       default:
         break;
@@ -269,7 +279,7 @@ static void producer_loop(void* arg) {
       log_dtrace("[PRODUCER] %d frames written to buffer", w);
     }
     
-    ms_sleep(100);
+    audiobuffer_wait_writable(state.buffer, PLAYBACK_REFILL_FRAMES, PLAYBACK_WAIT_TIMEOUT_NS);
   }
 }
 
@@ -280,7 +290,6 @@ static void consumer_loop(void* arg) {
   uint8_t output_buf[PLAYBACK_IO_BUFFER_SAMPLES];
   uint32_t r, w, available, space;
 
-  uint64_t audio_wait_time = pcm_frames_to_ns(af_get_rate(internal_af), PLAYBACK_IO_BUFFER_SAMPLES * af_get_channels(output_af));
   uint64_t delta = 1;
   
   uint64_t last_time = uv_hrtime();
@@ -302,9 +311,12 @@ static void consumer_loop(void* arg) {
 
     space = output_device_ops.wait();
     if(space <= 0) {
-      goto consumer_end_sleep;
+      goto consumer_end;
     }
     
+    // Device asked for frames, sleep only while producer hasn't delivered them
+    audiobuffer_wait_readable(state.buffer, space, PLAYBACK_WAIT_TIMEOUT_NS);
+
     available = audiobuffer_read_begin(state.buffer, space);
     if(available > 0) {
       uv_mutex_lock(&state.consumer_mutex);
@@ -325,11 +337,9 @@ static void consumer_loop(void* arg) {
       log_dtrace("[CONSUMER] %d frames written to the output device", w);
     }
     
-    consumer_end_sleep:
+    consumer_end:
 
-    delta = uv_hrtime() - last_time;    
-    ns_sleep(audio_wait_time - delta);
-    delta = uv_hrtime() - last_time;  
+    delta = uv_hrtime() - last_time;
     last_time = uv_hrtime();
 
     playback_calculate_pps(delta);
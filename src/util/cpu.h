@@ -0,0 +1,33 @@
+#ifndef _H_UTIL_CPU_
+#define _H_UTIL_CPU_
+
+#if defined(__x86_64__) || defined(__i386__)
+  #define CPU_X86 1
+#endif
+
+#if defined(__aarch64__) || (defined(__ARM_NEON) && defined(__arm__))
+  #define CPU_NEON 1
+#endif
+
+#define CPU_FEATURE_SSE2  0x01
+#define CPU_FEATURE_AVX2  0x02
+#define CPU_FEATURE_NEON  0x04
+
+// Runtime detected SIMD extensions usable by dispatched kernels
+static inline unsigned cpu_features(void) {
+  unsigned features = 0;
+
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) features |= CPU_FEATURE_SSE2;
+  if (__builtin_cpu_supports("avx2")) features |= CPU_FEATURE_AVX2;
+#endif
+
+#if defined(CPU_NEON)
+  features |= CPU_FEATURE_NEON;
+#endif
+
+  return features;
+}
+
+#endif
\ No newline at end of file
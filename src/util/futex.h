@@ -0,0 +1,27 @@
+#ifndef _H_UTIL_FUTEX_
+#define _H_UTIL_FUTEX_
+
+// syscall() needs _GNU_SOURCE defined by the including file before any system header
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#define OS_FUTEX_INFINITE UINT64_MAX
+
+// Sleeps while *addr == value, at most timeout_ns. Spurious returns are possible
+static inline void os_futex_wait(atomic_uint_least32_t *addr, uint32_t value, uint64_t timeout_ns) {
+  struct timespec ts = { .tv_sec = timeout_ns / 1000000000ULL, .tv_nsec = timeout_ns % 1000000000ULL };
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, timeout_ns == OS_FUTEX_INFINITE ? NULL : &ts, NULL, 0);
+}
+
+// Changes *addr so waiters that haven't slept yet don't, then wakes up to count sleeping ones
+static inline void os_futex_wake(atomic_uint_least32_t *addr, int count) {
+  atomic_fetch_add_explicit(addr, 1, memory_order_release);
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+#endif
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef _H_UTIL_TIME_
 #define _H_UTIL_TIME_
 
+#include <stdint.h>
+#include <errno.h>
 #include <time.h>
 #include <sys/times.h>
 
@@ -17,6 +19,13 @@ static inline uint64_t os_gettime_ns(void) {
 	return ((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
 }
 
+static inline void os_sleep_until_ns(uint64_t ns) {
+  struct timespec req;
+  req.tv_sec = ns / 1000000000ULL;
+  req.tv_nsec = ns % 1000000000ULL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &req, NULL) == EINTR);
+}
+
 #define os_sleep_ns(ns) os_sleep(0, (ns))
 #define os_sleep_us(us) os_sleep_ns((us) * 1e3)
 #define os_sleep_ms(us) os_sleep_ns((us) * 1e6)
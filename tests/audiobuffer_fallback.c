@@ -0,0 +1,20 @@
+// audiobuffer.c without the mirrored mapping under fallback_ names, regions split at the end
+#define AUDIOBUFFER_NO_MIRROR
+#define audiobuffer_create         fallback_audiobuffer_create
+#define audiobuffer_destroy        fallback_audiobuffer_destroy
+#define audiobuffer_reset          fallback_audiobuffer_reset
+#define audiobuffer_get_frames     fallback_audiobuffer_get_frames
+#define audiobuffer_set_frames     fallback_audiobuffer_set_frames
+#define audiobuffer_read_begin     fallback_audiobuffer_read_begin
+#define audiobuffer_read           fallback_audiobuffer_read
+#define audiobuffer_read_consume   fallback_audiobuffer_read_consume
+#define audiobuffer_read_end       fallback_audiobuffer_read_end
+#define audiobuffer_write_begin    fallback_audiobuffer_write_begin
+#define audiobuffer_write          fallback_audiobuffer_write
+#define audiobuffer_write_fill     fallback_audiobuffer_write_fill
+#define audiobuffer_write_end      fallback_audiobuffer_write_end
+#define audiobuffer_wait_readable  fallback_audiobuffer_wait_readable
+#define audiobuffer_wait_writable  fallback_audiobuffer_wait_writable
+#define audiobuffer_wakeup         fallback_audiobuffer_wakeup
+
+#include "src/audiobuffer.c"
\ No newline at end of file
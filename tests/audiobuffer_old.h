@@ -0,0 +1,45 @@
+#ifndef _H_TESTS_AUDIOBUFFER_OLD_
+#define _H_TESTS_AUDIOBUFFER_OLD_
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "pcm.h"
+
+// audiobuffer.h before the SPSC ring rewrite: shared available counter, % wrapping
+typedef struct {
+  audio_format_t af;
+  size_t capacity;
+
+  // last consume frame number
+  atomic_uint_least64_t	 frames;
+
+  // all indexes and ofsets in pcm samples
+  atomic_uint_least32_t available;
+
+  uint32_t read_index;
+  uint32_t write_index;
+
+  // read/write begin/end state
+  uint8_t r_begin;
+  uint8_t w_begin;
+  uint32_t r_available, r_max_samples, r_index, r_count;
+  uint32_t w_available, w_max_samples, w_index, w_count;
+
+  float data[];
+} old_audiobuffer_t;
+
+old_audiobuffer_t* old_audiobuffer_create(audio_format_t af, uint32_t frames);
+void old_audiobuffer_destroy(old_audiobuffer_t* b);
+void old_audiobuffer_reset(old_audiobuffer_t* b);
+uint64_t old_audiobuffer_get_frames(old_audiobuffer_t* b);
+void old_audiobuffer_set_frames(old_audiobuffer_t* b, uint64_t frame);
+uint32_t old_audiobuffer_read_begin(old_audiobuffer_t* b, const uint32_t max_frames);
+uint32_t old_audiobuffer_read(old_audiobuffer_t* b, float** ptr);
+uint32_t old_audiobuffer_read_consume(old_audiobuffer_t* b, const uint32_t frames);
+uint32_t old_audiobuffer_read_end(old_audiobuffer_t* b);
+uint32_t old_audiobuffer_write_begin(old_audiobuffer_t* b, const uint32_t max_frames);
+uint32_t old_audiobuffer_write(old_audiobuffer_t* b, float** ptr);
+uint32_t old_audiobuffer_write_fill(old_audiobuffer_t* b, const uint32_t frames);
+uint32_t old_audiobuffer_write_end(old_audiobuffer_t* b);
+
+#endif
\ No newline at end of file
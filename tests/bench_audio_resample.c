@@ -0,0 +1,62 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // clock_gettime
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "audio_resample.h"
+#include "util/time.h"
+#include "tests/test.h"
+
+#define BENCH_SECONDS 30
+#define BENCH_ROUNDS 3
+#define BENCH_PERIOD 1024
+
+// Stereo noise converted in periods of the output, rate is input frames per second, best of rounds
+int main(void) {
+  static const struct { uint32_t in_rate, out_rate; } rates[] = { { 44100, 48000 }, { 48000, 44100 }, { 96000, 48000 } };
+
+  printf("%-10s %-14s %12s %10s\n", "preset", "rate", "Mframes/s", "realtime");
+
+  for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+    uint32_t frames = rates[i].in_rate * BENCH_SECONDS;
+    float *in = malloc((size_t) frames * 2 * sizeof(float));
+    float *out = malloc((size_t) BENCH_PERIOD * 2 * sizeof(float));
+    if (!in || !out) return 1;
+
+    for (uint32_t j = 0; j < frames * 2; j++) in[j] = test_randf(-0.5f, 0.5f);
+
+    for (int quality = AUDIO_RESAMPLE_FAST; quality <= AUDIO_RESAMPLE_BEST; quality++) {
+      uint64_t best = UINT64_MAX;
+
+      for (int round = 0; round < BENCH_ROUNDS; round++) {
+        audio_resampler_t *r = audio_resampler_create(rates[i].in_rate, rates[i].out_rate, 2, quality);
+        if (!r) return 1;
+
+        uint64_t start = os_gettime_ns();
+
+        uint32_t consumed = 0;
+        while (consumed < frames) {
+          uint32_t count = frames - consumed;
+          audio_resampler_process(r, in + (size_t) consumed * 2, &count, out, BENCH_PERIOD);
+          consumed += count;
+        }
+
+        uint64_t elapsed = os_gettime_ns() - start;
+        if (elapsed && elapsed < best) best = elapsed;
+
+        audio_resampler_destroy(r);
+      }
+
+      char rate[32];
+      snprintf(rate, sizeof(rate), "%u->%u", rates[i].in_rate, rates[i].out_rate);
+      printf("%-10s %-14s %12.2f %9.0fx\n", audio_resample_quality_name(quality), rate, frames * 1e3 / best, BENCH_SECONDS * 1e9 / best);
+    }
+
+    free(in);
+    free(out);
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // clock_nanosleep, sched_yield
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include "audiobuffer.h"
+#include "tests/ring.h"
+
+#define BENCH_FRAMES (32u << 20)
+#define BENCH_ROUNDS 3
+
+// Producer and consumer move stereo periods through a ring of 4096 frames, best of rounds
+int main(void) {
+  static const ring_ops_t *rings[] = { &ring_old, &ring_mirrored, &ring_fallback };
+  static const struct { uint32_t write_chunk, read_chunk; } loads[] = { { 256, 256 }, { 256, 240 }, { 1024, 64 } };
+
+  printf("%-10s %-12s %12s\n", "ring", "write/read", "Mframes/s");
+
+  for (size_t l = 0; l < sizeof(loads) / sizeof(loads[0]); l++) {
+    for (size_t r = 0; r < sizeof(rings) / sizeof(rings[0]); r++) {
+      uint64_t best = UINT64_MAX;
+
+      for (int round = 0; round < BENCH_ROUNDS; round++) {
+        ring_load_t load = {
+          .ops = rings[r], .channels = 2, .frames = BENCH_FRAMES, .capacity = 4096,
+          .write_chunk = loads[l].write_chunk, .read_chunk = loads[l].read_chunk,
+        };
+
+        uint64_t elapsed = ring_run(&load);
+        if (elapsed && elapsed < best) best = elapsed;
+      }
+
+      char chunks[32];
+      snprintf(chunks, sizeof(chunks), "%u/%u", loads[l].write_chunk, loads[l].read_chunk);
+      printf("%-10s %-12s %12.1f\n", rings[r]->name, chunks, BENCH_FRAMES * 1e3 / best);
+    }
+  }
+
+  return 0;
+}
\ No newline at end of file
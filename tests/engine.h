@@ -0,0 +1,165 @@
+#ifndef _H_TESTS_ENGINE_
+#define _H_TESTS_ENGINE_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include "audio_io.h"
+#include "decoder/decoder.h"
+
+/**
+ * Audio engine driven period by period from the test thread. Output wait blocks until the
+ * test releases the next period and the output callback keeps every rendered period, so
+ * parameters changed between engine_step() calls apply to a known period and the exact bus
+ * output can be inspected. Buses use clip mode, output equals the mix below full scale.
+ *
+ * Inputs are synthetic stereo decoders, frame n of channel c is value[c] for constants and
+ * value[c] * (n + 1) for counters, exact for power of two values.
+ */
+
+#define ENGINE_RATE 48000
+#define ENGINE_CHANNELS 2
+#define ENGINE_PERIOD 256
+#define ENGINE_PERIODS 64 // captured periods
+
+typedef struct {
+  audio_io_t *audio;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint32_t released; // periods the audio thread may render
+  uint32_t periods;  // periods rendered
+  bool running;      // periods are neither waited for nor captured, see engine_run()
+  float capture[ENGINE_CHANNELS][ENGINE_PERIOD * ENGINE_PERIODS];
+} engine_t;
+
+typedef struct {
+  decoder_t decoder;
+  uint64_t frames;
+  uint64_t position;
+  float value[ENGINE_CHANNELS];
+  bool counter;
+} engine_signal_t;
+
+static void engine_output(struct audio_data *data, uint32_t frames, void *param) {
+  engine_t *engine = param;
+
+  pthread_mutex_lock(&engine->lock);
+
+  if (!engine->running && engine->periods < ENGINE_PERIODS) {
+    for (uint8_t ch = 0; ch < ENGINE_CHANNELS; ch++)
+      memcpy(engine->capture[ch] + engine->periods * ENGINE_PERIOD, data->data[ch], frames * sizeof(float));
+  }
+
+  engine->periods++;
+  pthread_cond_broadcast(&engine->cond);
+  pthread_mutex_unlock(&engine->lock);
+}
+
+static uint32_t engine_wait(void *param) {
+  engine_t *engine = param;
+
+  pthread_mutex_lock(&engine->lock);
+  while (!engine->running && engine->released == 0) pthread_cond_wait(&engine->cond, &engine->lock);
+  if (engine->released) engine->released--;
+  pthread_mutex_unlock(&engine->lock);
+
+  return ENGINE_PERIOD;
+}
+
+// Render periods and return once they are captured
+static inline void engine_step(engine_t *engine, uint32_t periods) {
+  pthread_mutex_lock(&engine->lock);
+
+  uint32_t target = engine->periods + periods;
+  engine->released += periods;
+  pthread_cond_broadcast(&engine->cond);
+  while (engine->periods < target) pthread_cond_wait(&engine->cond, &engine->lock);
+
+  pthread_mutex_unlock(&engine->lock);
+}
+
+// Sample of the captured output, frame counts from the first rendered period
+static inline float engine_sample(const engine_t *engine, uint8_t ch, uint32_t frame) {
+  return engine->capture[ch][frame];
+}
+
+// Open engine and return once the first period, rendered without waiting, is captured
+static inline int engine_open(engine_t *engine) {
+  memset(engine, 0, sizeof(engine_t));
+  pthread_mutex_init(&engine->lock, NULL);
+  pthread_cond_init(&engine->cond, NULL);
+
+  audio_output_info_t info = {
+    .name = "engine",
+    .af = af_endian(AF_NATIVE_ENDIAN) | af_format(SF_FORMAT_FLOAT) | af_rate(ENGINE_RATE) | af_channels(ENGINE_CHANNELS),
+    .callback = engine_output,
+    .wait = engine_wait,
+    .param = engine,
+    .period_frames = ENGINE_PERIOD,
+    .limiter = { .mode = AUDIO_LIMITER_CLIP },
+    .pacing = AUDIO_IO_PACING_OUTPUT,
+  };
+
+  if (audio_io_open(&engine->audio, &info) != AUDIO_IO_SUCCESS) return -1;
+
+  pthread_mutex_lock(&engine->lock);
+  while (engine->periods == 0) pthread_cond_wait(&engine->cond, &engine->lock);
+  pthread_mutex_unlock(&engine->lock);
+
+  return 0;
+}
+
+// Let the audio thread run freely, needed by calls that wait for it to finish a period
+static inline void engine_run(engine_t *engine) {
+  pthread_mutex_lock(&engine->lock);
+  engine->running = true;
+  pthread_cond_broadcast(&engine->cond);
+  pthread_mutex_unlock(&engine->lock);
+}
+
+static inline void engine_close(engine_t *engine) {
+  engine_run(engine);
+
+  // Queued and replaced decoders are released with the input
+  for (uint8_t i = 0; i < AUDIO_IO_INPUTS; i++) audio_io_input_detach(engine->audio, i);
+
+  audio_io_close(engine->audio);
+  pthread_cond_destroy(&engine->cond);
+  pthread_mutex_destroy(&engine->lock);
+}
+
+static size_t engine_signal_read(decoder_data_t *data, float **buffer, uint8_t planes, size_t frames) {
+  engine_signal_t *signal = data->priv;
+  size_t count = 0;
+
+  (void) planes; // prefetch reads interleaved frames
+
+  for (; count < frames && signal->position < signal->frames; count++, signal->position++) {
+    for (uint8_t ch = 0; ch < ENGINE_CHANNELS; ch++)
+      buffer[0][count * ENGINE_CHANNELS + ch] = signal->value[ch] * (signal->counter ? signal->position + 1 : 1);
+  }
+
+  return count;
+}
+
+static uint64_t engine_signal_length(decoder_data_t *data) {
+  return ((engine_signal_t *) data->priv)->frames;
+}
+
+static inline decoder_t *engine_signal(engine_signal_t *signal, uint64_t frames, float left, float right, bool counter) {
+  memset(signal, 0, sizeof(engine_signal_t));
+  signal->frames = frames;
+  signal->value[0] = left;
+  signal->value[1] = right;
+  signal->counter = counter;
+
+  signal->decoder.data.af = af_endian(AF_NATIVE_ENDIAN) | af_format(SF_FORMAT_FLOAT) | af_rate(ENGINE_RATE) | af_channels(ENGINE_CHANNELS);
+  signal->decoder.data.priv = signal;
+  signal->decoder.ops.read_f32 = engine_signal_read;
+  signal->decoder.ops.length = engine_signal_length;
+
+  return &signal->decoder;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,11 @@
+// Scalar build of pcm_conv.c under ref_ names, the reference for test_pcm_conv
+#define PCM_CONV_NO_SIMD
+#define pcm_samples_to_fixed   ref_samples_to_fixed
+#define pcm_samples_to_float   ref_samples_to_float
+#define pcm_float_to_fixed     ref_float_to_fixed
+#define pcm_fixed_to_float     ref_fixed_to_float
+#define pcm_planar_to_fixed    ref_planar_to_fixed
+#define pcm_fixed_to_planar    ref_fixed_to_planar
+#define pcm_deinterleave_float ref_deinterleave_float
+
+#include "src/pcm_conv.c"
\ No newline at end of file
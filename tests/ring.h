@@ -0,0 +1,221 @@
+#ifndef _H_TESTS_RING_
+#define _H_TESTS_RING_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include "audiobuffer.h"
+#include "tests/audiobuffer_old.h"
+#include "util/math.h"
+#include "util/time.h"
+
+/**
+ * One producer and one consumer thread moving frames through a ring, shared by the
+ * audiobuffer stress test and benchmark. Every ring implementation is reached through
+ * ring_ops_t, frame k of channel c carries (k * channels + c) mod 2^24 so the consumer
+ * can verify order and content.
+ */
+
+audiobuffer_t* fallback_audiobuffer_create(audio_format_t af, uint32_t frames);
+void fallback_audiobuffer_destroy(audiobuffer_t* b);
+uint32_t fallback_audiobuffer_read_begin(audiobuffer_t* b, const uint32_t max_frames);
+uint32_t fallback_audiobuffer_read(audiobuffer_t* b, float** ptr);
+uint32_t fallback_audiobuffer_read_consume(audiobuffer_t* b, const uint32_t frames);
+uint32_t fallback_audiobuffer_read_end(audiobuffer_t* b);
+uint32_t fallback_audiobuffer_write_begin(audiobuffer_t* b, const uint32_t max_frames);
+uint32_t fallback_audiobuffer_write(audiobuffer_t* b, float** ptr);
+uint32_t fallback_audiobuffer_write_fill(audiobuffer_t* b, const uint32_t frames);
+uint32_t fallback_audiobuffer_write_end(audiobuffer_t* b);
+uint32_t fallback_audiobuffer_wait_readable(audiobuffer_t* b, uint32_t min_frames, uint64_t timeout_ns);
+uint32_t fallback_audiobuffer_wait_writable(audiobuffer_t* b, uint32_t min_frames, uint64_t timeout_ns);
+
+typedef struct {
+  const char *name;
+  void *(*create)(audio_format_t af, uint32_t frames);
+  void (*destroy)(void *b);
+  uint32_t (*read_begin)(void *b, uint32_t max_frames);
+  uint32_t (*read)(void *b, float **ptr);
+  uint32_t (*read_consume)(void *b, uint32_t frames);
+  uint32_t (*read_end)(void *b);
+  uint32_t (*write_begin)(void *b, uint32_t max_frames);
+  uint32_t (*write)(void *b, float **ptr);
+  uint32_t (*write_fill)(void *b, uint32_t frames);
+  uint32_t (*write_end)(void *b);
+  // NULL when the ring can't block, sides spin with sched_yield instead
+  uint32_t (*wait_readable)(void *b, uint32_t min_frames, uint64_t timeout_ns);
+  uint32_t (*wait_writable)(void *b, uint32_t min_frames, uint64_t timeout_ns);
+} ring_ops_t;
+
+#define RING_OPS_WRAPPERS(prefix, type)                                                                         \
+  static void *prefix##_ring_create(audio_format_t af, uint32_t frames) { return prefix##_create(af, frames); }   \
+  static void prefix##_ring_destroy(void *b) { prefix##_destroy((type *) b); }                                    \
+  static uint32_t prefix##_ring_read_begin(void *b, uint32_t n) { return prefix##_read_begin((type *) b, n); }    \
+  static uint32_t prefix##_ring_read(void *b, float **p) { return prefix##_read((type *) b, p); }                 \
+  static uint32_t prefix##_ring_read_consume(void *b, uint32_t n) { return prefix##_read_consume((type *) b, n); }\
+  static uint32_t prefix##_ring_read_end(void *b) { return prefix##_read_end((type *) b); }                       \
+  static uint32_t prefix##_ring_write_begin(void *b, uint32_t n) { return prefix##_write_begin((type *) b, n); }  \
+  static uint32_t prefix##_ring_write(void *b, float **p) { return prefix##_write((type *) b, p); }               \
+  static uint32_t prefix##_ring_write_fill(void *b, uint32_t n) { return prefix##_write_fill((type *) b, n); }    \
+  static uint32_t prefix##_ring_write_end(void *b) { return prefix##_write_end((type *) b); }
+
+#define RING_OPS_WAITS(prefix, type)                                                                                                   \
+  static uint32_t prefix##_ring_wait_readable(void *b, uint32_t n, uint64_t t) { return prefix##_wait_readable((type *) b, n, t); }    \
+  static uint32_t prefix##_ring_wait_writable(void *b, uint32_t n, uint64_t t) { return prefix##_wait_writable((type *) b, n, t); }
+
+#define RING_OPS(prefix, label, wait_readable, wait_writable) {                                        \
+    label, prefix##_ring_create, prefix##_ring_destroy,                                                 \
+    prefix##_ring_read_begin, prefix##_ring_read, prefix##_ring_read_consume, prefix##_ring_read_end,   \
+    prefix##_ring_write_begin, prefix##_ring_write, prefix##_ring_write_fill, prefix##_ring_write_end,  \
+    wait_readable, wait_writable                                                                        \
+  }
+
+RING_OPS_WRAPPERS(old_audiobuffer, old_audiobuffer_t)
+RING_OPS_WRAPPERS(audiobuffer, audiobuffer_t)
+RING_OPS_WRAPPERS(fallback_audiobuffer, audiobuffer_t)
+RING_OPS_WAITS(audiobuffer, audiobuffer_t)
+RING_OPS_WAITS(fallback_audiobuffer, audiobuffer_t)
+
+static const ring_ops_t ring_old = RING_OPS(old_audiobuffer, "old", NULL, NULL);
+static const ring_ops_t ring_mirrored = RING_OPS(audiobuffer, "mirrored", audiobuffer_ring_wait_readable, audiobuffer_ring_wait_writable);
+static const ring_ops_t ring_fallback = RING_OPS(fallback_audiobuffer, "fallback", fallback_audiobuffer_ring_wait_readable, fallback_audiobuffer_ring_wait_writable);
+
+typedef struct {
+  const ring_ops_t *ops;
+  void *ring;
+  uint8_t channels;
+  uint64_t frames;       // total frames to move
+  uint32_t write_chunk;  // largest routine of each side, 0 picks random sizes up to the capacity
+  uint32_t read_chunk;
+  uint32_t capacity;
+  bool check;            // generate and verify the frame pattern, otherwise copy blocks
+  bool wait;             // block in waits of the ring instead of spinning
+
+  uint64_t errors;       // written by the consumer
+  uint32_t seed;
+} ring_load_t;
+
+static inline uint32_t ring_rand(uint32_t *seed) {
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return *seed;
+}
+
+static inline float ring_value(uint64_t frame, uint8_t channels, uint8_t ch) {
+  return (float) ((frame * channels + ch) & 0xffffff);
+}
+
+static float ring_block[8192 * 8];
+
+static void *ring_producer(void *param) {
+  ring_load_t *load = param;
+  const ring_ops_t *ops = load->ops;
+  uint32_t seed = load->seed;
+  uint64_t done = 0;
+
+  while (done < load->frames) {
+    uint32_t chunk = load->write_chunk ? load->write_chunk : 1 + ring_rand(&seed) % load->capacity;
+    chunk = (uint32_t) min(chunk, load->frames - done);
+
+    uint32_t n = ops->write_begin(load->ring, chunk);
+    if (n == 0) {
+      ops->write_end(load->ring);
+      if (load->wait && ops->wait_writable) ops->wait_writable(load->ring, min(chunk, load->capacity / 2), 1000000);
+      else sched_yield();
+      continue;
+    }
+
+    uint32_t written = 0, count;
+    float *ptr;
+
+    while (written < n && (count = ops->write(load->ring, &ptr)) > 0) {
+      count = min(count, n - written);
+
+      if (load->check) {
+        for (uint32_t i = 0; i < count; i++)
+          for (uint8_t ch = 0; ch < load->channels; ch++) ptr[i * load->channels + ch] = ring_value(done + written + i, load->channels, ch);
+      } else {
+        memcpy(ptr, ring_block, (size_t) count * load->channels * sizeof(float));
+      }
+
+      ops->write_fill(load->ring, count);
+      written += count;
+    }
+
+    ops->write_end(load->ring);
+    done += written;
+  }
+
+  return NULL;
+}
+
+static void *ring_consumer(void *param) {
+  ring_load_t *load = param;
+  const ring_ops_t *ops = load->ops;
+  uint32_t seed = load->seed * 7 + 1;
+  uint64_t done = 0;
+  float sink[8192 * 8];
+
+  while (done < load->frames) {
+    uint32_t chunk = load->read_chunk ? load->read_chunk : 1 + ring_rand(&seed) % load->capacity;
+
+    uint32_t n = ops->read_begin(load->ring, chunk);
+    if (n == 0) {
+      ops->read_end(load->ring);
+      if (load->wait && ops->wait_readable) ops->wait_readable(load->ring, min(chunk, load->capacity / 2), 1000000);
+      else sched_yield();
+      continue;
+    }
+
+    // Random loads consume only part of the routine now and then
+    if (!load->read_chunk && ring_rand(&seed) % 4 == 0) n = 1 + ring_rand(&seed) % n;
+
+    uint32_t consumed = 0, count;
+    float *ptr;
+
+    while (consumed < n && (count = ops->read(load->ring, &ptr)) > 0) {
+      count = min(count, n - consumed);
+
+      if (load->check) {
+        for (uint32_t i = 0; i < count; i++)
+          for (uint8_t ch = 0; ch < load->channels; ch++)
+            if (ptr[i * load->channels + ch] != ring_value(done + consumed + i, load->channels, ch)) load->errors++;
+      } else {
+        memcpy(sink, ptr, (size_t) min(count, 8192) * load->channels * sizeof(float));
+      }
+
+      ops->read_consume(load->ring, count);
+      consumed += count;
+    }
+
+    ops->read_end(load->ring);
+    done += consumed;
+  }
+
+  return NULL;
+}
+
+// Move the load through a new ring, return elapsed ns or 0 if the ring can't be created
+static inline uint64_t ring_run(ring_load_t *load) {
+  audio_format_t af = af_endian(AF_NATIVE_ENDIAN) | af_format(SF_FORMAT_FLOAT) | af_rate(48000) | af_channels(load->channels);
+  pthread_t producer, consumer;
+
+  if (!(load->ring = load->ops->create(af, load->capacity))) return 0;
+  load->errors = 0;
+
+  uint64_t start = os_gettime_ns();
+  pthread_create(&consumer, NULL, ring_consumer, load);
+  pthread_create(&producer, NULL, ring_producer, load);
+  pthread_join(producer, NULL);
+  pthread_join(consumer, NULL);
+  uint64_t elapsed = os_gettime_ns() - start;
+
+  load->ops->destroy(load->ring);
+  load->ring = NULL;
+
+  return elapsed;
+}
+
+#endif
\ No newline at end of file
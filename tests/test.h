@@ -0,0 +1,58 @@
+#ifndef _H_TESTS_TEST_
+#define _H_TESTS_TEST_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * Checks shared by meson test() executables. Failed checks are reported and counted, the
+ * executable returns test_result() so meson sees a non zero exit code.
+ */
+
+static int test_failures;
+
+#define TEST_CHECK(cond, ...) do {                                      \
+    if (!(cond)) {                                                      \
+      test_failures++;                                                  \
+      fprintf(stderr, "%s:%d: %s failed: ", __FILE__, __LINE__, #cond); \
+      fprintf(stderr, __VA_ARGS__);                                     \
+      fprintf(stderr, "\n");                                            \
+    }                                                                   \
+  } while (0)
+
+static inline int test_result(const char *name) {
+  if (test_failures) fprintf(stderr, "%s: %d checks failed\n", name, test_failures);
+  else printf("%s: ok\n", name);
+
+  return test_failures ? 1 : 0;
+}
+
+// xorshift32, tests are reproducible
+static uint32_t test_seed = 0x9e3779b9;
+
+static inline uint32_t test_rand(void) {
+  test_seed ^= test_seed << 13;
+  test_seed ^= test_seed >> 17;
+  test_seed ^= test_seed << 5;
+  return test_seed;
+}
+
+static inline float test_randf(float lo, float hi) {
+  return lo + (hi - lo) * (test_rand() >> 8) * (1.0f / 16777216.0f);
+}
+
+// Distance in units in the last place, both zeros are equal
+static inline uint32_t test_ulps(float a, float b) {
+  int32_t ia, ib;
+  memcpy(&ia, &a, sizeof(float));
+  memcpy(&ib, &b, sizeof(float));
+
+  if (ia < 0) ia = INT32_MIN - ia;
+  if (ib < 0) ib = INT32_MIN - ib;
+
+  return ia > ib ? (uint32_t) ia - (uint32_t) ib : (uint32_t) ib - (uint32_t) ia;
+}
+
+#endif
\ No newline at end of file
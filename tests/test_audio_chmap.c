@@ -0,0 +1,152 @@
+#include <stdint.h>
+#include <string.h>
+#include "audio_chmap.h"
+#include "tests/test.h"
+
+#define H 0.70710678f
+
+#define TEST_FRAMES 5
+
+// Default matrices, row major out x in, WAVE and FLAC channel order
+static const struct {
+  const char *name;
+  uint8_t in, out;
+  float matrix[AUDIO_CHMAP_MAX_OUT * DECODER_MAX_CHANNELS];
+} test_maps[] = {
+  { "5.0 -> 5.1", 5, 6, {
+    1, 0, 0, 0, 0,
+    0, 1, 0, 0, 0,
+    0, 0, 1, 0, 0,
+    0, 0, 0, 0, 0,
+    0, 0, 0, 1, 0,
+    0, 0, 0, 0, 1,
+  } },
+  { "quad -> 5.1", 4, 6, {
+    1, 0, 0, 0,
+    0, 1, 0, 0,
+    0, 0, 0, 0,
+    0, 0, 0, 0,
+    0, 0, 1, 0,
+    0, 0, 0, 1,
+  } },
+  { "3.0 -> quad", 3, 4, {
+    1, 0, H,
+    0, 1, H,
+    0, 0, 0,
+    0, 0, 0,
+  } },
+  { "6.1 -> 7.1", 7, 8, {
+    1, 0, 0, 0, 0, 0, 0,
+    0, 1, 0, 0, 0, 0, 0,
+    0, 0, 1, 0, 0, 0, 0,
+    0, 0, 0, 1, 0, 0, 0,
+    0, 0, 0, 0, H, 0, 0,
+    0, 0, 0, 0, H, 0, 0,
+    0, 0, 0, 0, 0, 1, 0,
+    0, 0, 0, 0, 0, 0, 1,
+  } },
+  { "5.1 -> quad", 6, 4, {
+    1, 0, H, 0, 0, 0,
+    0, 1, H, 0, 0, 0,
+    0, 0, 0, 0, 1, 0,
+    0, 0, 0, 0, 0, 1,
+  } },
+  { "7.1 -> 5.1", 8, 6, {
+    1, 0, 0, 0, 0, 0, 0, 0,
+    0, 1, 0, 0, 0, 0, 0, 0,
+    0, 0, 1, 0, 0, 0, 0, 0,
+    0, 0, 0, 1, 0, 0, 0, 0,
+    0, 0, 0, 0, 1, 0, 1, 0,
+    0, 0, 0, 0, 0, 1, 0, 1,
+  } },
+  { "5.1 -> stereo", 6, 2, {
+    1, 0, H, 0, H, 0,
+    0, 1, H, 0, 0, H,
+  } },
+  { "6.1 -> stereo", 7, 2, {
+    1, 0, H, 0, 0.5f, H, 0,
+    0, 1, H, 0, 0.5f, 0, H,
+  } },
+  { "mono -> 5.1", 1, 6, { 1, 1, 0, 0, 0, 0 } },
+  { "stereo -> mono", 2, 1, { 0.5f, 0.5f } },
+};
+
+// LFE position in default layouts, -1 for none
+static const int test_lfe[DECODER_MAX_CHANNELS + 1] = { -1, -1, -1, -1, -1, -1, 3, 3, 3 };
+
+static float planes[DECODER_MAX_CHANNELS][TEST_FRAMES], outs[AUDIO_CHMAP_MAX_OUT][TEST_FRAMES];
+
+// Recover the matrix of a map by feeding one input channel at a time
+static void test_matrix(const audio_chmap_t *map, float *m) {
+  float *src[DECODER_MAX_CHANNELS], *dst[AUDIO_CHMAP_MAX_OUT];
+  for (uint8_t c = 0; c < DECODER_MAX_CHANNELS; c++) src[c] = planes[c];
+  for (uint8_t c = 0; c < AUDIO_CHMAP_MAX_OUT; c++) dst[c] = outs[c];
+
+  for (uint8_t i = 0; i < map->in_channels; i++) {
+    memset(planes, 0, sizeof(planes));
+    for (uint32_t f = 0; f < TEST_FRAMES; f++) planes[i][f] = 1.0f;
+
+    audio_chmap_apply(map, &audio_mix_c, dst, src, TEST_FRAMES);
+
+    for (uint8_t o = 0; o < map->out_channels; o++) m[o * map->in_channels + i] = outs[o][TEST_FRAMES - 1];
+  }
+}
+
+static void test_layouts(void) {
+  for (size_t t = 0; t < sizeof(test_maps) / sizeof(test_maps[0]); t++) {
+    audio_chmap_t map;
+    float m[AUDIO_CHMAP_MAX_OUT * DECODER_MAX_CHANNELS];
+
+    TEST_CHECK(audio_chmap_init(&map, test_maps[t].in, test_maps[t].out, NULL) == 0, "%s init", test_maps[t].name);
+    test_matrix(&map, m);
+
+    for (uint8_t o = 0; o < test_maps[t].out; o++) {
+      for (uint8_t i = 0; i < test_maps[t].in; i++) {
+        float expected = test_maps[t].matrix[o * test_maps[t].in + i];
+        float gain = m[o * test_maps[t].in + i];
+        TEST_CHECK(fabsf(gain - expected) <= 1e-6f, "%s: out %u in %u gain %.6f != %.6f", test_maps[t].name, o, i, gain, expected);
+      }
+    }
+  }
+}
+
+// Every pair of default layouts: matching layouts are identity, LFE is routed only to LFE and nothing else is lost
+static void test_invariants(void) {
+  for (uint8_t in = 1; in <= DECODER_MAX_CHANNELS; in++) {
+    for (uint8_t out = 1; out <= AUDIO_CHMAP_MAX_OUT; out++) {
+      audio_chmap_t map;
+      float m[AUDIO_CHMAP_MAX_OUT * DECODER_MAX_CHANNELS];
+
+      TEST_CHECK(audio_chmap_init(&map, in, out, NULL) == 0, "%u -> %u init", in, out);
+      test_matrix(&map, m);
+
+      TEST_CHECK(map.identity == (in == out), "%u -> %u identity %d", in, out, map.identity);
+
+      for (uint8_t i = 0; i < in; i++) {
+        float total = 0;
+
+        for (uint8_t o = 0; o < out; o++) {
+          float gain = m[o * in + i];
+          total += gain;
+
+          TEST_CHECK(gain >= 0.0f && gain <= 1.0f, "%u -> %u: out %u in %u gain %.6f", in, out, o, i, gain);
+          if (gain != 0.0f && (o == test_lfe[out] || i == test_lfe[in]))
+            TEST_CHECK(o == test_lfe[out] && i == test_lfe[in], "%u -> %u: out %u in %u, LFE mixed with %.6f", in, out, o, i, gain);
+        }
+
+        if (i != test_lfe[in]) TEST_CHECK(total > 0.0f, "%u -> %u: in %u dropped", in, out, i);
+      }
+    }
+  }
+}
+
+int main(void) {
+  audio_chmap_t map;
+  TEST_CHECK(audio_chmap_init(&map, 0, 2, NULL) == -1, "no input channels");
+  TEST_CHECK(audio_chmap_init(&map, 2, AUDIO_CHMAP_MAX_OUT + 1, NULL) == -1, "too many output channels");
+
+  test_layouts();
+  test_invariants();
+
+  return test_result("audio_chmap");
+}
\ No newline at end of file
@@ -0,0 +1,158 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // clock_nanosleep
+#endif
+
+#include <stdint.h>
+#include "audio_io.h"
+#include "tests/engine.h"
+#include "tests/test.h"
+
+#define TEST_LEVEL 0.5f
+
+static engine_t engine;
+
+// Frames of a captured period scaled from gain to target, the last one lands on target
+static void check_ramp(const char *name, uint32_t period, uint8_t ch, float gain, float target) {
+  for (uint32_t i = 0; i < ENGINE_PERIOD; i++) {
+    float expected = TEST_LEVEL * (gain + (target - gain) * (i + 1) / ENGINE_PERIOD);
+    float sample = engine_sample(&engine, ch, period * ENGINE_PERIOD + i);
+
+    TEST_CHECK(fabsf(sample - expected) <= 1e-6f, "%s: period %u ch %u frame %u: %.9g != %.9g", name, period, ch, i, sample, expected);
+    if (fabsf(sample - expected) > 1e-6f) return;
+  }
+}
+
+// Every frame of a captured period at gain, exact
+static void check_level(const char *name, uint32_t period, uint8_t ch, float gain) {
+  for (uint32_t i = 0; i < ENGINE_PERIOD; i++) {
+    float sample = engine_sample(&engine, ch, period * ENGINE_PERIOD + i);
+
+    TEST_CHECK(sample == TEST_LEVEL * gain, "%s: period %u ch %u frame %u: %.9g != %.9g", name, period, ch, i, sample, TEST_LEVEL * gain);
+    if (sample != TEST_LEVEL * gain) return;
+  }
+}
+
+// Gain changes ramp over the next period and reach the target on its last frame
+static void test_ramps(void) {
+  engine_signal_t signal;
+
+  TEST_CHECK(engine_open(&engine) == 0, "engine open");
+  TEST_CHECK(audio_io_input_attach(engine.audio, 0, 0, engine_signal(&signal, ENGINE_RATE, TEST_LEVEL, TEST_LEVEL, false)) == AUDIO_IO_SUCCESS, "attach");
+
+  // Periods are counted from the first one, rendered before the input was attached
+  engine_step(&engine, 1);
+  for (uint8_t ch = 0; ch < ENGINE_CHANNELS; ch++) check_level("attach", 1, ch, 1.0f);
+
+  audio_io_input_set_gain(engine.audio, 0, 0.25f);
+  engine_step(&engine, 2);
+  for (uint8_t ch = 0; ch < ENGINE_CHANNELS; ch++) {
+    check_ramp("input gain", 2, ch, 1.0f, 0.25f);
+    check_level("input gain", 3, ch, 0.25f);
+  }
+
+  audio_io_bus_set_gain(engine.audio, 0, 3.0f);
+  engine_step(&engine, 2);
+  for (uint8_t ch = 0; ch < ENGINE_CHANNELS; ch++) {
+    check_ramp("bus gain", 4, ch, 0.25f, 0.75f);
+    check_level("bus gain", 5, ch, 0.75f);
+  }
+
+  audio_io_input_set_mute(engine.audio, 0, true);
+  engine_step(&engine, 2);
+  for (uint8_t ch = 0; ch < ENGINE_CHANNELS; ch++) {
+    check_ramp("mute", 6, ch, 0.75f, 0.0f);
+    check_level("mute", 7, ch, 0.0f);
+  }
+
+  audio_io_input_set_mute(engine.audio, 0, false);
+  engine_step(&engine, 2);
+  for (uint8_t ch = 0; ch < ENGINE_CHANNELS; ch++) {
+    check_ramp("unmute", 8, ch, 0.0f, 0.75f);
+    check_level("unmute", 9, ch, 0.75f);
+  }
+
+  engine_close(&engine);
+}
+
+// Pan is balance: hard pans silence the other channel, center is at unity on both and the near
+// side stays at unity in between
+static void test_pan(void) {
+  engine_signal_t signal;
+
+  TEST_CHECK(engine_open(&engine) == 0, "engine open");
+  TEST_CHECK(audio_io_input_attach(engine.audio, 0, 0, engine_signal(&signal, ENGINE_RATE, TEST_LEVEL, TEST_LEVEL, false)) == AUDIO_IO_SUCCESS, "attach");
+
+  audio_io_input_set_pan(engine.audio, 0, 0.0f);
+  engine_step(&engine, 1);
+  check_level("center", 1, 0, 1.0f);
+  check_level("center", 1, 1, 1.0f);
+
+  audio_io_input_set_pan(engine.audio, 0, -1.0f);
+  engine_step(&engine, 2);
+  check_ramp("left", 2, 1, 1.0f, 0.0f);
+  check_level("left", 3, 0, 1.0f);
+  check_level("left", 3, 1, 0.0f);
+
+  audio_io_input_set_pan(engine.audio, 0, 0.0f);
+  engine_step(&engine, 2);
+  check_ramp("left to center", 4, 1, 0.0f, 1.0f);
+  check_level("left to center", 5, 0, 1.0f);
+  check_level("left to center", 5, 1, 1.0f);
+
+  audio_io_bus_set_pan(engine.audio, 0, 1.0f);
+  engine_step(&engine, 2);
+  check_ramp("bus right", 6, 0, 1.0f, 0.0f);
+  check_level("bus right", 7, 0, 0.0f);
+  check_level("bus right", 7, 1, 1.0f);
+
+  audio_io_bus_set_pan(engine.audio, 0, 0.0f);
+  engine_step(&engine, 2);
+  check_level("bus center", 9, 0, 1.0f);
+  check_level("bus center", 9, 1, 1.0f);
+
+  // sqrt(2) * sin(pi / 8) on the far side
+  audio_io_input_set_pan(engine.audio, 0, -0.5f);
+  engine_step(&engine, 2);
+  check_level("half left", 11, 0, 1.0f);
+  check_ramp("half left", 11, 1, 0.5411961f, 0.5411961f);
+
+  TEST_CHECK(audio_io_input_set_pan(engine.audio, 0, 1.5f) == AUDIO_IO_INVALIDPARAM, "pan out of range");
+
+  engine_close(&engine);
+}
+
+// Queued decoder without crossfade continues on the frame after the last one of the playing
+// decoder, within the same period. Counters show any frame dropped, repeated or zeroed
+static void test_gapless(void) {
+  const uint32_t first = 1000, second = 3000;
+  const float step = 1.0f / 4096;
+  engine_signal_t a, b;
+
+  TEST_CHECK(engine_open(&engine) == 0, "engine open");
+  TEST_CHECK(audio_io_input_attach(engine.audio, 0, 0, engine_signal(&a, first, step, -step, true)) == AUDIO_IO_SUCCESS, "attach");
+  TEST_CHECK(audio_io_input_queue(engine.audio, 0, engine_signal(&b, second, -step, step, true), 0) == AUDIO_IO_SUCCESS, "queue");
+
+  // Input starts with period 1
+  engine_step(&engine, (first + second) / ENGINE_PERIOD + 2);
+
+  for (uint32_t n = 0; n < first + second + ENGINE_PERIOD; n++) {
+    float expected = n < first ? step * (n + 1) : n < first + second ? -step * (n - first + 1) : 0.0f;
+    float left = engine_sample(&engine, 0, ENGINE_PERIOD + n), right = engine_sample(&engine, 1, ENGINE_PERIOD + n);
+
+    TEST_CHECK(left == expected && right == -expected, "frame %u: %.9g %.9g, expected %.9g", n, left, right, expected);
+    if (left != expected || right != -expected) break;
+  }
+
+  engine_run(&engine);
+  TEST_CHECK(audio_io_input_reclaim(engine.audio, 0) == &a.decoder, "replaced decoder is reclaimed");
+
+  engine_close(&engine);
+}
+
+int main(void) {
+  test_ramps();
+  test_pan();
+  test_gapless();
+
+  return test_result("audio_io");
+}
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include <stdint.h>
+#include <string.h>
+#include "audio_limiter.h"
+#include "util/math.h"
+#include "tests/test.h"
+
+#define TEST_PI 3.14159265358979323846
+#define TEST_RATE 48000
+#define TEST_FRAMES 48000
+#define TEST_BLOCK 1024
+#define TEST_DRAIN_BLOCK 97
+
+// Reference true peak meter, 4x oversampling as dBTP of ITU-R BS.1770 with a long Kaiser windowed sinc
+#define TEST_OVERSAMPLE 4
+#define TEST_TAPS 64
+#define TEST_BETA 9.0
+
+// Noise is band limited to 20 kHz, onsets are faded in as a hard step isn't band limited
+#define TEST_LOWPASS 0.417
+#define TEST_LOWPASS_TAPS 255
+#define TEST_FADE 480
+
+static float in[2][TEST_FRAMES], out[2][TEST_FRAMES + TEST_BLOCK];
+static float sinc[TEST_OVERSAMPLE][TEST_TAPS];
+
+static double test_i0(double x) {
+  double sum = 1.0, term = 1.0;
+
+  for (int k = 1; k < 64; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+  }
+
+  return sum;
+}
+
+static void test_build_sinc(void) {
+  for (int ph = 0; ph < TEST_OVERSAMPLE; ph++) {
+    for (int k = 0; k < TEST_TAPS; k++) {
+      double t = k - TEST_TAPS / 2 + 1 - (double) ph / TEST_OVERSAMPLE, r = t / (TEST_TAPS / 2);
+      double window = fabs(r) >= 1.0 ? 0.0 : test_i0(TEST_BETA * sqrt(1.0 - r * r)) / test_i0(TEST_BETA);
+
+      sinc[ph][k] = (t == 0.0 ? 1.0 : sin(TEST_PI * t) / (TEST_PI * t)) * window;
+    }
+  }
+}
+
+static double test_true_peak(const float *x, uint32_t frames) {
+  double peak = 0.0;
+
+  for (uint32_t n = TEST_TAPS; n + TEST_TAPS < frames; n++) {
+    for (int ph = 0; ph < TEST_OVERSAMPLE; ph++) {
+      double s = 0.0;
+      for (int k = 0; k < TEST_TAPS; k++) s += x[n - TEST_TAPS / 2 + 1 + k] * sinc[ph][k];
+      peak = fmax(peak, fabs(s));
+    }
+  }
+
+  return peak;
+}
+
+// Input through the limiter in blocks of varying size, then drained. Returns frames the
+// limiter held back after the last block
+static uint32_t test_run(audio_limiter_t *l, uint32_t frames) {
+  audio_meter_t meter[2];
+  uint32_t done = 0, size = 1;
+
+  memset(out, 0, sizeof(out));
+  memcpy(out[0], in[0], frames * sizeof(float));
+  memcpy(out[1], in[1], frames * sizeof(float));
+
+  while (done < frames) {
+    uint32_t count = min(size, frames - done);
+    float *planes[2] = { out[0] + done, out[1] + done };
+
+    memset(meter, 0, sizeof(meter));
+    audio_limiter_process(l, planes, count, meter);
+
+    done += count;
+    size = size * 7 % TEST_BLOCK + 1;
+  }
+
+  uint32_t pending = audio_limiter_pending(l);
+
+  while (audio_limiter_pending(l) > 0) {
+    uint32_t left = audio_limiter_pending(l), count = min(left, TEST_DRAIN_BLOCK);
+    float *planes[2] = { out[0] + done, out[1] + done };
+
+    memset(meter, 0, sizeof(meter));
+    audio_limiter_drain(l, planes, count, meter);
+
+    TEST_CHECK(audio_limiter_pending(l) == left - count, "pending %u after draining %u of %u", audio_limiter_pending(l), count, left);
+    done += count;
+  }
+
+  return pending;
+}
+
+static void test_lowpass(float *x, uint32_t frames) {
+  static float tmp[TEST_FRAMES];
+  double h[TEST_LOWPASS_TAPS], sum = 0.0;
+
+  for (int k = 0; k < TEST_LOWPASS_TAPS; k++) {
+    double t = k - TEST_LOWPASS_TAPS / 2, r = t / (TEST_LOWPASS_TAPS / 2 + 1);
+    h[k] = (t == 0.0 ? 2 * TEST_LOWPASS : sin(2 * TEST_PI * TEST_LOWPASS * t) / (TEST_PI * t)) * test_i0(TEST_BETA * sqrt(1.0 - r * r));
+    sum += h[k];
+  }
+
+  for (uint32_t n = 0; n < frames; n++) {
+    double s = 0.0;
+
+    for (int k = 0; k < TEST_LOWPASS_TAPS; k++) {
+      int64_t i = (int64_t) n - TEST_LOWPASS_TAPS / 2 + k;
+      if (i >= 0 && i < frames) s += x[i] * h[k];
+    }
+
+    tmp[n] = s / sum;
+  }
+
+  memcpy(x, tmp, frames * sizeof(float));
+}
+
+// Signals with inter-sample peaks above the ceiling and sample peaks below or far above it
+static void test_ceiling(audio_limiter_t *l, float ceiling) {
+  for (uint32_t n = 0; n < TEST_FRAMES; n++) in[1][n] = test_randf(-1.0f, 1.0f);
+  test_lowpass(in[1], TEST_FRAMES);
+
+  for (uint32_t n = 0; n < TEST_FRAMES; n++) {
+    float fade = n < TEST_FADE ? 0.5f - 0.5f * cos(TEST_PI * n / TEST_FADE) : 1.0f;
+
+    // fs/4 at 45 degrees peaks halfway between samples, 3 dB above them. Noise is 10 dB louder
+    // in its second half
+    in[0][n] = fade * 1.2f * sin(TEST_PI / 2 * n + TEST_PI / 4);
+    in[1][n] *= fade * (n < TEST_FRAMES / 2 ? 1.0f : 3.0f);
+  }
+
+  test_run(l, TEST_FRAMES);
+
+  for (int ch = 0; ch < 2; ch++) {
+    float peak = 0.0f;
+    for (uint32_t n = 0; n < TEST_FRAMES; n++) peak = fmaxf(peak, fabsf(out[ch][n]));
+
+    double true_peak = test_true_peak(out[ch], TEST_FRAMES);
+    TEST_CHECK(peak <= ceiling * 1.000001f, "ch %d sample peak %.6f above ceiling %.6f", ch, peak, ceiling);
+    // Gain moving within a short attack adds a little of its own, 0.02 dB is the margin
+    TEST_CHECK(true_peak <= ceiling * 1.0023, "ch %d true peak %.6f above ceiling %.6f by more than 0.02 dB", ch, true_peak, ceiling);
+    printf("ch %d: input true peak %.3f, output sample peak %.4f, true peak %.4f, ceiling %.4f\n", ch,
+      test_true_peak(in[ch], TEST_FRAMES), peak, true_peak, ceiling);
+  }
+}
+
+// Spike on a quiet carrier, gain of the other channel shows when reduction starts and where
+// it is deepest. Output frame n carries input frame n - delay
+static void test_alignment(audio_limiter_t *l, float ceiling, uint32_t lookahead) {
+  const uint32_t spike = 10000;
+
+  for (uint32_t n = 0; n < TEST_FRAMES; n++) in[0][n] = in[1][n] = 0.25f;
+  in[0][spike] = 2.0f;
+
+  test_run(l, TEST_FRAMES);
+
+  uint32_t delay = 0;
+  while (delay < TEST_FRAMES && out[1][delay] == 0.0f) delay++;
+
+  uint32_t deepest = delay, start = UINT32_MAX;
+  for (uint32_t n = delay; n < TEST_FRAMES; n++) {
+    float gain = out[1][n] / 0.25f;
+    if (gain < 1.0f && start == UINT32_MAX) start = n;
+    if (gain < out[1][deepest] / 0.25f) deepest = n;
+  }
+
+  TEST_CHECK(out[0][spike + delay] <= ceiling * 1.000001f, "spike %.6f above ceiling %.6f", out[0][spike + delay], ceiling);
+  TEST_CHECK(deepest == spike + delay, "deepest reduction at %u, spike leaves the delay line at %u", deepest, spike + delay);
+  TEST_CHECK(start + lookahead > spike + delay, "reduction starts at %u, %u frames before the spike", start, spike + delay - start);
+  TEST_CHECK(start + lookahead <= spike + delay + 1, "reduction starts at %u, after attack of %u frames", start, lookahead);
+}
+
+// Every frame comes out once, drain plays out exactly the frames held back
+static void test_drain(audio_limiter_t *l) {
+  const uint32_t frames = 10007;
+
+  for (uint32_t n = 0; n < frames; n++) {
+    in[0][n] = 0.5f;
+    in[1][n] = -0.5f;
+  }
+
+  uint32_t pending = test_run(l, frames);
+
+  TEST_CHECK(pending > 0, "look-ahead limiter holds frames back");
+
+  for (uint32_t n = 0; n < frames + TEST_BLOCK; n++) {
+    float expected = n >= pending && n < frames + pending ? 0.5f : 0.0f;
+
+    TEST_CHECK(out[0][n] == expected && out[1][n] == -expected, "frame %u: %.6f %.6f, expected %.6f", n, out[0][n], out[1][n], expected);
+    if (out[0][n] != expected || out[1][n] != -expected) return;
+  }
+}
+
+int main(void) {
+  static const float attacks[] = { 0.0f, 1.0f, 12.5f };
+
+  test_build_sinc();
+
+  for (size_t i = 0; i < sizeof(attacks) / sizeof(attacks[0]); i++) {
+    audio_limiter_params_t params = { .mode = AUDIO_LIMITER_LOOKAHEAD, .attack_ms = attacks[i] };
+    float ceiling = powf(10.0f, AUDIO_LIMITER_CEILING_DB / 20.0f);
+    uint32_t lookahead = lroundf((attacks[i] > 0.0f ? attacks[i] : AUDIO_LIMITER_ATTACK_MS) * TEST_RATE / 1000.0f);
+
+    audio_limiter_t *l = audio_limiter_create(TEST_RATE, 2, TEST_BLOCK, &params);
+    TEST_CHECK(l != NULL, "create");
+    if (!l) continue;
+
+    test_ceiling(l, ceiling);
+    audio_limiter_reset(l);
+    test_alignment(l, ceiling, lookahead);
+    audio_limiter_reset(l);
+    test_drain(l);
+
+    audio_limiter_destroy(l);
+  }
+
+  return test_result("audio_limiter");
+}
\ No newline at end of file
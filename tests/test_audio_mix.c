@@ -0,0 +1,79 @@
+#include <stdint.h>
+#include <string.h>
+#include "audio_mix.h"
+#include "tests/test.h"
+
+#define TEST_SAMPLES 1031
+
+// Odd lengths reach the scalar tails of every vector width
+static const uint32_t test_lengths[] = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 17, 31, 33, 63, 255, 1024, TEST_SAMPLES };
+
+static float src[TEST_SAMPLES], base[TEST_SAMPLES];
+static float ref[TEST_SAMPLES], out[TEST_SAMPLES];
+
+static void compare(const char *ops, const char *kernel, int mode, uint32_t samples) {
+  for (uint32_t i = 0; i < samples; i++) {
+    uint32_t ulps = test_ulps(out[i], ref[i]);
+    TEST_CHECK(ulps <= 1, "%s %s mode %d, %u samples: [%u] %.9g != %.9g", ops, kernel, mode, samples, i, out[i], ref[i]);
+    if (ulps > 1) return;
+  }
+}
+
+static void test_ops(const audio_mix_ops_t *ops) {
+  const audio_mix_ops_t *c = &audio_mix_c;
+
+  for (size_t l = 0; l < sizeof(test_lengths) / sizeof(test_lengths[0]); l++) {
+    uint32_t samples = test_lengths[l];
+
+    for (int mode = AUDIO_MIX_SET; mode <= AUDIO_MIX_ADD; mode++) {
+      float gain = test_randf(0.0f, 2.0f);
+      float step = samples ? test_randf(-gain, 2.0f - gain) / samples : 0.0f;
+
+      memcpy(ref, base, sizeof(base)); memcpy(out, base, sizeof(base));
+      c->mix(ref, src, samples, mode); ops->mix(out, src, samples, mode);
+      compare(ops->name, "mix", mode, samples);
+
+      memcpy(ref, base, sizeof(base)); memcpy(out, base, sizeof(base));
+      c->mix_gain(ref, src, samples, gain, mode); ops->mix_gain(out, src, samples, gain, mode);
+      compare(ops->name, "mix_gain", mode, samples);
+
+      memcpy(ref, base, sizeof(base)); memcpy(out, base, sizeof(base));
+      c->mix_ramp(ref, src, samples, gain, step, mode); ops->mix_ramp(out, src, samples, gain, step, mode);
+      compare(ops->name, "mix_ramp", mode, samples);
+
+      // Metering with source, with ramp and clamping only in place
+      for (int pass = 0; pass < 3; pass++) {
+        const float *s = pass == 2 ? NULL : src;
+        float g = pass == 0 ? 1.0f : gain, st = pass == 0 ? 0.0f : step;
+        audio_meter_t mref = { 0.25f, 1.0f }, mout = mref;
+
+        memcpy(ref, base, sizeof(base)); memcpy(out, base, sizeof(base));
+        c->mix_meter(ref, s, samples, g, st, mode, &mref); ops->mix_meter(out, s, samples, g, st, mode, &mout);
+        compare(ops->name, "mix_meter", mode, samples);
+
+        TEST_CHECK(test_ulps(mout.peak, mref.peak) <= 1, "%s mix_meter peak, %u samples: %.9g != %.9g", ops->name, samples, mout.peak, mref.peak);
+        TEST_CHECK(fabsf(mout.sum - mref.sum) <= 1e-5f * mref.sum, "%s mix_meter sum, %u samples: %.9g != %.9g", ops->name, samples, mout.sum, mref.sum);
+      }
+    }
+  }
+}
+
+int main(void) {
+  const audio_mix_ops_t *ops[AUDIO_MIX_TABLES];
+  uint32_t count = audio_mix_available(ops, AUDIO_MIX_TABLES);
+
+  TEST_CHECK(count > 0 && ops[0] == &audio_mix_c, "scalar kernels come first");
+
+  // Levels above full scale exercise clamping
+  for (uint32_t i = 0; i < TEST_SAMPLES; i++) {
+    src[i] = test_randf(-1.5f, 1.5f);
+    base[i] = test_randf(-1.5f, 1.5f);
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    for (int round = 0; round < 16; round++) test_ops(ops[i]);
+    printf("%s kernels checked\n", ops[i]->name);
+  }
+
+  return test_result("audio_mix");
+}
\ No newline at end of file
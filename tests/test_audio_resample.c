@@ -0,0 +1,70 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "audio_resample.h"
+#include "tests/test.h"
+
+#define TEST_PI 3.14159265358979323846
+#define TEST_RATE 44100
+#define TEST_FRAMES 44100
+#define TEST_TONE 1000.0
+
+// Rates with an exact table and with one reduced to AUDIO_RESAMPLE_MAX_PHASES nearest phases
+static const struct {
+  uint32_t out_rate;
+  double snr[AUDIO_RESAMPLE_BEST + 1]; // dB, by preset
+} test_rates[] = {
+  { 48000, { 0, 74.0, 86.0, 105.0 } },
+  { 47997, { 0, 74.0, 83.0, 86.0 } },
+  { 44101, { 0, 74.0, 83.0, 86.0 } },
+};
+
+static float in[TEST_FRAMES * 2], out[TEST_FRAMES * 3 * 2];
+
+// Stereo tone with channels in antiphase, output is compared with the ideal tone at the new rate
+static void test_tone(int quality, uint32_t out_rate, double min_snr) {
+  audio_resampler_t *r = audio_resampler_create(TEST_RATE, out_rate, 2, quality);
+  TEST_CHECK(r != NULL, "create %u -> %u", TEST_RATE, out_rate);
+  if (!r) return;
+
+  for (uint32_t i = 0; i < TEST_FRAMES; i++) {
+    in[i * 2] = 0.5 * sin(2 * TEST_PI * TEST_TONE * i / TEST_RATE);
+    in[i * 2 + 1] = -in[i * 2];
+  }
+
+  // Odd input pieces, then flush
+  uint32_t consumed = 0, produced = 0, size = 777;
+  while (consumed < TEST_FRAMES) {
+    uint32_t frames = TEST_FRAMES - consumed < size ? TEST_FRAMES - consumed : size;
+    produced += audio_resampler_process(r, in + consumed * 2, &frames, out + produced * 2, 512);
+    consumed += frames;
+  }
+
+  uint32_t count;
+  while ((count = audio_resampler_process(r, NULL, NULL, out + produced * 2, 512)) > 0) produced += count;
+
+  uint64_t expected = ((uint64_t) TEST_FRAMES * out_rate + TEST_RATE - 1) / TEST_RATE;
+  TEST_CHECK(produced + 1 >= expected && produced <= expected + 1, "%s %u -> %u: %u frames, expected %llu",
+    audio_resample_quality_name(quality), TEST_RATE, out_rate, produced, (unsigned long long) expected);
+
+  // Edges hold the filter transient of the cut tone
+  double signal = 0, noise = 0;
+  for (uint32_t i = 2000; i + 2000 < produced; i++) {
+    double ref = 0.5 * sin(2 * TEST_PI * TEST_TONE * i / out_rate);
+    signal += ref * ref;
+    noise += (out[i * 2] - ref) * (out[i * 2] - ref) + (out[i * 2 + 1] + ref) * (out[i * 2 + 1] + ref);
+  }
+
+  double snr = 10 * log10(2 * signal / noise);
+  TEST_CHECK(snr >= min_snr, "%s %u -> %u: SNR %.1f dB below %.1f dB", audio_resample_quality_name(quality), TEST_RATE, out_rate, snr, min_snr);
+  printf("%-8s %u -> %u: %u frames, SNR %.1f dB\n", audio_resample_quality_name(quality), TEST_RATE, out_rate, produced, snr);
+
+  audio_resampler_destroy(r);
+}
+
+int main(void) {
+  for (int quality = AUDIO_RESAMPLE_FAST; quality <= AUDIO_RESAMPLE_BEST; quality++) {
+    for (size_t i = 0; i < sizeof(test_rates) / sizeof(test_rates[0]); i++) test_tone(quality, test_rates[i].out_rate, test_rates[i].snr[quality]);
+  }
+
+  return test_result("audio_resample");
+}
\ No newline at end of file
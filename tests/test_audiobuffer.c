@@ -0,0 +1,81 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // clock_nanosleep, sched_yield
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "audiobuffer.h"
+#include "tests/test.h"
+#include "tests/ring.h"
+
+// Single thread checks of positions, spans and wrapping
+static void test_spans(const ring_ops_t *ops) {
+  audio_format_t af = af_endian(AF_NATIVE_ENDIAN) | af_format(SF_FORMAT_FLOAT) | af_channels(2);
+  audiobuffer_t *b = ops->create(af, 1000);
+  float *ptr;
+
+  TEST_CHECK(b != NULL, "%s create", ops->name);
+  if (!b) return;
+
+  TEST_CHECK(b->capacity >= 1000 && (b->capacity & b->mask) == 0, "%s capacity %u is a power of two", ops->name, b->capacity);
+  TEST_CHECK(ops->read_begin(b, 16) == 0, "%s empty ring has nothing to read", ops->name);
+  ops->read_end(b);
+
+  // Move the positions near the end of storage, then cross it
+  uint32_t capacity = b->capacity, offset = capacity - 10;
+  ops->write_begin(b, offset); ops->write_fill(b, offset); ops->write_end(b);
+  ops->read_begin(b, offset); ops->read_consume(b, offset); ops->read_end(b);
+
+  TEST_CHECK(ops->write_begin(b, capacity) == capacity, "%s empty ring is writable in full", ops->name);
+  uint32_t first = ops->write(b, &ptr);
+  TEST_CHECK(first == (b->mirrored ? capacity : 10), "%s first span %u", ops->name, first);
+  for (uint32_t i = 0; i < first * 2; i++) ptr[i] = i;
+  ops->write_fill(b, first);
+
+  uint32_t second = ops->write(b, &ptr);
+  TEST_CHECK(first + second == capacity, "%s spans cover the region: %u + %u", ops->name, first, second);
+  for (uint32_t i = 0; i < second * 2; i++) ptr[i] = (first * 2) + i;
+  ops->write_fill(b, second);
+  TEST_CHECK(ops->write_end(b) == capacity, "%s write routine count", ops->name);
+
+  TEST_CHECK(ops->write_begin(b, 1) == 0, "%s full ring has no space", ops->name);
+  ops->write_end(b);
+
+  uint32_t read = 0, count, errors = 0;
+  TEST_CHECK(ops->read_begin(b, capacity) == capacity, "%s full ring is readable in full", ops->name);
+  while ((count = ops->read(b, &ptr)) > 0) {
+    for (uint32_t i = 0; i < count * 2; i++) errors += ptr[i] != (float) (read * 2 + i);
+    ops->read_consume(b, count);
+    read += count;
+  }
+  TEST_CHECK(ops->read_end(b) == capacity && read == capacity && errors == 0, "%s read back %u frames, %u errors", ops->name, read, errors);
+
+  ops->destroy(b);
+}
+
+int main(void) {
+  static const ring_ops_t *rings[] = { &ring_mirrored, &ring_fallback };
+
+  for (size_t r = 0; r < sizeof(rings) / sizeof(rings[0]); r++) {
+    test_spans(rings[r]);
+
+    // Random routine sizes and partial consumes, spinning and blocking in waits
+    for (int wait = 0; wait <= 1; wait++) {
+      for (uint8_t channels = 1; channels <= 3; channels += 2) {
+        ring_load_t load = {
+          .ops = rings[r], .channels = channels, .frames = 4000000, .capacity = 4096,
+          .check = true, .wait = wait, .seed = 12345 + channels,
+        };
+
+        TEST_CHECK(ring_run(&load) > 0, "%s ring created", rings[r]->name);
+        TEST_CHECK(load.errors == 0, "%s, %u channels, wait %d: %llu samples out of order", rings[r]->name, channels, wait, (unsigned long long) load.errors);
+      }
+    }
+
+    printf("%s ring checked\n", rings[r]->name);
+  }
+
+  TEST_CHECK(ring_mirrored.create != ring_fallback.create, "both implementations are built");
+
+  return test_result("audiobuffer");
+}
\ No newline at end of file
@@ -0,0 +1,388 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // mkdtemp, setenv, utimensat
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "decoder/decoder.h"
+#include "decoder/cache.h"
+#include "decoder/pcm_cache.h"
+#include "util/math.h"
+#include "tests/test.h"
+
+/*
+  Decoder caches of copies of tests/data/seek.mp3 in a temporary directory, with XDG_CACHE_HOME
+  pointing there too. Everything is removed on exit. The fixture is LAME 3.100 VBR at 22050 Hz,
+  4 seconds of a mono chirp written by libsndfile, with frames small enough that the bit
+  reservoir reaches back over 20 of them:
+
+    n = numpy.arange(88200) / 22050; T = 4
+    soundfile.write('seek.mp3', (0.5 * numpy.cos(2 * numpy.pi * (100 * n + 4900 / (2 * T) * n * n))).astype(numpy.float32),
+      22050, format='MP3', subtype='MPEG_LAYER_III')
+*/
+#define TEST_MP3_SEEK_KIND "mp3seek"
+#define TEST_RATE 22050
+#define TEST_FRAMES 88200
+#define TEST_SEEK_FRAMES 64
+
+// Mostly backwards, each one starts from a seek point
+static const long test_seeks[] = { 3900, 3000, 2500, 1999, 1200, 1000, 3333, 100, 0 }; // ms
+
+static char test_dir[PATH_MAX / 2];
+static uint8_t *fixture;
+static size_t fixture_size;
+
+// What a decoder reports and reads after each seek, compared between opens
+typedef struct {
+  uint64_t length;
+  long duration;
+  uint32_t seek_frames[sizeof(test_seeks) / sizeof(test_seeks[0])];
+  float seek_data[sizeof(test_seeks) / sizeof(test_seeks[0])][TEST_SEEK_FRAMES];
+} test_stream_t;
+
+static int test_load(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return 0;
+
+  fseek(f, 0, SEEK_END);
+  fixture_size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  fixture = malloc(fixture_size);
+  int ok = fixture && fread(fixture, 1, fixture_size, f) == fixture_size;
+
+  fclose(f);
+  return ok;
+}
+
+static void test_path(char *path, const char *name) {
+  snprintf(path, PATH_MAX, "%s/%s", test_dir, name);
+}
+
+static int test_write(const char *name, const uint8_t *data, size_t size) {
+  char path[PATH_MAX];
+  test_path(path, name);
+
+  FILE *f = fopen(path, "wb");
+  if (!f) return 0;
+
+  int ok = fwrite(data, 1, size, f) == size;
+  return fclose(f) == 0 && ok;
+}
+
+// Modification time of the file is moved by a second, size stays the same
+static void test_touch(const char *name) {
+  char path[PATH_MAX];
+  struct stat st;
+  test_path(path, name);
+
+  if (stat(path, &st) != 0) return;
+
+  struct timespec times[2] = { st.st_atim, st.st_mtim };
+  times[1].tv_sec += 1;
+  utimensat(AT_FDCWD, path, times, 0);
+}
+
+static int test_entry(const char *name, const char *kind) {
+  char path[PATH_MAX], entry[PATH_MAX];
+  decoder_source_t source;
+  struct stat st;
+  test_path(path, name);
+
+  if (decoder_source_open_file(&source, path) != DECODER_SUCCESS) return 0;
+  int rc = decoder_cache_path(entry, sizeof(entry), &source, kind);
+  decoder_source_close(&source);
+
+  return rc == DECODER_SUCCESS && stat(entry, &st) == 0;
+}
+
+static void test_remove_dir(const char *path) {
+  DIR *dir = opendir(path);
+  if (!dir) return;
+
+  struct dirent *entry;
+  char child[PATH_MAX];
+
+  while ((entry = readdir(dir))) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+    snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+    if (entry->d_type == DT_DIR) test_remove_dir(child);
+    else unlink(child);
+  }
+
+  closedir(dir);
+  rmdir(path);
+}
+
+// Length, duration and frames after each seek of a file decoded through the cache
+static int test_stream(test_stream_t *stream, const char *name) {
+  char path[PATH_MAX];
+  decoder_t decoder;
+  test_path(path, name);
+
+  memset(stream, 0, sizeof(test_stream_t));
+  if (decoder_open(&decoder, path, NULL) != DECODER_SUCCESS) return 0;
+
+  stream->length = decoder.ops.length(&decoder.data);
+  stream->duration = decoder.ops.duration(&decoder.data);
+
+  for (size_t i = 0; i < sizeof(test_seeks) / sizeof(test_seeks[0]); i++) {
+    float *ptr = stream->seek_data[i];
+
+    if (decoder.ops.seek(&decoder.data, test_seeks[i]))
+      stream->seek_frames[i] = decoder.ops.read_f32(&decoder.data, &ptr, 1, TEST_SEEK_FRAMES);
+  }
+
+  decoder_close(&decoder);
+  return 1;
+}
+
+static void test_same_stream(const test_stream_t *a, const test_stream_t *b, const char *what) {
+  TEST_CHECK(a->length == b->length, "%s: length %llu, %llu before", what, (unsigned long long) b->length, (unsigned long long) a->length);
+  TEST_CHECK(a->duration == b->duration, "%s: duration %ld, %ld before", what, b->duration, a->duration);
+
+  for (size_t i = 0; i < sizeof(test_seeks) / sizeof(test_seeks[0]); i++) {
+    TEST_CHECK(a->seek_frames[i] == TEST_SEEK_FRAMES && b->seek_frames[i] == TEST_SEEK_FRAMES,
+      "%s: seek to %ld ms read %u and %u frames", what, test_seeks[i], a->seek_frames[i], b->seek_frames[i]);
+    TEST_CHECK(memcmp(a->seek_data[i], b->seek_data[i], sizeof(a->seek_data[i])) == 0,
+      "%s: frames after seek to %ld ms differ", what, test_seeks[i]);
+  }
+}
+
+// Whole stream decoded from the start, returns frames read
+static uint32_t test_decode(const char *name, float *buffer, uint32_t frames) {
+  char path[PATH_MAX];
+  decoder_t decoder;
+  test_path(path, name);
+
+  if (decoder_open(&decoder, path, NULL) != DECODER_SUCCESS) return 0;
+  TEST_CHECK(af_get_channels(decoder.data.af) == 1, "%s: mono", name);
+
+  uint32_t done = 0;
+  size_t r;
+  do {
+    float *ptr = buffer + done;
+    r = decoder.ops.read_f32(&decoder.data, &ptr, 1, min(frames - done, 4096u));
+    done += r;
+  } while (r > 0 && done < frames);
+
+  decoder_close(&decoder);
+  return done;
+}
+
+// Frames after a seek are the frames at that position of a decode from the start
+static void test_seek_positions(const test_stream_t *stream, const char *name) {
+  static float sequential[TEST_FRAMES];
+  uint32_t done = test_decode(name, sequential, TEST_FRAMES);
+
+  TEST_CHECK(done == TEST_FRAMES, "%s: decoded %u frames, encoded %u", name, done, TEST_FRAMES);
+
+  for (size_t i = 0; i < sizeof(test_seeks) / sizeof(test_seeks[0]); i++) {
+    uint32_t frame = (uint64_t) TEST_RATE * test_seeks[i] / 1000;
+
+    TEST_CHECK(frame + TEST_SEEK_FRAMES <= done &&
+      memcmp(stream->seek_data[i], sequential + frame, sizeof(stream->seek_data[i])) == 0,
+      "%s: seek to %ld ms doesn't land on frame %u", name, test_seeks[i], frame);
+  }
+}
+
+// First open scans the stream and stores its seek table, later opens bind the stored one
+static void test_seek_table(const char *name) {
+  test_stream_t *scanned = malloc(sizeof(test_stream_t)), *cached = malloc(sizeof(test_stream_t));
+  if (!scanned || !cached) goto out;
+
+  TEST_CHECK(!test_entry(name, TEST_MP3_SEEK_KIND), "%s: seek table cached before first open", name);
+  TEST_CHECK(test_stream(scanned, name), "%s: open", name);
+  TEST_CHECK(test_entry(name, TEST_MP3_SEEK_KIND), "%s: seek table isn't cached", name);
+  test_seek_positions(scanned, name);
+
+  TEST_CHECK(test_stream(cached, name), "%s: open", name);
+  test_same_stream(scanned, cached, name);
+
+  // Changed file is scanned again
+  test_touch(name);
+  TEST_CHECK(test_stream(cached, name), "%s: open", name);
+  test_same_stream(scanned, cached, name);
+
+out:
+  free(scanned);
+  free(cached);
+}
+
+// Without Xing frame length comes from the seek table, a changed entry shows whether it is used
+// and a changed file shows whether it is dropped
+static void test_seek_table_bound(const char *name) {
+  char path[PATH_MAX];
+  decoder_source_t source;
+  decoder_t decoder;
+  size_t size;
+  test_path(path, name);
+
+  if (decoder_open(&decoder, path, NULL) != DECODER_SUCCESS) return;
+  uint64_t length = decoder.ops.length(&decoder.data);
+  decoder_close(&decoder);
+
+  if (decoder_source_open_file(&source, path) != DECODER_SUCCESS) return;
+
+  // Entry payload starts with total frames
+  uint64_t *table = decoder_cache_load(&source, TEST_MP3_SEEK_KIND, &size);
+  TEST_CHECK(table && size >= sizeof(uint64_t), "%s: seek table isn't cached", name);
+
+  if (table && size >= sizeof(uint64_t)) {
+    table[0] += 576;
+    decoder_cache_store(&source, TEST_MP3_SEEK_KIND, table, size);
+  }
+
+  free(table);
+  decoder_source_close(&source);
+
+  if (decoder_open(&decoder, path, NULL) != DECODER_SUCCESS) return;
+  TEST_CHECK(decoder.ops.length(&decoder.data) == length + 576, "%s: length %llu ignores cached %llu frames", name,
+    (unsigned long long) decoder.ops.length(&decoder.data), (unsigned long long) length + 576);
+  decoder_close(&decoder);
+
+  test_touch(name);
+  if (decoder_open(&decoder, path, NULL) != DECODER_SUCCESS) return;
+  TEST_CHECK(decoder.ops.length(&decoder.data) == length, "%s: length %llu of a stale entry, scanned %llu", name,
+    (unsigned long long) decoder.ops.length(&decoder.data), (unsigned long long) length);
+  decoder_close(&decoder);
+}
+
+// Writers of one entry at once don't share the unfinished file, the entry is one of their payloads
+static void test_writers(const char *name) {
+  char path[PATH_MAX], first[16], second[12];
+  decoder_source_t source;
+  decoder_cache_writer_t a, b;
+  size_t size;
+  test_path(path, name);
+
+  memset(first, 'a', sizeof(first));
+  memset(second, 'b', sizeof(second));
+
+  if (decoder_source_open_file(&source, path) != DECODER_SUCCESS) return;
+
+  TEST_CHECK(decoder_cache_writer_open(&a, &source, "test") == DECODER_SUCCESS &&
+    decoder_cache_writer_open(&b, &source, "test") == DECODER_SUCCESS, "%s: open writers", name);
+
+  decoder_cache_writer_append(&a, first, sizeof(first) / 2);
+  decoder_cache_writer_append(&b, second, sizeof(second));
+  decoder_cache_writer_append(&a, first + sizeof(first) / 2, sizeof(first) / 2);
+
+  TEST_CHECK(decoder_cache_writer_commit(&a) == DECODER_SUCCESS, "%s: first writer commit", name);
+  TEST_CHECK(decoder_cache_writer_commit(&b) == DECODER_SUCCESS, "%s: second writer commit", name);
+
+  char *payload = decoder_cache_load(&source, "test", &size);
+  TEST_CHECK(payload && ((size == sizeof(first) && memcmp(payload, first, size) == 0) ||
+    (size == sizeof(second) && memcmp(payload, second, size) == 0)), "%s: entry of two writers is mixed", name);
+
+  free(payload);
+  decoder_source_close(&source);
+}
+
+// Opens the file, reads it to the end unless stopped at frames and seeked to seek_ms first if not
+// negative. Returns frames read, the decoder used is written to impl
+static uint32_t test_play(const char *name, float *buffer, uint32_t frames, long seek_ms, const char **impl) {
+  char path[PATH_MAX];
+  decoder_t decoder;
+  test_path(path, name);
+
+  *impl = NULL;
+  if (decoder_open(&decoder, path, NULL) != DECODER_SUCCESS) return 0;
+  *impl = decoder.info->name;
+
+  if (seek_ms >= 0) decoder.ops.seek(&decoder.data, seek_ms);
+
+  uint32_t done = 0;
+  size_t r;
+  do {
+    float *ptr = buffer + done;
+    r = decoder.ops.read_f32(&decoder.data, &ptr, 1, min(frames - done, 4096u));
+    done += r;
+  } while (r > 0 && done < frames);
+
+  decoder_close(&decoder);
+  return done;
+}
+
+// File read to the end is recorded on close and replayed from the entry, a changed one is decoded again
+static void test_pcm_cache(const char *name) {
+  static float decoded[TEST_FRAMES + 1], replayed[TEST_FRAMES + 1];
+  const char *impl;
+
+  // Room for one more frame, the read that returns nothing marks the end of stream
+  uint32_t frames = test_play(name, decoded, TEST_FRAMES + 1, -1, &impl);
+  TEST_CHECK(impl && strcmp(impl, "mp3") == 0, "%s: first open with %s", name, impl ? impl : "nothing");
+  TEST_CHECK(frames == TEST_FRAMES, "%s: decoded %u frames, encoded %u", name, frames, TEST_FRAMES);
+  TEST_CHECK(test_entry(name, DECODER_PCM_CACHE_KIND), "%s: decoded stream isn't cached", name);
+
+  uint32_t replay = test_play(name, replayed, TEST_FRAMES + 1, -1, &impl);
+  TEST_CHECK(impl && strcmp(impl, "cache") == 0, "%s: second open with %s", name, impl ? impl : "nothing");
+  TEST_CHECK(replay == frames && memcmp(decoded, replayed, frames * sizeof(float)) == 0,
+    "%s: replayed %u frames differ from %u decoded", name, replay, frames);
+
+  // Entry of the old file is left alone, the new one replaces it once read to the end
+  test_touch(name);
+  replay = test_play(name, replayed, TEST_FRAMES + 1, -1, &impl);
+  TEST_CHECK(impl && strcmp(impl, "mp3") == 0, "%s: changed file opened with %s", name, impl ? impl : "nothing");
+  TEST_CHECK(replay == frames && memcmp(decoded, replayed, frames * sizeof(float)) == 0, "%s: decoded again %u frames differ", name, replay);
+
+  test_play(name, replayed, 1, -1, &impl);
+  TEST_CHECK(impl && strcmp(impl, "cache") == 0, "%s: changed file isn't cached again, opened with %s", name, impl ? impl : "nothing");
+}
+
+// Only a read from start to end without seeking is recorded
+static void test_pcm_cache_partial(const char *name) {
+  static float buffer[TEST_FRAMES + 1];
+  const char *impl;
+
+  test_play(name, buffer, TEST_FRAMES / 2, -1, &impl);
+  TEST_CHECK(!test_entry(name, DECODER_PCM_CACHE_KIND), "%s: half read stream is cached", name);
+
+  test_play(name, buffer, TEST_FRAMES + 1, 1000, &impl);
+  TEST_CHECK(!test_entry(name, DECODER_PCM_CACHE_KIND), "%s: stream with a seek is cached", name);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || !test_load(argv[1])) {
+    fprintf(stderr, "usage: %s seek.mp3\n", argv[0]);
+    return 1;
+  }
+
+  snprintf(test_dir, sizeof(test_dir), "%s/mizar-test-XXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+  if (!mkdtemp(test_dir) || setenv("XDG_CACHE_HOME", test_dir, 1) != 0) {
+    fprintf(stderr, "unable to create %s\n", test_dir);
+    return 1;
+  }
+
+  // Without Xing frame the first one is decoded as audio, length is unknown until the stream is scanned
+  uint8_t *plain = malloc(fixture_size);
+  if (!plain) return 1;
+  memcpy(plain, fixture, fixture_size);
+  for (size_t i = 0; i + 4 <= 64 && i + 4 <= fixture_size; i++)
+    if (memcmp(plain + i, "Xing", 4) == 0 || memcmp(plain + i, "Info", 4) == 0) memset(plain + i, 0, 4);
+
+  TEST_CHECK(test_write("seek.mp3", fixture, fixture_size) && test_write("plain.mp3", plain, fixture_size), "write to %s", test_dir);
+
+  // Seek tables only, decoded entries would replace the decoder
+  decoder_pcm_cache_budget(0);
+  test_seek_table("seek.mp3");
+  test_seek_table("plain.mp3");
+  test_seek_table_bound("plain.mp3");
+  test_writers("seek.mp3");
+
+  decoder_pcm_cache_budget(DECODER_PCM_CACHE_BUDGET);
+  test_pcm_cache("seek.mp3");
+  test_pcm_cache_partial("plain.mp3");
+
+  test_remove_dir(test_dir);
+  free(plain);
+  free(fixture);
+  return test_result("decoder_cache");
+}
\ No newline at end of file
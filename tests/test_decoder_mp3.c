@@ -0,0 +1,160 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "decoder/decoder.h"
+#include "util/math.h"
+#include "tests/test.h"
+
+#define TEST_PI 3.14159265358979323846
+
+/*
+  tests/data/lame.mp3 is LAME 3.100 VBR at 44100 Hz of 10000 stereo frames, an up and a down
+  chirp at half scale, written by libsndfile:
+
+    n = numpy.arange(10000) / 44100; T = 10000 / 44100
+    chirp = lambda f0, f1: 0.5 * numpy.cos(2 * numpy.pi * (f0 * n + (f1 - f0) / (2 * T) * n * n))
+    soundfile.write('lame.mp3', numpy.stack([chirp(200, 4000), chirp(3000, 300)], axis=1).astype(numpy.float32),
+      44100, format='MP3', subtype='MPEG_LAYER_III')
+
+  Its Info frame is followed by 10 frames of 1152 samples, LAME tag gives delay 576 and padding 944
+*/
+#define TEST_RATE 44100
+#define TEST_FRAMES 10000
+#define TEST_MP3_FRAMES 10
+#define TEST_DELAY 576
+#define TEST_DECODER_DELAY 529
+#define TEST_MAX_LAG 64
+
+static uint8_t *fixture;
+static size_t fixture_size;
+static float gapless[TEST_FRAMES * 2], raw[TEST_MP3_FRAMES * 1152 * 2];
+
+static double test_source(uint8_t ch, uint32_t n) {
+  double t = (double) n / TEST_RATE, T = (double) TEST_FRAMES / TEST_RATE;
+  double f0 = ch == 0 ? 200 : 3000, f1 = ch == 0 ? 4000 : 300;
+
+  return 0.5 * cos(2 * TEST_PI * (f0 * t + (f1 - f0) / (2 * T) * t * t));
+}
+
+static int test_load(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return 0;
+
+  fseek(f, 0, SEEK_END);
+  fixture_size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  fixture = malloc(fixture_size);
+  int ok = fixture && fread(fixture, 1, fixture_size, f) == fixture_size;
+
+  fclose(f);
+  return ok;
+}
+
+// Decode the whole stream interleaved, returns frames read and length() through length
+static uint32_t test_decode(const uint8_t *data, size_t size, float *buffer, uint32_t frames, uint64_t *length) {
+  decoder_source_t source;
+  decoder_t decoder;
+
+  decoder_source_open_memory(&source, "lame.mp3", data, size);
+  if (decoder_open_source(&decoder, &source, NULL) != DECODER_SUCCESS) return 0;
+
+  TEST_CHECK(af_get_channels(decoder.data.af) == 2 && af_get_rate(decoder.data.af) == TEST_RATE, "stereo at %u Hz", TEST_RATE);
+  *length = decoder.ops.length(&decoder.data);
+
+  uint32_t done = 0;
+  size_t r;
+  do {
+    float *ptr = buffer + (size_t) done * 2;
+    r = decoder.ops.read_f32(&decoder.data, &ptr, 1, min(frames - done, 1000u));
+    done += r;
+  } while (r > 0 && done < frames);
+
+  // Nothing is left past the padding
+  float extra[2 * 16];
+  float *ptr = extra;
+  TEST_CHECK(decoder.ops.read_f32(&decoder.data, &ptr, 1, 16) == 0, "frames past the end of stream");
+
+  decoder_close(&decoder);
+  return done;
+}
+
+// Encoder and decoder delays are both skipped, frame n of the output is frame n of the source
+static void test_lame(void) {
+  uint64_t length;
+  uint32_t frames = test_decode(fixture, fixture_size, gapless, TEST_FRAMES, &length);
+
+  TEST_CHECK(length == TEST_FRAMES, "length %llu, encoded %u", (unsigned long long) length, TEST_FRAMES);
+  TEST_CHECK(frames == TEST_FRAMES, "decoded %u frames, encoded %u", frames, TEST_FRAMES);
+
+  for (uint8_t ch = 0; ch < 2; ch++) {
+    int best_lag = 0;
+    double best = INFINITY, error0 = 0.0;
+
+    // Chirps match themselves only in place, edges are left out for the lags
+    for (int lag = -TEST_MAX_LAG; lag <= TEST_MAX_LAG; lag++) {
+      double error = 0.0;
+
+      for (uint32_t n = TEST_MAX_LAG; n + TEST_MAX_LAG < TEST_FRAMES; n++) {
+        double d = gapless[(n + lag) * 2 + ch] - test_source(ch, n);
+        error += d * d;
+      }
+
+      if (error < best) {
+        best = error;
+        best_lag = lag;
+      }
+      if (lag == 0) error0 = sqrt(error / (TEST_FRAMES - 2 * TEST_MAX_LAG));
+    }
+
+    TEST_CHECK(best_lag == 0, "ch %u: decoded stream is %d frames off the source", ch, best_lag);
+    TEST_CHECK(error0 < 0.01, "ch %u: rms error %.4f against the source", ch, error0);
+
+    // Onset of the stream is coded with some pre-echo, still close to the source
+    TEST_CHECK(fabs(gapless[ch] - test_source(ch, 0)) < 0.05, "ch %u: first frame %.4f, source %.4f", ch, gapless[ch], test_source(ch, 0));
+    printf("ch %u: lag %d, rms error %.5f, first frame %.4f of %.4f\n", ch, best_lag, error0, gapless[ch], test_source(ch, 0));
+  }
+}
+
+// Without LAME tag delays are unknown, only the Info frame is skipped and padding is kept
+static void test_xing(void) {
+  uint8_t *copy = malloc(fixture_size);
+  if (!copy) return;
+  memcpy(copy, fixture, fixture_size);
+
+  // LAME tag follows the Xing fields, an empty version string means no tag
+  uint8_t *lame = NULL;
+  for (size_t i = 0; !lame && i + 4 <= fixture_size; i++)
+    if (memcmp(copy + i, "LAME", 4) == 0) lame = copy + i;
+
+  TEST_CHECK(lame != NULL, "fixture has a LAME tag");
+  if (lame) memset(lame, 0, 9);
+
+  uint64_t length;
+  uint32_t frames = test_decode(copy, fixture_size, raw, TEST_MP3_FRAMES * 1152, &length);
+
+  TEST_CHECK(length == TEST_MP3_FRAMES * 1152, "length %llu, expected %u", (unsigned long long) length, TEST_MP3_FRAMES * 1152);
+  TEST_CHECK(frames == TEST_MP3_FRAMES * 1152, "decoded %u frames, expected %u", frames, TEST_MP3_FRAMES * 1152);
+
+  for (uint32_t n = 0; n < TEST_FRAMES * 2; n++) {
+    float sample = raw[n + (TEST_DELAY + TEST_DECODER_DELAY) * 2];
+
+    TEST_CHECK(sample == gapless[n], "frame %u ch %u: %.6f, gapless stream has %.6f", n / 2, n % 2, sample, gapless[n]);
+    if (sample != gapless[n]) break;
+  }
+
+  free(copy);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || !test_load(argv[1])) {
+    fprintf(stderr, "usage: %s lame.mp3\n", argv[0]);
+    return 1;
+  }
+
+  test_lame();
+  test_xing();
+
+  free(fixture);
+  return test_result("decoder_mp3");
+}
\ No newline at end of file
@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <string.h>
+#include "pcm_conv.h"
+#include "tests/test.h"
+
+uint32_t ref_samples_to_fixed(audio_format_t af, uint8_t* dst, const float* src, uint32_t samples);
+uint32_t ref_samples_to_float(audio_format_t af, float* dst, const uint8_t* src, uint32_t samples);
+uint32_t ref_float_to_fixed(audio_format_t af, uint8_t* dst, const float* src, uint32_t frames);
+uint32_t ref_fixed_to_float(audio_format_t af, float* dst, const uint8_t* src, uint32_t frames);
+uint32_t ref_planar_to_fixed(audio_format_t af, uint8_t* dst, const float* const* src, uint32_t frames);
+uint32_t ref_fixed_to_planar(audio_format_t af, float** dst, const uint8_t* src, uint32_t frames);
+
+#define TEST_FRAMES 2053
+#define TEST_CHANNELS 3
+
+// Odd lengths reach the scalar tails, long ones the staging chunks of planar conversions
+static const uint32_t test_lengths[] = { 1, 3, 5, 7, 9, 15, 17, 33, 63, 341, 1025, TEST_FRAMES };
+
+static float samples[TEST_FRAMES * TEST_CHANNELS];
+static uint8_t raw[TEST_FRAMES * TEST_CHANNELS * 4];
+
+static uint8_t fixed_out[TEST_FRAMES * TEST_CHANNELS * 4], fixed_ref[TEST_FRAMES * TEST_CHANNELS * 4];
+static float float_out[TEST_FRAMES * TEST_CHANNELS], float_ref[TEST_FRAMES * TEST_CHANNELS];
+static float planes_out[TEST_CHANNELS][TEST_FRAMES], planes_ref[TEST_CHANNELS][TEST_FRAMES];
+
+static const char *format_names[] = {
+  [SF_FORMAT_S8] = "s8", [SF_FORMAT_U8] = "u8", [SF_FORMAT_S16] = "s16", [SF_FORMAT_U16] = "u16",
+  [SF_FORMAT_S24] = "s24", [SF_FORMAT_U24] = "u24", [SF_FORMAT_S32] = "s32", [SF_FORMAT_U32] = "u32",
+  [SF_FORMAT_FLOAT] = "float", [SF_FORMAT_S24_32] = "s24_32", [SF_FORMAT_U24_32] = "u24_32",
+};
+
+// Float outputs are compared bitwise, a NaN from float format round trips is equal to itself
+static int same_floats(const float *a, const float *b, uint32_t count) {
+  return memcmp(a, b, count * sizeof(float)) == 0;
+}
+
+static void test_format(int format, int endian, uint8_t channels) {
+  audio_format_t af = af_endian(endian) | af_format(format) | af_rate(48000) | af_channels(channels);
+  uint32_t sample_size = af_get_sample_size(af);
+  const char *name = format_names[format];
+
+  for (size_t l = 0; l < sizeof(test_lengths) / sizeof(test_lengths[0]); l++) {
+    uint32_t frames = test_lengths[l];
+    uint32_t count = frames * channels;
+    uint32_t bytes = count * sample_size;
+
+    // Interleaved and sample based conversions
+    memset(fixed_out, 0xaa, sizeof(fixed_out)); memset(fixed_ref, 0xaa, sizeof(fixed_ref));
+    TEST_CHECK(pcm_float_to_fixed(af, fixed_out, samples, frames) == frames, "%s float_to_fixed result", name);
+    ref_float_to_fixed(af, fixed_ref, samples, frames);
+    TEST_CHECK(memcmp(fixed_out, fixed_ref, sizeof(fixed_out)) == 0, "%s endian %d, %u x %u: float_to_fixed", name, endian, frames, channels);
+
+    memset(fixed_out, 0xaa, sizeof(fixed_out));
+    TEST_CHECK(pcm_samples_to_fixed(af, fixed_out, samples, count) == count, "%s samples_to_fixed result", name);
+    TEST_CHECK(memcmp(fixed_out, fixed_ref, sizeof(fixed_out)) == 0, "%s endian %d, %u samples: samples_to_fixed", name, endian, count);
+
+    TEST_CHECK(pcm_fixed_to_float(af, float_out, raw, frames) == frames, "%s fixed_to_float result", name);
+    ref_fixed_to_float(af, float_ref, raw, frames);
+    TEST_CHECK(same_floats(float_out, float_ref, count), "%s endian %d, %u x %u: fixed_to_float", name, endian, frames, channels);
+
+    TEST_CHECK(pcm_samples_to_float(af, float_out, raw, count) == count, "%s samples_to_float result", name);
+    TEST_CHECK(same_floats(float_out, float_ref, count), "%s endian %d, %u samples: samples_to_float", name, endian, count);
+
+    // Planar conversions, stereo takes the fused kernels, other layouts the staging chunks
+    const float *src_planes[TEST_CHANNELS];
+    float *out_planes[TEST_CHANNELS], *ref_planes[TEST_CHANNELS];
+    for (uint8_t ch = 0; ch < channels; ch++) {
+      src_planes[ch] = samples + ch * TEST_FRAMES;
+      out_planes[ch] = planes_out[ch];
+      ref_planes[ch] = planes_ref[ch];
+    }
+
+    memset(fixed_out, 0xaa, sizeof(fixed_out)); memset(fixed_ref, 0xaa, sizeof(fixed_ref));
+    TEST_CHECK(pcm_planar_to_fixed(af, fixed_out, src_planes, frames) == frames, "%s planar_to_fixed result", name);
+    ref_planar_to_fixed(af, fixed_ref, src_planes, frames);
+    TEST_CHECK(memcmp(fixed_out, fixed_ref, sizeof(fixed_out)) == 0, "%s endian %d, %u x %u: planar_to_fixed", name, endian, frames, channels);
+
+    TEST_CHECK(pcm_fixed_to_planar(af, out_planes, raw, frames) == frames, "%s fixed_to_planar result", name);
+    ref_fixed_to_planar(af, ref_planes, raw, frames);
+    for (uint8_t ch = 0; ch < channels; ch++)
+      TEST_CHECK(same_floats(planes_out[ch], planes_ref[ch], frames), "%s endian %d, %u x %u: fixed_to_planar channel %u", name, endian, frames, channels, ch);
+
+    // Nothing is written past the converted bytes
+    TEST_CHECK(bytes == sizeof(fixed_out) || fixed_out[bytes] == 0xaa, "%s endian %d, %u x %u: overrun", name, endian, frames, channels);
+  }
+}
+
+// Full scale and beyond saturates to the signed range, before unsigned formats flip the sign bit
+static void test_saturation(void) {
+  static const float in[] = { 1.0f, -1.0f, 1.5f, -1.5f };
+  static const struct { int format; int64_t hi, lo; } ranges[] = {
+    { SF_FORMAT_S8,     127,        -128 },
+    { SF_FORMAT_S16,    32767,      -32768 },
+    { SF_FORMAT_S24,    8388607,    -8388608 },
+    { SF_FORMAT_S24_32, 8388607,    -8388608 },
+    { SF_FORMAT_S32,    2147483520, -2147483648LL },
+  };
+
+  for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+    audio_format_t af = af_endian(AF_NATIVE_ENDIAN) | af_format(ranges[r].format) | af_channels(1);
+    uint8_t out[4 * 4];
+    uint32_t size = af_get_sample_size(af);
+
+    pcm_samples_to_fixed(af, out, in, 4);
+
+    for (int i = 0; i < 4; i++) {
+      int64_t v;
+      switch (size) {
+        case 1: v = (int8_t) out[i]; break;
+        case 2: { int16_t t; memcpy(&t, out + i * 2, 2); v = t; break; }
+        case 3: {
+          const uint8_t *b = out + i * 3;
+          uint32_t u = AF_NATIVE_ENDIAN ? (uint32_t) b[0] << 16 | b[1] << 8 | b[2] : (uint32_t) b[2] << 16 | b[1] << 8 | b[0];
+          v = (int32_t) (u << 8) >> 8;
+          break;
+        }
+        default: { int32_t t; memcpy(&t, out + i * 4, 4); v = t; break; }
+      }
+
+      int64_t expected = in[i] > 0 ? ranges[r].hi : ranges[r].lo;
+      TEST_CHECK(v == expected, "%s saturation of %g: %lld != %lld", format_names[ranges[r].format], in[i], (long long) v, (long long) expected);
+    }
+  }
+}
+
+int main(void) {
+  // Levels beyond full scale and exact full scale samples, raw bytes cover every code
+  for (uint32_t i = 0; i < TEST_FRAMES * TEST_CHANNELS; i++) samples[i] = test_randf(-1.2f, 1.2f);
+  for (uint32_t i = 0; i < TEST_FRAMES * TEST_CHANNELS; i += 97) samples[i] = (i / 97) & 1 ? -1.0f : 1.0f;
+  for (uint32_t i = 0; i < sizeof(raw); i++) raw[i] = test_rand() >> 24;
+
+  for (int format = SF_FORMAT_S8; format <= SF_FORMAT_U24_32; format++) {
+    for (int endian = 0; endian <= 1; endian++) {
+      for (uint8_t channels = 1; channels <= TEST_CHANNELS; channels++) test_format(format, endian, channels);
+    }
+  }
+
+  test_saturation();
+
+  return test_result("pcm_conv");
+}
\ No newline at end of file